@@ -79,6 +79,9 @@ struct spa_chunk {
 /** Data for a buffer */
 struct spa_data {
 	uint32_t type;			/**< memory type */
+#define SPA_DATA_FLAG_MIRRORED	(1 << 0)	/**< data is mapped twice back to back,
+						  *  maxsize bytes starting at any offset
+						  *  below maxsize can be accessed directly */
 	uint32_t flags;			/**< data flags */
 	int fd;				/**< optional fd for data */
 	uint32_t mapoffset;		/**< offset to map fd at */
@@ -69,7 +69,9 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 				pport->io->buffer_id, pready, prequired);
 
 		if (prequired > 0 && pready >= prequired) {
+			spa_graph_process_begin(pnode->graph, pnode);
 			pnode->state = spa_node_process_output(pnode->implementation);
+			spa_graph_process_end(pnode->graph, pnode, pnode->state);
 
 			spa_debug("peer %p processed out %d", pnode, pnode->state);
 			if (pnode->state == SPA_STATUS_HAVE_BUFFER)
@@ -117,7 +119,9 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 				pport->io->buffer_id, pready, prequired);
 
 		if (prequired > 0 && pready >= prequired) {
+			spa_graph_process_begin(pnode->graph, pnode);
 			pnode->state = spa_node_process_input(pnode->implementation);
+			spa_graph_process_end(pnode->graph, pnode, pnode->state);
 
 			spa_debug("peer %p processed in %d", pnode, pnode->state);
 			if (pnode->state == SPA_STATUS_HAVE_BUFFER)
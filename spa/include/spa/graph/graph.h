@@ -45,16 +45,32 @@ struct spa_graph_callbacks {
 	int (*have_output) (void *data, struct spa_graph_node *node);
 };
 
+/** Optional hooks around the processing of a node, used for profiling */
+struct spa_graph_profiler {
+#define SPA_VERSION_GRAPH_PROFILER	0
+	uint32_t version;
+
+	void (*process_begin) (void *data, struct spa_graph_node *node);
+	void (*process_end) (void *data, struct spa_graph_node *node, int status);
+};
+
 struct spa_graph {
 	struct spa_list nodes;
 	const struct spa_graph_callbacks *callbacks;
 	void *callbacks_data;
+	const struct spa_graph_profiler *profiler;
+	void *profiler_data;
 };
 
 #define spa_graph_need_input(g,n)	((g)->callbacks->need_input((g)->callbacks_data, (n)))
 #define spa_graph_have_output(g,n)	((g)->callbacks->have_output((g)->callbacks_data, (n)))
 #define spa_graph_reuse_buffer(g,n,p,i)	((g)->callbacks->reuse_buffer((g)->callbacks_data, (n),(p),(i)))
 
+#define spa_graph_process_begin(g,n)	\
+	((g)->profiler ? (g)->profiler->process_begin((g)->profiler_data, (n)) : (void)0)
+#define spa_graph_process_end(g,n,s)	\
+	((g)->profiler ? (g)->profiler->process_end((g)->profiler_data, (n), (s)) : (void)0)
+
 struct spa_graph_node {
 	struct spa_list link;		/**< link in graph nodes list */
 	struct spa_graph *graph;	/**< owner graph */
@@ -84,6 +100,8 @@ struct spa_graph_port {
 static inline void spa_graph_init(struct spa_graph *graph)
 {
 	spa_list_init(&graph->nodes);
+	graph->profiler = NULL;
+	graph->profiler_data = NULL;
 }
 
 static inline void
@@ -95,6 +113,15 @@ spa_graph_set_callbacks(struct spa_graph *graph,
 	graph->callbacks_data = data;
 }
 
+static inline void
+spa_graph_set_profiler(struct spa_graph *graph,
+		       const struct spa_graph_profiler *profiler,
+		       void *data)
+{
+	graph->profiler = profiler;
+	graph->profiler_data = data;
+}
+
 static inline void
 spa_graph_node_init(struct spa_graph_node *node)
 {
@@ -24,7 +24,10 @@
 extern "C" {
 #endif
 
+#include <errno.h>
+
 #include <spa/support/type-map.h>
+#include <spa/utils/ringbuffer.h>
 
 /** Base for IO structures to interface with node ports */
 #define SPA_TYPE__IO			SPA_TYPE_POINTER_BASE "IO"
@@ -38,6 +41,10 @@ extern "C" {
 #define SPA_TYPE_IO__Prop		SPA_TYPE_IO_BASE "Prop"
 #define SPA_TYPE_IO_PROP_BASE		SPA_TYPE_IO__Prop ":"
 
+/** Base for controlable properties with sample accurate control sequences */
+#define SPA_TYPE_IO__PropSequence	SPA_TYPE_IO_BASE "PropSequence"
+#define SPA_TYPE_IO_PROP_SEQUENCE_BASE	SPA_TYPE_IO__PropSequence ":"
+
 /** An io area to exchange buffers with a port */
 #define SPA_TYPE_IO__Buffers		SPA_TYPE_IO_BASE "Buffers"
 
@@ -69,10 +76,194 @@ struct spa_io_control_range {
 	uint32_t max_size;	/**< maximum size of data */
 };
 
+/** A timestamped control value */
+struct spa_io_control_event {
+	uint32_t offset;	/**< offset in samples from the start of the cycle */
+	uint32_t flags;		/**< extra flags, currently 0 */
+	double value;		/**< new value of the property */
+};
+
+/** A sequence of control events
+ *
+ * A single producer, single consumer ring of control events, placed
+ * in the io area of a property that can be controlled with sample
+ * accuracy. The producer appends events with increasing offsets, the
+ * consumer drains all available events in each cycle and applies them
+ * at their offset. Offsets beyond the end of the cycle are applied at
+ * the end of the cycle.
+ */
+struct spa_io_control_sequence {
+	struct spa_ringbuffer ring;	/**< read and write index of events */
+	uint32_t n_events;		/**< number of events in \a events, power of 2 */
+	uint32_t padding;
+	struct spa_io_control_event events[0];	/**< array of events */
+};
+
+/** size of a control sequence io area with room for \a n events */
+#define SPA_IO_CONTROL_SEQUENCE_SIZE(n) \
+	(sizeof(struct spa_io_control_sequence) + (n) * sizeof(struct spa_io_control_event))
+
+/** default number of events in a control sequence */
+#define SPA_IO_CONTROL_SEQUENCE_EVENTS	64
+
+/**
+ * Initialize a control sequence in an io area of \a size bytes.
+ *
+ * \return the number of events that fit in the sequence, 0 when
+ *	the area is too small
+ */
+static inline uint32_t
+spa_io_control_sequence_init(struct spa_io_control_sequence *seq, size_t size)
+{
+	uint32_t n_events = 1;
+
+	if (size < SPA_IO_CONTROL_SEQUENCE_SIZE(1))
+		return 0;
+
+	/* largest power of 2 that fits */
+	while (SPA_IO_CONTROL_SEQUENCE_SIZE(n_events * 2) <= size)
+		n_events *= 2;
+
+	spa_ringbuffer_init(&seq->ring);
+	seq->n_events = n_events;
+	seq->padding = 0;
+
+	return n_events;
+}
+
+/** Check if \a seq is a valid sequence in an io area of \a size bytes */
+static inline bool
+spa_io_control_sequence_is_valid(const struct spa_io_control_sequence *seq, size_t size)
+{
+	return seq->n_events > 0 &&
+		(seq->n_events & (seq->n_events - 1)) == 0 &&
+		SPA_IO_CONTROL_SEQUENCE_SIZE(seq->n_events) <= size;
+}
+
+/**
+ * Append an event to \a seq. Must only be called from the producer.
+ *
+ * \return 0 on success, -ENOSPC when the sequence is full
+ */
+static inline int
+spa_io_control_sequence_push(struct spa_io_control_sequence *seq,
+			     uint32_t offset, double value)
+{
+	struct spa_io_control_event *ev;
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&seq->ring, &index);
+	if (filled < 0 || (uint32_t) filled >= seq->n_events)
+		return -ENOSPC;
+
+	ev = &seq->events[index & (seq->n_events - 1)];
+	ev->offset = offset;
+	ev->flags = 0;
+	ev->value = value;
+
+	spa_ringbuffer_write_update(&seq->ring, index + 1);
+
+	return 0;
+}
+
+/**
+ * Get the next event from \a seq without consuming it. Must only be
+ * called from the consumer.
+ *
+ * \return the next event or NULL when the sequence is empty
+ */
+static inline struct spa_io_control_event *
+spa_io_control_sequence_peek(struct spa_io_control_sequence *seq)
+{
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&seq->ring, &index);
+	if (avail <= 0)
+		return NULL;
+
+	return &seq->events[index & (seq->n_events - 1)];
+}
+
+/**
+ * Consume the event returned by spa_io_control_sequence_peek()
+ */
+static inline void
+spa_io_control_sequence_advance(struct spa_io_control_sequence *seq)
+{
+	uint32_t index;
+
+	spa_ringbuffer_get_read_index(&seq->ring, &index);
+	spa_ringbuffer_read_update(&seq->ring, index + 1);
+}
+
+/** Clock information of a driver, updated every cycle */
+#define SPA_TYPE_IO__Clock		SPA_TYPE_IO_BASE "Clock"
+
+/** Clock IO area
+ *
+ * Written by the driver every cycle and read by anyone that has it
+ * mapped. Updates are protected with a sequence counter, use
+ * spa_io_clock_read() to get a consistent snapshot.
+ */
+struct spa_io_clock {
+	uint32_t seq;			/**< sequence counter, odd while updating */
+#define SPA_IO_CLOCK_FLAG_LIVE	(1 << 0)
+#define SPA_IO_CLOCK_FLAG_FREEWHEEL	(1 << 1)	/**< the graph runs as fast as possible,
+							  *  \a ticks advance with the processed
+							  *  data and not with \a monotonic_time */
+	uint32_t flags;			/**< extra flags */
+	struct spa_fraction rate;	/**< rate of \a ticks */
+	uint64_t ticks;			/**< driver ticks at \a monotonic_time */
+	int64_t monotonic_time;		/**< CLOCK_MONOTONIC time in nanoseconds */
+	double rate_diff;		/**< measured rate against the monotonic clock,
+					  *  1.0 is nominal */
+	uint64_t latency;		/**< latency of the driver in ticks, 0 when unknown */
+};
+
+/** Start an update of \a clock, only one writer is allowed */
+static inline void spa_io_clock_write_begin(struct spa_io_clock *clock)
+{
+	__atomic_store_n(&clock->seq, clock->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/** Finish an update of \a clock */
+static inline void spa_io_clock_write_end(struct spa_io_clock *clock)
+{
+	__atomic_store_n(&clock->seq, clock->seq + 1, __ATOMIC_RELEASE);
+}
+
+/** Copy a consistent snapshot of \a clock into \a copy
+ * \return 0 on success, -EAGAIN when the clock was never written,
+ *         -EBUSY when no consistent snapshot could be made */
+static inline int spa_io_clock_read(const struct spa_io_clock *clock, struct spa_io_clock *copy)
+{
+	uint32_t seq, retry;
+
+	for (retry = 0; retry < 1024; retry++) {
+		seq = __atomic_load_n(&clock->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		*copy = *clock;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (seq == __atomic_load_n(&clock->seq, __ATOMIC_RELAXED)) {
+			copy->seq = seq;
+			return seq == 0 ? -EAGAIN : 0;
+		}
+	}
+	return -EBUSY;
+}
+
 struct spa_type_io {
 	uint32_t Buffers;
 	uint32_t ControlRange;
 	uint32_t Prop;
+	uint32_t PropSequence;
+	uint32_t Clock;
 };
 
 static inline void spa_type_io_map(struct spa_type_map *map, struct spa_type_io *type)
@@ -81,6 +272,8 @@ static inline void spa_type_io_map(struct spa_type_map *map, struct spa_type_io
 		type->Buffers = spa_type_map_get_id(map, SPA_TYPE_IO__Buffers);
 		type->ControlRange = spa_type_map_get_id(map, SPA_TYPE_IO_CONTROL__Range);
 		type->Prop = spa_type_map_get_id(map, SPA_TYPE_IO__Prop);
+		type->PropSequence = spa_type_map_get_id(map, SPA_TYPE_IO__PropSequence);
+		type->Clock = spa_type_map_get_id(map, SPA_TYPE_IO__Clock);
 	}
 }
 
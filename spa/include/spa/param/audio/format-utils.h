@@ -50,17 +50,24 @@ spa_type_format_audio_map(struct spa_type_map *map, struct spa_type_format_audio
 	}
 }
 
+/* the members of the audio info struct have the same names as the keys */
+#define SPA_FORMAT_AUDIO_FIELD(key,type,flags)					\
+	SPA_POD_OBJECT_FIELD(struct spa_type_format_audio, key, type, flags,	\
+			     struct spa_audio_info_raw, key)
+
 static inline int
 spa_format_audio_raw_parse(const struct spa_pod *format,
 			   struct spa_audio_info_raw *info, struct spa_type_format_audio *type)
 {
-	return spa_pod_object_parse(format,
-		":",type->format,	"I", &info->format,
-		":",type->rate,		"i", &info->rate,
-		":",type->channels,	"i", &info->channels,
-		":",type->flags,	"?i", &info->flags,
-		":",type->layout,	"?i", &info->layout,
-		":",type->channel_mask,	"?i", &info->channel_mask, NULL);
+	static const struct spa_pod_object_field fields[] = {
+		SPA_FORMAT_AUDIO_FIELD(format, 'I', 0),
+		SPA_FORMAT_AUDIO_FIELD(rate, 'i', 0),
+		SPA_FORMAT_AUDIO_FIELD(channels, 'i', 0),
+		SPA_FORMAT_AUDIO_FIELD(flags, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_AUDIO_FIELD(layout, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_AUDIO_FIELD(channel_mask, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+	};
+	return spa_pod_object_parse_fields(format, type, fields, SPA_N_ELEMENTS(fields), info);
 }
 
 #ifdef __cplusplus
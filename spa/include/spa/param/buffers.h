@@ -35,6 +35,11 @@ extern "C" {
 #define SPA_TYPE_PARAM_BUFFERS__stride		SPA_TYPE_PARAM_BUFFERS_BASE "stride"
 #define SPA_TYPE_PARAM_BUFFERS__buffers		SPA_TYPE_PARAM_BUFFERS_BASE "buffers"
 #define SPA_TYPE_PARAM_BUFFERS__align		SPA_TYPE_PARAM_BUFFERS_BASE "align"
+/** number of data blocks (planes) per buffer, 1 when not given */
+#define SPA_TYPE_PARAM_BUFFERS__blocks		SPA_TYPE_PARAM_BUFFERS_BASE "blocks"
+/** request data memory that is mapped twice back to back so that a ring
+ * buffer can be accessed without wrapping, 0 when not given */
+#define SPA_TYPE_PARAM_BUFFERS__mirrored	SPA_TYPE_PARAM_BUFFERS_BASE "mirrored"
 
 struct spa_type_param_buffers {
 	uint32_t Buffers;
@@ -42,6 +47,8 @@ struct spa_type_param_buffers {
 	uint32_t stride;
 	uint32_t buffers;
 	uint32_t align;
+	uint32_t blocks;
+	uint32_t mirrored;
 };
 
 static inline void
@@ -54,6 +61,8 @@ spa_type_param_buffers_map(struct spa_type_map *map,
 		type->stride = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__stride);
 		type->buffers = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__buffers);
 		type->align = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__align);
+		type->blocks = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__blocks);
+		type->mirrored = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__mirrored);
 	}
 }
 
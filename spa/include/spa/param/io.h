@@ -56,6 +56,11 @@ extern "C" {
 #define SPA_TYPE_PARAM_IO__Prop		SPA_TYPE_PARAM_IO_BASE "Prop"
 #define SPA_TYPE_PARAM_IO_PROP_BASE	SPA_TYPE_PARAM_IO__Prop ":"
 
+/* an io area to exchange a sequence of timestamped property values, see
+ * struct spa_io_control_sequence. Contents are the same as for
+ * SPA_TYPE_PARAM_IO__Prop */
+#define SPA_TYPE_PARAM_IO__PropSequence	SPA_TYPE_PARAM_IO_BASE "PropSequence"
+
 struct spa_type_param_io {
 	uint32_t id;		/**< id to configure the io area */
 	uint32_t size;		/**< size of io area */
@@ -66,6 +71,7 @@ struct spa_type_param_io {
 	uint32_t idPropsIn;	/**< id to enumerate input properties io */
 	uint32_t idPropsOut;	/**< id to enumerate output properties io */
 	uint32_t Prop;		/**< object type of property area */
+	uint32_t PropSequence;	/**< object type of property sequence area */
 };
 
 static inline void
@@ -82,6 +88,7 @@ spa_type_param_io_map(struct spa_type_map *map,
 		type->idPropsIn = spa_type_map_get_id(map, SPA_TYPE_PARAM_ID_IO_PROPS__In);
 		type->idPropsOut = spa_type_map_get_id(map, SPA_TYPE_PARAM_ID_IO_PROPS__Out);
 		type->Prop = spa_type_map_get_id(map, SPA_TYPE_PARAM_IO__Prop);
+		type->PropSequence = spa_type_map_get_id(map, SPA_TYPE_PARAM_IO__PropSequence);
 	}
 }
 
@@ -75,47 +75,58 @@ spa_type_format_video_map(struct spa_type_map *map, struct spa_type_format_video
 	}
 }
 
+/* the members of the video info structs have the same names as the keys */
+#define SPA_FORMAT_VIDEO_FIELD(info_type,key,type,flags)			\
+	SPA_POD_OBJECT_FIELD(struct spa_type_format_video, key, type, flags,	\
+			     info_type, key)
+
 static inline int
 spa_format_video_raw_parse(const struct spa_pod *format,
 			   struct spa_video_info_raw *info, struct spa_type_format_video *type)
 {
-	return spa_pod_object_parse(format,
-		":",type->format,		"I", &info->format,
-		":",type->size,			"R", &info->size,
-		":",type->framerate,		"F", &info->framerate,
-		":",type->max_framerate,	"?F", &info->max_framerate,
-		":",type->views,		"?i", &info->views,
-		":",type->interlace_mode,	"?i", &info->interlace_mode,
-		":",type->pixel_aspect_ratio,	"?F", &info->pixel_aspect_ratio,
-		":",type->multiview_mode,	"?i", &info->multiview_mode,
-		":",type->multiview_flags,	"?i", &info->multiview_flags,
-		":",type->chroma_site,		"?i", &info->chroma_site,
-		":",type->color_range,		"?i", &info->color_range,
-		":",type->color_matrix,		"?i", &info->color_matrix,
-		":",type->transfer_function,	"?i", &info->transfer_function,
-		":",type->color_primaries,	"?i", &info->color_primaries, NULL);
+	static const struct spa_pod_object_field fields[] = {
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, format, 'I', 0),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, size, 'R', 0),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, framerate, 'F', 0),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, max_framerate, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, views, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, interlace_mode, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, pixel_aspect_ratio, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, multiview_mode, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, multiview_flags, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, chroma_site, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, color_range, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, color_matrix, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, transfer_function, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_raw, color_primaries, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+	};
+	return spa_pod_object_parse_fields(format, type, fields, SPA_N_ELEMENTS(fields), info);
 }
 
 static inline int
 spa_format_video_h264_parse(const struct spa_pod *format,
 			    struct spa_video_info_h264 *info, struct spa_type_format_video *type)
 {
-	return spa_pod_object_parse(format,
-		":",type->size,			"?R", &info->size,
-		":",type->framerate,		"?F", &info->framerate,
-		":",type->max_framerate,	"?F", &info->max_framerate,
-		":",type->stream_format,	"?i", &info->stream_format,
-		":",type->alignment,		"?i", &info->alignment, NULL);
+	static const struct spa_pod_object_field fields[] = {
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_h264, size, 'R', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_h264, framerate, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_h264, max_framerate, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_h264, stream_format, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_h264, alignment, 'i', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+	};
+	return spa_pod_object_parse_fields(format, type, fields, SPA_N_ELEMENTS(fields), info);
 }
 
 static inline int
 spa_format_video_mjpg_parse(const struct spa_pod *format,
 			    struct spa_video_info_mjpg *info, struct spa_type_format_video *type)
 {
-	return spa_pod_object_parse(format,
-		":",type->size,			"?R", &info->size,
-		":",type->framerate,		"?F", &info->framerate,
-		":",type->max_framerate,	"?F", &info->max_framerate, NULL);
+	static const struct spa_pod_object_field fields[] = {
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_mjpg, size, 'R', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_mjpg, framerate, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+		SPA_FORMAT_VIDEO_FIELD(struct spa_video_info_mjpg, max_framerate, 'F', SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+	};
+	return spa_pod_object_parse_fields(format, type, fields, SPA_N_ELEMENTS(fields), info);
 }
 
 #ifdef __cplusplus
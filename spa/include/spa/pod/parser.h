@@ -315,6 +315,145 @@ static inline int spa_pod_parser_get(struct spa_pod_parser *parser,
 	spa_pod_parser_get(&__p, "<", ##__VA_ARGS__, NULL);	\
 })
 
+/**
+ * Describes where a property of an object is stored in a struct.
+ *
+ * The key is not stored in the field itself but at \a key_offset in a
+ * struct with the mapped type ids, so that a table of fields can be
+ * static and const.
+ */
+struct spa_pod_object_field {
+	uint16_t key_offset;	/**< offset of the uint32_t key in the keys struct */
+	uint16_t offset;	/**< offset of the value in the destination struct */
+	char type;		/**< type of the value, as in spa_pod_parser_get(), the
+				  *  types with extra arguments 'S' and 'z' are not
+				  *  supported */
+	uint8_t flags;
+#define SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL	(1 << 0)	/**< the property can be absent */
+};
+
+#define SPA_POD_OBJECT_FIELD(keys_type,key,type,flags,dest_type,member)	\
+	{ offsetof(keys_type, key), offsetof(dest_type, member), type, flags }
+
+#define SPA_POD_OBJECT_MAX_FIELDS	64
+
+static inline void spa_pod_object_field_collect(const struct spa_pod *pod, char type, void *dest)
+{
+	switch (type) {
+	case 'b':
+		*(int *) dest = SPA_POD_VALUE(struct spa_pod_bool, pod);
+		break;
+	case 'I':
+	case 'i':
+		*(int32_t *) dest = SPA_POD_VALUE(struct spa_pod_int, pod);
+		break;
+	case 'l':
+		*(int64_t *) dest = SPA_POD_VALUE(struct spa_pod_long, pod);
+		break;
+	case 'f':
+		*(float *) dest = SPA_POD_VALUE(struct spa_pod_float, pod);
+		break;
+	case 'd':
+		*(double *) dest = SPA_POD_VALUE(struct spa_pod_double, pod);
+		break;
+	case 's':
+		*(char **) dest = SPA_POD_TYPE(pod) == SPA_POD_TYPE_NONE ?
+			NULL : (char *) SPA_POD_CONTENTS(struct spa_pod_string, pod);
+		break;
+	case 'R':
+		*(struct spa_rectangle *) dest = SPA_POD_VALUE(struct spa_pod_rectangle, pod);
+		break;
+	case 'F':
+		*(struct spa_fraction *) dest = SPA_POD_VALUE(struct spa_pod_fraction, pod);
+		break;
+	case 'B':
+		*(uint32_t **) dest = (uint32_t *) SPA_POD_CONTENTS(struct spa_pod_bitmap, pod);
+		break;
+	case 'p':
+		*(void **) dest = ((struct spa_pod_pointer_body *) SPA_POD_BODY(pod))->value;
+		break;
+	case 'h':
+		*(int *) dest = SPA_POD_VALUE(struct spa_pod_fd, pod);
+		break;
+	case 'V':
+	case 'P':
+	case 'O':
+	case 'T':
+		*(const struct spa_pod **) dest = SPA_POD_TYPE(pod) == SPA_POD_TYPE_NONE ?
+			NULL : pod;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Parse the properties of an object into a struct in one pass over the object.
+ *
+ * This does the same as spa_pod_object_parse() with a ":", key, type sequence
+ * for each of the \a fields but without interpreting a format string and
+ * without a search through the object for each key.
+ *
+ * \param pod the object to parse
+ * \param keys struct with the mapped keys
+ * \param fields array of fields, at most SPA_POD_OBJECT_MAX_FIELDS
+ * \param n_fields number of fields
+ * \param dest the struct to fill
+ * \return 0 on success, -EINVAL when \a pod is not an object, -ESRCH when
+ *         a required property is missing or has the wrong type
+ */
+static inline int spa_pod_object_parse_fields(const struct spa_pod *pod, const void *keys,
+					      const struct spa_pod_object_field *fields,
+					      uint32_t n_fields, void *dest)
+{
+	const struct spa_pod *p, *v;
+	uint64_t found = 0;
+	uint32_t i, j, next = 0;
+
+	if (pod == NULL || SPA_POD_TYPE(pod) != SPA_POD_TYPE_OBJECT ||
+	    n_fields > SPA_POD_OBJECT_MAX_FIELDS)
+		return -EINVAL;
+
+	SPA_POD_OBJECT_FOREACH((const struct spa_pod_object *) pod, p) {
+		const struct spa_pod_prop *prop = (const struct spa_pod_prop *) p;
+
+		if (SPA_POD_TYPE(p) != SPA_POD_TYPE_PROP ||
+		    (prop->body.flags & SPA_POD_PROP_FLAG_UNSET))
+			continue;
+
+		/* properties are usually in the same order as the fields,
+		 * start looking after the previous match */
+		for (i = next, j = 0; j < n_fields; j++) {
+			if (*SPA_MEMBER(keys, fields[i].key_offset, const uint32_t) == prop->body.key)
+				break;
+			if (++i == n_fields)
+				i = 0;
+		}
+		if (j == n_fields)
+			continue;
+
+		next = i + 1 == n_fields ? 0 : i + 1;
+
+		if (fields[i].type == 'V')
+			v = (const struct spa_pod *) prop;
+		else if (spa_pod_parser_can_collect((struct spa_pod *) &prop->body.value,
+						    fields[i].type))
+			v = &prop->body.value;
+		else
+			continue;
+
+		spa_pod_object_field_collect(v, fields[i].type,
+					     SPA_MEMBER(dest, fields[i].offset, void));
+		found |= 1ULL << i;
+	}
+	for (i = 0; i < n_fields; i++) {
+		if (!(fields[i].flags & SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL) &&
+		    !(found & (1ULL << i)))
+			return -ESRCH;
+	}
+	return 0;
+}
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -66,13 +66,24 @@ typedef int (*spa_invoke_func_t) (struct spa_loop *loop,
 				  size_t size,
 				  void *user_data);
 
+/** An item for spa_loop_invoke_many() */
+struct spa_loop_invoke_item {
+	spa_invoke_func_t func;		/**< function to invoke */
+	uint32_t seq;			/**< sequence number passed to \a func */
+	const void *data;		/**< data passed to \a func, copied */
+	size_t size;			/**< size of \a data */
+	void *user_data;		/**< user_data passed to \a func */
+	int res;			/**< result of \a func when the invoke blocked
+					  *  or was executed from the loop thread */
+};
+
 /**
  * Register sources and work items to an event loop
  */
 struct spa_loop {
 	/* the version of this structure. This can be used to expand this
 	 * structure in the future */
-#define SPA_VERSION_LOOP	0
+#define SPA_VERSION_LOOP	1
 	uint32_t version;
 
 	/** add a source to the loop */
@@ -93,6 +104,17 @@ struct spa_loop {
 		       size_t size,
 		       bool block,
 		       void *user_data);
+
+	/** invoke \a n_items functions in the context of this loop.
+	 * The items are queued in order and the loop is woken up once.
+	 * When \a block is true, wait until all items are executed.
+	 * When the items can't be queued, none of them is executed and
+	 * a negative errno is returned.
+	 * Since version 1. */
+	int (*invoke_many) (struct spa_loop *loop,
+			    struct spa_loop_invoke_item *items,
+			    uint32_t n_items,
+			    bool block);
 };
 
 #define spa_loop_add_source(l,...)	(l)->add_source((l),__VA_ARGS__)
@@ -100,6 +122,26 @@ struct spa_loop {
 #define spa_loop_remove_source(l,...)	(l)->remove_source(__VA_ARGS__)
 #define spa_loop_invoke(l,...)		(l)->invoke((l),__VA_ARGS__)
 
+static inline int
+spa_loop_invoke_many(struct spa_loop *loop,
+		     struct spa_loop_invoke_item *items, uint32_t n_items, bool block)
+{
+	uint32_t i;
+	int res;
+
+	if (loop->version >= 1 && loop->invoke_many)
+		return loop->invoke_many(loop, items, n_items, block);
+
+	for (i = 0; i < n_items; i++) {
+		res = loop->invoke(loop, items[i].func, items[i].seq, items[i].data,
+				   items[i].size, block, items[i].user_data);
+		if (res < 0 && !SPA_RESULT_IS_ASYNC(res))
+			return res;
+		items[i].res = res;
+	}
+	return 0;
+}
+
 
 /** Control hooks */
 struct spa_loop_control_hooks {
@@ -125,6 +125,10 @@ struct spa_fraction {
 #define SPA_ROUND_DOWN_N(num,align)	((num) & ~((align) - 1))
 #define SPA_ROUND_UP_N(num,align)	SPA_ROUND_DOWN_N((num) + ((align) - 1),align)
 
+/** size of a cache line, used to keep data that is written by different
+ * threads apart */
+#define SPA_CACHE_LINE_SIZE		64
+
 #ifndef SPA_LIKELY
 #ifdef __GNUC__
 #define SPA_LIKELY(x) (__builtin_expect(!!(x),1))
@@ -29,6 +29,7 @@ struct spa_ringbuffer;
 #define SPA_TYPE_RINGBUFFER_BASE	SPA_TYPE__RingBuffer ":"
 
 #include <string.h>
+#include <errno.h>
 
 #include <spa/utils/defs.h>
 
@@ -163,6 +164,316 @@ static inline void spa_ringbuffer_write_update(struct spa_ringbuffer *rbuf, int3
 	__atomic_store_n(&rbuf->writeindex, index, __ATOMIC_RELEASE);
 }
 
+/**
+ * A single producer, single consumer ringbuffer with the read and write
+ * index on separate cache lines.
+ *
+ * Each side keeps a cached copy of the index of the other side next to its
+ * own index and only loads the index of the other side when the cached copy
+ * does not have enough room for the requested operation. The cache line of
+ * the other side is then only touched once per batch instead of on every
+ * operation.
+ */
+struct spa_ringbuffer_padded {
+	/* written by the consumer */
+	uint32_t readindex;		/*< the current read index */
+	uint32_t writeindex_cache;	/*< last writeindex seen by the consumer */
+	uint8_t _padding1[SPA_CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+	/* written by the producer */
+	uint32_t writeindex;		/*< the current write index */
+	uint32_t readindex_cache;	/*< last readindex seen by the producer */
+	uint8_t _padding2[SPA_CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+};
+
+/**
+ * Initialize a spa_ringbuffer_padded.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ */
+static inline void spa_ringbuffer_padded_init(struct spa_ringbuffer_padded *rbuf)
+{
+	memset(rbuf, 0, sizeof(struct spa_ringbuffer_padded));
+}
+
+/**
+ * Get the read index and available bytes for reading. Called by the consumer.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of readindex
+ * \param need the number of bytes the caller wants to read, the write index
+ *        is only loaded when less than this is known to be available
+ * \return number of available bytes to read, this can be less than what is
+ *        really available but is at least \a need when that much is available.
+ */
+static inline int32_t
+spa_ringbuffer_padded_get_read_index(struct spa_ringbuffer_padded *rbuf,
+				     uint32_t *index, uint32_t need)
+{
+	int32_t avail;
+
+	*index = __atomic_load_n(&rbuf->readindex, __ATOMIC_RELAXED);
+	avail = (int32_t) (rbuf->writeindex_cache - *index);
+	if (avail < (int32_t) need) {
+		rbuf->writeindex_cache = __atomic_load_n(&rbuf->writeindex, __ATOMIC_ACQUIRE);
+		avail = (int32_t) (rbuf->writeindex_cache - *index);
+	}
+	return avail;
+}
+
+/**
+ * Update the read pointer to \a index. Called by the consumer.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index new index
+ */
+static inline void
+spa_ringbuffer_padded_read_update(struct spa_ringbuffer_padded *rbuf, uint32_t index)
+{
+	__atomic_store_n(&rbuf->readindex, index, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the write index and the number of bytes inside the ringbuffer.
+ * Called by the producer.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of writeindex
+ * \param size the size of the ringbuffer memory
+ * \param need the number of bytes the caller wants to write, the read index
+ *        is only loaded when less than this is known to be free
+ * \return the fill level of \a rbuf, this can be more than the real fill
+ *        level but leaves at least \a need bytes when that much is free.
+ */
+static inline int32_t
+spa_ringbuffer_padded_get_write_index(struct spa_ringbuffer_padded *rbuf,
+				      uint32_t *index, uint32_t size, uint32_t need)
+{
+	int32_t filled;
+
+	*index = __atomic_load_n(&rbuf->writeindex, __ATOMIC_RELAXED);
+	filled = (int32_t) (*index - rbuf->readindex_cache);
+	if (filled + need > size) {
+		rbuf->readindex_cache = __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE);
+		filled = (int32_t) (*index - rbuf->readindex_cache);
+	}
+	return filled;
+}
+
+/**
+ * Update the write pointer to \a index. Called by the producer.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index new index
+ */
+static inline void
+spa_ringbuffer_padded_write_update(struct spa_ringbuffer_padded *rbuf, uint32_t index)
+{
+	__atomic_store_n(&rbuf->writeindex, index, __ATOMIC_RELEASE);
+}
+
+/**
+ * Read as much as possible, up to \a len bytes, from \a rbuf and update the
+ * read index once.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param buffer memory to read from
+ * \param size the size of \a buffer, a power of 2
+ * \param data destination memory
+ * \param len max number of bytes to read
+ * \return the number of bytes read
+ */
+static inline uint32_t
+spa_ringbuffer_padded_read(struct spa_ringbuffer_padded *rbuf,
+			   const void *buffer, uint32_t size, void *data, uint32_t len)
+{
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_padded_get_read_index(rbuf, &index, len);
+	if (avail <= 0)
+		return 0;
+
+	len = SPA_MIN(len, (uint32_t) avail);
+	spa_ringbuffer_read_data(NULL, buffer, size, index & (size - 1), data, len);
+	spa_ringbuffer_padded_read_update(rbuf, index + len);
+
+	return len;
+}
+
+/**
+ * Write as much as possible, up to \a len bytes, to \a rbuf and update the
+ * write index once.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param buffer memory to write to
+ * \param size the size of \a buffer, a power of 2
+ * \param data source memory
+ * \param len max number of bytes to write
+ * \return the number of bytes written
+ */
+static inline uint32_t
+spa_ringbuffer_padded_write(struct spa_ringbuffer_padded *rbuf,
+			    void *buffer, uint32_t size, const void *data, uint32_t len)
+{
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_padded_get_write_index(rbuf, &index, size, len);
+	if (filled < 0 || (uint32_t) filled >= size)
+		return 0;
+
+	len = SPA_MIN(len, size - filled);
+	spa_ringbuffer_write_data(NULL, buffer, size, index & (size - 1), data, len);
+	spa_ringbuffer_padded_write_update(rbuf, index + len);
+
+	return len;
+}
+
+/**
+ * A multiple producer, single consumer ringbuffer of records.
+ *
+ * Producers reserve a record with spa_ringbuffer_mpsc_reserve(), fill it and
+ * commit it with spa_ringbuffer_mpsc_commit(). Each record starts with a
+ * header word in the ringbuffer memory that is set when the record is
+ * committed, producers never wait for each other. The consumer reads the
+ * records in reservation order and stops at the first one that is not
+ * committed yet.
+ *
+ * The ringbuffer memory must be zeroed before use, the consumer clears the
+ * records it has read.
+ */
+struct spa_ringbuffer_mpsc {
+	/* written by the consumer */
+	uint32_t readindex;		/*< the current read index */
+	uint8_t _padding1[SPA_CACHE_LINE_SIZE - sizeof(uint32_t)];
+	/* written by the producers */
+	uint32_t reserveindex;		/*< end of the reserved space */
+	uint32_t readindex_cache;	/*< last readindex seen by a producer */
+	uint8_t _padding2[SPA_CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+};
+
+#define SPA_RINGBUFFER_MPSC_COMMITTED	(1u << 31)	/*< set in the header of a committed record */
+
+/** the space used by a record of \a len bytes */
+#define SPA_RINGBUFFER_MPSC_RECORD_SIZE(len)	\
+	(sizeof(uint32_t) + SPA_ROUND_UP_N((uint32_t)(len), sizeof(uint32_t)))
+
+/**
+ * Initialize a spa_ringbuffer_mpsc.
+ *
+ * \param rbuf a spa_ringbuffer_mpsc
+ */
+static inline void spa_ringbuffer_mpsc_init(struct spa_ringbuffer_mpsc *rbuf)
+{
+	memset(rbuf, 0, sizeof(struct spa_ringbuffer_mpsc));
+}
+
+static inline uint32_t *
+spa_ringbuffer_mpsc_header(void *buffer, uint32_t size, uint32_t index)
+{
+	return SPA_MEMBER(buffer, (index - sizeof(uint32_t)) & (size - 1), uint32_t);
+}
+
+/**
+ * Reserve a record of \a len bytes. Safe to call from multiple threads.
+ *
+ * \param rbuf a spa_ringbuffer_mpsc
+ * \param size the size of the ringbuffer memory, a power of 2
+ * \param len the number of bytes to reserve
+ * \param index the index of the record data, should be taken modulo the
+ *         size of the ringbuffer memory to get the offset in the ringbuffer memory
+ * \return 0 on success, -ENOSPC when there is not enough free space
+ */
+static inline int
+spa_ringbuffer_mpsc_reserve(struct spa_ringbuffer_mpsc *rbuf,
+			    uint32_t size, uint32_t len, uint32_t *index)
+{
+	uint32_t idx, readindex, total = SPA_RINGBUFFER_MPSC_RECORD_SIZE(len);
+
+	idx = __atomic_load_n(&rbuf->reserveindex, __ATOMIC_RELAXED);
+	do {
+		readindex = __atomic_load_n(&rbuf->readindex_cache, __ATOMIC_ACQUIRE);
+		if (idx - readindex + total > size) {
+			/* a stale cache only makes the ringbuffer look fuller */
+			readindex = __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE);
+			__atomic_store_n(&rbuf->readindex_cache, readindex, __ATOMIC_RELEASE);
+			if (idx - readindex + total > size)
+				return -ENOSPC;
+		}
+	} while (!__atomic_compare_exchange_n(&rbuf->reserveindex, &idx, idx + total,
+					      true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	*index = idx + sizeof(uint32_t);
+	return 0;
+}
+
+/**
+ * Make the record of \a len bytes reserved at \a index visible to the
+ * consumer. This never waits for other producers.
+ *
+ * \param rbuf a spa_ringbuffer_mpsc
+ * \param buffer the ringbuffer memory
+ * \param size the size of \a buffer
+ * \param index the index returned by spa_ringbuffer_mpsc_reserve()
+ * \param len the number of reserved bytes
+ */
+static inline void
+spa_ringbuffer_mpsc_commit(struct spa_ringbuffer_mpsc *rbuf,
+			   void *buffer, uint32_t size, uint32_t index, uint32_t len)
+{
+	__atomic_store_n(spa_ringbuffer_mpsc_header(buffer, size, index),
+			 len | SPA_RINGBUFFER_MPSC_COMMITTED, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the next committed record. Called by the consumer.
+ *
+ * \param rbuf a spa_ringbuffer_mpsc
+ * \param buffer the ringbuffer memory
+ * \param size the size of \a buffer
+ * \param index the index of the record data
+ * \return the length of the record or -EAGAIN when the next record is not
+ *         committed yet
+ */
+static inline int32_t
+spa_ringbuffer_mpsc_get_read_index(struct spa_ringbuffer_mpsc *rbuf,
+				   void *buffer, uint32_t size, uint32_t *index)
+{
+	uint32_t header;
+
+	*index = __atomic_load_n(&rbuf->readindex, __ATOMIC_RELAXED) + sizeof(uint32_t);
+	header = __atomic_load_n(spa_ringbuffer_mpsc_header(buffer, size, *index),
+				 __ATOMIC_ACQUIRE);
+	if (!(header & SPA_RINGBUFFER_MPSC_COMMITTED))
+		return -EAGAIN;
+
+	return header & ~SPA_RINGBUFFER_MPSC_COMMITTED;
+}
+
+/**
+ * Clear the record at \a index and move to the next one. Called by the consumer.
+ *
+ * \param rbuf a spa_ringbuffer_mpsc
+ * \param buffer the ringbuffer memory
+ * \param size the size of \a buffer
+ * \param index the index from spa_ringbuffer_mpsc_get_read_index()
+ * \param len the length from spa_ringbuffer_mpsc_get_read_index()
+ */
+static inline void
+spa_ringbuffer_mpsc_read_update(struct spa_ringbuffer_mpsc *rbuf,
+				void *buffer, uint32_t size, uint32_t index, uint32_t len)
+{
+	uint32_t start = index - sizeof(uint32_t);
+	uint32_t total = SPA_RINGBUFFER_MPSC_RECORD_SIZE(len);
+	uint32_t offset = start & (size - 1), l0 = SPA_MIN(total, size - offset);
+
+	/* a later record can start anywhere in this one, its header must
+	 * read as not committed until its producer commits it */
+	memset(SPA_MEMBER(buffer, offset, void), 0, l0);
+	if (SPA_UNLIKELY(total > l0))
+		memset(buffer, 0, total - l0);
+
+	__atomic_store_n(&rbuf->readindex, start + total, __ATOMIC_RELEASE);
+}
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -17,8 +17,14 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -32,9 +38,15 @@
 #include <spa/support/loop.h>
 #include <spa/support/plugin.h>
 #include <spa/monitor/monitor.h>
+#include <spa/utils/list.h>
 
 #define NAME  "alsa-monitor"
 
+#define MAX_PROBE_THREADS	8
+
+#define CACHE_NAME		"alsa-monitor.cache"
+#define CACHE_VERSION		1
+
 extern const struct spa_handle_factory spa_alsa_sink_factory;
 extern const struct spa_handle_factory spa_alsa_source_factory;
 
@@ -49,6 +61,58 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	spa_type_monitor_map(map, &type->monitor);
 }
 
+struct pcm {
+	int device;
+	snd_pcm_stream_t stream;
+	char id[64];
+	char name[80];
+	char subname[32];
+};
+
+/* probe results of a card. The alsa fields are filled by the probe threads
+ * or from the cache file, the udev device is only touched from the main loop */
+struct card {
+	struct spa_list link;
+
+	struct udev_device *dev;
+	char *syspath;
+	uint64_t timestamp;
+	char card_name[16];
+	bool removed;
+
+	char id[16];
+	char driver[16];
+	char name[32];
+	char longname[80];
+	char mixername[80];
+	char components[128];
+
+	struct pcm *pcms;
+	uint32_t n_pcms;
+};
+
+#define PROBE_RUNNING	0
+#define PROBE_POSTED	1
+#define PROBE_CANCELLED	2
+
+struct probe {
+	struct spa_list link;
+	struct impl *impl;
+	uint32_t type;
+
+	struct card **cards;
+	uint32_t n_cards;
+	int *res;
+
+	uint32_t next;
+	uint32_t n_running;
+	uint32_t state;
+
+	pthread_t threads[MAX_PROBE_THREADS];
+	uint32_t n_threads;
+	uint32_t n_deferred;	/**< threads that could not be started */
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_monitor monitor;
@@ -63,15 +127,11 @@ struct impl {
 
 	struct udev *udev;
 	struct udev_monitor *umonitor;
-	struct udev_enumerate *enumerate;
-	uint32_t index;
-	struct udev_list_entry *devices;
 
-	snd_ctl_t *ctl_hndl;
-	struct udev_device *dev;
-	char card_name[16];
-	int dev_idx;
-	int stream_idx;
+	struct spa_list cards;
+	struct spa_list probes;
+	bool cache_loaded;
+	bool cache_dirty;
 
 	int fd;
 	struct spa_source source;
@@ -103,16 +163,170 @@ static const char *path_get_card_id(const char *path)
 	return e + 5;
 }
 
+static uint64_t get_timestamp(struct udev_device *dev)
+{
+	const char *str;
+
+	if ((str = udev_device_get_property_value(dev, "USEC_INITIALIZED")) == NULL)
+		return 0;
+
+	return strtoull(str, NULL, 10);
+}
+
+static struct card *card_new(struct udev_device *dev, const char *syspath,
+			     const char *card_name, uint64_t timestamp)
+{
+	struct card *card;
+
+	card = calloc(1, sizeof(struct card));
+	if (card == NULL)
+		return NULL;
+
+	card->syspath = strdup(syspath);
+	if (card->syspath == NULL) {
+		free(card);
+		return NULL;
+	}
+	card->dev = dev;
+	card->timestamp = timestamp;
+	snprintf(card->card_name, sizeof(card->card_name), "%s", card_name);
+
+	return card;
+}
+
+static void card_free(struct card *card)
+{
+	if (card->dev)
+		udev_device_unref(card->dev);
+	free(card->pcms);
+	free(card->syspath);
+	free(card);
+}
+
+static struct card *find_card(struct impl *this, const char *syspath)
+{
+	struct card *card;
+
+	spa_list_for_each(card, &this->cards, link) {
+		if (strcmp(card->syspath, syspath) == 0)
+			return card;
+	}
+	return NULL;
+}
+
+static struct card *find_probing_card(struct impl *this, const char *syspath)
+{
+	struct probe *p;
+	uint32_t i;
+
+	spa_list_for_each(p, &this->probes, link) {
+		for (i = 0; i < p->n_cards; i++) {
+			if (!p->cards[i]->removed && strcmp(p->cards[i]->syspath, syspath) == 0)
+				return p->cards[i];
+		}
+	}
+	return NULL;
+}
+
+static void remove_card(struct impl *this, struct card *card)
+{
+	spa_list_remove(&card->link);
+	card_free(card);
+	this->cache_dirty = true;
+}
+
+static int add_pcm(struct card *card, snd_pcm_info_t *dev_info)
+{
+	struct pcm *pcms, *pcm;
+
+	pcms = realloc(card->pcms, (card->n_pcms + 1) * sizeof(struct pcm));
+	if (pcms == NULL)
+		return -ENOMEM;
+
+	card->pcms = pcms;
+	pcm = &pcms[card->n_pcms++];
+	pcm->device = snd_pcm_info_get_device(dev_info);
+	pcm->stream = snd_pcm_info_get_stream(dev_info);
+	snprintf(pcm->id, sizeof(pcm->id), "%s", snd_pcm_info_get_id(dev_info));
+	snprintf(pcm->name, sizeof(pcm->name), "%s", snd_pcm_info_get_name(dev_info));
+	snprintf(pcm->subname, sizeof(pcm->subname), "%s", snd_pcm_info_get_subdevice_name(dev_info));
+
+	return 0;
+}
+
+/* called from the probe threads */
+static int probe_card(struct impl *this, struct card *card)
+{
+	int err, dev_idx = -1;
+	snd_ctl_t *ctl_hndl;
+	snd_ctl_card_info_t *card_info;
+	snd_pcm_info_t *dev_info;
+	static const snd_pcm_stream_t streams[] = {
+		SND_PCM_STREAM_PLAYBACK,
+		SND_PCM_STREAM_CAPTURE,
+	};
+	uint32_t i;
+
+	if ((err = snd_ctl_open(&ctl_hndl, card->card_name, 0)) < 0) {
+		spa_log_error(this->log, "can't open control for card %s: %s",
+				card->card_name, snd_strerror(err));
+		return err;
+	}
+
+	snd_ctl_card_info_alloca(&card_info);
+
+	if ((err = snd_ctl_card_info(ctl_hndl, card_info)) < 0) {
+		spa_log_error(this->log, "can't get card info for %s: %s",
+				card->card_name, snd_strerror(err));
+		goto exit;
+	}
+	snprintf(card->id, sizeof(card->id), "%s", snd_ctl_card_info_get_id(card_info));
+	snprintf(card->driver, sizeof(card->driver), "%s", snd_ctl_card_info_get_driver(card_info));
+	snprintf(card->name, sizeof(card->name), "%s", snd_ctl_card_info_get_name(card_info));
+	snprintf(card->longname, sizeof(card->longname), "%s", snd_ctl_card_info_get_longname(card_info));
+	snprintf(card->mixername, sizeof(card->mixername), "%s", snd_ctl_card_info_get_mixername(card_info));
+	snprintf(card->components, sizeof(card->components), "%s", snd_ctl_card_info_get_components(card_info));
+
+	snd_pcm_info_alloca(&dev_info);
+
+	while (true) {
+		if ((err = snd_ctl_pcm_next_device(ctl_hndl, &dev_idx)) < 0) {
+			spa_log_error(this->log, "error iterating devices: %s", snd_strerror(err));
+			goto exit;
+		}
+		if (dev_idx < 0)
+			break;
+
+		for (i = 0; i < SPA_N_ELEMENTS(streams); i++) {
+			snd_pcm_info_set_device(dev_info, dev_idx);
+			snd_pcm_info_set_subdevice(dev_info, 0);
+			snd_pcm_info_set_stream(dev_info, streams[i]);
+
+			if (snd_ctl_pcm_info(ctl_hndl, dev_info) < 0)
+				continue;
+
+			if ((err = add_pcm(card, dev_info)) < 0)
+				goto exit;
+		}
+	}
+	err = 0;
+
+      exit:
+	snd_ctl_close(ctl_hndl);
+	return err;
+}
+
 static int
-fill_item(struct impl *this, snd_ctl_card_info_t *card_info, snd_pcm_info_t *dev_info, struct udev_device *dev,
+fill_item(struct impl *this, struct card *card, struct pcm *pcm,
 		struct spa_pod **item, struct spa_pod_builder *builder)
 {
 	const char *str, *name, *klass = NULL;
 	const struct spa_handle_factory *factory = NULL;
 	char device_name[64];
 	struct type *t = &this->type;
+	struct udev_device *dev = card->dev;
 
-	switch (snd_pcm_info_get_stream(dev_info)) {
+	switch (pcm->stream) {
 	case SND_PCM_STREAM_PLAYBACK:
 		factory = &spa_alsa_sink_factory;
 		klass = "Audio/Sink";
@@ -135,7 +349,7 @@ fill_item(struct impl *this, snd_ctl_card_info_t *card_info, snd_pcm_info_t *dev
 	if (!(name && *name))
 		name = "Unknown";
 
-	snprintf(device_name, 64, "%s,%d", this->card_name, snd_pcm_info_get_device(dev_info));
+	snprintf(device_name, 64, "%s,%d", card->card_name, pcm->device);
 
 	spa_pod_builder_add(builder,
 		"<", 0, t->monitor.MonitorItem,
@@ -150,19 +364,19 @@ fill_item(struct impl *this, snd_ctl_card_info_t *card_info, snd_pcm_info_t *dev
 		":", t->monitor.info,    "[", NULL);
 
 	spa_pod_builder_add(builder,
-		"s", "alsa.card",            "s", this->card_name,
+		"s", "alsa.card",            "s", card->card_name,
 		"s", "alsa.device",          "s", device_name,
-		"s", "alsa.card.id",         "s", snd_ctl_card_info_get_id(card_info),
-		"s", "alsa.card.components", "s", snd_ctl_card_info_get_components(card_info),
-		"s", "alsa.card.driver",     "s", snd_ctl_card_info_get_driver(card_info),
-		"s", "alsa.card.name",       "s", snd_ctl_card_info_get_name(card_info),
-		"s", "alsa.card.longname",   "s", snd_ctl_card_info_get_longname(card_info),
-		"s", "alsa.card.mixername",  "s", snd_ctl_card_info_get_mixername(card_info),
+		"s", "alsa.card.id",         "s", card->id,
+		"s", "alsa.card.components", "s", card->components,
+		"s", "alsa.card.driver",     "s", card->driver,
+		"s", "alsa.card.name",       "s", card->name,
+		"s", "alsa.card.longname",   "s", card->longname,
+		"s", "alsa.card.mixername",  "s", card->mixername,
 		"s", "udev-probed",          "s", "1",
 		"s", "device.api",           "s", "alsa",
-		"s", "alsa.pcm.id",          "s", snd_pcm_info_get_id(dev_info),
-		"s", "alsa.pcm.name",        "s", snd_pcm_info_get_name(dev_info),
-		"s", "alsa.pcm.subname",     "s", snd_pcm_info_get_subdevice_name(dev_info),
+		"s", "alsa.pcm.id",          "s", pcm->id,
+		"s", "alsa.pcm.name",        "s", pcm->name,
+		"s", "alsa.pcm.subname",     "s", pcm->subname,
 		NULL);
 
 	if ((str = udev_device_get_property_value(dev, "SOUND_CLASS")) && *str) {
@@ -216,21 +430,10 @@ fill_item(struct impl *this, snd_ctl_card_info_t *card_info, snd_pcm_info_t *dev
 	return 0;
 }
 
-static void close_card(struct impl *this)
-{
-	if (this->ctl_hndl)
-		snd_ctl_close(this->ctl_hndl);
-	this->ctl_hndl = NULL;
-}
-
-static int open_card(struct impl *this, struct udev_device *dev)
+static int check_device(struct impl *this, struct udev_device *dev, char *card_name, size_t size)
 {
-	int err;
 	const char *str;
 
-	if (this->ctl_hndl)
-		return 0;
-
 	if (udev_device_get_property_value(dev, "PULSE_IGNORE"))
 		return -1;
 
@@ -240,74 +443,450 @@ static int open_card(struct impl *this, struct udev_device *dev)
 	if ((str = path_get_card_id(udev_device_get_property_value(dev, "DEVPATH"))) == NULL)
 		return -1;
 
-	snprintf(this->card_name, 16, "hw:%s", str);
+	snprintf(card_name, size, "hw:%s", str);
 
-	if ((err = snd_ctl_open(&this->ctl_hndl, this->card_name, 0)) < 0) {
-		spa_log_error(this->log, "can't open control for card %s: %s", this->card_name, snd_strerror(err));
-		return err;
+	return 0;
+}
+
+static void emit_card(struct impl *this, struct card *card, uint32_t type)
+{
+	uint32_t i;
+
+	if (this->callbacks == NULL || card->dev == NULL)
+		return;
+
+	for (i = 0; i < card->n_pcms; i++) {
+		uint8_t buffer[4096];
+		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+		struct spa_event *event;
+		struct spa_pod *item;
+
+		event = spa_pod_builder_object(&b, 0, type);
+		if (fill_item(this, card, &card->pcms[i], &item, &b) < 0)
+			continue;
+
+		this->callbacks->event(this->callbacks_data, event);
 	}
-	this->dev_idx = -1;
-	this->stream_idx = -1;
+}
+
+static int get_cache_path(char *path, size_t size, bool create)
+{
+	const char *dir;
+	int len;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL && *dir)
+		len = snprintf(path, size, "%s", dir);
+	else if ((dir = getenv("HOME")) != NULL && *dir)
+		len = snprintf(path, size, "%s/.cache", dir);
+	else
+		return -ENOENT;
+
+	if (create)
+		mkdir(path, 0700);
+	len += snprintf(path + len, size - len, "/pipewire");
+	if (create)
+		mkdir(path, 0700);
+	len += snprintf(path + len, size - len, "/" CACHE_NAME);
+
+	return len < size ? 0 : -ENAMETOOLONG;
+}
+
+static void put_field(FILE *f, const char *str)
+{
+	fputc('\t', f);
+	for (; *str; str++)
+		fputc(*str == '\t' || *str == '\n' ? ' ' : *str, f);
+}
+
+static void save_cache(struct impl *this)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 4];
+	struct card *card;
+	uint32_t i;
+	FILE *f;
+
+	this->cache_dirty = false;
+
+	if (get_cache_path(path, sizeof(path), true) < 0)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if ((f = fopen(tmp, "we")) == NULL) {
+		spa_log_warn(this->log, NAME " %p: can't write cache %s: %s", this, tmp, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "%s %d\n", NAME, CACHE_VERSION);
+	spa_list_for_each(card, &this->cards, link) {
+		if (card->timestamp == 0)
+			continue;
+
+		fprintf(f, "card");
+		put_field(f, card->syspath);
+		fprintf(f, "\t%" PRIu64, card->timestamp);
+		put_field(f, card->card_name);
+		put_field(f, card->id);
+		put_field(f, card->driver);
+		put_field(f, card->name);
+		put_field(f, card->longname);
+		put_field(f, card->mixername);
+		put_field(f, card->components);
+		fputc('\n', f);
+
+		for (i = 0; i < card->n_pcms; i++) {
+			struct pcm *pcm = &card->pcms[i];
+
+			fprintf(f, "pcm\t%d\t%d", pcm->device, pcm->stream);
+			put_field(f, pcm->id);
+			put_field(f, pcm->name);
+			put_field(f, pcm->subname);
+			fputc('\n', f);
+		}
+	}
+	if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		spa_log_warn(this->log, NAME " %p: can't write cache %s: %s", this, path, strerror(errno));
+		unlink(tmp);
+	}
+}
+
+static void load_cache(struct impl *this)
+{
+	char path[PATH_MAX], *line = NULL, *s, *fields[10];
+	struct card *card = NULL;
+	size_t len = 0;
+	ssize_t r;
+	int n;
+	FILE *f;
+
+	this->cache_loaded = true;
+
+	if (get_cache_path(path, sizeof(path), false) < 0)
+		return;
+
+	if ((f = fopen(path, "re")) == NULL)
+		return;
+
+	if ((r = getline(&line, &len, f)) < 0 ||
+	    strncmp(line, NAME " ", strlen(NAME " ")) != 0 ||
+	    atoi(line + strlen(NAME " ")) != CACHE_VERSION)
+		goto done;
+
+	while ((r = getline(&line, &len, f)) > 0) {
+		if (line[r - 1] == '\n')
+			line[r - 1] = '\0';
+
+		for (s = line, n = 0; n < SPA_N_ELEMENTS(fields); n++)
+			if ((fields[n] = strsep(&s, "\t")) == NULL)
+				break;
+
+		if (n == 10 && strcmp(fields[0], "card") == 0) {
+			if (find_card(this, fields[1]) != NULL) {
+				card = NULL;
+				continue;
+			}
+			card = card_new(NULL, fields[1], fields[3], strtoull(fields[2], NULL, 10));
+			if (card == NULL)
+				break;
+
+			snprintf(card->id, sizeof(card->id), "%s", fields[4]);
+			snprintf(card->driver, sizeof(card->driver), "%s", fields[5]);
+			snprintf(card->name, sizeof(card->name), "%s", fields[6]);
+			snprintf(card->longname, sizeof(card->longname), "%s", fields[7]);
+			snprintf(card->mixername, sizeof(card->mixername), "%s", fields[8]);
+			snprintf(card->components, sizeof(card->components), "%s", fields[9]);
+			spa_list_append(&this->cards, &card->link);
+		}
+		else if (n == 6 && strcmp(fields[0], "pcm") == 0 && card != NULL) {
+			struct pcm *pcms, *pcm;
+
+			pcms = realloc(card->pcms, (card->n_pcms + 1) * sizeof(struct pcm));
+			if (pcms == NULL)
+				break;
+
+			card->pcms = pcms;
+			pcm = &pcms[card->n_pcms++];
+			pcm->device = atoi(fields[1]);
+			pcm->stream = atoi(fields[2]);
+			snprintf(pcm->id, sizeof(pcm->id), "%s", fields[3]);
+			snprintf(pcm->name, sizeof(pcm->name), "%s", fields[4]);
+			snprintf(pcm->subname, sizeof(pcm->subname), "%s", fields[5]);
+		}
+	}
+	spa_log_debug(this->log, NAME " %p: loaded cache %s", this, path);
+
+      done:
+	free(line);
+	fclose(f);
+}
+
+static void probe_free(struct probe *p)
+{
+	uint32_t i;
+
+	for (i = 0; i < p->n_cards; i++)
+		card_free(p->cards[i]);
+	free(p->cards);
+	free(p->res);
+	free(p);
+}
+
+static int probe_done(struct spa_loop *loop,
+		      bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct probe *p = *(struct probe **) data;
+	struct impl *this = p->impl;
+	struct card *card, *old;
+	uint32_t i;
+
+	if (this == NULL) {
+		/* the monitor was cleared after we posted */
+		probe_free(p);
+		return 0;
+	}
+
+	for (i = 0; i < p->n_threads; i++)
+		pthread_join(p->threads[i], NULL);
+
+	spa_list_remove(&p->link);
+
+	for (i = 0; i < p->n_cards; i++) {
+		card = p->cards[i];
+
+		if (p->res[i] < 0 || card->removed)
+			continue;
+
+		if ((old = find_card(this, card->syspath)) != NULL)
+			remove_card(this, old);
+
+		p->cards[i] = NULL;
+		spa_list_append(&this->cards, &card->link);
+		this->cache_dirty = true;
+
+		emit_card(this, card, p->type);
+	}
+	for (i = 0; i < p->n_cards; i++) {
+		if (p->cards[i])
+			card_free(p->cards[i]);
+	}
+	p->n_cards = 0;
+	probe_free(p);
+
+	if (this->cache_dirty)
+		save_cache(this);
 
 	return 0;
 }
 
-static int get_next_device(struct impl *this, struct udev_device *dev,
-			   struct spa_pod **item, struct spa_pod_builder *builder)
+static void probe_work(struct probe *p)
 {
-	int err;
-	snd_pcm_info_t *dev_info;
-	snd_ctl_card_info_t *card_info;
+	uint32_t idx;
 
-	if (this->stream_idx == -1) {
-	      next_device:
-		if ((err = snd_ctl_pcm_next_device(this->ctl_hndl, &this->dev_idx)) < 0) {
-			spa_log_error(this->log, "error iterating devices: %s", snd_strerror(err));
-			return err;
+	while (__atomic_load_n(&p->state, __ATOMIC_ACQUIRE) != PROBE_CANCELLED) {
+		idx = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+		if (idx >= p->n_cards)
+			break;
+		p->res[idx] = probe_card(p->impl, p->cards[idx]);
+	}
+}
+
+static void probe_release(struct probe *p, uint32_t count)
+{
+	uint32_t state = PROBE_RUNNING;
+
+	if (__atomic_sub_fetch(&p->n_running, count, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	/* last one out posts the results to the main loop */
+	if (__atomic_compare_exchange_n(&p->state, &state, PROBE_POSTED,
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		spa_loop_invoke(p->impl->main_loop, probe_done, 0, &p, sizeof(struct probe *),
+				false, NULL);
+}
+
+static void *probe_thread(void *data)
+{
+	struct probe *p = data;
+
+	probe_work(p);
+	probe_release(p, 1);
+
+	return NULL;
+}
+
+/* do the work of the threads that could not be started */
+static void probe_run_deferred(struct probe *p)
+{
+	uint32_t count = p->n_deferred;
+
+	p->n_deferred = 0;
+	probe_work(p);
+	probe_release(p, count);
+}
+
+/* probe @cards in parallel, the results are emitted as @type events from
+ * the main loop. Takes ownership of @cards. */
+static int start_probe(struct impl *this, struct card **cards, uint32_t n_cards, uint32_t type)
+{
+	struct probe *p;
+	uint32_t i, n_threads;
+
+	p = calloc(1, sizeof(struct probe));
+	if (p == NULL)
+		goto no_mem;
+
+	p->res = calloc(n_cards, sizeof(int));
+	if (p->res == NULL)
+		goto no_mem;
+
+	p->impl = this;
+	p->type = type;
+	p->cards = cards;
+	p->n_cards = n_cards;
+	p->state = PROBE_RUNNING;
+
+	n_threads = SPA_MIN(n_cards, MAX_PROBE_THREADS);
+	p->n_running = n_threads;
+	p->n_threads = n_threads;
+
+	spa_list_append(&this->probes, &p->link);
+
+	spa_log_debug(this->log, NAME " %p: probe %u cards with %u threads", this, n_cards, n_threads);
+
+	for (i = 0; i < n_threads; i++) {
+		if (pthread_create(&p->threads[i], NULL, probe_thread, p) != 0) {
+			spa_log_warn(this->log, NAME " %p: can't create probe thread", this);
+			break;
 		}
-		if (this->dev_idx < 0)
-			return -1;
+	}
+	if (i < n_threads) {
+		/* do the remaining work ourselves. The results would be
+		 * emitted right away, wait until there are callbacks */
+		p->n_threads = i;
+		p->n_deferred = n_threads - i;
+		if (this->callbacks)
+			probe_run_deferred(p);
+	}
+	return 0;
+
+      no_mem:
+	free(p);
+	for (i = 0; i < n_cards; i++)
+		card_free(cards[i]);
+	free(cards);
+	return -ENOMEM;
+}
+
+static void cancel_probes(struct impl *this)
+{
+	struct probe *p, *t;
+	uint32_t i, state;
 
-		this->stream_idx = 0;
+	spa_list_for_each_safe(p, t, &this->probes, link) {
+		state = __atomic_exchange_n(&p->state, PROBE_CANCELLED, __ATOMIC_ACQ_REL);
+
+		for (i = 0; i < p->n_threads; i++)
+			pthread_join(p->threads[i], NULL);
+
+		spa_list_remove(&p->link);
+
+		if (state == PROBE_POSTED)
+			p->impl = NULL;
+		else
+			probe_free(p);
 	}
+}
 
-	snd_pcm_info_alloca(&dev_info);
-	snd_pcm_info_set_device(dev_info, this->dev_idx);
-	snd_pcm_info_set_subdevice(dev_info, 0);
+static int scan_cards(struct impl *this)
+{
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *devices;
+	struct card *card, *t, **probe = NULL, **tmp;
+	uint32_t n_probe = 0;
+	char card_name[16];
 
-      again:
-	switch (this->stream_idx++) {
-	case 0:
-		snd_pcm_info_set_stream(dev_info, SND_PCM_STREAM_PLAYBACK);
-		break;
-	case 1:
-		snd_pcm_info_set_stream(dev_info, SND_PCM_STREAM_CAPTURE);
-		break;
-	default:
-		goto next_device;
+	if (!this->cache_loaded)
+		load_cache(this);
+
+	spa_list_for_each(card, &this->cards, link) {
+		if (card->dev)
+			udev_device_unref(card->dev);
+		card->dev = NULL;
 	}
 
-	snd_ctl_card_info_alloca(&card_info);
+	enumerate = udev_enumerate_new(this->udev);
+	if (enumerate == NULL)
+		return -ENOMEM;
 
-	if ((err = snd_ctl_card_info(this->ctl_hndl, card_info)) < 0) {
-		spa_log_error(this->log, "can't get card info for device: %s", snd_strerror(err));
-		return err;
+	udev_enumerate_add_match_subsystem(enumerate, "sound");
+	udev_enumerate_scan_devices(enumerate);
+
+	for (devices = udev_enumerate_get_list_entry(enumerate); devices;
+	     devices = udev_list_entry_get_next(devices)) {
+		struct udev_device *dev;
+		const char *syspath;
+		uint64_t timestamp;
+
+		dev = udev_device_new_from_syspath(this->udev, udev_list_entry_get_name(devices));
+		if (dev == NULL)
+			continue;
+
+		syspath = udev_device_get_syspath(dev);
+
+		if (check_device(this, dev, card_name, sizeof(card_name)) < 0 ||
+		    find_probing_card(this, syspath) != NULL) {
+			udev_device_unref(dev);
+			continue;
+		}
+		timestamp = get_timestamp(dev);
+
+		if ((card = find_card(this, syspath)) != NULL) {
+			if (timestamp != 0 && card->timestamp == timestamp &&
+			    strcmp(card->card_name, card_name) == 0) {
+				card->dev = dev;
+				continue;
+			}
+			remove_card(this, card);
+		}
+
+		if ((tmp = realloc(probe, (n_probe + 1) * sizeof(struct card *))) == NULL ||
+		    (tmp[n_probe] = card_new(dev, syspath, card_name, timestamp)) == NULL) {
+			if (tmp)
+				probe = tmp;
+			udev_device_unref(dev);
+			continue;
+		}
+		probe = tmp;
+		n_probe++;
+	}
+	udev_enumerate_unref(enumerate);
+
+	/* drop cached cards that are gone */
+	spa_list_for_each_safe(card, t, &this->cards, link) {
+		if (card->dev == NULL)
+			remove_card(this, card);
 	}
+	if (this->cache_dirty)
+		save_cache(this);
 
-	if ((err = snd_ctl_pcm_info(this->ctl_hndl, dev_info)) < 0)
-		goto again;
+	if (n_probe > 0)
+		return start_probe(this, probe, n_probe, this->type.monitor.Added);
 
-	return fill_item(this, card_info, dev_info, dev, item, builder);
+	free(probe);
+	return 0;
 }
 
 static void impl_on_fd_events(struct spa_source *source)
 {
 	struct impl *this = source->data;
 	struct udev_device *dev;
-	const char *action;
+	struct card *card, **cards;
+	const char *action, *syspath;
 	uint32_t type;
+	char card_name[16];
 
 	dev = udev_monitor_receive_device(this->umonitor);
+	if (dev == NULL)
+		return;
 
 	if ((action = udev_device_get_action(dev)) == NULL)
 		action = "change";
@@ -319,24 +898,37 @@ static void impl_on_fd_events(struct spa_source *source)
 	} else if (strcmp(action, "remove") == 0) {
 		type = this->type.monitor.Removed;
 	} else
-		return;
+		goto done;
 
-	if (open_card(this, dev) < 0)
-		return;
+	syspath = udev_device_get_syspath(dev);
 
-	while (true) {
-		uint8_t buffer[4096];
-		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
-		struct spa_event *event;
-		struct spa_pod *item;
+	if (type == this->type.monitor.Removed) {
+		if ((card = find_probing_card(this, syspath)) != NULL)
+			card->removed = true;
+		if ((card = find_card(this, syspath)) != NULL) {
+			emit_card(this, card, type);
+			remove_card(this, card);
+			save_cache(this);
+		}
+		goto done;
+	}
 
-		event = spa_pod_builder_object(&b, 0, type);
-		if (get_next_device(this, dev, &item, &b) < 0)
-			break;
+	if (check_device(this, dev, card_name, sizeof(card_name)) < 0 ||
+	    find_probing_card(this, syspath) != NULL)
+		goto done;
 
-		this->callbacks->event(this->callbacks_data, event);
+	if ((cards = malloc(sizeof(struct card *))) == NULL)
+		goto done;
+
+	if ((cards[0] = card_new(dev, syspath, card_name, get_timestamp(dev))) == NULL) {
+		free(cards);
+		goto done;
 	}
-	close_card(this);
+	start_probe(this, cards, 1, type);
+	return;
+
+      done:
+	udev_device_unref(dev);
 }
 
 static int
@@ -346,6 +938,7 @@ impl_monitor_set_callbacks(struct spa_monitor *monitor,
 {
 	int res;
 	struct impl *this;
+	struct probe *p, *t;
 
 	spa_return_val_if_fail(monitor != NULL, -EINVAL);
 
@@ -373,6 +966,11 @@ impl_monitor_set_callbacks(struct spa_monitor *monitor,
 		this->source.mask = SPA_IO_IN | SPA_IO_ERR;
 
 		spa_loop_add_source(this->main_loop, &this->source);
+
+		spa_list_for_each_safe(p, t, &this->probes, link) {
+			if (p->n_deferred > 0)
+				probe_run_deferred(p);
+		}
 	} else {
 		spa_loop_remove_source(this->main_loop, &this->source);
 	}
@@ -380,6 +978,9 @@ impl_monitor_set_callbacks(struct spa_monitor *monitor,
 	return 0;
 }
 
+/* Cards that are in the cache and did not change are returned directly.
+ * Other cards are probed in parallel on worker threads and are emitted
+ * with an Added event when their probe completes. */
 static int impl_monitor_enum_items(struct spa_monitor *monitor,
 				   uint32_t *index,
 				   struct spa_pod **item,
@@ -387,6 +988,8 @@ static int impl_monitor_enum_items(struct spa_monitor *monitor,
 {
 	int res;
 	struct impl *this;
+	struct card *card;
+	uint32_t count = 0;
 
 	spa_return_val_if_fail(monitor != NULL, -EINVAL);
 	spa_return_val_if_fail(item != NULL, -EINVAL);
@@ -396,46 +999,26 @@ static int impl_monitor_enum_items(struct spa_monitor *monitor,
 	if ((res = impl_udev_open(this)) < 0)
 		return res;
 
-	if (*index == 0 || this->index > *index) {
-		if (this->enumerate)
-			udev_enumerate_unref(this->enumerate);
-		this->enumerate = udev_enumerate_new(this->udev);
-
-		udev_enumerate_add_match_subsystem(this->enumerate, "sound");
-		udev_enumerate_scan_devices(this->enumerate);
-
-		this->devices = udev_enumerate_get_list_entry(this->enumerate);
-		this->index = 0;
-	}
-	while (*index > this->index && this->devices) {
-		this->devices = udev_list_entry_get_next(this->devices);
-		this->index++;
+	if (*index == 0) {
+		if ((res = scan_cards(this)) < 0)
+			return res;
 	}
-      again:
-	if (this->devices == NULL)
-		return 0;
 
-	if (this->dev == NULL) {
-		this->dev = udev_device_new_from_syspath(this->udev, udev_list_entry_get_name(this->devices));
+	spa_list_for_each(card, &this->cards, link) {
+		if (card->dev == NULL)
+			continue;
 
-		if (open_card(this, this->dev) < 0) {
-			udev_device_unref(this->dev);
-		      next:
-			this->dev = NULL;
-			this->devices = udev_list_entry_get_next(this->devices);
-			goto again;
+		if (*index >= count + card->n_pcms) {
+			count += card->n_pcms;
+			continue;
 		}
-	}
-	if (get_next_device(this, this->dev, item, builder) < 0) {
-		udev_device_unref(this->dev);
-		close_card(this);
-		goto next;
-	}
-
-	this->index++;
-	(*index)++;
+		if (fill_item(this, card, &card->pcms[*index - count], item, builder) < 0)
+			return -EIO;
 
-	return 1;
+		(*index)++;
+		return 1;
+	}
+	return 0;
 }
 
 static const struct spa_monitor impl_monitor = {
@@ -465,11 +1048,13 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 static int impl_clear(struct spa_handle *handle)
 {
         struct impl *this = (struct impl *) handle;
+	struct card *card, *tmp;
+
+	cancel_probes(this);
+
+	spa_list_for_each_safe(card, tmp, &this->cards, link)
+		card_free(card);
 
-	if (this->dev)
-		udev_device_unref(this->dev);
-        if (this->enumerate)
-                udev_enumerate_unref(this->enumerate);
         if (this->umonitor)
                 udev_monitor_unref(this->umonitor);
         if (this->udev)
@@ -517,6 +1102,9 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this->monitor = impl_monitor;
 
+	spa_list_init(&this->cards);
+	spa_list_init(&this->probes);
+
 	return 0;
 }
 
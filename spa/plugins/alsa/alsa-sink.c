@@ -356,7 +356,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "ir", 1,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.align,   "i", 16,
+			":", t->param_buffers.mirrored, "iru", 1,
+				SPA_POD_PROP_MIN_MAX(0, 1));
 	}
 	else if (id == t->param.idMeta) {
 		if (!this->have_format)
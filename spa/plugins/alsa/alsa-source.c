@@ -369,7 +369,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "ir", 2,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.align,   "i", 16,
+			":", t->param_buffers.mirrored, "iru", 1,
+				SPA_POD_PROP_MIN_MAX(0, 1));
 	}
 	else if (id == t->param.idMeta) {
 		if (!this->have_format)
@@ -775,10 +777,15 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&this->free);
 	spa_list_init(&this->ready);
 
+	this->silence_threshold = -1;
+
 	for (i = 0; info && i < info->n_items; i++) {
 		if (!strcmp(info->items[i].key, "alsa.card")) {
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
 		}
+		else if (!strcmp(info->items[i].key, "alsa.silence-threshold")) {
+			this->silence_threshold = atoi(info->items[i].value);
+		}
 	}
 	return 0;
 }
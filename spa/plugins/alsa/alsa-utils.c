@@ -385,12 +385,16 @@ pull_frames(struct state *state,
 		n_bytes = n_frames * state->frame_size;
 
 		offs = index % d[0].maxsize;
-		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
-		l1 = n_bytes - l0;
-
-		memcpy(dst, src + offs, l0);
-		if (l1 > 0)
-			memcpy(dst + l0, src, l1);
+		if (d[0].flags & SPA_DATA_FLAG_MIRRORED) {
+			memcpy(dst, src + offs, n_bytes);
+		} else {
+			l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
+			l1 = n_bytes - l0;
+
+			memcpy(dst, src + offs, l0);
+			if (l1 > 0)
+				memcpy(dst + l0, src, l1);
+		}
 
 		state->ready_offset += n_bytes;
 
@@ -428,6 +432,48 @@ pull_frames(struct state *state,
 	return total_frames;
 }
 
+/* check if all samples are below the silence threshold, only the native
+ * 16 and 32 bits integer and float formats are checked */
+static bool is_silence(struct state *state, const void *data, size_t n_bytes)
+{
+	int32_t threshold = state->silence_threshold;
+	size_t i;
+
+	if (threshold < 0)
+		return false;
+
+	switch (state->format) {
+	case SND_PCM_FORMAT_S16:
+	{
+		const int16_t *s = data;
+		for (i = 0; i < n_bytes / sizeof(int16_t); i++)
+			if (abs(s[i]) > threshold)
+				return false;
+		return true;
+	}
+	case SND_PCM_FORMAT_S32:
+	{
+		const int32_t *s = data;
+		int64_t t = (int64_t) threshold << 16;
+		for (i = 0; i < n_bytes / sizeof(int32_t); i++)
+			if (llabs((int64_t) s[i]) > t)
+				return false;
+		return true;
+	}
+	case SND_PCM_FORMAT_FLOAT:
+	{
+		const float *s = data;
+		float t = threshold / 32768.0f;
+		for (i = 0; i < n_bytes / sizeof(float); i++)
+			if (fabsf(s[i]) > t)
+				return false;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
 static snd_pcm_uframes_t
 push_frames(struct state *state,
 	    const snd_pcm_channel_area_t *my_areas,
@@ -449,12 +495,6 @@ push_frames(struct state *state,
 		b = spa_list_first(&state->free, struct buffer, link);
 		spa_list_remove(&b->link);
 
-		if (b->h) {
-			b->h->seq = state->sample_count;
-			b->h->pts = state->last_monotonic;
-			b->h->dts_offset = 0;
-		}
-
 		d = b->outbuf->datas;
 
 		src = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, uint8_t);
@@ -464,13 +504,24 @@ push_frames(struct state *state,
 		total_frames = SPA_MIN(avail, frames);
 		n_bytes = total_frames * state->frame_size;
 
-		offs = index % d[0].maxsize;
-		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
-		l1 = n_bytes - l0;
+		if (b->h) {
+			b->h->flags = is_silence(state, src, n_bytes) ? SPA_META_HEADER_FLAG_GAP : 0;
+			b->h->seq = state->sample_count;
+			b->h->pts = state->last_monotonic;
+			b->h->dts_offset = 0;
+		}
 
-		memcpy(src, d[0].data + offs, l0);
-		if (l1 > 0)
-			memcpy(src + l0, d[0].data, l1);
+		offs = index % d[0].maxsize;
+		if (d[0].flags & SPA_DATA_FLAG_MIRRORED) {
+			memcpy(d[0].data + offs, src, n_bytes);
+		} else {
+			l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
+			l1 = n_bytes - l0;
+
+			memcpy(d[0].data + offs, src, l0);
+			if (l1 > 0)
+				memcpy(d[0].data, src + l0, l1);
+		}
 
 		d[0].chunk->offset = index;
 		d[0].chunk->size = n_bytes;
@@ -160,6 +160,7 @@ struct state {
 	int timerfd;
 	bool alsa_started;
 	int threshold;
+	int silence_threshold;		/**< max 16 bits amplitude of captured silence, -1 to disable */
 
 	snd_htimestamp_t now;
 	int64_t sample_count;
@@ -20,8 +20,10 @@
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <spa/support/log.h>
+#include <spa/support/loop.h>
 #include <spa/support/type-map.h>
 #include <spa/utils/list.h>
 #include <spa/node/node.h>
@@ -37,7 +39,7 @@
 #define NAME "audiomixer"
 
 #define MAX_BUFFERS     64
-#define MAX_PORTS       128
+#define MAX_PORTS       65536
 
 #define PORT_DEFAULT_VOLUME	1.0
 #define PORT_DEFAULT_MUTE	false
@@ -63,7 +65,8 @@ struct buffer {
 };
 
 struct port {
-	bool valid;
+	uint32_t id;
+	uint32_t active_index;		/**< index in the active ports */
 
 	struct port_props props;
 
@@ -71,12 +74,13 @@ struct port {
 	struct spa_io_control_range *io_range;
 	double *io_volume;
 	int32_t *io_mute;
+	struct spa_io_control_sequence *io_volume_seq;
 
 	struct spa_port_info info;
 
 	bool have_format;
 
-	struct buffer buffers[MAX_BUFFERS];
+	struct buffer *buffers;
 	uint32_t n_buffers;
 
 	struct spa_list queue;
@@ -90,6 +94,7 @@ struct type {
 	uint32_t prop_mute;
 	uint32_t io_prop_volume;
 	uint32_t io_prop_mute;
+	uint32_t io_prop_volume_seq;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_media_type media_type;
@@ -112,6 +117,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_mute = spa_type_map_get_id(map, SPA_TYPE_PROPS__mute);
 	type->io_prop_volume = spa_type_map_get_id(map, SPA_TYPE_IO_PROP_BASE "volume");
 	type->io_prop_mute = spa_type_map_get_id(map, SPA_TYPE_IO_PROP_BASE "mute");
+	type->io_prop_volume_seq = spa_type_map_get_id(map, SPA_TYPE_IO_PROP_SEQUENCE_BASE "volume");
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_media_type_map(map, &type->media_type);
@@ -133,15 +139,17 @@ struct impl {
 	struct type type;
 	struct spa_type_map *map;
 	struct spa_log *log;
+	struct spa_loop *data_loop;
 
 	struct spa_audiomixer_ops ops;
 
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
-	int port_count;
-	int last_port;
-	struct port in_ports[MAX_PORTS];
+	struct port **in_ports;		/**< input ports by id, NULL when unused */
+	uint32_t n_in_ports;		/**< size of in_ports and active */
+	struct port **active;		/**< the input ports without holes */
+	uint32_t port_count;		/**< number of active ports */
 	struct port out_ports[1];
 
 	bool have_format;
@@ -158,11 +166,13 @@ struct impl {
 	bool started;
 };
 
-#define CHECK_FREE_IN_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && !this->in_ports[(p)].valid)
-#define CHECK_IN_PORT(this,d,p)      ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && this->in_ports[(p)].valid)
+#define CHECK_FREE_IN_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && \
+				      ((p) >= this->n_in_ports || this->in_ports[(p)] == NULL))
+#define CHECK_IN_PORT(this,d,p)      ((d) == SPA_DIRECTION_INPUT && (p) < this->n_in_ports && \
+				      this->in_ports[(p)] != NULL)
 #define CHECK_OUT_PORT(this,d,p)     ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
 #define CHECK_PORT(this,d,p)         (CHECK_OUT_PORT(this,d,p) || CHECK_IN_PORT (this,d,p))
-#define GET_IN_PORT(this,p)          (&this->in_ports[p])
+#define GET_IN_PORT(this,p)          (this->in_ports[p])
 #define GET_OUT_PORT(this,p)         (&this->out_ports[p])
 #define GET_PORT(this,d,p)           (d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
 
@@ -250,15 +260,15 @@ impl_node_get_port_ids(struct spa_node *node,
 		       uint32_t n_output_ids)
 {
 	struct impl *this;
-	int i, idx;
+	uint32_t i, idx;
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	if (input_ids) {
-		for (i = 0, idx = 0; i < this->last_port && idx < n_input_ids; i++) {
-			if (this->in_ports[i].valid)
+		for (i = 0, idx = 0; i < this->n_in_ports && idx < n_input_ids; i++) {
+			if (this->in_ports[i] != NULL)
 				input_ids[idx++] = i;
 		}
 	}
@@ -268,10 +278,102 @@ impl_node_get_port_ids(struct spa_node *node,
 	return 0;
 }
 
+/* the port tables are only changed in the data thread, where they are
+ * used. New tables are made in the main thread and the old ones freed
+ * there after the swap */
+struct port_tables {
+	struct port **in_ports;
+	struct port **active;
+	uint32_t n_in_ports;
+	struct port *port;
+};
+
+static int do_add_port(struct spa_loop *loop,
+		       bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	struct port_tables *t = *(struct port_tables **) data;
+	struct port *port = t->port, **in_ports, **active;
+
+	if (t->in_ports != NULL) {
+		in_ports = this->in_ports;
+		active = this->active;
+		this->in_ports = t->in_ports;
+		this->active = t->active;
+		this->n_in_ports = t->n_in_ports;
+		t->in_ports = in_ports;
+		t->active = active;
+	}
+	this->in_ports[port->id] = port;
+	port->active_index = this->port_count;
+	this->active[port->active_index] = port;
+	__atomic_store_n(&this->port_count, this->port_count + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int do_remove_port(struct spa_loop *loop,
+			  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	struct port_tables *t = *(struct port_tables **) data;
+	struct port *port = t->port, *last;
+
+	/* move the last active port in the hole */
+	last = this->active[this->port_count - 1];
+	last->active_index = port->active_index;
+	this->active[last->active_index] = last;
+	this->in_ports[port->id] = NULL;
+	__atomic_store_n(&this->port_count, this->port_count - 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int update_tables(struct impl *this, spa_invoke_func_t func, struct port_tables *t)
+{
+	if (this->data_loop)
+		return spa_loop_invoke(this->data_loop, func, 0, &t, sizeof(t), true, this);
+	else
+		return func(NULL, false, 0, &t, sizeof(t), this);
+}
+
+/* make new tables when there is no room for input port @port_id, the id
+ * table and the active ports grow together */
+static int make_tables(struct impl *this, uint32_t port_id, struct port_tables *t)
+{
+	uint32_t n_ports;
+
+	t->in_ports = NULL;
+	t->active = NULL;
+
+	if (port_id < this->n_in_ports)
+		return 0;
+
+	n_ports = SPA_MAX(port_id + 1, this->n_in_ports * 2);
+	n_ports = SPA_MAX(n_ports, 8u);
+
+	t->in_ports = calloc(n_ports, sizeof(struct port *));
+	t->active = calloc(n_ports, sizeof(struct port *));
+	if (t->in_ports == NULL || t->active == NULL) {
+		free(t->in_ports);
+		free(t->active);
+		return -ENOMEM;
+	}
+	if (this->n_in_ports > 0) {
+		memcpy(t->in_ports, this->in_ports, this->n_in_ports * sizeof(struct port *));
+		memcpy(t->active, this->active, this->port_count * sizeof(struct port *));
+	}
+	t->n_in_ports = n_ports;
+
+	return 0;
+}
+
 static int impl_node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
 {
 	struct impl *this;
 	struct port *port;
+	struct port_tables t;
+	int res;
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
 
@@ -279,8 +381,15 @@ static int impl_node_add_port(struct spa_node *node, enum spa_direction directio
 
 	spa_return_val_if_fail(CHECK_FREE_IN_PORT(this, direction, port_id), -EINVAL);
 
-	port = GET_IN_PORT (this, port_id);
-	port->valid = true;
+	if ((port = calloc(1, sizeof(struct port))) == NULL)
+		return -ENOMEM;
+
+	if ((res = make_tables(this, port_id, &t)) < 0) {
+		free(port);
+		return res;
+	}
+
+	port->id = port_id;
 
 	port_props_reset(&port->props);
 	port->io_volume = &port->props.volume;
@@ -292,9 +401,12 @@ static int impl_node_add_port(struct spa_node *node, enum spa_direction directio
 			   SPA_PORT_INFO_FLAG_OPTIONAL |
 			   SPA_PORT_INFO_FLAG_IN_PLACE;
 
-	this->port_count++;
-	if (this->last_port <= port_id)
-		this->last_port = port_id + 1;
+	t.port = port;
+	update_tables(this, do_add_port, &t);
+
+	/* the old tables after a swap */
+	free(t.in_ports);
+	free(t.active);
 
 	spa_log_info(this->log, NAME " %p: add port %d", this, port_id);
 
@@ -306,6 +418,7 @@ impl_node_remove_port(struct spa_node *node, enum spa_direction direction, uint3
 {
 	struct impl *this;
 	struct port *port;
+	struct port_tables t = { 0, };
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
 
@@ -315,22 +428,17 @@ impl_node_remove_port(struct spa_node *node, enum spa_direction direction, uint3
 
 	port = GET_IN_PORT (this, port_id);
 
-	this->port_count--;
+	/* the data thread no longer uses the port after this */
+	t.port = port;
+	update_tables(this, do_remove_port, &t);
+
 	if (port->have_format && this->have_format) {
 		if (--this->n_formats == 0)
 			this->have_format = false;
 	}
-	spa_memzero(port, sizeof(struct port));
-
-	if (port_id == this->last_port + 1) {
-		int i;
+	free(port->buffers);
+	free(port);
 
-		for (i = this->last_port; i >= 0; i--)
-			if (GET_IN_PORT (this, i)->valid)
-				break;
-
-		this->last_port = i + 1;
-	}
 	spa_log_info(this->log, NAME " %p: remove port %d", this, port_id);
 
 	return 0;
@@ -489,7 +597,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "iru", 1,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.align,   "i", 16,
+			":", t->param_buffers.mirrored, "iru", 1,
+				SPA_POD_PROP_MIN_MAX(0, 1));
 	}
 	else if (id == t->param.idMeta) {
 		if (!port->have_format)
@@ -554,6 +664,16 @@ impl_node_port_enum_params(struct spa_node *node,
 				":", t->param.propId,   "I", t->prop_mute,
 				":", t->param.propType, "b", p->mute);
 			break;
+		case 2:
+			param = spa_pod_builder_object(&b,
+				id, t->param_io.PropSequence,
+				":", t->param_io.id,    "I", t->io_prop_volume_seq,
+				":", t->param_io.size,  "i", SPA_IO_CONTROL_SEQUENCE_SIZE(
+								SPA_IO_CONTROL_SEQUENCE_EVENTS),
+				":", t->param.propId,   "I", t->prop_volume,
+				":", t->param.propType, "dru", p->volume,
+					SPA_POD_PROP_MIN_MAX(0.0, 10.0));
+			break;
 		default:
 			return 0;
 		}
@@ -699,6 +819,17 @@ impl_node_port_use_buffers(struct spa_node *node,
 
 	clear_buffers(this, port);
 
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	if (n_buffers > 0) {
+		struct buffer *bufs;
+
+		if ((bufs = realloc(port->buffers, n_buffers * sizeof(struct buffer))) == NULL)
+			return -ENOMEM;
+		port->buffers = bufs;
+	}
+
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b;
 		struct spa_data *d = buffers[i]->datas;
@@ -771,6 +902,11 @@ impl_node_port_set_io(struct spa_node *node,
 			port->io_mute = &SPA_POD_VALUE(struct spa_pod_bool, data);
 		else
 			port->io_mute = &port->props.mute;
+	else if (id == t->io_prop_volume_seq && direction == SPA_DIRECTION_INPUT)
+		if (data && spa_io_control_sequence_is_valid(data, size))
+			port->io_volume_seq = data;
+		else
+			port->io_volume_seq = NULL;
 	else
 		return -ENOENT;
 
@@ -817,30 +953,13 @@ impl_node_port_send_command(struct spa_node *node,
 }
 
 static inline void
-add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, int layer)
+mix_port_data(struct impl *this, void *out, size_t outsize, void *data, uint32_t maxsize,
+	      bool mirrored, uint32_t offset, double volume, bool mute, int layer)
 {
-	size_t insize;
-	struct buffer *b;
-	uint32_t index, offset, len1, len2, maxsize;
-	struct spa_data *d;
-	void *data;
-	double volume = *port->io_volume;
-	bool mute = *port->io_mute;
-
-	b = spa_list_first(&port->queue, struct buffer, link);
-
-	d = b->outbuf->datas;
-
-	maxsize = d[0].maxsize;
-	data = d[0].data;
+	uint32_t len1, len2;
 
-	insize = SPA_MIN(d[0].chunk->size, maxsize);
-	outsize = SPA_MIN(outsize, insize);
-
-	index = d[0].chunk->offset + (insize - port->queued_bytes);
-	offset = index % maxsize;
-
-	len1 = SPA_MIN(outsize, maxsize - offset);
+	/* mirrored data can be read past maxsize without wrapping */
+	len1 = mirrored ? outsize : SPA_MIN(outsize, maxsize - offset);
 	len2 = outsize - len1;
 
 	if (volume < 0.001 || mute) {
@@ -865,6 +984,74 @@ add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, i
 		if (len2 > 0)
 			mix(out + len1, data, len2);
 	}
+}
+
+/* apply the volume events up to byte position @pos in the cycle and return
+ * the number of bytes, at most @len, that can be mixed before the next event */
+static inline size_t
+port_apply_sequence(struct impl *this, struct port *port, size_t pos, size_t len)
+{
+	struct spa_io_control_event *ev;
+
+	while ((ev = spa_io_control_sequence_peek(port->io_volume_seq)) != NULL) {
+		size_t ev_pos = (size_t) ev->offset * this->bpf;
+
+		if (ev_pos > pos)
+			return SPA_MIN(len, ev_pos - pos);
+
+		port->props.volume = ev->value;
+		spa_io_control_sequence_advance(port->io_volume_seq);
+	}
+	return len;
+}
+
+/* mix the queued data of @port into @out, gap buffers and muted ports are
+ * only consumed. Returns true when data was added to @out. */
+static inline bool
+add_port_data(struct impl *this, void *out, size_t outsize, size_t pos,
+	      struct port *port, int layer)
+{
+	size_t insize, done, len;
+	struct buffer *b;
+	uint32_t index, maxsize;
+	struct spa_data *d;
+	void *data;
+	bool gap;
+
+	b = spa_list_first(&port->queue, struct buffer, link);
+
+	d = b->outbuf->datas;
+
+	maxsize = d[0].maxsize;
+	data = d[0].data;
+
+	insize = SPA_MIN(d[0].chunk->size, maxsize);
+	outsize = SPA_MIN(outsize, insize);
+
+	index = d[0].chunk->offset + (insize - port->queued_bytes);
+
+	gap = *port->io_mute ||
+	      (port->io_volume_seq == NULL && *port->io_volume < 0.001) ||
+	      (b->h && (b->h->flags & SPA_META_HEADER_FLAG_GAP));
+
+	for (done = 0; done < outsize; done += len) {
+		double volume;
+
+		len = outsize - done;
+		if (port->io_volume_seq) {
+			len = port_apply_sequence(this, port, pos + done, len);
+			volume = port->props.volume;
+		}
+		else
+			volume = *port->io_volume;
+
+		if (gap)
+			continue;
+
+		mix_port_data(this, SPA_MEMBER(out, done, void), len, data, maxsize,
+			      d[0].flags & SPA_DATA_FLAG_MIRRORED,
+			      (index + done) % maxsize, volume, false, layer);
+	}
 
 	port->queued_bytes -= outsize;
 
@@ -878,12 +1065,15 @@ add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, i
 		spa_log_trace(this->log, NAME " %p: keeping buffer %d on port %p %zd %zd",
 			      this, b->outbuf->id, port, port->queued_bytes, outsize);
 	}
+	return !gap;
 }
 
 static int mix_output(struct impl *this, size_t n_bytes)
 {
 	struct buffer *outbuf;
-	int i, layer;
+	uint32_t i;
+	int layer;
+	bool added;
 	struct port *outport;
 	struct spa_io_buffers *outio;
 	struct spa_data *od;
@@ -909,27 +1099,52 @@ static int mix_output(struct impl *this, size_t n_bytes)
 	n_bytes = SPA_MIN(n_bytes, avail);
 
 	offset = index % maxsize;
-	len1 = SPA_MIN(n_bytes, maxsize - offset);
+	if (od[0].flags & SPA_DATA_FLAG_MIRRORED)
+		len1 = n_bytes;
+	else
+		len1 = SPA_MIN(n_bytes, maxsize - offset);
 	len2 = n_bytes - len1;
 
 	spa_log_trace(this->log, NAME " %p: dequeue output buffer %d %zd %d %d %d",
 		      this, outbuf->outbuf->id, n_bytes, offset, len1, len2);
 
-	for (layer = 0, i = 0; i < this->last_port; i++) {
-		struct port *in_port = GET_IN_PORT(this, i);
+	for (layer = 0, i = 0; i < this->port_count; i++) {
+		struct port *in_port = this->active[i];
 
 		if (in_port->io == NULL || in_port->n_buffers == 0)
 			continue;
 
 		if (in_port->queued_bytes == 0) {
-			spa_log_warn(this->log, NAME " %p: underrun stream %d", this, i);
+			spa_log_warn(this->log, NAME " %p: underrun stream %d", this, in_port->id);
 			continue;
 		}
 
-		add_port_data(this, SPA_MEMBER(od[0].data, offset, void), len1, in_port, layer);
+		added = add_port_data(this, SPA_MEMBER(od[0].data, offset, void), len1, 0, in_port, layer);
+		if (len2 > 0)
+			added |= add_port_data(this, od[0].data, len2, len1, in_port, layer);
+		if (added)
+			layer++;
+	}
+
+	/* all inputs were silent, produce a gap */
+	if (layer == 0) {
+		this->clear(SPA_MEMBER(od[0].data, offset, void), len1);
 		if (len2 > 0)
-			add_port_data(this, od[0].data, len2, in_port, layer);
-		layer++;
+			this->clear(od[0].data, len2);
+	}
+	if (outbuf->h) {
+		if (layer == 0)
+			outbuf->h->flags |= SPA_META_HEADER_FLAG_GAP;
+		else
+			outbuf->h->flags &= ~SPA_META_HEADER_FLAG_GAP;
+	}
+
+	/* events past the end of the cycle are applied at the end */
+	for (i = 0; i < this->port_count; i++) {
+		struct port *in_port = this->active[i];
+
+		if (in_port->io_volume_seq)
+			port_apply_sequence(this, in_port, SIZE_MAX, 0);
 	}
 
 	od[0].chunk->offset = index;
@@ -961,8 +1176,8 @@ static int impl_node_process_input(struct spa_node *node)
 	if (outio->status == SPA_STATUS_HAVE_BUFFER)
 		return SPA_STATUS_HAVE_BUFFER;
 
-	for (i = 0; i < this->last_port; i++) {
-		struct port *inport = GET_IN_PORT(this, i);
+	for (i = 0; i < this->port_count; i++) {
+		struct port *inport = this->active[i];
 		struct spa_io_buffers *inio;
 
 		if ((inio = inport->io) == NULL)
@@ -989,7 +1204,7 @@ static int impl_node_process_input(struct spa_node *node)
 			inport->queued_bytes = SPA_MIN(d[0].chunk->size, d[0].maxsize);
 
 			spa_log_trace(this->log, NAME " %p: queue buffer %d on port %d %zd %zd",
-				      this, b->outbuf->id, i, inport->queued_bytes, min_queued);
+				      this, b->outbuf->id, inport->id, inport->queued_bytes, min_queued);
 		}
 		if (inport->queued_bytes > 0 && inport->queued_bytes < min_queued)
 			min_queued = inport->queued_bytes;
@@ -1008,7 +1223,7 @@ static int impl_node_process_output(struct spa_node *node)
 	struct impl *this;
 	struct port *outport;
 	struct spa_io_buffers *outio;
-	int i;
+	uint32_t i;
 	size_t min_queued = SIZE_MAX;
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
@@ -1028,8 +1243,8 @@ static int impl_node_process_output(struct spa_node *node)
 		outio->buffer_id = SPA_ID_INVALID;
 	}
 	/* produce more output if possible */
-	for (i = 0; i < this->last_port; i++) {
-		struct port *inport = GET_IN_PORT(this, i);
+	for (i = 0; i < this->port_count; i++) {
+		struct port *inport = this->active[i];
 
 		if (inport->io == NULL || inport->n_buffers == 0)
 			continue;
@@ -1041,15 +1256,15 @@ static int impl_node_process_output(struct spa_node *node)
 		outio->status = mix_output(this, min_queued);
 	} else {
 		/* take requested output range and apply to input */
-		for (i = 0; i < this->last_port; i++) {
-			struct port *inport = GET_IN_PORT(this, i);
+		for (i = 0; i < this->port_count; i++) {
+			struct port *inport = this->active[i];
 			struct spa_io_buffers *inio;
 
 			if ((inio = inport->io) == NULL || inport->n_buffers == 0)
 				continue;
 
 			spa_log_trace(this->log, NAME " %p: port %d queued %zd, res %d", this,
-				      i, inport->queued_bytes, inio->status);
+				      inport->id, inport->queued_bytes, inio->status);
 
 			if (inport->queued_bytes == 0 && inio->status == SPA_STATUS_OK) {
 				if (inport->io_range && outport->io_range)
@@ -1103,6 +1318,21 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < this->port_count; i++) {
+		free(this->active[i]->buffers);
+		free(this->active[i]);
+	}
+	free(this->in_ports);
+	free(this->active);
+	free(this->out_ports[0].buffers);
+
 	return 0;
 }
 
@@ -1130,6 +1360,8 @@ impl_init(const struct spa_handle_factory *factory,
 			this->map = support[i].data;
 		else if (strcmp(support[i].type, SPA_TYPE__Log) == 0)
 			this->log = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+			this->data_loop = support[i].data;
 	}
 	if (this->map == NULL) {
 		spa_log_error(this->log, "an id-map is needed");
@@ -1140,7 +1372,6 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 
 	port = GET_OUT_PORT(this, 0);
-	port->valid = true;
 	port->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
 	    SPA_PORT_INFO_FLAG_NO_REF;
 	spa_list_init(&port->queue);
@@ -362,6 +362,7 @@ static int make_buffer(struct impl *this)
 	struct spa_data *d;
 	int32_t filled, avail;
 	uint32_t index, offset, l0, l1;
+	bool gap;
 
 	read_timer(this);
 
@@ -400,15 +401,25 @@ static int make_buffer(struct impl *this)
 	l0 = SPA_MIN(n_bytes, maxsize - offset) / this->bpf;
 	l1 = n_samples - l0;
 
-	this->render_func(this, SPA_MEMBER(data, offset, void), l0);
-	if (l1 > 0)
-		this->render_func(this, data, l1);
+	/* no need to render the wave when it is silent */
+	gap = *this->io_volume == 0.0;
+	if (gap) {
+		memset(SPA_MEMBER(data, offset, void), 0, l0 * this->bpf);
+		if (l1 > 0)
+			memset(data, 0, l1 * this->bpf);
+	}
+	else {
+		this->render_func(this, SPA_MEMBER(data, offset, void), l0);
+		if (l1 > 0)
+			this->render_func(this, data, l1);
+	}
 
 	d[0].chunk->offset = index;
 	d[0].chunk->size = n_bytes;
 	d[0].chunk->stride = this->bpf;
 
 	if (b->h) {
+		b->h->flags = gap ? SPA_META_HEADER_FLAG_GAP : 0;
 		b->h->seq = this->sample_count;
 		b->h->pts = this->start_time + this->elapsed_time;
 		b->h->dts_offset = 0;
@@ -0,0 +1,389 @@
+/* Spa A2DP SBC codec
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#include <sbc/sbc.h>
+
+#include "rtp.h"
+#include "a2dp-codecs.h"
+
+/* the frame count in the rtp payload header has 4 bits */
+#define MAX_FRAME_COUNT 15
+
+struct impl {
+	sbc_t sbc;
+
+	struct rtp_payload *payload;
+
+	int mtu;
+	int codesize;
+	int frame_length;
+	int frame_count;
+
+	int min_bitpool;
+	int max_bitpool;
+};
+
+static int codec_fill_caps(const struct a2dp_codec *codec,
+			   uint8_t caps[A2DP_MAX_CAPS_SIZE])
+{
+	memcpy(caps, &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+	return sizeof(bluez_a2dp_sbc);
+}
+
+static uint8_t default_bitpool(uint8_t freq, uint8_t mode)
+{
+	/* These bitpool values were chosen based on the A2DP spec recommendation */
+	switch (freq) {
+	case SBC_SAMPLING_FREQ_16000:
+	case SBC_SAMPLING_FREQ_32000:
+		return 53;
+
+	case SBC_SAMPLING_FREQ_44100:
+		switch (mode) {
+		case SBC_CHANNEL_MODE_MONO:
+		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+			return 31;
+
+		case SBC_CHANNEL_MODE_STEREO:
+		case SBC_CHANNEL_MODE_JOINT_STEREO:
+			return 53;
+		}
+		return 53;
+
+	case SBC_SAMPLING_FREQ_48000:
+		switch (mode) {
+		case SBC_CHANNEL_MODE_MONO:
+		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+			return 29;
+
+		case SBC_CHANNEL_MODE_STEREO:
+		case SBC_CHANNEL_MODE_JOINT_STEREO:
+			return 51;
+		}
+		return 51;
+	}
+	return 53;
+}
+
+static int codec_select_config(const struct a2dp_codec *codec,
+			       const void *caps, size_t caps_size,
+			       uint8_t config[A2DP_MAX_CAPS_SIZE])
+{
+	a2dp_sbc_t conf;
+	int bitpool;
+
+	if (caps_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, caps, sizeof(conf));
+
+	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
+		conf.frequency = SBC_SAMPLING_FREQ_48000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
+		conf.frequency = SBC_SAMPLING_FREQ_44100;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
+		conf.frequency = SBC_SAMPLING_FREQ_32000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
+		conf.frequency = SBC_SAMPLING_FREQ_16000;
+	else
+		return -ENOTSUP;
+
+	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
+		conf.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
+		conf.channel_mode = SBC_CHANNEL_MODE_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
+		conf.channel_mode = SBC_CHANNEL_MODE_DUAL_CHANNEL;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
+		conf.channel_mode = SBC_CHANNEL_MODE_MONO;
+	else
+		return -ENOTSUP;
+
+	if (conf.block_length & SBC_BLOCK_LENGTH_16)
+		conf.block_length = SBC_BLOCK_LENGTH_16;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_12)
+		conf.block_length = SBC_BLOCK_LENGTH_12;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_8)
+		conf.block_length = SBC_BLOCK_LENGTH_8;
+	else if (conf.block_length & SBC_BLOCK_LENGTH_4)
+		conf.block_length = SBC_BLOCK_LENGTH_4;
+	else
+		return -ENOTSUP;
+
+	if (conf.subbands & SBC_SUBBANDS_8)
+		conf.subbands = SBC_SUBBANDS_8;
+	else if (conf.subbands & SBC_SUBBANDS_4)
+		conf.subbands = SBC_SUBBANDS_4;
+	else
+		return -ENOTSUP;
+
+	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
+		conf.allocation_method = SBC_ALLOCATION_LOUDNESS;
+	else if (conf.allocation_method & SBC_ALLOCATION_SNR)
+		conf.allocation_method = SBC_ALLOCATION_SNR;
+	else
+		return -ENOTSUP;
+
+	bitpool = default_bitpool(conf.frequency, conf.channel_mode);
+
+	conf.min_bitpool = SPA_MAX(MIN_BITPOOL, conf.min_bitpool);
+	conf.max_bitpool = SPA_MIN(bitpool, conf.max_bitpool);
+
+	memcpy(config, &conf, sizeof(conf));
+
+	return sizeof(conf);
+}
+
+static int codec_get_format(const struct a2dp_codec *codec,
+			    const void *config, size_t config_size,
+			    struct a2dp_codec_format *format)
+{
+	a2dp_sbc_t conf;
+	int rate, channels;
+
+	if (config_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, config, sizeof(conf));
+
+	if ((rate = a2dp_sbc_get_frequency(&conf)) < 0)
+		return -EINVAL;
+	if ((channels = a2dp_sbc_get_channels(&conf)) < 0)
+		return -EINVAL;
+
+	format->format = A2DP_CODEC_FORMAT_S16;
+	format->rate = rate;
+	format->channels = channels;
+
+	return 0;
+}
+
+static int set_bitpool(struct impl *this, int bitpool)
+{
+	bitpool = SPA_CLAMP(bitpool, this->min_bitpool, this->max_bitpool);
+
+	if (this->sbc.bitpool == bitpool)
+		return 0;
+
+	this->sbc.bitpool = bitpool;
+	this->codesize = sbc_get_codesize(&this->sbc);
+	this->frame_length = sbc_get_frame_length(&this->sbc);
+
+	return bitpool;
+}
+
+static void *codec_init(const struct a2dp_codec *codec,
+			const void *config, size_t config_size, int mtu)
+{
+	struct impl *this;
+	a2dp_sbc_t conf;
+
+	if (config_size < sizeof(conf)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	memcpy(&conf, config, sizeof(conf));
+
+	if ((this = calloc(1, sizeof(struct impl))) == NULL)
+		return NULL;
+
+	sbc_init(&this->sbc, 0);
+	this->sbc.endian = SBC_LE;
+	this->mtu = mtu;
+
+	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
+		this->sbc.frequency = SBC_FREQ_48000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
+		this->sbc.frequency = SBC_FREQ_44100;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
+		this->sbc.frequency = SBC_FREQ_32000;
+	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
+		this->sbc.frequency = SBC_FREQ_16000;
+	else
+		goto error;
+
+	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
+		this->sbc.mode = SBC_MODE_JOINT_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
+		this->sbc.mode = SBC_MODE_STEREO;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
+		this->sbc.mode = SBC_MODE_DUAL_CHANNEL;
+	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
+		this->sbc.mode = SBC_MODE_MONO;
+	else
+		goto error;
+
+	switch (conf.subbands) {
+	case SBC_SUBBANDS_4:
+		this->sbc.subbands = SBC_SB_4;
+		break;
+	case SBC_SUBBANDS_8:
+		this->sbc.subbands = SBC_SB_8;
+		break;
+	default:
+		goto error;
+	}
+
+	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
+		this->sbc.allocation = SBC_AM_LOUDNESS;
+	else
+		this->sbc.allocation = SBC_AM_SNR;
+
+	switch (conf.block_length) {
+	case SBC_BLOCK_LENGTH_4:
+		this->sbc.blocks = SBC_BLK_4;
+		break;
+	case SBC_BLOCK_LENGTH_8:
+		this->sbc.blocks = SBC_BLK_8;
+		break;
+	case SBC_BLOCK_LENGTH_12:
+		this->sbc.blocks = SBC_BLK_12;
+		break;
+	case SBC_BLOCK_LENGTH_16:
+		this->sbc.blocks = SBC_BLK_16;
+		break;
+	default:
+		goto error;
+	}
+
+	this->min_bitpool = SPA_MAX(conf.min_bitpool, 12);
+	this->max_bitpool = SPA_MAX(conf.max_bitpool, this->min_bitpool);
+
+	this->sbc.bitpool = this->max_bitpool;
+	this->codesize = sbc_get_codesize(&this->sbc);
+	this->frame_length = sbc_get_frame_length(&this->sbc);
+
+	return this;
+
+      error:
+	sbc_finish(&this->sbc);
+	free(this);
+	errno = EINVAL;
+	return NULL;
+}
+
+static void codec_deinit(void *data)
+{
+	struct impl *this = data;
+
+	sbc_finish(&this->sbc);
+	free(this);
+}
+
+static int codec_get_block_size(void *data)
+{
+	struct impl *this = data;
+	return this->codesize;
+}
+
+static int codec_get_num_blocks(void *data)
+{
+	struct impl *this = data;
+	size_t avail = this->mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload);
+
+	return SPA_MIN(avail / this->frame_length, MAX_FRAME_COUNT);
+}
+
+static int codec_start_encode(void *data, void *dst, size_t dst_size,
+			      uint16_t seqnum, uint32_t timestamp)
+{
+	struct impl *this = data;
+	struct rtp_header *header = dst;
+	size_t header_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	if (dst_size < header_size)
+		return -EINVAL;
+
+	this->payload = SPA_MEMBER(dst, sizeof(struct rtp_header), struct rtp_payload);
+	this->frame_count = 0;
+
+	memset(dst, 0, header_size);
+	header->v = 2;
+	header->pt = 1;
+	header->sequence_number = htons(seqnum);
+	header->timestamp = htonl(timestamp);
+	header->ssrc = htonl(1);
+
+	return header_size;
+}
+
+static int codec_encode(void *data, const void *src, size_t src_size,
+			void *dst, size_t dst_size, size_t *dst_out, bool *need_flush)
+{
+	struct impl *this = data;
+	ssize_t out_encoded;
+	int processed;
+
+	*dst_out = 0;
+
+	if (this->frame_count >= MAX_FRAME_COUNT || dst_size < this->frame_length) {
+		*need_flush = true;
+		return -ENOSPC;
+	}
+
+	processed = sbc_encode(&this->sbc, src, src_size, dst, dst_size, &out_encoded);
+	if (processed <= 0)
+		return processed;
+
+	*dst_out = out_encoded;
+	this->frame_count += processed / this->codesize;
+	this->payload->frame_count = this->frame_count;
+
+	*need_flush = this->frame_count >= MAX_FRAME_COUNT ||
+		dst_size - out_encoded < this->frame_length;
+
+	return processed;
+}
+
+static int codec_reduce_quality(void *data)
+{
+	struct impl *this = data;
+	return set_bitpool(this, this->sbc.bitpool - 2);
+}
+
+static int codec_increase_quality(void *data)
+{
+	struct impl *this = data;
+	return set_bitpool(this, this->sbc.bitpool + 1);
+}
+
+const struct a2dp_codec a2dp_codec_sbc = {
+	.codec_id = A2DP_CODEC_SBC,
+	.name = "SBC",
+	.fill_caps = codec_fill_caps,
+	.select_config = codec_select_config,
+	.get_format = codec_get_format,
+	.init = codec_init,
+	.deinit = codec_deinit,
+	.get_block_size = codec_get_block_size,
+	.get_num_blocks = codec_get_num_blocks,
+	.start_encode = codec_start_encode,
+	.encode = codec_encode,
+	.reduce_quality = codec_reduce_quality,
+	.increase_quality = codec_increase_quality,
+};
@@ -121,3 +121,28 @@ const a2dp_aptx_t bluez_a2dp_aptx = {
 		APTX_SAMPLING_FREQ_48000,
 };
 #endif
+
+const struct a2dp_codec * const a2dp_codecs[] = {
+	&a2dp_codec_sbc,
+	NULL,
+};
+
+const struct a2dp_codec *a2dp_codec_find(int codec_id, const void *config, size_t config_size)
+{
+	const a2dp_vendor_codec_t *vendor = config;
+	int i;
+
+	for (i = 0; a2dp_codecs[i]; i++) {
+		const struct a2dp_codec *c = a2dp_codecs[i];
+
+		if (c->codec_id != codec_id)
+			continue;
+		if (codec_id != A2DP_CODEC_VENDOR)
+			return c;
+		if (config_size >= sizeof(*vendor) &&
+		    vendor->vendor_id == c->vendor.vendor_id &&
+		    vendor->codec_id == c->vendor.codec_id)
+			return c;
+	}
+	return NULL;
+}
@@ -26,6 +26,8 @@
 #define BLUEALSA_A2DPCODECS_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #define A2DP_CODEC_SBC			0x00
 #define A2DP_CODEC_MPEG12		0x01
@@ -284,15 +286,80 @@ static inline int a2dp_sbc_get_frequency(a2dp_sbc_t *config)
         }
 }
 
-const a2dp_sbc_t bluez_a2dp_sbc;
+extern const a2dp_sbc_t bluez_a2dp_sbc;
 #if ENABLE_MP3
-const a2dp_mpeg_t bluez_a2dp_mpeg;
+extern const a2dp_mpeg_t bluez_a2dp_mpeg;
 #endif
 #if ENABLE_AAC
-const a2dp_aac_t bluez_a2dp_aac;
+extern const a2dp_aac_t bluez_a2dp_aac;
 #endif
 #if ENABLE_APTX
-const a2dp_aptx_t bluez_a2dp_aptx;
+extern const a2dp_aptx_t bluez_a2dp_aptx;
 #endif
 
+#define A2DP_MAX_CAPS_SIZE	254
+
+enum a2dp_codec_sample_format {
+	A2DP_CODEC_FORMAT_S16,
+	A2DP_CODEC_FORMAT_S24,		/**< packed 24 bits */
+};
+
+struct a2dp_codec_format {
+	enum a2dp_codec_sample_format format;
+	uint32_t rate;
+	uint32_t channels;
+};
+
+/** An A2DP source codec
+ *
+ * The monitor uses the caps and config functions to register the endpoint
+ * and negotiate a configuration, the sink uses the encoder functions from
+ * the data loop. A packet is made with start_encode followed by encode
+ * calls until the encoder asks for a flush.
+ */
+struct a2dp_codec {
+	uint8_t codec_id;
+	a2dp_vendor_codec_t vendor;	/**< for A2DP_CODEC_VENDOR codecs */
+	const char *name;		/**< used in the endpoint path */
+
+	int (*fill_caps) (const struct a2dp_codec *codec,
+			  uint8_t caps[A2DP_MAX_CAPS_SIZE]);
+	/** select a config from the remote caps, returns the config size */
+	int (*select_config) (const struct a2dp_codec *codec,
+			      const void *caps, size_t caps_size,
+			      uint8_t config[A2DP_MAX_CAPS_SIZE]);
+	/** get the raw audio format to feed to the encoder */
+	int (*get_format) (const struct a2dp_codec *codec,
+			   const void *config, size_t config_size,
+			   struct a2dp_codec_format *format);
+
+	void *(*init) (const struct a2dp_codec *codec,
+		       const void *config, size_t config_size, int mtu);
+	void (*deinit) (void *data);
+
+	/** input bytes consumed per encoded block */
+	int (*get_block_size) (void *data);
+	/** number of blocks in a full packet */
+	int (*get_num_blocks) (void *data);
+
+	/** write the packet header, returns the header size */
+	int (*start_encode) (void *data, void *dst, size_t dst_size,
+			     uint16_t seqnum, uint32_t timestamp);
+	/** encode into the packet, returns the number of input bytes consumed
+	 * or -ENOSPC when the packet is full */
+	int (*encode) (void *data, const void *src, size_t src_size,
+		       void *dst, size_t dst_size, size_t *dst_out, bool *need_flush);
+
+	/** lower and raise the bitrate on congestion, optional */
+	int (*reduce_quality) (void *data);
+	int (*increase_quality) (void *data);
+};
+
+extern const struct a2dp_codec a2dp_codec_sbc;
+
+/** NULL terminated, in order of preference */
+extern const struct a2dp_codec * const a2dp_codecs[];
+
+const struct a2dp_codec *a2dp_codec_find(int codec_id, const void *config, size_t config_size);
+
 #endif
@@ -38,10 +38,7 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
-#include <sbc/sbc.h>
-
 #include "defs.h"
-#include "rtp.h"
 #include "a2dp-codecs.h"
 
 struct props {
@@ -50,7 +47,6 @@ struct props {
 };
 
 #define FILL_FRAMES 2
-#define MAX_FRAME_COUNT 32
 #define MAX_BUFFERS 32
 
 struct buffer {
@@ -125,6 +121,8 @@ struct impl {
 	struct props props;
 
 	struct spa_bt_transport *transport;
+	const struct a2dp_codec *codec;
+	void *codec_data;
 
 	bool opened;
 
@@ -150,21 +148,17 @@ struct impl {
 	int threshold;
 	struct spa_source flush_source;
 
-	sbc_t sbc;
 	int read_size;
 	int write_size;
 	int write_samples;
-	int frame_length;
-	int codesize;
+	int block_size;
 	uint8_t buffer[4096];
 	int buffer_used;
-	int frame_count;
+	int header_size;
+	bool need_flush;
 	uint16_t seqnum;
 	uint32_t timestamp;
 
-	int min_bitpool;
-	int max_bitpool;
-
 	uint64_t last_time;
 	uint64_t last_error;
 
@@ -333,33 +327,30 @@ static inline void calc_timeout(size_t target, size_t current,
 
 static int reset_buffer(struct impl *this)
 {
-	this->buffer_used = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
-	this->frame_count = 0;
+	int res;
+
+	res = this->codec->start_encode(this->codec_data,
+			this->buffer, sizeof(this->buffer),
+			this->seqnum, this->timestamp);
+	if (res < 0)
+		return res;
+
+	this->header_size = this->buffer_used = res;
+	this->need_flush = false;
 	return 0;
 }
 
 static int send_buffer(struct impl *this)
 {
 	int val, written;
-	struct rtp_header *header;
-	struct rtp_payload *payload;
-
-	header = (struct rtp_header *)this->buffer;
-	payload = (struct rtp_payload *)(this->buffer + sizeof(struct rtp_header));
-	memset(this->buffer, 0, sizeof(struct rtp_header)+sizeof(struct rtp_payload));
-
-	payload->frame_count = this->frame_count;
-	header->v = 2;
-	header->pt = 1;
-	header->sequence_number = htons(this->seqnum);
-	header->timestamp = htonl(this->timestamp);
-	header->ssrc = htonl(1);
 
-	ioctl(this->transport->fd, TIOCOUTQ, &val);
-
-	spa_log_trace(this->log, "a2dp-sink %p: send %d %u %u %u %lu %d",
-			this, this->frame_count, this->seqnum, this->timestamp, this->buffer_used,
-			this->sample_time, val);
+	/* this is an extra syscall for each packet, only do it when tracing */
+	if (spa_log_level_enabled(this->log, SPA_LOG_LEVEL_TRACE)) {
+		ioctl(this->transport->fd, TIOCOUTQ, &val);
+		spa_log_trace(this->log, "a2dp-sink %p: send %u %u %u %lu %d",
+				this, this->seqnum, this->timestamp,
+				this->buffer_used, this->sample_time, val);
+	}
 
 	written = write(this->transport->fd, this->buffer, this->buffer_used);
 	spa_log_trace(this->log, "a2dp-sink %p: send %d", this, written);
@@ -376,44 +367,37 @@ static int send_buffer(struct impl *this)
 static int encode_buffer(struct impl *this, const void *data, int size)
 {
 	int processed;
-	ssize_t out_encoded;
+	size_t out_encoded;
 
 	spa_log_trace(this->log, "a2dp-sink %p: encode %d used %d, %d %d",
 			this, size, this->buffer_used, this->frame_size, this->write_size);
 
-	if (this->frame_count > MAX_FRAME_COUNT)
+	if (this->need_flush)
 		return -ENOSPC;
 
-	processed = sbc_encode(&this->sbc, data, size,
-			       this->buffer + this->buffer_used,
-			       this->write_size - this->buffer_used,
-			       &out_encoded);
+	processed = this->codec->encode(this->codec_data, data, size,
+			this->buffer + this->buffer_used,
+			this->write_size - this->buffer_used,
+			&out_encoded, &this->need_flush);
 	if (processed < 0)
 		return processed;
 
 	this->sample_count += processed / this->frame_size;
 	this->sample_time += processed / this->frame_size;
-	this->frame_count += processed / this->codesize;
 	this->buffer_used += out_encoded;
 
-	spa_log_trace(this->log, "a2dp-sink %p: processed %d %ld used %d",
+	spa_log_trace(this->log, "a2dp-sink %p: processed %d %zu used %d",
 			this, processed, out_encoded, this->buffer_used);
 
 	return processed;
 }
 
-static bool need_flush(struct impl *this)
-{
-	return (this->buffer_used + this->frame_length > this->write_size) ||
-		this->frame_count > MAX_FRAME_COUNT;
-}
-
 static int flush_buffer(struct impl *this, bool force)
 {
-	spa_log_trace(this->log, "%d %d %d", this->buffer_used, this->frame_length,
+	spa_log_trace(this->log, "%d %d %d", this->buffer_used, this->header_size,
 			this->write_size);
 
-	if (force || need_flush(this))
+	if (this->need_flush || (force && this->buffer_used > this->header_size))
 		return send_buffer(this);
 
 	return 0;
@@ -466,40 +450,41 @@ static int add_data(struct impl *this, const void *data, int size)
 	return total;
 }
 
-static int set_bitpool(struct impl *this, int bitpool)
+static void update_write_size(struct impl *this)
 {
-	if (bitpool < this->min_bitpool)
-		bitpool = this->min_bitpool;
-	if (bitpool > this->max_bitpool)
-		bitpool = this->max_bitpool;
-
-	if (this->sbc.bitpool == bitpool)
-		return 0;
-
-	this->sbc.bitpool = bitpool;
-
-	spa_log_debug(this->log, "set bitpool %d", this->sbc.bitpool);
-
-	this->codesize = sbc_get_codesize(&this->sbc);
-	this->frame_length = sbc_get_frame_length(&this->sbc);
-
-	this->read_size = this->transport->read_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_size = this->transport->write_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_samples = (this->write_size / this->frame_length) * (this->codesize / this->frame_size);
-
-	return 0;
+	/* write_size is the size of a complete packet, we put as many blocks in
+	 * a packet as the mtu and the codec allow */
+	this->block_size = this->codec->get_block_size(this->codec_data);
+	this->read_size = SPA_MIN(this->transport->read_mtu, sizeof(this->buffer));
+	this->write_size = SPA_MIN(this->transport->write_mtu, sizeof(this->buffer));
+	this->write_samples = this->codec->get_num_blocks(this->codec_data) *
+		this->block_size / this->frame_size;
 }
 
-static int reduce_bitpool(struct impl *this)
+static int reduce_quality(struct impl *this)
 {
-	return set_bitpool(this, this->sbc.bitpool - 2);
+	int res;
+
+	if (this->codec->reduce_quality == NULL)
+		return 0;
+	if ((res = this->codec->reduce_quality(this->codec_data)) > 0) {
+		spa_log_debug(this->log, "a2dp-sink %p: reduce quality %d", this, res);
+		update_write_size(this);
+	}
+	return res;
 }
 
-static int increase_bitpool(struct impl *this)
+static int increase_quality(struct impl *this)
 {
-	return set_bitpool(this, this->sbc.bitpool + 1);
+	int res;
+
+	if (this->codec->increase_quality == NULL)
+		return 0;
+	if ((res = this->codec->increase_quality(this->codec_data)) > 0) {
+		spa_log_debug(this->log, "a2dp-sink %p: increase quality %d", this, res);
+		update_write_size(this);
+	}
+	return res;
 }
 
 static int flush_data(struct impl *this, uint64_t now_time)
@@ -530,7 +515,10 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		n_frames = avail;
 		n_bytes = n_frames * this->frame_size;
 
-		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
+		if (d[0].flags & SPA_DATA_FLAG_MIRRORED)
+			l0 = n_bytes;
+		else
+			l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
 		l1 = n_bytes - l0;
 
 		n_bytes = add_data(this, src + offs, l0);
@@ -574,7 +562,7 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	}
 	else if (written > 0) {
 		if (now_time - this->last_error > SPA_NSEC_PER_SEC * 3) {
-			increase_bitpool(this);
+			increase_quality(this);
 			this->last_error = now_time;
 		}
 	}
@@ -602,7 +590,7 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		}
 		if (!spa_list_is_empty(&this->ready) &&
 		    now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
-			reduce_bitpool(this);
+			reduce_quality(this);
 			this->last_error = now_time;
 		}
 
@@ -668,83 +656,36 @@ static void a2dp_on_timeout(struct spa_source *source)
 	flush_data(this, now_time);
 }
 
-static int init_sbc(struct impl *this)
+static int init_codec(struct impl *this)
 {
-        struct spa_bt_transport *transport = this->transport;
-	a2dp_sbc_t *conf = transport->configuration;
-
-	sbc_init(&this->sbc, 0);
-	this->sbc.endian = SBC_LE;
-
-	if (conf->frequency & SBC_SAMPLING_FREQ_48000)
-		this->sbc.frequency = SBC_FREQ_48000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_44100)
-		this->sbc.frequency = SBC_FREQ_44100;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_32000)
-		this->sbc.frequency = SBC_FREQ_32000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_16000)
-		this->sbc.frequency = SBC_FREQ_16000;
-	else
-		return -EINVAL;
-
-	if (conf->channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		this->sbc.mode = SBC_MODE_JOINT_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_STEREO)
-		this->sbc.mode = SBC_MODE_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		this->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_MONO)
-		this->sbc.mode = SBC_MODE_MONO;
-	else
-		return -EINVAL;
-
-	switch (conf->subbands) {
-	case SBC_SUBBANDS_4:
-		this->sbc.subbands = SBC_SB_4;
-		break;
-	case SBC_SUBBANDS_8:
-		this->sbc.subbands = SBC_SB_8;
-		break;
-	default:
-		return -EINVAL;
-	}
-
-	if (conf->allocation_method & SBC_ALLOCATION_LOUDNESS)
-		this->sbc.allocation = SBC_AM_LOUDNESS;
-	else
-		this->sbc.allocation = SBC_AM_SNR;
-
-	switch (conf->block_length) {
-	case SBC_BLOCK_LENGTH_4:
-		this->sbc.blocks = SBC_BLK_4;
-		break;
-	case SBC_BLOCK_LENGTH_8:
-		this->sbc.blocks = SBC_BLK_8;
-		break;
-	case SBC_BLOCK_LENGTH_12:
-		this->sbc.blocks = SBC_BLK_12;
-		break;
-	case SBC_BLOCK_LENGTH_16:
-		this->sbc.blocks = SBC_BLK_16;
-		break;
-	default:
-		return -EINVAL;
-	}
+	struct spa_bt_transport *transport = this->transport;
 
-	this->min_bitpool = SPA_MAX(conf->min_bitpool, 12);
-	this->max_bitpool = conf->max_bitpool;
+	this->codec_data = this->codec->init(this->codec,
+			transport->configuration, transport->configuration_len,
+			SPA_MIN(transport->write_mtu, sizeof(this->buffer)));
+	if (this->codec_data == NULL)
+		return errno ? -errno : -EIO;
 
-	set_bitpool(this, conf->max_bitpool);
+	update_write_size(this);
 
 	this->seqnum = 0;
 
-        spa_log_debug(this->log, "a2dp-sink %p: codesize %d frame_length %d size %d:%d %d",
-			this, this->codesize, this->frame_length, this->read_size, this->write_size,
-			this->sbc.bitpool);
+	spa_log_debug(this->log, "a2dp-sink %p: codec %s block_size %d size %d:%d samples %d",
+			this, this->codec->name, this->block_size, this->read_size,
+			this->write_size, this->write_samples);
 
 	return 0;
 }
 
+static void deinit_codec(struct impl *this)
+{
+	if (this->codec_data == NULL)
+		return;
+
+	this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
+}
+
 static int do_start(struct impl *this)
 {
 	int res, val;
@@ -759,7 +700,10 @@ static int do_start(struct impl *this)
 	if ((res = this->transport->acquire(this->transport, false)) < 0)
 		return res;
 
-	init_sbc(this);
+	if ((res = init_codec(this)) < 0) {
+		this->transport->release(this->transport);
+		return res;
+	}
 
 	val = FILL_FRAMES * this->transport->write_mtu;
 	if (setsockopt(this->transport->fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
@@ -781,7 +725,11 @@ static int do_start(struct impl *this)
 	if (setsockopt(this->transport->fd, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val)) < 0)
 		spa_log_warn(this->log, "SO_PRIORITY failed: %m");
 
-	reset_buffer(this);
+	if ((res = reset_buffer(this)) < 0) {
+		deinit_codec(this);
+		this->transport->release(this->transport);
+		return res;
+	}
 
 	this->source.data = this;
 	this->source.fd = this->timerfd;
@@ -842,6 +790,8 @@ static int do_stop(struct impl *this)
 
 	this->started = false;
 
+	deinit_codec(this);
+
 	res = this->transport->release(this->transport);
 
 	return res;
@@ -997,28 +947,25 @@ impl_node_port_enum_params(struct spa_node *node,
 			return 0;
 	}
 	else if (id == t->param.idEnumFormat) {
+		struct a2dp_codec_format f;
+
 		if (*index > 0)
 			return 0;
 
-		if (this->transport->codec == 0) {
-			a2dp_sbc_t *config = this->transport->configuration;
-			int rate, channels;
-
-			if ((rate = a2dp_sbc_get_frequency(config)) < 0)
-				return -EIO;
-			if ((channels = a2dp_sbc_get_channels(config)) < 0)
-				return -EIO;
-
-			param = spa_pod_builder_object(&b,
-				id, t->format,
-				"I", t->media_type.audio,
-				"I", t->media_subtype.raw,
-				":", t->format_audio.format,   "I", t->audio_format.S16,
-				":", t->format_audio.rate,     "i", rate,
-				":", t->format_audio.channels, "i", channels);
-		}
-		else
+		if (this->codec->get_format(this->codec,
+				this->transport->configuration,
+				this->transport->configuration_len, &f) < 0)
 			return -EIO;
+
+		param = spa_pod_builder_object(&b,
+			id, t->format,
+			"I", t->media_type.audio,
+			"I", t->media_subtype.raw,
+			":", t->format_audio.format,   "I", f.format == A2DP_CODEC_FORMAT_S24 ?
+								t->audio_format.S24 :
+								t->audio_format.S16,
+			":", t->format_audio.rate,     "i", f.rate,
+			":", t->format_audio.channels, "i", f.channels);
 	}
 	else if (id == t->param.idFormat) {
 		if (!this->have_format)
@@ -1049,7 +996,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "ir", 2,
 				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.align,   "i", 16,
+			":", t->param_buffers.mirrored, "iru", 1,
+				SPA_POD_PROP_MIN_MAX(0, 1));
 	}
 	else if (id == t->param.idMeta) {
 		if (!this->have_format)
@@ -1114,7 +1063,10 @@ static int port_set_format(struct spa_node *node,
 		if (spa_format_audio_raw_parse(format, &info.info.raw, &this->type.format_audio) < 0)
 			return -EINVAL;
 
-		this->frame_size = info.info.raw.channels * 2;
+		if (info.info.raw.format == this->type.audio_format.S24)
+			this->frame_size = info.info.raw.channels * 3;
+		else
+			this->frame_size = info.info.raw.channels * 2;
 		this->threshold = this->props.min_latency;
 		this->current_format = info;
 		this->have_format = true;
@@ -1403,6 +1355,13 @@ impl_init(const struct spa_handle_factory *factory,
 		spa_log_error(this->log, "a transport is needed");
 		return -EINVAL;
 	}
+	this->codec = a2dp_codec_find(this->transport->codec,
+			this->transport->configuration,
+			this->transport->configuration_len);
+	if (this->codec == NULL) {
+		spa_log_error(this->log, "unsupported codec %d", this->transport->codec);
+		return -ENOTSUP;
+	}
 	this->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
 
 	return 0;
@@ -107,133 +107,34 @@ static void fill_item(struct spa_bt_monitor *this, struct spa_bt_transport *tran
 	*result = spa_pod_builder_add(builder, "]>", NULL);
 }
 
-static uint8_t a2dp_default_bitpool(struct spa_bt_monitor *monitor, uint8_t freq, uint8_t mode) {
-	/* These bitpool values were chosen based on the A2DP spec recommendation */
-	switch (freq) {
-	case SBC_SAMPLING_FREQ_16000:
-        case SBC_SAMPLING_FREQ_32000:
-		return 53;
-
-	case SBC_SAMPLING_FREQ_44100:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 31;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 53;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 53;
-	case SBC_SAMPLING_FREQ_48000:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 29;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 51;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 51;
-	}
-	spa_log_warn(monitor->log, "Invalid sampling freq %u", freq);
-	return 53;
-}
-
-static int select_configuration_sbc(struct spa_bt_monitor *monitor, void *capabilities, int size, void *config)
+static const struct a2dp_codec *a2dp_endpoint_to_codec(const char *path)
 {
-	a2dp_sbc_t *cap, conf;
-	int bitpool;
+	const char *prefix = "/A2DP/";
+	size_t len = strlen(prefix);
+	int i;
 
-	if (size < sizeof(conf)) {
-		spa_log_error(monitor->log, "Capabilities array has invalid size");
-		return -ENOSPC;
-	}
-	cap = capabilities;
-	conf = *cap;
-
-	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
-		conf.frequency = SBC_SAMPLING_FREQ_48000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
-		conf.frequency = SBC_SAMPLING_FREQ_44100;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
-		conf.frequency = SBC_SAMPLING_FREQ_32000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
-		conf.frequency = SBC_SAMPLING_FREQ_16000;
-	else {
-		spa_log_error(monitor->log, "No supported sampling frequencies: 0x%x", conf.frequency);
-		return -ENOTSUP;
-	}
-
-	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		conf.channel_mode = SBC_CHANNEL_MODE_DUAL_CHANNEL;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
-		conf.channel_mode = SBC_CHANNEL_MODE_MONO;
-	else {
-		spa_log_error(monitor->log, "No supported channel modes: 0x%x", conf.channel_mode);
-		return -ENOTSUP;
-	}
-
-	if (conf.block_length & SBC_BLOCK_LENGTH_16)
-		conf.block_length = SBC_BLOCK_LENGTH_16;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_12)
-		conf.block_length = SBC_BLOCK_LENGTH_12;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_8)
-		conf.block_length = SBC_BLOCK_LENGTH_8;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_4)
-		conf.block_length = SBC_BLOCK_LENGTH_4;
-	else {
-		spa_log_error(monitor->log, "No supported block lengths: 0x%x", conf.block_length);
-		return -ENOTSUP;
-	}
+	if (path == NULL || strncmp(path, prefix, len) != 0)
+		return NULL;
 
-	if (conf.subbands & SBC_SUBBANDS_8)
-		conf.subbands = SBC_SUBBANDS_8;
-	else if (conf.subbands & SBC_SUBBANDS_4)
-		conf.subbands = SBC_SUBBANDS_4;
-	else {
-		spa_log_error(monitor->log, "No supported subbands: 0x%x", conf.subbands);
-		return -ENOTSUP;
-	}
+	for (i = 0; a2dp_codecs[i]; i++) {
+		const struct a2dp_codec *codec = a2dp_codecs[i];
+		size_t l = strlen(codec->name);
 
-	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
-		conf.allocation_method = SBC_ALLOCATION_LOUDNESS;
-	else if (conf.allocation_method & SBC_ALLOCATION_SNR)
-		conf.allocation_method = SBC_ALLOCATION_SNR;
-	else {
-		spa_log_error(monitor->log, "No supported allocation: 0x%x", conf.allocation_method);
-		return -ENOTSUP;
+		if (strncmp(path + len, codec->name, l) == 0 && path[len + l] == '/')
+			return codec;
 	}
-
-	bitpool = a2dp_default_bitpool(monitor, conf.frequency, conf.channel_mode);
-
-	conf.min_bitpool = SPA_MAX(MIN_BITPOOL, conf.min_bitpool);
-	conf.max_bitpool = SPA_MIN(bitpool, conf.max_bitpool);
-	memcpy(config, &conf, size);
-
-	spa_log_debug(monitor->log, "SelectConfiguration(): %d %d %d %d ",
-			conf.frequency, conf.channel_mode, conf.min_bitpool, conf.max_bitpool);
-
-	return 0;
+	return NULL;
 }
 
 static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBusMessage *m, void *userdata)
 {
 	struct spa_bt_monitor *monitor = userdata;
-	a2dp_sbc_t *cap, config;
-	uint8_t *pconf = (uint8_t *) &config;
+	const struct a2dp_codec *codec;
+	uint8_t *cap, config[A2DP_MAX_CAPS_SIZE];
+	uint8_t *pconf = (uint8_t *) config;
 	DBusMessage *r;
 	DBusError err;
-	int size;
+	int size, res;
 
 	dbus_error_init(&err);
 
@@ -244,17 +145,26 @@ static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBu
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	}
 
-	if (select_configuration_sbc(monitor, cap, size, &config) < 0) {
+	codec = a2dp_endpoint_to_codec(dbus_message_get_path(m));
+	if (codec == NULL)
+		res = -ENOTSUP;
+	else
+		res = codec->select_config(codec, cap, size, config);
+
+	if (res < 0) {
+		spa_log_error(monitor->log, "can't select %s configuration: %s",
+				codec ? codec->name : "unknown", spa_strerror(res));
 		if ((r = dbus_message_new_error(m, "org.bluez.Error.InvalidArguments",
 				"Unable to select configuration")) == NULL)
 			return DBUS_HANDLER_RESULT_NEED_MEMORY;
 		goto exit_send;
 	}
+	spa_log_debug(monitor->log, "SelectConfiguration(): %s %d", codec->name, res);
 
 	if ((r = dbus_message_new_method_return(m)) == NULL)
 		return DBUS_HANDLER_RESULT_NEED_MEMORY;
 	if (!dbus_message_append_args(r, DBUS_TYPE_ARRAY,
-			DBUS_TYPE_BYTE, &pconf, size, DBUS_TYPE_INVALID))
+			DBUS_TYPE_BYTE, &pconf, res, DBUS_TYPE_INVALID))
 		return DBUS_HANDLER_RESULT_NEED_MEMORY;
 
       exit_send:
@@ -606,7 +516,7 @@ static int transport_update_props(struct spa_bt_transport *transport,
 			}
 		}
 		else if (strcmp(key, "Codec") == 0) {
-			int8_t value;
+			uint8_t value;
 
 			if (type != DBUS_TYPE_BYTE)
 				goto next;
@@ -914,12 +824,12 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 				  const char *path,
 				  const char *uuid,
 				  enum spa_bt_profile profile,
-				  uint16_t codec,
-				  const void *configuration,
-				  size_t configuration_size)
+				  const struct a2dp_codec *codec)
 {
 	const char *profile_path;
 	char *object_path, *str;
+	uint8_t caps[A2DP_MAX_CAPS_SIZE], *pcaps = caps;
+	int caps_size;
 	const DBusObjectPathVTable vtable_endpoint = {
 		.message_function = endpoint_handler,
 	};
@@ -929,19 +839,16 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 
 	switch (profile) {
 	case SPA_BT_PROFILE_A2DP_SOURCE:
-		switch (codec) {
-		case A2DP_CODEC_SBC:
-			profile_path = "/A2DP/SBC/Source";
-			break;
-		default:
-			return -ENOTSUP;
-		}
+		profile_path = "Source";
 		break;
 	default:
 		return -ENOTSUP;
 	}
 
-	asprintf(&object_path, "%s/%d", profile_path, monitor->count++);
+	if ((caps_size = codec->fill_caps(codec, caps)) < 0)
+		return caps_size;
+
+	asprintf(&object_path, "/A2DP/%s/%s/%d", codec->name, profile_path, monitor->count++);
 
 	spa_log_debug(monitor->log, "Registering endpoint: %s", object_path);
 
@@ -974,7 +881,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	str = "Codec";
 	dbus_message_iter_append_basic(&it[2], DBUS_TYPE_STRING, &str);
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "y", &it[3]);
-	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec);
+	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec->codec_id);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
 
@@ -984,7 +891,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "ay", &it[3]);
 	dbus_message_iter_open_container(&it[3], DBUS_TYPE_ARRAY, "y", &it[4]);
 	dbus_message_iter_append_fixed_array (&it[4], DBUS_TYPE_BYTE,
-			&configuration, configuration_size);
+			&pcaps, caps_size);
 	dbus_message_iter_close_container(&it[3], &it[4]);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
@@ -1000,12 +907,13 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 static int adapter_register_endpoints(struct spa_bt_adapter *a)
 {
 	struct spa_bt_monitor *monitor = a->monitor;
+	int i;
 
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SOURCE,
-			       SPA_BT_PROFILE_A2DP_SOURCE,
-			       A2DP_CODEC_SBC,
-			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+	for (i = 0; a2dp_codecs[i]; i++)
+		register_a2dp_endpoint(monitor, a->path,
+				       SPA_BT_UUID_A2DP_SOURCE,
+				       SPA_BT_PROFILE_A2DP_SOURCE,
+				       a2dp_codecs[i]);
 	return 0;
 }
 
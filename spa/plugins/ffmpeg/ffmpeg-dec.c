@@ -19,17 +19,31 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
 #include <spa/support/type-map.h>
 #include <spa/support/log.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/pod/filter.h>
 
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-dec"
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
@@ -37,40 +51,73 @@
 
 #define MAX_BUFFERS    32
 
+/* size of the input buffers when the size of the video is not known */
+#define DEFAULT_INPUT_SIZE	(1024 * 1024)
+
+struct impl;
+
 struct buffer {
+	struct impl *impl;
+	uint32_t id;
 	struct spa_buffer *outbuf;
-	bool outstanding;
-	struct buffer *next;
+	struct spa_meta_header *h;
+	/* output buffers are referenced by the codec when it decodes into
+	 * them and by the peer when they are pushed out. They become free
+	 * when both references are released. */
+	int ref;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	enum AVPixelFormat pix_fmt;
+	int stride;
+	int size;		/**< size of a frame */
+	int alloc_size;		/**< size of the buffers we ask for */
+	int linesize[4];
+	int offset[4];
+	bool direct;		/**< decode directly into our buffers */
+
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list free;
+
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
 	struct spa_type_io io;
 	struct spa_type_param param;
+	struct spa_type_meta meta;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
 }
 
 struct impl {
@@ -87,6 +134,15 @@ struct impl {
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	uint32_t subtype;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	/* protects the free list and the refcounts of the output buffers,
+	 * the codec releases buffers from its own threads */
+	pthread_mutex_t lock;
+
 	bool started;
 };
 
@@ -116,6 +172,8 @@ static int spa_ffmpeg_dec_node_send_command(struct spa_node *node, const struct
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	if (SPA_COMMAND_TYPE(command) == this->type.command_node.Start) {
+		if (this->context == NULL)
+			return -EIO;
 		this->started = true;
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		this->started = false;
@@ -222,6 +280,50 @@ spa_ffmpeg_dec_node_port_get_info(struct spa_node *node,
 	return 0;
 }
 
+static void add_size_framerate(struct impl *this, struct spa_pod_builder *builder,
+			       struct spa_rectangle *size, struct spa_fraction *framerate)
+{
+	struct type *t = &this->type;
+
+	if (size && size->width > 0 && size->height > 0)
+		spa_pod_builder_add(builder,
+			":", t->format_video.size, "R", size, 0);
+	else
+		spa_pod_builder_add(builder,
+			":", t->format_video.size, "Rru", &SPA_RECTANGLE(320, 240),
+				SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(1, 1),
+						     &SPA_RECTANGLE(INT32_MAX, INT32_MAX)), 0);
+
+	if (framerate && framerate->denom > 0)
+		spa_pod_builder_add(builder,
+			":", t->format_video.framerate, "F", framerate, 0);
+	else
+		spa_pod_builder_add(builder,
+			":", t->format_video.framerate, "Fru", &SPA_FRACTION(25,1),
+				SPA_POD_PROP_MIN_MAX(&SPA_FRACTION(0, 1),
+						     &SPA_FRACTION(INT32_MAX, 1)), 0);
+}
+
+/* the pixel format to enumerate on the output port. Most decoders only
+ * know their pixel format after parsing the stream, for those we offer
+ * the common 4:2:0 format. */
+static enum AVPixelFormat get_output_pix_fmt(struct impl *this, uint32_t index)
+{
+	const enum AVPixelFormat *pix_fmts = this->codec->pix_fmts;
+	uint32_t i, n;
+
+	if (pix_fmts == NULL)
+		return index == 0 ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NONE;
+
+	for (i = 0, n = 0; pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+		if (ffmpeg_pix_fmt_to_format(&this->type.video_format, pix_fmts[i]) == SPA_ID_INVALID)
+			continue;
+		if (n++ == index)
+			return pix_fmts[i];
+	}
+	return AV_PIX_FMT_NONE;
+}
+
 static int port_enum_formats(struct spa_node *node,
 			     enum spa_direction direction, uint32_t port_id,
 			     uint32_t *index,
@@ -229,23 +331,55 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this;
+	struct impl *this;
+	struct type *t;
+	struct port *in_port;
+	struct spa_rectangle *size = NULL;
+	struct spa_fraction *framerate = NULL;
 
 	if (node == NULL || index == NULL)
 		return -EINVAL;
 
-	//this = SPA_CONTAINER_OF (node, struct impl, node);
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	if (this->subtype == SPA_ID_INVALID)
 		return 0;
+
+	in_port = GET_IN_PORT(this, 0);
+	if (in_port->have_format) {
+		size = &in_port->current_format.info.mjpg.size;
+		framerate = &in_port->current_format.info.mjpg.framerate;
 	}
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		if (*index > 0)
+			return 0;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_add(builder,
+			"I", t->media_type.video,
+			"I", this->subtype, 0);
+		add_size_framerate(this, builder, NULL, NULL);
+	} else {
+		enum AVPixelFormat pix_fmt;
+
+		if ((pix_fmt = get_output_pix_fmt(this, *index)) == AV_PIX_FMT_NONE)
+			return 0;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_add(builder,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format, "I",
+				ffmpeg_pix_fmt_to_format(&t->video_format, pix_fmt), 0);
+		add_size_framerate(this, builder, size, framerate);
+	}
+	*param = spa_pod_builder_pop(builder);
+
 	return 1;
 }
 
@@ -257,6 +391,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -267,8 +402,31 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
-
+	if (direction == SPA_DIRECTION_INPUT) {
+		struct spa_video_info_mjpg *info = &port->current_format.info.mjpg;
+
+		spa_pod_builder_push_object(builder, t->param.idFormat, t->format);
+		spa_pod_builder_add(builder,
+			"I", t->media_type.video,
+			"I", port->current_format.media_subtype, 0);
+		if (info->size.width > 0)
+			spa_pod_builder_add(builder,
+				":", t->format_video.size, "R", &info->size, 0);
+		if (info->framerate.denom > 0)
+			spa_pod_builder_add(builder,
+				":", t->format_video.framerate, "F", &info->framerate, 0);
+		*param = spa_pod_builder_pop(builder);
+	} else {
+		struct spa_video_info_raw *info = &port->current_format.info.raw;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", info->format,
+			":", t->format_video.size,      "R", &info->size,
+			":", t->format_video.framerate, "F", &info->framerate);
+	}
 	return 1;
 }
 
@@ -285,14 +443,22 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -308,6 +474,35 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		param = spa_pod_builder_object(&b,
+			id, t->param_buffers.Buffers,
+			":", t->param_buffers.size,    "i", port->alloc_size,
+			":", t->param_buffers.stride,  "i", port->stride,
+			":", t->param_buffers.buffers, "ir", 16,
+				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+			":", t->param_buffers.align,   "i", FFMPEG_ALIGN);
+	}
+	else if (id == t->param.idMeta) {
+		if (!port->have_format)
+			return -EIO;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -319,18 +514,204 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static void unref_buffer(struct impl *this, struct buffer *b)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+
+	pthread_mutex_lock(&this->lock);
+	if (--b->ref == 0)
+		spa_list_append(&port->free, &b->link);
+	pthread_mutex_unlock(&this->lock);
+}
+
+static struct buffer *dequeue_buffer(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = NULL;
+
+	pthread_mutex_lock(&this->lock);
+	if (!spa_list_is_empty(&port->free)) {
+		b = spa_list_first(&port->free, struct buffer, link);
+		spa_list_remove(&b->link);
+		b->ref = 1;
+	}
+	pthread_mutex_unlock(&this->lock);
+
+	return b;
+}
+
+static void release_buffer(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	unref_buffer(b->impl, b);
+}
+
+static struct buffer *frame_buffer(struct impl *this, AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b;
+
+	if (frame->buf[0] == NULL || port->n_buffers == 0)
+		return NULL;
+
+	b = av_buffer_get_opaque(frame->buf[0]);
+	if (b < &port->buffers[0] || b >= &port->buffers[port->n_buffers])
+		return NULL;
+
+	return b;
+}
+
+/* called by libavcodec, possibly from one of its threads, to get memory
+ * to decode a frame in. When the frame matches the negotiated format we
+ * decode straight into one of our output buffers. */
+static int get_buffer(AVCodecContext *context, AVFrame *frame, int flags)
+{
+	struct impl *this = context->opaque;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_video_info_raw *info = &port->current_format.info.raw;
+	struct buffer *b;
+	uint8_t *data;
+	int i;
+
+	if (!port->direct ||
+	    frame->width != info->size.width ||
+	    frame->height != info->size.height ||
+	    ffmpeg_pix_fmt_to_format(&this->type.video_format, frame->format) != info->format)
+		goto fallback;
+
+	if ((b = dequeue_buffer(this)) == NULL)
+		goto fallback;
+
+	data = b->outbuf->datas[0].data;
+	if (data == NULL ||
+	    b->outbuf->datas[0].maxsize < port->alloc_size ||
+	    ((uintptr_t) data & (FFMPEG_ALIGN - 1))) {
+		unref_buffer(this, b);
+		goto fallback;
+	}
+
+	if ((frame->buf[0] = av_buffer_create(data, port->alloc_size,
+					      release_buffer, b, 0)) == NULL) {
+		unref_buffer(this, b);
+		return AVERROR(ENOMEM);
+	}
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = port->linesize[i] ? data + port->offset[i] : NULL;
+		frame->linesize[i] = port->linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+
+      fallback:
+	return avcodec_default_get_buffer2(context, frame, flags);
+}
+
+static void close_codec(struct impl *this)
+{
+	if (this->context)
+		avcodec_free_context(&this->context);
+}
+
+static int open_codec(struct impl *this)
+{
+	struct port *port = GET_IN_PORT(this, 0);
+	struct spa_video_info_mjpg *info = &port->current_format.info.mjpg;
+	int res;
+
+	close_codec(this);
+
+	if ((this->context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	this->context->opaque = this;
+	this->context->width = info->size.width;
+	this->context->height = info->size.height;
+	if (info->framerate.denom > 0)
+		this->context->framerate = (AVRational) { info->framerate.num, info->framerate.denom };
+	/* we pass the pts in nanoseconds */
+	this->context->pkt_timebase = (AVRational) { 1, SPA_NSEC_PER_SEC };
+
+	/* let libavcodec pick the number of threads, frame threading gives
+	 * the best throughput, slice threading the lowest latency */
+	this->context->thread_count = 0;
+	this->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if (this->codec->capabilities & AV_CODEC_CAP_DR1)
+		this->context->get_buffer2 = get_buffer;
+
+	if ((res = avcodec_open2(this->context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %d",
+				this, this->codec->name, res);
+		close_codec(this);
+		return -EIO;
+	}
+	spa_log_info(this->log, NAME " %p: opened %s with %d threads (%d)", this,
+			this->codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+	return 0;
+}
+
+static void update_output_layout(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_video_info_raw *info = &port->current_format.info.raw;
+	const AVPixFmtDescriptor *desc;
+	int i, width, height, align[AV_NUM_DATA_POINTERS];
+
+	if (!port->have_format)
+		return;
+
+	port->stride = ffmpeg_video_stride(port->pix_fmt, info->size.width, FFMPEG_ALIGN);
+	port->size = ffmpeg_video_layout(port->pix_fmt, info->size.width, info->size.height,
+			port->stride, port->linesize, port->offset);
+	port->alloc_size = port->size;
+	port->direct = false;
+
+	if (port->size < 0 || this->context == NULL ||
+	    !(this->codec->capabilities & AV_CODEC_CAP_DR1) ||
+	    (desc = av_pix_fmt_desc_get(port->pix_fmt)) == NULL)
+		return;
+
+	/* the codec might write more lines than visible, the planes are laid
+	 * out for the visible height so we can only decode directly when the
+	 * extra lines of a plane don't overwrite the next plane. */
+	this->context->pix_fmt = port->pix_fmt;
+	width = info->size.width;
+	height = info->size.height;
+	avcodec_align_dimensions2(this->context, &width, &height, align);
+
+	for (i = 0; i < 4 && port->linesize[i]; i++) {
+		int lines = (i == 0 || i == 3) ? height : AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+
+		if (port->linesize[i] % align[i] != 0)
+			return;
+		if (i < 3 && port->linesize[i + 1] &&
+		    port->offset[i] + port->linesize[i] * lines > port->offset[i + 1])
+			return;
+	}
+	/* room for the extra lines of the last plane and the overread of
+	 * the simd functions */
+	port->alloc_size = port->size + port->stride * (height - info->size.height) +
+		FFMPEG_ALIGN;
+	port->direct = true;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
 			   const struct spa_pod *format)
 {
 	struct impl *this;
+	struct type *t;
 	struct port *port;
+	int res;
 
-	if (node == NULL || format == NULL)
+	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
@@ -339,6 +720,8 @@ static int port_set_format(struct spa_node *node,
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_codec(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
@@ -347,16 +730,50 @@ static int port_set_format(struct spa_node *node,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != this->subtype)
+				return -EINVAL;
+			if (spa_format_video_mjpg_parse(format, &info.info.mjpg, &t->format_video) < 0)
+				return -EINVAL;
+		} else {
+			enum AVPixelFormat pix_fmt;
+
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+			if (info.info.raw.size.width == 0 || info.info.raw.size.height == 0)
+				return -EINVAL;
+
+			pix_fmt = ffmpeg_format_to_pix_fmt(&t->video_format, this->codec->pix_fmts,
+							   info.info.raw.format);
+			if (pix_fmt == AV_PIX_FMT_NONE)
+				return -EINVAL;
+
+			if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY))
+				port->pix_fmt = pix_fmt;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
 			port->current_format = info;
 			port->have_format = true;
+
+			if (direction == SPA_DIRECTION_INPUT) {
+				if ((res = open_codec(this)) < 0) {
+					port->have_format = false;
+					return res;
+				}
+				port->stride = 0;
+				port->alloc_size = info.info.mjpg.size.width > 0 ?
+					av_image_get_buffer_size(AV_PIX_FMT_YUV420P,
+						info.info.mjpg.size.width,
+						info.info.mjpg.size.height, 1) :
+					DEFAULT_INPUT_SIZE;
+			}
+			update_output_layout(this);
 		}
 	}
 	return 0;
@@ -378,6 +795,20 @@ spa_ffmpeg_dec_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static void clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers == 0)
+		return;
+
+	/* make the codec release the buffers it decoded in */
+	if (port == GET_OUT_PORT(this, 0) && this->context)
+		avcodec_flush_buffers(this->context);
+
+	spa_log_info(this->log, NAME " %p: clear buffers", this);
+	port->n_buffers = 0;
+	spa_list_init(&port->free);
+}
+
 static int
 spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
@@ -385,13 +816,47 @@ spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->impl = this;
+		b->id = i;
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+		b->ref = 0;
+
+		if (buffers[i]->n_datas < 1 || d[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %d", this, i);
+			return -EINVAL;
+		}
+		spa_list_append(&port->free, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -436,46 +901,244 @@ spa_ffmpeg_dec_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
+/* feed the pending input buffer to the codec */
+static int send_input(struct impl *this)
+{
+	struct port *port = GET_IN_PORT(this, 0);
+	struct spa_io_buffers *input = port->io;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+	struct spa_data *d;
+	AVPacket *pkt = this->packet;
+	int res;
+
+	if (input == NULL || input->status != SPA_STATUS_HAVE_BUFFER)
+		return 0;
+
+	if (input->buffer_id >= port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+
+	buf = port->buffers[input->buffer_id].outbuf;
+	h = port->buffers[input->buffer_id].h;
+	d = &buf->datas[0];
+
+	/* the data is not refcounted, libavcodec will copy it */
+	pkt->data = SPA_MEMBER(d->data, d->chunk->offset, uint8_t);
+	pkt->size = SPA_MIN(d->chunk->size, d->maxsize - d->chunk->offset);
+	pkt->pts = h ? (int64_t) h->pts : AV_NOPTS_VALUE;
+	pkt->dts = AV_NOPTS_VALUE;
+
+	res = avcodec_send_packet(this->context, pkt);
+	pkt->data = NULL;
+	pkt->size = 0;
+
+	/* the codec has frames to give first, retry later */
+	if (res == AVERROR(EAGAIN))
+		return 0;
+
+	if (res < 0)
+		spa_log_warn(this->log, NAME " %p: error decoding buffer %u: %d",
+				this, input->buffer_id, res);
+
+	input->status = SPA_STATUS_OK;
+
+	return 0;
+}
+
+/* push a decoded frame to the output port */
+static int push_frame(struct impl *this, AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_io_buffers *output = port->io;
+	struct buffer *b;
+	struct spa_data *d;
+
+	if ((b = frame_buffer(this, frame)) != NULL) {
+		/* decoded in our buffer, add a ref for the peer */
+		pthread_mutex_lock(&this->lock);
+		b->ref++;
+		pthread_mutex_unlock(&this->lock);
+	} else {
+		uint8_t *data[4];
+		int i;
+
+		if (ffmpeg_pix_fmt_to_format(&this->type.video_format, frame->format) !=
+		    port->current_format.info.raw.format ||
+		    frame->width != port->current_format.info.raw.size.width ||
+		    frame->height != port->current_format.info.raw.size.height) {
+			spa_log_error(this->log, NAME " %p: decoded frame %dx%d format %d does "
+					"not match the negotiated format", this,
+					frame->width, frame->height, frame->format);
+			return -ENOTSUP;
+		}
+		if ((b = dequeue_buffer(this)) == NULL) {
+			spa_log_error(this->log, NAME " %p: out of buffers", this);
+			return -EPIPE;
+		}
+		d = &b->outbuf->datas[0];
+		if (d->maxsize < port->size) {
+			unref_buffer(this, b);
+			return -ENOSPC;
+		}
+		for (i = 0; i < 4; i++)
+			data[i] = port->linesize[i] ? SPA_MEMBER(d->data, port->offset[i], uint8_t) : NULL;
+
+		av_image_copy(data, port->linesize,
+			      (const uint8_t **) frame->data, frame->linesize,
+			      frame->format, frame->width, frame->height);
+	}
+
+	d = &b->outbuf->datas[0];
+	d->chunk->offset = 0;
+	d->chunk->size = port->size;
+	d->chunk->stride = port->stride;
+
+	if (b->h) {
+		b->h->flags = 0;
+		b->h->seq++;
+		b->h->pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ?
+			frame->best_effort_timestamp : frame->pts;
+		b->h->dts_offset = 0;
+	}
+	av_frame_unref(frame);
+
+	spa_log_trace(this->log, NAME " %p: push buffer %u", this, b->id);
+
+	output->buffer_id = b->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int receive_frame(struct impl *this)
+{
+	int res;
+
+	res = avcodec_receive_frame(this->context, this->frame);
+	if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+		return SPA_STATUS_NEED_BUFFER;
+	if (res < 0) {
+		spa_log_error(this->log, NAME " %p: error receiving frame: %d", this, res);
+		return -EIO;
+	}
+	return push_frame(this, this->frame);
+}
+
 static int spa_ffmpeg_dec_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *port;
+	struct spa_io_buffers *input, *output;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	port = GET_OUT_PORT(this, 0);
+
+	if ((output = port->io) == NULL)
+		return -EIO;
+	if ((input = GET_IN_PORT(this, 0)->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (this->context == NULL || !port->have_format) {
+		input->status = -EIO;
+		return -EIO;
+	}
+
+	/* recycle */
+	if (output->buffer_id < port->n_buffers) {
+		unref_buffer(this, &port->buffers[output->buffer_id]);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if ((res = send_input(this)) < 0)
+		return res;
+
+	if ((res = receive_frame(this)) != SPA_STATUS_NEED_BUFFER)
+		return res;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
 }
 
 static int spa_ffmpeg_dec_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
 	struct port *port;
-	struct spa_io_buffers *output;
+	struct spa_io_buffers *input, *output;
+	int res;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	port = &this->out_ports[0];
+	port = GET_OUT_PORT(this, 0);
 
 	if ((output = port->io) == NULL)
 		return -EIO;
+	if ((input = GET_IN_PORT(this, 0)->io) == NULL)
+		return -EIO;
 
-	if (!port->have_format) {
+	if (!port->have_format || this->context == NULL) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	/* recycle */
+	if (output->buffer_id < port->n_buffers) {
+		unref_buffer(this, &port->buffers[output->buffer_id]);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* the codec can have more frames queued, with frame threading or
+	 * when an input buffer was not accepted yet */
+	if ((res = send_input(this)) < 0)
+		return res;
+
+	if ((res = receive_frame(this)) != SPA_STATUS_NEED_BUFFER)
+		return res;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
 }
 
 static int
 spa_ffmpeg_dec_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *this;
+	struct port *port;
+
 	if (node == NULL)
 		return -EINVAL;
 
 	if (port_id != 0)
 		return -EINVAL;
 
-	return -ENOTSUP;
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	unref_buffer(this, &port->buffers[buffer_id]);
+
+	return 0;
 }
 
 static int
@@ -529,8 +1192,26 @@ spa_ffmpeg_dec_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
-int
-spa_ffmpeg_dec_init(struct spa_handle *handle,
+static int spa_ffmpeg_dec_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+
+	close_codec(this);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+	pthread_mutex_destroy(&this->lock);
+
+	return 0;
+}
+
+static int
+spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
@@ -538,7 +1219,11 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	struct impl *this;
 	uint32_t i;
 
+	if (factory == NULL || handle == NULL)
+		return -EINVAL;
+
 	handle->get_interface = spa_ffmpeg_dec_get_interface;
+	handle->clear = spa_ffmpeg_dec_clear;
 
 	this = (struct impl *) handle;
 
@@ -554,10 +1239,58 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	}
 	init_type(&this->type, this->map);
 
+	if (strncmp(factory->name, FFMPEG_DEC_PREFIX, strlen(FFMPEG_DEC_PREFIX)) != 0 ||
+	    (this->codec = avcodec_find_decoder_by_name(factory->name +
+							 strlen(FFMPEG_DEC_PREFIX))) == NULL) {
+		spa_log_error(this->log, "unknown decoder %s", factory->name);
+		return -ENOENT;
+	}
+	this->subtype = ffmpeg_codec_to_subtype(&this->type.media_subtype_video, this->codec->id);
+
+	this->packet = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->packet == NULL || this->frame == NULL) {
+		av_packet_free(&this->packet);
+		av_frame_free(&this->frame);
+		return -ENOMEM;
+	}
+	pthread_mutex_init(&this->lock, NULL);
+
 	this->node = ffmpeg_dec_node;
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_NO_REF;
+	spa_list_init(&this->in_ports[0].free);
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->out_ports[0].free);
 
 	return 0;
 }
+
+static const struct spa_interface_info ffmpeg_dec_interfaces[] = {
+	{SPA_TYPE__Node, },
+};
+
+static int
+spa_ffmpeg_dec_enum_interface_info(const struct spa_handle_factory *factory,
+				   const struct spa_interface_info **info,
+				   uint32_t *index)
+{
+	if (factory == NULL || info == NULL || index == NULL)
+		return -EINVAL;
+
+	if (*index < SPA_N_ELEMENTS(ffmpeg_dec_interfaces))
+		*info = &ffmpeg_dec_interfaces[(*index)++];
+	else
+		return 0;
+
+	return 1;
+}
+
+const struct spa_handle_factory spa_ffmpeg_dec_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NULL,
+	NULL,
+	sizeof(struct impl),
+	spa_ffmpeg_dec_init,
+	spa_ffmpeg_dec_enum_interface_info,
+};
@@ -19,17 +19,28 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+
 #include <spa/support/log.h>
 #include <spa/support/type-map.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/pod/filter.h>
 
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-enc"
 
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
@@ -38,44 +49,66 @@
 
 #define MAX_BUFFERS    32
 
+/* the codec can delay frames, we keep the pts of the frames in flight */
+#define MAX_PTS		64
+
+/* extra room in the output buffers for the headers of a packet */
+#define OUTPUT_EXTRA	16384
+
 struct buffer {
-	struct spa_buffer buffer;
-	struct spa_meta metas[1];
-	struct spa_meta_header header;
-	struct spa_data datas[1];
-	struct spa_buffer *imported;
+	uint32_t id;
+	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
 	bool outstanding;
-	struct buffer *next;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	enum AVPixelFormat pix_fmt;
+	int stride;
+	int size;
+
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list free;
+
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
 	struct spa_type_io io;
 	struct spa_type_param param;
+	struct spa_type_meta meta;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
 }
 
 struct impl {
@@ -92,19 +125,29 @@ struct impl {
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	uint32_t subtype;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+
+	int64_t frame_count;
+	uint64_t pts[MAX_PTS];
+
 	bool started;
 };
 
 static int spa_ffmpeg_enc_node_enum_params(struct spa_node *node,
 					   uint32_t id, uint32_t *index,
 					   const struct spa_pod *filter,
-					   struct spa_pod **param,
+					   struct spa_pod **result,
 					   struct spa_pod_builder *builder)
 {
 	return -ENOTSUP;
 }
 
-static int spa_ffmpeg_enc_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+static int spa_ffmpeg_enc_node_set_param(struct spa_node *node,
+					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
 	return -ENOTSUP;
@@ -120,6 +163,8 @@ static int spa_ffmpeg_enc_node_send_command(struct spa_node *node, const struct
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
 	if (SPA_COMMAND_TYPE(command) == this->type.command_node.Start) {
+		if (this->context == NULL)
+			return -EIO;
 		this->started = true;
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		this->started = false;
@@ -195,8 +240,7 @@ spa_ffmpeg_enc_node_add_port(struct spa_node *node, enum spa_direction direction
 }
 
 static int
-spa_ffmpeg_enc_node_remove_port(struct spa_node *node,
-				enum spa_direction direction, uint32_t port_id)
+spa_ffmpeg_enc_node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
 {
 	return -ENOTSUP;
 }
@@ -204,7 +248,8 @@ spa_ffmpeg_enc_node_remove_port(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 				  enum spa_direction direction,
-				  uint32_t port_id, const struct spa_port_info **info)
+				  uint32_t port_id,
+				  const struct spa_port_info **info)
 {
 	struct impl *this;
 	struct port *port;
@@ -223,6 +268,47 @@ spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 	return 0;
 }
 
+static void add_size_framerate(struct impl *this, struct spa_pod_builder *builder,
+			       struct spa_rectangle *size, struct spa_fraction *framerate)
+{
+	struct type *t = &this->type;
+
+	if (size && size->width > 0 && size->height > 0)
+		spa_pod_builder_add(builder,
+			":", t->format_video.size, "R", size, 0);
+	else
+		spa_pod_builder_add(builder,
+			":", t->format_video.size, "Rru", &SPA_RECTANGLE(320, 240),
+				SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(1, 1),
+						     &SPA_RECTANGLE(INT32_MAX, INT32_MAX)), 0);
+
+	if (framerate && framerate->denom > 0)
+		spa_pod_builder_add(builder,
+			":", t->format_video.framerate, "F", framerate, 0);
+	else
+		spa_pod_builder_add(builder,
+			":", t->format_video.framerate, "Fru", &SPA_FRACTION(25,1),
+				SPA_POD_PROP_MIN_MAX(&SPA_FRACTION(1, 1),
+						     &SPA_FRACTION(INT32_MAX, 1)), 0);
+}
+
+static enum AVPixelFormat get_input_pix_fmt(struct impl *this, uint32_t index)
+{
+	const enum AVPixelFormat *pix_fmts = this->codec->pix_fmts;
+	uint32_t i, n;
+
+	if (pix_fmts == NULL)
+		return index == 0 ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NONE;
+
+	for (i = 0, n = 0; pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+		if (ffmpeg_pix_fmt_to_format(&this->type.video_format, pix_fmts[i]) == SPA_ID_INVALID)
+			continue;
+		if (n++ == index)
+			return pix_fmts[i];
+	}
+	return AV_PIX_FMT_NONE;
+}
+
 static int port_enum_formats(struct spa_node *node,
 			     enum spa_direction direction, uint32_t port_id,
 			     uint32_t *index,
@@ -230,18 +316,55 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this = SPA_CONTAINER_OF (node, struct impl, node);
-	//struct port *port;
+	struct impl *this;
+	struct type *t;
+	struct port *in_port;
+	struct spa_rectangle *size = NULL;
+	struct spa_fraction *framerate = NULL;
+
+	if (node == NULL || index == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
 
-	//port = GET_PORT(this, direction, port_id);
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	if (this->subtype == SPA_ID_INVALID)
 		return 0;
+
+	in_port = GET_IN_PORT(this, 0);
+	if (in_port->have_format) {
+		size = &in_port->current_format.info.raw.size;
+		framerate = &in_port->current_format.info.raw.framerate;
 	}
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		enum AVPixelFormat pix_fmt;
+
+		if ((pix_fmt = get_input_pix_fmt(this, *index)) == AV_PIX_FMT_NONE)
+			return 0;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_add(builder,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format, "I",
+				ffmpeg_pix_fmt_to_format(&t->video_format, pix_fmt), 0);
+		add_size_framerate(this, builder, NULL, NULL);
+	} else {
+		if (*index > 0)
+			return 0;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_add(builder,
+			"I", t->media_type.video,
+			"I", this->subtype, 0);
+		add_size_framerate(this, builder, size, framerate);
+	}
+	*param = spa_pod_builder_pop(builder);
+
 	return 1;
 }
 
@@ -253,6 +376,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -263,8 +387,26 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
+	if (direction == SPA_DIRECTION_INPUT) {
+		struct spa_video_info_raw *info = &port->current_format.info.raw;
 
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", info->format,
+			":", t->format_video.size,      "R", &info->size,
+			":", t->format_video.framerate, "F", &info->framerate);
+	} else {
+		struct spa_video_info_mjpg *info = &port->current_format.info.mjpg;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.size,      "R", &info->size,
+			":", t->format_video.framerate, "F", &info->framerate);
+	}
 	return 1;
 }
 
@@ -281,14 +423,22 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -304,6 +454,35 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		param = spa_pod_builder_object(&b,
+			id, t->param_buffers.Buffers,
+			":", t->param_buffers.size,    "i", port->size,
+			":", t->param_buffers.stride,  "i", port->stride,
+			":", t->param_buffers.buffers, "ir", 8,
+				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+			":", t->param_buffers.align,   "i", 16);
+	}
+	else if (id == t->param.idMeta) {
+		if (!port->have_format)
+			return -EIO;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -315,35 +494,128 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static void close_codec(struct impl *this)
+{
+	if (this->context)
+		avcodec_free_context(&this->context);
+}
+
+static int open_codec(struct impl *this)
+{
+	struct port *port = GET_IN_PORT(this, 0);
+	struct spa_video_info_raw *info = &port->current_format.info.raw;
+	int res;
+
+	close_codec(this);
+
+	if ((this->context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	this->context->width = info->size.width;
+	this->context->height = info->size.height;
+	this->context->pix_fmt = port->pix_fmt;
+	if (info->framerate.num > 0 && info->framerate.denom > 0) {
+		this->context->framerate = (AVRational) { info->framerate.num, info->framerate.denom };
+		this->context->time_base = (AVRational) { info->framerate.denom, info->framerate.num };
+	} else {
+		this->context->framerate = (AVRational) { 25, 1 };
+		this->context->time_base = (AVRational) { 1, 25 };
+	}
+	this->context->thread_count = 0;
+	this->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if ((res = avcodec_open2(this->context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %d",
+				this, this->codec->name, res);
+		close_codec(this);
+		return -EIO;
+	}
+	this->frame_count = 0;
+
+	spa_log_info(this->log, NAME " %p: opened %s with %d threads (%d)", this,
+			this->codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
-			   uint32_t flags, const struct spa_pod *format)
+			   uint32_t flags,
+			   const struct spa_pod *format)
 {
-	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct impl *this;
+	struct type *t;
 	struct port *port;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
 
 	port = GET_PORT(this, direction, port_id);
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_codec(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
+		enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
 
 		spa_pod_object_parse(format,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+			if (info.info.raw.size.width == 0 || info.info.raw.size.height == 0)
+				return -EINVAL;
+
+			pix_fmt = ffmpeg_format_to_pix_fmt(&t->video_format, this->codec->pix_fmts,
+							   info.info.raw.format);
+			if (pix_fmt == AV_PIX_FMT_NONE)
+				return -EINVAL;
+		} else {
+			if (info.media_subtype != this->subtype)
+				return -EINVAL;
+			if (spa_format_video_mjpg_parse(format, &info.info.mjpg, &t->format_video) < 0)
+				return -EINVAL;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
 			port->current_format = info;
 			port->have_format = true;
+
+			if (direction == SPA_DIRECTION_INPUT) {
+				struct spa_video_info_raw *raw = &info.info.raw;
+				struct port *out_port = GET_OUT_PORT(this, 0);
+				int linesize[4], offset[4];
+
+				port->pix_fmt = pix_fmt;
+				port->stride = ffmpeg_video_stride(pix_fmt, raw->size.width, 4);
+				port->size = ffmpeg_video_layout(pix_fmt, raw->size.width,
+						raw->size.height, port->stride, linesize, offset);
+
+				if ((res = open_codec(this)) < 0) {
+					port->have_format = false;
+					return res;
+				}
+				/* a packet is almost always smaller than the raw frame */
+				out_port->stride = 0;
+				out_port->size = port->size + OUTPUT_EXTRA;
+			}
 		}
 	}
 	return 0;
@@ -365,19 +637,63 @@ spa_ffmpeg_enc_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static void clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers == 0)
+		return;
+
+	spa_log_info(this->log, NAME " %p: clear buffers", this);
+	port->n_buffers = 0;
+	spa_list_init(&port->free);
+}
+
 static int
 spa_ffmpeg_enc_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
 				     uint32_t port_id,
-				     struct spa_buffer **buffers, uint32_t n_buffers)
+				     struct spa_buffer **buffers,
+				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->id = i;
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+		b->outstanding = false;
+
+		if (buffers[i]->n_datas < 1 || d[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %d", this, i);
+			return -EINVAL;
+		}
+		spa_list_append(&port->free, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -422,54 +738,259 @@ spa_ffmpeg_enc_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
-static int
-spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+static void recycle_buffer(struct impl *this, uint32_t id)
 {
-	if (node == NULL)
-		return -EINVAL;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = &port->buffers[id];
 
-	if (port_id != 0)
+	if (!b->outstanding)
+		return;
+
+	b->outstanding = false;
+	spa_list_append(&port->free, &b->link);
+}
+
+/* feed the pending input buffer to the codec */
+static int send_input(struct impl *this)
+{
+	struct port *port = GET_IN_PORT(this, 0);
+	struct spa_io_buffers *input = port->io;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+	struct spa_data *d;
+	AVFrame *frame = this->frame;
+	int i, res, linesize[4], offset[4];
+
+	if (input == NULL || input->status != SPA_STATUS_HAVE_BUFFER)
+		return 0;
+
+	if (input->buffer_id >= port->n_buffers) {
+		input->status = -EINVAL;
 		return -EINVAL;
+	}
 
-	return -ENOTSUP;
+	buf = port->buffers[input->buffer_id].outbuf;
+	h = port->buffers[input->buffer_id].h;
+	d = &buf->datas[0];
+
+	if (ffmpeg_video_layout(port->pix_fmt,
+				port->current_format.info.raw.size.width,
+				port->current_format.info.raw.size.height,
+				d->chunk->stride > 0 ? d->chunk->stride : port->stride,
+				linesize, offset) > (int) d->maxsize - d->chunk->offset) {
+		spa_log_warn(this->log, NAME " %p: buffer %u too small", this, input->buffer_id);
+		input->status = SPA_STATUS_OK;
+		return 0;
+	}
+
+	/* the frame is not refcounted so libavcodec makes a copy when it needs to
+	 * keep it, the input buffer is recycled as soon as we return */
+	frame->format = port->pix_fmt;
+	frame->width = port->current_format.info.raw.size.width;
+	frame->height = port->current_format.info.raw.size.height;
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = linesize[i] ?
+			SPA_MEMBER(d->data, d->chunk->offset + offset[i], uint8_t) : NULL;
+		frame->linesize[i] = linesize[i];
+	}
+	frame->extended_data = frame->data;
+	frame->pts = this->frame_count;
+	this->pts[this->frame_count % MAX_PTS] = h ? h->pts : 0;
+
+	res = avcodec_send_frame(this->context, frame);
+
+	for (i = 0; i < 4; i++)
+		frame->data[i] = NULL;
+
+	if (res == AVERROR(EAGAIN))
+		return 0;
+
+	if (res < 0)
+		spa_log_warn(this->log, NAME " %p: error encoding buffer %u: %d",
+				this, input->buffer_id, res);
+	else
+		this->frame_count++;
+
+	input->status = SPA_STATUS_OK;
+
+	return 0;
 }
 
-static int
-spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
-				      enum spa_direction direction,
-				      uint32_t port_id, const struct spa_command *command)
+static int receive_packet(struct impl *this)
 {
-	return -ENOTSUP;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_io_buffers *output = port->io;
+	AVPacket *pkt = this->packet;
+	struct buffer *b;
+	struct spa_data *d;
+	int res;
+
+	res = avcodec_receive_packet(this->context, pkt);
+	if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+		return SPA_STATUS_NEED_BUFFER;
+	if (res < 0) {
+		spa_log_error(this->log, NAME " %p: error receiving packet: %d", this, res);
+		return -EIO;
+	}
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_error(this->log, NAME " %p: out of buffers", this);
+		av_packet_unref(pkt);
+		return -EPIPE;
+	}
+	b = spa_list_first(&port->free, struct buffer, link);
+
+	d = &b->outbuf->datas[0];
+	if (pkt->size > d->maxsize) {
+		spa_log_error(this->log, NAME " %p: packet of %d bytes too large", this, pkt->size);
+		av_packet_unref(pkt);
+		return -ENOSPC;
+	}
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	memcpy(d->data, pkt->data, pkt->size);
+	d->chunk->offset = 0;
+	d->chunk->size = pkt->size;
+	d->chunk->stride = 0;
+
+	if (b->h) {
+		b->h->flags = (pkt->flags & AV_PKT_FLAG_KEY) ? 0 : SPA_META_HEADER_FLAG_DELTA_UNIT;
+		b->h->seq++;
+		b->h->pts = pkt->pts != AV_NOPTS_VALUE && this->frame_count - pkt->pts <= MAX_PTS ?
+			this->pts[pkt->pts % MAX_PTS] : 0;
+		b->h->dts_offset = 0;
+	}
+	av_packet_unref(pkt);
+
+	spa_log_trace(this->log, NAME " %p: push buffer %u", this, b->id);
+
+	output->buffer_id = b->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
 }
 
 static int spa_ffmpeg_enc_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *port;
+	struct spa_io_buffers *input, *output;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	port = GET_OUT_PORT(this, 0);
+
+	if ((output = port->io) == NULL)
+		return -EIO;
+	if ((input = GET_IN_PORT(this, 0)->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (this->context == NULL || !port->have_format) {
+		input->status = -EIO;
+		return -EIO;
+	}
+
+	/* recycle */
+	if (output->buffer_id < port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if ((res = send_input(this)) < 0)
+		return res;
+
+	if ((res = receive_packet(this)) != SPA_STATUS_NEED_BUFFER)
+		return res;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
 }
 
 static int spa_ffmpeg_enc_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
 	struct port *port;
-	struct spa_io_buffers *output;
+	struct spa_io_buffers *input, *output;
+	int res;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	if ((output = this->out_ports[0].io) == NULL)
-		return -EIO;
+	port = GET_OUT_PORT(this, 0);
 
-	port = &this->out_ports[0];
+	if ((output = port->io) == NULL)
+		return -EIO;
+	if ((input = GET_IN_PORT(this, 0)->io) == NULL)
+		return -EIO;
 
-	if (!port->have_format) {
+	if (!port->have_format || this->context == NULL) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	/* recycle */
+	if (output->buffer_id < port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if ((res = send_input(this)) < 0)
+		return res;
+
+	if ((res = receive_packet(this)) != SPA_STATUS_NEED_BUFFER)
+		return res;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
+}
+
+static int
+spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	if (port_id != 0)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
+}
+
+static int
+spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
+				      enum spa_direction direction,
+				      uint32_t port_id,
+				      const struct spa_command *command)
+{
+	return -ENOTSUP;
 }
 
 static const struct spa_node ffmpeg_enc_node = {
@@ -513,15 +1034,37 @@ spa_ffmpeg_enc_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
-int
-spa_ffmpeg_enc_init(struct spa_handle *handle,
+static int spa_ffmpeg_enc_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+
+	close_codec(this);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+
+	return 0;
+}
+
+static int
+spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
-		    const struct spa_support *support, uint32_t n_support)
+		    const struct spa_support *support,
+		    uint32_t n_support)
 {
 	struct impl *this;
 	uint32_t i;
 
+	if (factory == NULL || handle == NULL)
+		return -EINVAL;
+
 	handle->get_interface = spa_ffmpeg_enc_get_interface;
+	handle->clear = spa_ffmpeg_enc_clear;
 
 	this = (struct impl *) handle;
 
@@ -535,11 +1078,59 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 		spa_log_error(this->log, "a type-map is needed");
 		return -EINVAL;
 	}
+	init_type(&this->type, this->map);
+
+	if (strncmp(factory->name, FFMPEG_ENC_PREFIX, strlen(FFMPEG_ENC_PREFIX)) != 0 ||
+	    (this->codec = avcodec_find_encoder_by_name(factory->name +
+							 strlen(FFMPEG_ENC_PREFIX))) == NULL) {
+		spa_log_error(this->log, "unknown encoder %s", factory->name);
+		return -ENOENT;
+	}
+	this->subtype = ffmpeg_codec_to_subtype(&this->type.media_subtype_video, this->codec->id);
+
+	this->packet = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->packet == NULL || this->frame == NULL) {
+		av_packet_free(&this->packet);
+		av_frame_free(&this->frame);
+		return -ENOMEM;
+	}
 
 	this->node = ffmpeg_enc_node;
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_NO_REF;
+	spa_list_init(&this->in_ports[0].free);
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->out_ports[0].free);
 
 	return 0;
 }
+
+static const struct spa_interface_info ffmpeg_enc_interfaces[] = {
+	{SPA_TYPE__Node, },
+};
+
+static int
+spa_ffmpeg_enc_enum_interface_info(const struct spa_handle_factory *factory,
+				   const struct spa_interface_info **info,
+				   uint32_t *index)
+{
+	if (factory == NULL || info == NULL || index == NULL)
+		return -EINVAL;
+
+	if (*index < SPA_N_ELEMENTS(ffmpeg_enc_interfaces))
+		*info = &ffmpeg_enc_interfaces[(*index)++];
+	else
+		return 0;
+
+	return 1;
+}
+
+const struct spa_handle_factory spa_ffmpeg_enc_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NULL,
+	NULL,
+	sizeof(struct impl),
+	spa_ffmpeg_enc_init,
+	spa_ffmpeg_enc_enum_interface_info,
+};
@@ -0,0 +1,182 @@
+/* Spa FFMpeg support
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "ffmpeg-utils.h"
+
+#define TYPE_ID(t,offset)	(*SPA_MEMBER(t, offset, const uint32_t))
+
+static const struct {
+	enum AVCodecID codec_id;
+	size_t offset;
+} codec_map[] = {
+	{ AV_CODEC_ID_H264, offsetof(struct spa_type_media_subtype_video, h264) },
+	{ AV_CODEC_ID_MJPEG, offsetof(struct spa_type_media_subtype_video, mjpg) },
+	{ AV_CODEC_ID_DVVIDEO, offsetof(struct spa_type_media_subtype_video, dv) },
+	{ AV_CODEC_ID_H263, offsetof(struct spa_type_media_subtype_video, h263) },
+	{ AV_CODEC_ID_MPEG1VIDEO, offsetof(struct spa_type_media_subtype_video, mpeg1) },
+	{ AV_CODEC_ID_MPEG2VIDEO, offsetof(struct spa_type_media_subtype_video, mpeg2) },
+	{ AV_CODEC_ID_MPEG4, offsetof(struct spa_type_media_subtype_video, mpeg4) },
+	{ AV_CODEC_ID_VC1, offsetof(struct spa_type_media_subtype_video, vc1) },
+	{ AV_CODEC_ID_VP8, offsetof(struct spa_type_media_subtype_video, vp8) },
+	{ AV_CODEC_ID_VP9, offsetof(struct spa_type_media_subtype_video, vp9) },
+};
+
+/* the full range (J) variants map to the same spa format, they are only
+ * used when the codec does not support the other variant */
+static const struct {
+	enum AVPixelFormat pix_fmt;
+	size_t offset;
+} pix_fmt_map[] = {
+	{ AV_PIX_FMT_YUV420P, offsetof(struct spa_type_video_format, I420) },
+	{ AV_PIX_FMT_YUVJ420P, offsetof(struct spa_type_video_format, I420) },
+	{ AV_PIX_FMT_YUV422P, offsetof(struct spa_type_video_format, Y42B) },
+	{ AV_PIX_FMT_YUVJ422P, offsetof(struct spa_type_video_format, Y42B) },
+	{ AV_PIX_FMT_YUV444P, offsetof(struct spa_type_video_format, Y444) },
+	{ AV_PIX_FMT_YUVJ444P, offsetof(struct spa_type_video_format, Y444) },
+	{ AV_PIX_FMT_YUV411P, offsetof(struct spa_type_video_format, Y41B) },
+	{ AV_PIX_FMT_NV12, offsetof(struct spa_type_video_format, NV12) },
+	{ AV_PIX_FMT_NV21, offsetof(struct spa_type_video_format, NV21) },
+	{ AV_PIX_FMT_YUYV422, offsetof(struct spa_type_video_format, YUY2) },
+	{ AV_PIX_FMT_UYVY422, offsetof(struct spa_type_video_format, UYVY) },
+	{ AV_PIX_FMT_YVYU422, offsetof(struct spa_type_video_format, YVYU) },
+	{ AV_PIX_FMT_GRAY8, offsetof(struct spa_type_video_format, GRAY8) },
+	{ AV_PIX_FMT_RGB24, offsetof(struct spa_type_video_format, RGB) },
+	{ AV_PIX_FMT_BGR24, offsetof(struct spa_type_video_format, BGR) },
+	{ AV_PIX_FMT_RGBA, offsetof(struct spa_type_video_format, RGBA) },
+	{ AV_PIX_FMT_BGRA, offsetof(struct spa_type_video_format, BGRA) },
+	{ AV_PIX_FMT_ARGB, offsetof(struct spa_type_video_format, ARGB) },
+	{ AV_PIX_FMT_ABGR, offsetof(struct spa_type_video_format, ABGR) },
+	{ AV_PIX_FMT_RGB0, offsetof(struct spa_type_video_format, RGBx) },
+	{ AV_PIX_FMT_BGR0, offsetof(struct spa_type_video_format, BGRx) },
+	{ AV_PIX_FMT_0RGB, offsetof(struct spa_type_video_format, xRGB) },
+	{ AV_PIX_FMT_0BGR, offsetof(struct spa_type_video_format, xBGR) },
+};
+
+bool ffmpeg_codec_is_supported(enum AVCodecID codec_id)
+{
+	int i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(codec_map); i++) {
+		if (codec_map[i].codec_id == codec_id)
+			return true;
+	}
+	return false;
+}
+
+uint32_t ffmpeg_codec_to_subtype(const struct spa_type_media_subtype_video *t,
+				 enum AVCodecID codec_id)
+{
+	int i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(codec_map); i++) {
+		if (codec_map[i].codec_id == codec_id)
+			return TYPE_ID(t, codec_map[i].offset);
+	}
+	return SPA_ID_INVALID;
+}
+
+uint32_t ffmpeg_pix_fmt_to_format(const struct spa_type_video_format *t,
+				  enum AVPixelFormat pix_fmt)
+{
+	int i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(pix_fmt_map); i++) {
+		if (pix_fmt_map[i].pix_fmt == pix_fmt)
+			return TYPE_ID(t, pix_fmt_map[i].offset);
+	}
+	return SPA_ID_INVALID;
+}
+
+enum AVPixelFormat ffmpeg_format_to_pix_fmt(const struct spa_type_video_format *t,
+					    const enum AVPixelFormat *pix_fmts,
+					    uint32_t format)
+{
+	int i;
+
+	if (pix_fmts == NULL) {
+		for (i = 0; i < SPA_N_ELEMENTS(pix_fmt_map); i++) {
+			if (TYPE_ID(t, pix_fmt_map[i].offset) == format)
+				return pix_fmt_map[i].pix_fmt;
+		}
+		return AV_PIX_FMT_NONE;
+	}
+	for (i = 0; pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+		if (ffmpeg_pix_fmt_to_format(t, pix_fmts[i]) == format)
+			return pix_fmts[i];
+	}
+	return AV_PIX_FMT_NONE;
+}
+
+int ffmpeg_video_stride(enum AVPixelFormat pix_fmt, int width, int align)
+{
+	const AVPixFmtDescriptor *desc;
+	int linesize[4], res;
+
+	if ((desc = av_pix_fmt_desc_get(pix_fmt)) == NULL)
+		return -EINVAL;
+	if ((res = av_image_fill_linesizes(linesize, pix_fmt, width)) < 0)
+		return res;
+
+	/* keep the stride of the subsampled chroma planes aligned as well */
+	if (av_pix_fmt_count_planes(pix_fmt) > 2)
+		align <<= desc->log2_chroma_w;
+
+	return SPA_ROUND_UP_N(linesize[0], align);
+}
+
+int ffmpeg_video_layout(enum AVPixelFormat pix_fmt, int width, int height,
+			int stride, int linesize[4], int offset[4])
+{
+	const AVPixFmtDescriptor *desc;
+	int i, n_planes, size = 0;
+
+	if ((desc = av_pix_fmt_desc_get(pix_fmt)) == NULL)
+		return -EINVAL;
+	if ((n_planes = av_pix_fmt_count_planes(pix_fmt)) <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < 4; i++) {
+		linesize[i] = 0;
+		offset[i] = 0;
+	}
+	for (i = 0; i < n_planes; i++) {
+		int h;
+
+		if (i == 0 || i == 3) {
+			linesize[i] = stride;
+			h = SPA_ROUND_UP_N(height, 1 << desc->log2_chroma_h);
+		} else {
+			/* semi planar formats interleave the chroma in one plane */
+			if (n_planes == 2)
+				linesize[i] = stride;
+			else
+				linesize[i] = SPA_ROUND_UP_N(stride >> desc->log2_chroma_w, 4);
+			h = AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+		}
+		offset[i] = size;
+		size += linesize[i] * h;
+	}
+	return size;
+}
@@ -0,0 +1,76 @@
+/* Spa FFMpeg support
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_FFMPEG_UTILS_H__
+#define __SPA_FFMPEG_UTILS_H__
+
+#include <libavcodec/avcodec.h>
+
+#include <spa/support/plugin.h>
+#include <spa/param/video/format-utils.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFMPEG_DEC_PREFIX	"ffdec_"
+#define FFMPEG_ENC_PREFIX	"ffenc_"
+
+/** alignment of the planes and the stride of the raw video we produce */
+#define FFMPEG_ALIGN		64
+
+/** templates for the factories, ffmpeg.c fills in the name of the codec */
+extern const struct spa_handle_factory spa_ffmpeg_dec_factory;
+extern const struct spa_handle_factory spa_ffmpeg_enc_factory;
+
+/** check if there is a spa media type for the codec */
+bool ffmpeg_codec_is_supported(enum AVCodecID codec_id);
+
+/** the media subtype for the given codec or SPA_ID_INVALID when the codec
+ * has no spa media type */
+uint32_t ffmpeg_codec_to_subtype(const struct spa_type_media_subtype_video *t,
+				 enum AVCodecID codec_id);
+
+/** the spa video format for the given pixel format or SPA_ID_INVALID */
+uint32_t ffmpeg_pix_fmt_to_format(const struct spa_type_video_format *t,
+				  enum AVPixelFormat pix_fmt);
+
+/** find a pixel format for @format in @pix_fmts. When @pix_fmts is NULL,
+ * any known pixel format is returned. */
+enum AVPixelFormat ffmpeg_format_to_pix_fmt(const struct spa_type_video_format *t,
+					    const enum AVPixelFormat *pix_fmts,
+					    uint32_t format);
+
+/** the smallest stride of the first plane, aligned to @align */
+int ffmpeg_video_stride(enum AVPixelFormat pix_fmt, int width, int align);
+
+/** Compute the layout of a raw video frame in a single buffer.
+ *
+ * The planes are stored one after the other, the first plane uses @stride
+ * and the stride of the chroma planes is derived from it.
+ *
+ * \return the size of the frame or < 0 on error */
+int ffmpeg_video_layout(enum AVPixelFormat pix_fmt, int width, int height,
+			int stride, int linesize[4], int offset[4]);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_FFMPEG_UTILS_H__ */
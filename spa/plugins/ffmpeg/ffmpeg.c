@@ -19,96 +19,90 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <spa/support/plugin.h>
 #include <spa/node/node.h>
 
 #include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
-int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
-
-static int
-ffmpeg_dec_init(const struct spa_handle_factory *factory,
-		struct spa_handle *handle,
-		const struct spa_dict *info,
-		const struct spa_support *support,
-		uint32_t n_support)
-{
-	if (factory == NULL || handle == NULL)
-		return -EINVAL;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
-}
-
-static int
-ffmpeg_enc_init(const struct spa_handle_factory *factory,
-		struct spa_handle *handle,
-		const struct spa_dict *info,
-		const struct spa_support *support,
-		uint32_t n_support)
-{
-	if (factory == NULL || handle == NULL)
-		return -EINVAL;
+#include "ffmpeg-utils.h"
 
-	return spa_ffmpeg_enc_init(handle, info, support, n_support);
-}
+#define MAX_FACTORIES	256
 
-static const struct spa_interface_info ffmpeg_interfaces[] = {
-	{SPA_TYPE__Node, },
+struct factory {
+	struct spa_handle_factory factory;
+	const AVCodec *codec;
+	char name[128];
 };
 
-static int
-ffmpeg_enum_interface_info(const struct spa_handle_factory *factory,
-			   const struct spa_interface_info **info,
-			   uint32_t *index)
-{
-	if (factory == NULL || info == NULL || index == NULL)
-		return -EINVAL;
+/* factories are handed out by pointer so they are kept around for the
+ * lifetime of the plugin */
+static struct factory *factories[MAX_FACTORIES];
 
-	if (*index < SPA_N_ELEMENTS(ffmpeg_interfaces))
-		*info = &ffmpeg_interfaces[(*index)++];
-	else
-		return 0;
+static const AVCodec *next_codec(void **state)
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 10, 100)
+	return av_codec_iterate(state);
+#else
+	const AVCodec *c = av_codec_next(*state);
+	*state = (void *) c;
+	return c;
+#endif
+}
 
-	return 1;
+static const AVCodec *find_codec(uint32_t index)
+{
+	const AVCodec *c;
+	void *state = NULL;
+	uint32_t i = 0;
+
+	while ((c = next_codec(&state))) {
+		/* we only have nodes for video */
+		if (c->type != AVMEDIA_TYPE_VIDEO ||
+		    !ffmpeg_codec_is_supported(c->id))
+			continue;
+		if (i++ == index)
+			return c;
+	}
+	return NULL;
 }
 
 int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
 {
-	static const AVCodec *c = NULL;
-	static int ci = 0;
-	static struct spa_handle_factory f;
-	static char name[128];
+	struct factory *f;
+	const AVCodec *c;
 
-	av_register_all();
+	if (factory == NULL || index == NULL)
+		return -EINVAL;
 
-	if (*index == 0) {
-		c = av_codec_next(NULL);
-		ci = 0;
-	}
-	while (*index > ci && c) {
-		c = av_codec_next(c);
-		ci++;
-	}
-	if (c == NULL)
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+	avcodec_register_all();
+#endif
+
+	if (*index >= MAX_FACTORIES)
 		return 0;
 
-	if (av_codec_is_encoder(c)) {
-		snprintf(name, 128, "ffenc_%s", c->name);
-		f.init = ffmpeg_enc_init;
-	} else {
-		snprintf(name, 128, "ffdec_%s", c->name);
-		f.init = ffmpeg_dec_init;
+	if ((f = factories[*index]) == NULL) {
+		if ((c = find_codec(*index)) == NULL)
+			return 0;
+
+		if ((f = calloc(1, sizeof(struct factory))) == NULL)
+			return -ENOMEM;
+
+		f->codec = c;
+		if (av_codec_is_encoder(c)) {
+			memcpy(&f->factory, &spa_ffmpeg_enc_factory, sizeof(struct spa_handle_factory));
+			snprintf(f->name, sizeof(f->name), FFMPEG_ENC_PREFIX "%s", c->name);
+		} else {
+			memcpy(&f->factory, &spa_ffmpeg_dec_factory, sizeof(struct spa_handle_factory));
+			snprintf(f->name, sizeof(f->name), FFMPEG_DEC_PREFIX "%s", c->name);
+		}
+		f->factory.name = f->name;
+		factories[*index] = f;
 	}
-	f.name = name;
-	f.info = NULL;
-	f.enum_interface_info = ffmpeg_enum_interface_info;
-
-	*factory = &f;
+	*factory = &f->factory;
 	(*index)++;
 
 	return 1;
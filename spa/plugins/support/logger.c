@@ -52,7 +52,7 @@ struct impl {
 	struct type type;
 	struct spa_type_map *map;
 
-	struct spa_ringbuffer trace_rb;
+	struct spa_ringbuffer_mpsc trace_rb;
 	uint8_t trace_data[TRACE_BUFFER];
 
 	bool have_source;
@@ -85,10 +85,17 @@ impl_log_logv(struct spa_log *log,
 		uint32_t index;
 		uint64_t count = 1;
 
-		spa_ringbuffer_get_write_index(&impl->trace_rb, &index);
-		spa_ringbuffer_write_data(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
+		size = SPA_MIN(size, (int) sizeof(location) - 1);
+
+		/* trace messages come from any thread, drop them when the
+		 * main loop can't keep up */
+		if (spa_ringbuffer_mpsc_reserve(&impl->trace_rb, TRACE_BUFFER, size, &index) < 0)
+			return;
+
+		spa_ringbuffer_write_data(NULL, impl->trace_data, TRACE_BUFFER,
 					  index & (TRACE_BUFFER - 1), location, size);
-		spa_ringbuffer_write_update(&impl->trace_rb, index + size);
+		spa_ringbuffer_mpsc_commit(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
+					   index, size);
 
 		if (write(impl->source.fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
 			fprintf(stderr, "error signaling eventfd: %s\n", strerror(errno));
@@ -121,13 +128,10 @@ static void on_trace_event(struct spa_source *source)
 	if (read(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
 		fprintf(stderr, "failed to read event fd: %s", strerror(errno));
 
-	while ((avail = spa_ringbuffer_get_read_index(&impl->trace_rb, &index)) > 0) {
+	while ((avail = spa_ringbuffer_mpsc_get_read_index(&impl->trace_rb, impl->trace_data,
+							  TRACE_BUFFER, &index)) >= 0) {
 		uint32_t offset, first;
 
-		if (avail > TRACE_BUFFER) {
-			index += avail - TRACE_BUFFER;
-			avail = TRACE_BUFFER;
-		}
 		offset = index & (TRACE_BUFFER - 1);
 		first = SPA_MIN(avail, TRACE_BUFFER - offset);
 
@@ -135,7 +139,8 @@ static void on_trace_event(struct spa_source *source)
 		if (SPA_UNLIKELY(avail > first)) {
 			fwrite(impl->trace_data, avail - first, 1, stderr);
 		}
-		spa_ringbuffer_read_update(&impl->trace_rb, index + avail);
+		spa_ringbuffer_mpsc_read_update(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
+						index, avail);
         }
 }
 
@@ -223,7 +228,8 @@ impl_init(const struct spa_handle_factory *factory,
 		this->have_source = true;
 	}
 
-	spa_ringbuffer_init(&this->trace_rb);
+	spa_ringbuffer_mpsc_init(&this->trace_rb);
+	memset(this->trace_data, 0, sizeof(this->trace_data));
 
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
@@ -27,31 +27,91 @@
 #include <sys/timerfd.h>
 #include <sys/eventfd.h>
 #include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
 #include <spa/support/type-map.h>
 #include <spa/support/plugin.h>
 #include <spa/utils/list.h>
-#include <spa/utils/ringbuffer.h>
+
+#ifdef ENABLE_IO_URING
+#include "uring.h"
+#endif
 
 #define NAME "loop"
 
 #define DATAS_SIZE (4096 * 8)
+#define ITEM_ALIGN 8
+#define MAX_INVOKE_ITEMS 64
+
+#define MAX_EVENTS	1024	/* events sharing the loop eventfd, more get their own */
+#define EVENT_WORDS	(MAX_EVENTS / 64)
 
 /** \cond */
 
+#define ITEM_EMPTY	0	/* not yet committed by the producer */
+#define ITEM_READY	1	/* ready to be invoked */
+#define ITEM_SKIP	2	/* padding up to the end of the queue or a cancelled item */
+
 struct invoke_item {
-	size_t item_size;
+	uint32_t item_size;
+	uint32_t state;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	void *data;
 	size_t size;
-	bool block;
 	void *user_data;
-	int res;
+	int *res;
+	uint32_t *pending;
+};
+
+/* The reserve word of a queue holds the producer write index in the
+ * lower 32 bits, a closed flag and a generation counter. Producers
+ * reserve space with a compare-and-swap on it. */
+#define RESERVE_INDEX(r)	((uint32_t)(r))
+#define RESERVE_CLOSED		(1ULL << 32)
+#define RESERVE_GEN		(1ULL << 33)
+
+/* a producer that finds the queue closed spins this many times for the
+ * producer that closed it to switch queues before it sleeps */
+#define SWITCH_SPIN		64
+#define SWITCH_WAIT_NSEC	1000000
+
+struct invoke_queue {
+	/* written by the producers */
+	uint64_t reserve;
+	uint32_t readindex_cache;	/* last readindex seen by a producer */
+	uint32_t size;
+	uint8_t *data;
+	struct invoke_queue *next;	/* queues form a circular chain */
+	uint8_t _padding[SPA_CACHE_LINE_SIZE];
+	/* written by the consumer, on its own cache line */
+	uint32_t readindex;
+};
+
+#ifdef ENABLE_IO_URING
+#define URING_ENTRIES	256
+#define URING_RETRY_MSEC	10	/* max wait while a request could not be posted */
+
+/* the request posted for a source. It stays allocated until the kernel
+ * completed the request, also when the source was removed before */
+struct uring_slot {
+	struct spa_list link;
+	struct spa_source *source;	/* NULL when the source was removed */
+	bool armed;			/* the request is still active */
+	bool collected;			/* queued for dispatch */
+	bool read;			/* read the counter instead of polling */
+	bool retry;			/* posting the request failed, retried on iterate */
+	bool has_value;
+	uint64_t value;			/* written by the kernel */
+	uint64_t result;		/* value of the last completed read */
 };
+#endif
 
 struct type {
 	uint32_t loop;
@@ -60,6 +120,8 @@ struct type {
 };
 
 static void loop_signal_event(struct spa_source *source);
+static int loop_invoke(struct spa_loop *loop, spa_invoke_func_t func, uint32_t seq,
+		       const void *data, size_t size, bool block, void *user_data);
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
@@ -85,10 +147,41 @@ struct impl {
 	int epoll_fd;
 	pthread_t thread;
 
+#ifdef ENABLE_IO_URING
+	bool use_uring;
+	struct uring ring;
+	struct spa_list slot_list;
+	struct uring_slot *timer_slot;
+	struct uring_slot *event_slot;
+	bool retry_pending;
+#endif
+
 	struct spa_source *wakeup;
-	int ack_fd;
 
-	struct spa_ringbuffer buffer;
+	/* all timers are kept in a heap, ordered on expiration, and driven
+	 * from one timerfd armed for the first one */
+	struct spa_source timer_source;
+	struct source_impl **timers;
+	uint32_t n_timers;
+	uint32_t max_timers;
+	uint64_t timer_armed;
+	bool dispatching_timers;
+
+	/* events set a bit in the pending mask and only write to the shared
+	 * eventfd when nothing was pending yet */
+	struct spa_source event_source;
+	uint32_t event_wakeup;
+	uint64_t event_pending[EVENT_WORDS];
+	uint64_t event_used[EVENT_WORDS];
+	struct source_impl *events[MAX_EVENTS];
+
+	struct spa_list idle_list;
+	uint32_t n_idle_enabled;
+
+	struct invoke_queue *write_queue;
+	struct invoke_queue *read_queue;
+	uint32_t switch_seq;		/* incremented after each queue switch */
+	struct invoke_queue queue;
 	uint8_t buffer_data[DATAS_SIZE];
 };
 
@@ -108,6 +201,15 @@ struct source_impl {
 	} func;
 	int signal_number;
 	bool enabled;
+
+	struct spa_list idle_link;
+
+	int slot;		/* bit in the pending events, -1 when using its own fd */
+	uint64_t count;
+
+	uint64_t expire;
+	uint64_t interval;
+	uint32_t heap_index;	/* index in the timer heap + 1, 0 when disarmed */
 };
 /** \endcond */
 
@@ -143,6 +245,165 @@ static inline enum spa_io spa_epoll_to_io(uint32_t events)
 	return mask;
 }
 
+#ifdef ENABLE_IO_URING
+static int uring_arm(struct impl *impl, struct uring_slot *slot)
+{
+	struct spa_source *source = slot->source;
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = uring_get_sqe(&impl->ring)) == NULL)
+		return -EBUSY;
+
+	if (slot->read) {
+		/* the wakeup and the counter arrive in one completion */
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = source->fd;
+		sqe->addr = (uint64_t) (uintptr_t) &slot->value;
+		sqe->len = sizeof(uint64_t);
+		sqe->off = -1;
+	} else {
+		/* a one-shot poll, armed again after the callback so that it
+		 * completes again while data is left, like epoll */
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = source->fd;
+		sqe->poll32_events = spa_io_to_epoll(source->mask);
+	}
+	sqe->user_data = (uint64_t) (uintptr_t) slot;
+	slot->armed = true;
+	return 0;
+}
+
+static int uring_add_source(struct impl *impl, struct spa_source *source)
+{
+	struct uring_slot *slot;
+	int res;
+
+	if ((slot = calloc(1, sizeof(struct uring_slot))) == NULL)
+		return -ENOMEM;
+
+	slot->source = source;
+	slot->read = source == &impl->timer_source || source == &impl->event_source;
+	spa_list_append(&impl->slot_list, &slot->link);
+
+	if ((res = uring_arm(impl, slot)) < 0) {
+		spa_list_remove(&slot->link);
+		free(slot);
+		return res;
+	}
+	if (source == &impl->timer_source)
+		impl->timer_slot = slot;
+	else if (source == &impl->event_source)
+		impl->event_slot = slot;
+	return 0;
+}
+
+/* the slots of removed sources stay in the list until their request
+ * completed, only look at the live ones */
+static struct uring_slot *uring_find_slot(struct impl *impl, struct spa_source *source)
+{
+	struct uring_slot *slot;
+
+	spa_list_for_each(slot, &impl->slot_list, link)
+		if (slot->source == source)
+			return slot;
+	return NULL;
+}
+
+/* post the request of @slot again, when that fails it is retried on the
+ * next iteration so that the source is not silently lost */
+static void uring_rearm(struct impl *impl, struct uring_slot *slot)
+{
+	int res;
+
+	if ((res = uring_arm(impl, slot)) < 0) {
+		if (!slot->retry)
+			spa_log_error(impl->log, NAME " %p: can't arm source %p: %s",
+					impl, slot->source, strerror(-res));
+		slot->retry = true;
+		impl->retry_pending = true;
+		return;
+	}
+	slot->retry = false;
+}
+
+static void uring_retry(struct impl *impl)
+{
+	struct uring_slot *slot;
+
+	impl->retry_pending = false;
+	spa_list_for_each(slot, &impl->slot_list, link) {
+		if (slot->retry && slot->source != NULL &&
+		    !slot->armed && !slot->collected)
+			uring_rearm(impl, slot);
+	}
+}
+
+static void uring_remove_source(struct impl *impl, struct spa_source *source)
+{
+	struct uring_slot *slot = uring_find_slot(impl, source);
+	struct io_uring_sqe *sqe;
+
+	if (slot == NULL)
+		return;
+
+	if (slot == impl->timer_slot)
+		impl->timer_slot = NULL;
+	else if (slot == impl->event_slot)
+		impl->event_slot = NULL;
+	slot->source = NULL;
+
+	/* the slot is freed with the last completion of its request */
+	if (!slot->armed) {
+		if (!slot->collected) {
+			spa_list_remove(&slot->link);
+			free(slot);
+		}
+		return;
+	}
+	if ((sqe = uring_get_sqe(&impl->ring)) == NULL)
+		return;
+
+	sqe->opcode = slot->read ? IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t) (uintptr_t) slot;
+	sqe->user_data = 0;
+}
+#endif
+
+#ifdef ENABLE_IO_URING
+/* unlike epoll_ctl(), the ring may only be used from the thread that runs
+ * the loop, other threads go through an invoke */
+static inline bool uring_other_thread(struct impl *impl)
+{
+	return impl->thread != 0 && !pthread_equal(impl->thread, pthread_self());
+}
+
+static int do_uring_add(struct spa_loop *loop, bool async, uint32_t seq,
+			const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+	return uring_add_source(impl, user_data);
+}
+
+static int do_uring_update(struct spa_loop *loop, bool async, uint32_t seq,
+			   const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+
+	/* post a new poll with the new mask */
+	uring_remove_source(impl, user_data);
+	return uring_add_source(impl, user_data);
+}
+
+static int do_uring_remove(struct spa_loop *loop, bool async, uint32_t seq,
+			   const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+	uring_remove_source(impl, user_data);
+	return 0;
+}
+#endif
+
 static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
 {
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
@@ -152,6 +413,14 @@ static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
 	if (source->fd != -1) {
 		struct epoll_event ep;
 
+#ifdef ENABLE_IO_URING
+		if (impl->use_uring) {
+			if (uring_other_thread(impl))
+				return loop_invoke(loop, do_uring_add, SPA_ID_INVALID,
+						   NULL, 0, true, source);
+			return uring_add_source(impl, source);
+		}
+#endif
 		spa_zero(ep);
 		ep.events = spa_io_to_epoll(source->mask);
 		ep.data.ptr = source;
@@ -170,6 +439,13 @@ static int loop_update_source(struct spa_source *source)
 	if (source->fd != -1) {
 		struct epoll_event ep;
 
+#ifdef ENABLE_IO_URING
+		if (impl->use_uring)
+			return uring_other_thread(impl) ?
+				loop_invoke(loop, do_uring_update, SPA_ID_INVALID,
+					    NULL, 0, true, source) :
+				do_uring_update(loop, false, SPA_ID_INVALID, NULL, 0, source);
+#endif
 		spa_zero(ep);
 		ep.events = spa_io_to_epoll(source->mask);
 		ep.data.ptr = source;
@@ -185,108 +461,298 @@ static void loop_remove_source(struct spa_source *source)
 	struct spa_loop *loop = source->loop;
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
 
+#ifdef ENABLE_IO_URING
+	if (impl->use_uring) {
+		if (uring_other_thread(impl))
+			loop_invoke(loop, do_uring_remove, SPA_ID_INVALID,
+				    NULL, 0, true, source);
+		else
+			uring_remove_source(impl, source);
+	} else
+#endif
 	if (source->fd != -1)
 		epoll_ctl(impl->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
 
 	source->loop = NULL;
 }
 
-static int
-loop_invoke(struct spa_loop *loop,
-	    spa_invoke_func_t func,
-	    uint32_t seq,
-	    const void *data,
-	    size_t size,
-	    bool block,
-	    void *user_data)
+static int futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *timeout)
 {
-	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
-	bool in_thread = pthread_equal(impl->thread, pthread_self());
-	struct invoke_item *item;
-	int res;
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
 
-	if (in_thread) {
-		res = func(loop, false, seq, data, size, user_data);
-	} else {
-		int32_t filled, avail;
-		uint32_t idx, offset, l0;
+static int futex_wake(uint32_t *uaddr)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
 
-		filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-		if (filled < 0 || filled > DATAS_SIZE) {
-			spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
-			return -EPIPE;
+static void switch_done(struct impl *impl)
+{
+	__atomic_add_fetch(&impl->switch_seq, 1, __ATOMIC_RELEASE);
+	futex_wake(&impl->switch_seq);
+}
+
+/* called by a producer that found @q closed. Waits a bounded time for the
+ * producer that closed it to move the write side to another queue. */
+static void switch_wait(struct impl *impl, struct invoke_queue *q)
+{
+	struct timespec timeout = { 0, SWITCH_WAIT_NSEC };
+	uint32_t i, seq;
+
+	seq = __atomic_load_n(&impl->switch_seq, __ATOMIC_ACQUIRE);
+	for (i = 0; i < SWITCH_SPIN; i++) {
+		if (__atomic_load_n(&impl->write_queue, __ATOMIC_ACQUIRE) != q ||
+		    !(__atomic_load_n(&q->reserve, __ATOMIC_ACQUIRE) & RESERVE_CLOSED))
+			return;
+		sched_yield();
+	}
+	/* returns right away when a switch completed after we read seq */
+	futex_wait(&impl->switch_seq, seq, &timeout);
+}
+
+/* called by the producer that closed @cur because it was full. Moves the
+ * write side to the next free queue in the chain or chains a new one. */
+static struct invoke_queue *switch_queue(struct impl *impl, struct invoke_queue *cur, uint32_t need)
+{
+	struct invoke_queue *next, *q;
+	uint32_t size;
+
+	next = cur->next;
+	if (next != cur &&
+	    next != __atomic_load_n(&impl->read_queue, __ATOMIC_ACQUIRE) &&
+	    next->size >= need * 2) {
+		/* next is drained and recycled, open it again */
+		__atomic_store_n(&next->reserve,
+				__atomic_load_n(&next->reserve, __ATOMIC_ACQUIRE) & ~RESERVE_CLOSED,
+				__ATOMIC_RELEASE);
+		__atomic_store_n(&impl->write_queue, next, __ATOMIC_RELEASE);
+		switch_done(impl);
+		return next;
+	}
+
+	for (size = DATAS_SIZE; size < need * 2; size <<= 1);
+
+	q = calloc(1, sizeof(struct invoke_queue) + size);
+	if (q == NULL) {
+		__atomic_store_n(&cur->reserve, cur->reserve & ~RESERVE_CLOSED, __ATOMIC_RELEASE);
+		switch_done(impl);
+		return NULL;
+	}
+	q->size = size;
+	q->data = SPA_MEMBER(q, sizeof(struct invoke_queue), uint8_t);
+	q->next = next;
+
+	spa_log_info(impl->log, NAME " %p: invoke queue full, chain queue %p of %u bytes",
+			impl, q, size);
+
+	__atomic_store_n(&cur->next, q, __ATOMIC_RELEASE);
+	__atomic_store_n(&impl->write_queue, q, __ATOMIC_RELEASE);
+	switch_done(impl);
+
+	return q;
+}
+
+/* reserve space for an item with @size bytes of data. Safe to call from
+ * multiple threads at the same time. */
+static struct invoke_item *alloc_item(struct impl *impl, size_t size)
+{
+	struct invoke_queue *q;
+	struct invoke_item *item;
+	uint32_t need, idx, filled, offset, l0, total, readindex;
+	uint64_t r;
+
+	need = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, ITEM_ALIGN);
+
+	q = __atomic_load_n(&impl->write_queue, __ATOMIC_ACQUIRE);
+	while (true) {
+		r = __atomic_load_n(&q->reserve, __ATOMIC_ACQUIRE);
+		if (r & RESERVE_CLOSED) {
+			switch_wait(impl, q);
+			q = __atomic_load_n(&impl->write_queue, __ATOMIC_ACQUIRE);
+			continue;
 		}
-		avail = DATAS_SIZE - filled;
-		if (avail < sizeof(struct invoke_item)) {
-			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
-			return -EPIPE;
+		idx = RESERVE_INDEX(r);
+		offset = idx & (q->size - 1);
+		l0 = q->size - offset;
+		/* items are contiguous, skip to the start when it does not fit */
+		total = l0 < need ? l0 + need : need;
+
+		/* only touch the consumer cache line when the queue looks full,
+		 * a stale cache only makes it look fuller */
+		readindex = __atomic_load_n(&q->readindex_cache, __ATOMIC_ACQUIRE);
+		filled = idx - readindex;
+		if (filled + total > q->size) {
+			readindex = __atomic_load_n(&q->readindex, __ATOMIC_ACQUIRE);
+			__atomic_store_n(&q->readindex_cache, readindex, __ATOMIC_RELEASE);
+			filled = idx - readindex;
 		}
-		offset = idx & (DATAS_SIZE - 1);
-
-		l0 = DATAS_SIZE - offset;
-
-		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
-		item->func = func;
-		item->seq = seq;
-		item->size = size;
-		item->block = block;
-		item->user_data = user_data;
-
-		if (l0 > sizeof(struct invoke_item) + size) {
-			item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-			item->item_size = sizeof(struct invoke_item) + size;
-			if (l0 < sizeof(struct invoke_item) + item->item_size)
-				item->item_size = l0;
-		} else {
-			item->data = impl->buffer_data;
-			item->item_size = l0 + size;
+		if (filled + total > q->size) {
+			if (!__atomic_compare_exchange_n(&q->reserve, &r, r | RESERVE_CLOSED,
+						false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				continue;
+			if ((q = switch_queue(impl, q, need)) == NULL)
+				return NULL;
+			continue;
 		}
-		memcpy(item->data, data, size);
+		if (__atomic_compare_exchange_n(&q->reserve, &r,
+					(r & ~(uint64_t)UINT32_MAX) | (uint32_t)(idx + total),
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			break;
+	}
+	if (total != need) {
+		item = SPA_MEMBER(q->data, offset, struct invoke_item);
+		item->item_size = l0;
+		__atomic_store_n(&item->state, ITEM_SKIP, __ATOMIC_RELEASE);
+		offset = 0;
+	}
+	item = SPA_MEMBER(q->data, offset, struct invoke_item);
+	item->item_size = need;
+	item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
 
-		spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+	return item;
+}
 
-		spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
+static int
+loop_invoke_many(struct spa_loop *loop,
+		 struct spa_loop_invoke_item *items,
+		 uint32_t n_items,
+		 bool block)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+	struct invoke_item *item[MAX_INVOKE_ITEMS];
+	uint32_t i, pending = 0, p;
 
-		if (block) {
-			uint64_t count = 1;
+	if (pthread_equal(impl->thread, pthread_self())) {
+		for (i = 0; i < n_items; i++)
+			items[i].res = items[i].func(loop, false, items[i].seq, items[i].data,
+						     items[i].size, items[i].user_data);
+		return 0;
+	}
 
-			spa_loop_control_hook_before(&impl->hooks_list);
+	if (n_items == 0)
+		return 0;
+	if (n_items > MAX_INVOKE_ITEMS)
+		return -EINVAL;
 
-			if (read(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
-						impl, strerror(errno));
+	/* reserve space for all items first so that either all or none
+	 * of them are invoked */
+	for (i = 0; i < n_items; i++) {
+		if ((item[i] = alloc_item(impl, items[i].size)) == NULL)
+			goto no_mem;
+	}
 
-			spa_loop_control_hook_after(&impl->hooks_list);
+	for (i = 0; i < n_items; i++) {
+		item[i]->func = items[i].func;
+		item[i]->seq = items[i].seq;
+		item[i]->size = items[i].size;
+		item[i]->user_data = items[i].user_data;
+		if (items[i].size > 0)
+			memcpy(item[i]->data, items[i].data, items[i].size);
 
-			res = item->res;
-		}
-		else {
-			if (seq != SPA_ID_INVALID)
-				res = SPA_RESULT_RETURN_ASYNC(seq);
+		if (block) {
+			item[i]->res = &items[i].res;
+			item[i]->pending = &pending;
+			__atomic_add_fetch(&pending, 1, __ATOMIC_RELAXED);
+		} else {
+			item[i]->res = NULL;
+			item[i]->pending = NULL;
+			if (items[i].seq != SPA_ID_INVALID)
+				items[i].res = SPA_RESULT_RETURN_ASYNC(items[i].seq);
 			else
-				res = 0;
+				items[i].res = 0;
 		}
+		__atomic_store_n(&item[i]->state, ITEM_READY, __ATOMIC_RELEASE);
 	}
-	return res;
+
+	spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
+
+	if (block) {
+		spa_loop_control_hook_before(&impl->hooks_list);
+
+		while ((p = __atomic_load_n(&pending, __ATOMIC_ACQUIRE)) != 0)
+			futex_wait(&pending, p, NULL);
+
+		spa_loop_control_hook_after(&impl->hooks_list);
+	}
+	return 0;
+
+      no_mem:
+	spa_log_warn(impl->log, NAME " %p: can't allocate invoke item", impl);
+	/* the loop skips the space that was already reserved */
+	while (i-- > 0)
+		__atomic_store_n(&item[i]->state, ITEM_SKIP, __ATOMIC_RELEASE);
+	spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
+	return -ENOMEM;
+}
+
+static int
+loop_invoke(struct spa_loop *loop,
+	    spa_invoke_func_t func,
+	    uint32_t seq,
+	    const void *data,
+	    size_t size,
+	    bool block,
+	    void *user_data)
+{
+	struct spa_loop_invoke_item item = { func, seq, data, size, user_data, 0 };
+	int res;
+
+	if ((res = loop_invoke_many(loop, &item, 1, block)) < 0)
+		return res;
+
+	return item.res;
 }
 
 static void wakeup_func(void *data, uint64_t count)
 {
 	struct impl *impl = data;
-	uint32_t index;
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
-		struct invoke_item *item =
-		    SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
-		item->res = item->func(&impl->loop, true, item->seq, item->data, item->size,
-			   item->user_data);
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
-
-		if (item->block) {
-			uint64_t count = 1;
-			if (write(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
-						impl, strerror(errno));
+	struct invoke_queue *q = impl->read_queue;
+	struct invoke_item *item;
+	uint32_t index, item_size;
+	uint64_t r;
+	int res;
+
+	while (true) {
+		index = q->readindex;
+		r = __atomic_load_n(&q->reserve, __ATOMIC_ACQUIRE);
+
+		if (index == RESERVE_INDEX(r)) {
+			/* drained, move to the next queue when the producers did */
+			if (!(r & RESERVE_CLOSED) ||
+			    __atomic_load_n(&impl->write_queue, __ATOMIC_ACQUIRE) == q)
+				break;
+
+			__atomic_store_n(&q->reserve, r + RESERVE_GEN, __ATOMIC_RELEASE);
+			q = __atomic_load_n(&q->next, __ATOMIC_ACQUIRE);
+			__atomic_store_n(&impl->read_queue, q, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		item = SPA_MEMBER(q->data, index & (q->size - 1), struct invoke_item);
+		switch (__atomic_load_n(&item->state, __ATOMIC_ACQUIRE)) {
+		case ITEM_EMPTY:
+			/* the producer will wake us up again after it committed */
+			return;
+		case ITEM_READY:
+			res = item->func(&impl->loop, true, item->seq, item->data, item->size,
+				   item->user_data);
+			if (item->res)
+				*item->res = res;
+			if (item->pending && __atomic_sub_fetch(item->pending, 1, __ATOMIC_RELEASE) == 0)
+				futex_wake(item->pending);
+			break;
+		case ITEM_SKIP:
+			break;
+		default:
+			spa_log_error(impl->log, NAME " %p: invalid invoke item %p state %u",
+					impl, item, item->state);
+			return;
 		}
+		/* clear the whole item, a later item can start anywhere in it and
+		 * must read as ITEM_EMPTY until its producer commits it */
+		item_size = item->item_size;
+		memset(item, 0, item_size);
+		__atomic_store_n(&q->readindex, index + item_size, __ATOMIC_RELEASE);
 	}
 }
 
@@ -294,6 +760,11 @@ static int loop_get_fd(struct spa_loop_control *ctrl)
 {
 	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
 
+#ifdef ENABLE_IO_URING
+	if (impl->use_uring)
+		return impl->ring.fd;
+#endif
+
 	return impl->epoll_fd;
 }
 
@@ -328,6 +799,104 @@ static void process_destroy(struct impl *impl)
 	spa_list_init(&impl->destroy_list);
 }
 
+static void process_idle(struct impl *impl)
+{
+	struct source_impl *source, *tmp;
+
+	spa_list_for_each_safe(source, tmp, &impl->idle_list, idle_link) {
+		if (source->enabled && source->source.loop == &impl->loop)
+			source->func.idle(source->source.data);
+	}
+}
+
+#ifdef ENABLE_IO_URING
+static int loop_iterate_uring(struct impl *impl, int timeout)
+{
+	struct uring_slot *slots[32], *slot;
+	struct io_uring_cqe *cqe;
+	struct spa_source *s;
+	int i, n = 0, res;
+
+	if (impl->retry_pending) {
+		uring_retry(impl);
+		if (impl->retry_pending &&
+		    (timeout < 0 || timeout > URING_RETRY_MSEC))
+			timeout = URING_RETRY_MSEC;
+	}
+
+	spa_loop_control_hook_before(&impl->hooks_list);
+
+	res = uring_submit_and_wait(&impl->ring, 1, timeout);
+
+	spa_loop_control_hook_after(&impl->hooks_list);
+
+	if (SPA_UNLIKELY(res < 0))
+		return -res;
+
+	while (n < SPA_N_ELEMENTS(slots) && (cqe = uring_peek_cqe(&impl->ring)) != NULL) {
+		int32_t cres = cqe->res;
+
+		slot = (struct uring_slot *) (uintptr_t) cqe->user_data;
+		if (slot && !(cqe->flags & IORING_CQE_F_MORE))
+			slot->armed = false;
+		uring_cqe_seen(&impl->ring);
+
+		if (slot == NULL)
+			continue;
+
+		if ((s = slot->source) == NULL) {
+			if (!slot->armed && !slot->collected) {
+				spa_list_remove(&slot->link);
+				free(slot);
+			}
+			continue;
+		}
+
+		if (slot->read) {
+			if (cres == sizeof(uint64_t)) {
+				slot->result = slot->value;
+				slot->has_value = true;
+				s->rmask = SPA_IO_IN;
+			} else
+				s->rmask = cres < 0 && cres != -EAGAIN ? SPA_IO_ERR : 0;
+		} else {
+			enum spa_io mask = cres < 0 ? SPA_IO_ERR : spa_epoll_to_io(cres);
+			s->rmask = slot->collected ? s->rmask | mask : mask;
+		}
+		if (slot->read && !slot->armed)
+			uring_rearm(impl, slot);
+
+		if (!slot->collected) {
+			slot->collected = true;
+			slots[n++] = slot;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		slot = slots[i];
+
+		/* the slot stays collected while the callback runs so that
+		 * removing the source does not free it */
+		if ((s = slot->source) != NULL &&
+		    s->rmask && s->fd != -1 && s->loop == &impl->loop)
+			s->func(s);
+
+		slot->collected = false;
+
+		if (slot->source == NULL) {
+			if (!slot->armed) {
+				spa_list_remove(&slot->link);
+				free(slot);
+			}
+			continue;
+		}
+		if (!slot->armed)
+			uring_rearm(impl, slot);
+	}
+	return 0;
+}
+#endif
+
 static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 {
 	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
@@ -335,6 +904,17 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 	struct epoll_event ep[32];
 	int i, nfds, save_errno = 0;
 
+	/* enabled idle sources run on each iteration */
+	if (impl->n_idle_enabled > 0)
+		timeout = 0;
+
+#ifdef ENABLE_IO_URING
+	if (impl->use_uring) {
+		if ((save_errno = loop_iterate_uring(impl, timeout)) != 0)
+			return save_errno;
+		goto done;
+	}
+#endif
 	spa_loop_control_hook_before(&impl->hooks_list);
 
 	if (SPA_UNLIKELY((nfds = epoll_wait(impl->epoll_fd, ep, SPA_N_ELEMENTS(ep), timeout)) < 0))
@@ -357,6 +937,12 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 		if (s->rmask && s->fd != -1 && s->loop == loop)
 			s->func(s);
 	}
+#ifdef ENABLE_IO_URING
+      done:
+#endif
+	if (impl->n_idle_enabled > 0)
+		process_idle(impl);
+
 	process_destroy(impl);
 
 	return 0;
@@ -409,6 +995,18 @@ static void source_idle_func(struct spa_source *source)
 	impl->func.idle(source->data);
 }
 
+static void wakeup_events(struct impl *impl)
+{
+	uint64_t count = 1;
+
+	if (__atomic_exchange_n(&impl->event_wakeup, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	if (write(impl->event_source.fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		spa_log_warn(impl->log, NAME " %p: failed to write event fd %d: %s",
+				impl, impl->event_source.fd, strerror(errno));
+}
+
 static struct spa_source *loop_add_idle(struct spa_loop_utils *utils,
 					bool enabled, spa_source_idle_func_t func, void *data)
 {
@@ -422,15 +1020,15 @@ static struct spa_source *loop_add_idle(struct spa_loop_utils *utils,
 	source->source.loop = &impl->loop;
 	source->source.func = source_idle_func;
 	source->source.data = data;
-	source->source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	source->source.fd = -1;
 	source->impl = impl;
-	source->close = true;
+	source->close = false;
 	source->source.mask = SPA_IO_IN;
 	source->func.idle = func;
-
-	spa_loop_add_source(&impl->loop, &source->source);
+	source->slot = -1;
 
 	spa_list_insert(&impl->source_list, &source->link);
+	spa_list_append(&impl->idle_list, &source->idle_link);
 
 	if (enabled)
 		spa_loop_utils_enable_idle(&impl->utils, &source->source, true);
@@ -441,21 +1039,40 @@ static struct spa_source *loop_add_idle(struct spa_loop_utils *utils,
 static void loop_enable_idle(struct spa_source *source, bool enabled)
 {
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
-	uint64_t count;
 
 	if (enabled && !impl->enabled) {
-		count = 1;
-		if (write(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-			spa_log_warn(impl->impl->log, NAME " %p: failed to write idle fd %d: %s",
-					source, source->fd, strerror(errno));
+		impl->impl->n_idle_enabled++;
+		/* make a blocked loop iterate */
+		wakeup_events(impl->impl);
 	} else if (!enabled && impl->enabled) {
-		if (read(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-			spa_log_warn(impl->impl->log, NAME " %p: failed to read idle fd %d: %s",
-					source, source->fd, strerror(errno));
+		impl->impl->n_idle_enabled--;
 	}
 	impl->enabled = enabled;
 }
 
+/* read the counter of the loop eventfd or timerfd, with io_uring the
+ * completion already carried it */
+static int read_counter(struct impl *impl, struct spa_source *source, uint64_t *value)
+{
+#ifdef ENABLE_IO_URING
+	if (impl->use_uring) {
+		struct uring_slot *slot = source == &impl->timer_source ?
+			impl->timer_slot : impl->event_slot;
+
+		if (slot == NULL || !slot->has_value) {
+			errno = EAGAIN;
+			return -EAGAIN;
+		}
+		*value = slot->result;
+		slot->has_value = false;
+		return 0;
+	}
+#endif
+	if (read(source->fd, value, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
 static void source_event_func(struct spa_source *source)
 {
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
@@ -468,6 +1085,60 @@ static void source_event_func(struct spa_source *source)
 	impl->func.event(source->data, count);
 }
 
+static void process_events(struct spa_source *source)
+{
+	struct impl *impl = SPA_CONTAINER_OF(source, struct impl, event_source);
+	uint64_t count, bits;
+	uint32_t i;
+
+	/* clear before collecting so that a new event makes us iterate again */
+	__atomic_store_n(&impl->event_wakeup, 0, __ATOMIC_SEQ_CST);
+
+	if (read_counter(impl, source, &count) < 0 && errno != EAGAIN)
+		spa_log_warn(impl->log, NAME " %p: failed to read event fd %d: %s",
+				impl, source->fd, strerror(errno));
+
+	for (i = 0; i < EVENT_WORDS; i++) {
+		if (__atomic_load_n(&impl->event_pending[i], __ATOMIC_RELAXED) == 0)
+			continue;
+
+		bits = __atomic_exchange_n(&impl->event_pending[i], 0, __ATOMIC_ACQUIRE);
+		while (bits) {
+			struct source_impl *s = impl->events[i * 64 + __builtin_ctzll(bits)];
+
+			bits &= bits - 1;
+			if (s == NULL || s->source.loop != &impl->loop)
+				continue;
+			if ((count = __atomic_exchange_n(&s->count, 0, __ATOMIC_ACQUIRE)) > 0)
+				s->func.event(s->source.data, count);
+		}
+	}
+}
+
+static int alloc_event_slot(struct impl *impl, struct source_impl *source)
+{
+	uint32_t i;
+	int bit;
+
+	for (i = 0; i < EVENT_WORDS; i++) {
+		if (impl->event_used[i] == UINT64_MAX)
+			continue;
+
+		bit = __builtin_ctzll(~impl->event_used[i]);
+		impl->event_used[i] |= 1ULL << bit;
+		__atomic_and_fetch(&impl->event_pending[i], ~(1ULL << bit), __ATOMIC_RELAXED);
+		impl->events[i * 64 + bit] = source;
+		return i * 64 + bit;
+	}
+	return -1;
+}
+
+static void free_event_slot(struct impl *impl, int slot)
+{
+	impl->events[slot] = NULL;
+	impl->event_used[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
 static struct spa_source *loop_add_event(struct spa_loop_utils *utils,
 					 spa_source_event_func_t func, void *data)
 {
@@ -481,13 +1152,18 @@ static struct spa_source *loop_add_event(struct spa_loop_utils *utils,
 	source->source.loop = &impl->loop;
 	source->source.func = source_event_func;
 	source->source.data = data;
-	source->source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 	source->source.mask = SPA_IO_IN;
 	source->impl = impl;
-	source->close = true;
 	source->func.event = func;
 
-	spa_loop_add_source(&impl->loop, &source->source);
+	if ((source->slot = alloc_event_slot(impl, source)) < 0) {
+		source->source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		source->close = true;
+		spa_loop_add_source(&impl->loop, &source->source);
+	} else {
+		source->source.fd = -1;
+		source->close = false;
+	}
 
 	spa_list_insert(&impl->source_list, &source->link);
 
@@ -499,21 +1175,144 @@ static void loop_signal_event(struct spa_source *source)
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
 	uint64_t count = 1;
 
+	if (impl->slot >= 0) {
+		__atomic_add_fetch(&impl->count, 1, __ATOMIC_RELEASE);
+		__atomic_or_fetch(&impl->impl->event_pending[impl->slot / 64],
+				1ULL << (impl->slot % 64), __ATOMIC_RELEASE);
+		wakeup_events(impl->impl);
+		return;
+	}
+
 	if (write(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
 		spa_log_warn(impl->impl->log, NAME " %p: failed to write event fd %d: %s",
 				source, source->fd, strerror(errno));
 }
 
-static void source_timer_func(struct spa_source *source)
+static uint64_t get_time(void)
 {
-	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
-	uint64_t expirations;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
 
-	if (read(source->fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
-		spa_log_warn(impl->impl->log, NAME " %p: failed to read timer fd %d: %s",
-				source, source->fd, strerror(errno));
+static inline bool timer_before(struct impl *impl, uint32_t a, uint32_t b)
+{
+	return impl->timers[a]->expire < impl->timers[b]->expire;
+}
 
-	impl->func.timer(source->data, expirations);
+static inline void timer_swap(struct impl *impl, uint32_t a, uint32_t b)
+{
+	struct source_impl *t = impl->timers[a];
+
+	impl->timers[a] = impl->timers[b];
+	impl->timers[b] = t;
+	impl->timers[a]->heap_index = a + 1;
+	impl->timers[b]->heap_index = b + 1;
+}
+
+static void timer_sift_up(struct impl *impl, uint32_t i)
+{
+	while (i > 0 && timer_before(impl, i, (i - 1) / 2)) {
+		timer_swap(impl, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void timer_sift_down(struct impl *impl, uint32_t i)
+{
+	uint32_t l, min;
+
+	while ((l = 2 * i + 1) < impl->n_timers) {
+		min = l;
+		if (l + 1 < impl->n_timers && timer_before(impl, l + 1, l))
+			min = l + 1;
+		if (!timer_before(impl, min, i))
+			break;
+		timer_swap(impl, i, min);
+		i = min;
+	}
+}
+
+static int timer_insert(struct impl *impl, struct source_impl *source)
+{
+	if (impl->n_timers == impl->max_timers) {
+		uint32_t max = impl->max_timers ? impl->max_timers * 2 : 64;
+		struct source_impl **timers = realloc(impl->timers, max * sizeof(*timers));
+		if (timers == NULL)
+			return -ENOMEM;
+		impl->timers = timers;
+		impl->max_timers = max;
+	}
+	impl->timers[impl->n_timers] = source;
+	source->heap_index = ++impl->n_timers;
+	timer_sift_up(impl, impl->n_timers - 1);
+	return 0;
+}
+
+static void timer_remove(struct impl *impl, struct source_impl *source)
+{
+	uint32_t i = source->heap_index - 1, last = --impl->n_timers;
+
+	source->heap_index = 0;
+	if (i == last)
+		return;
+
+	impl->timers[i] = impl->timers[last];
+	impl->timers[i]->heap_index = i + 1;
+	timer_sift_down(impl, i);
+	timer_sift_up(impl, i);
+}
+
+/* arm the timerfd for the first timer in the heap, when it changed */
+static void timer_rearm(struct impl *impl)
+{
+	struct itimerspec its;
+	uint64_t expire = impl->n_timers ? impl->timers[0]->expire : 0;
+
+	if (impl->dispatching_timers || expire == impl->timer_armed)
+		return;
+
+	spa_zero(its);
+	its.it_value.tv_sec = expire / SPA_NSEC_PER_SEC;
+	its.it_value.tv_nsec = expire % SPA_NSEC_PER_SEC;
+
+	if (timerfd_settime(impl->timer_source.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		spa_log_warn(impl->log, NAME " %p: failed to arm timer fd %d: %s",
+				impl, impl->timer_source.fd, strerror(errno));
+		return;
+	}
+	impl->timer_armed = expire;
+}
+
+static void process_timers(struct spa_source *source)
+{
+	struct impl *impl = SPA_CONTAINER_OF(source, struct impl, timer_source);
+	struct source_impl *t;
+	uint64_t expirations, now;
+
+	if (read_counter(impl, source, &expirations) < 0 && errno != EAGAIN)
+		spa_log_warn(impl->log, NAME " %p: failed to read timer fd %d: %s",
+				impl, source->fd, strerror(errno));
+
+	now = get_time();
+	impl->timer_armed = 0;
+	impl->dispatching_timers = true;
+
+	while (impl->n_timers > 0 && (t = impl->timers[0])->expire <= now) {
+		if (t->interval > 0) {
+			expirations = 1 + (now - t->expire) / t->interval;
+			t->expire += expirations * t->interval;
+			timer_sift_down(impl, 0);
+		} else {
+			expirations = 1;
+			timer_remove(impl, t);
+		}
+		/* the callback can update or destroy any timer */
+		t->func.timer(t->source.data, expirations);
+	}
+
+	impl->dispatching_timers = false;
+	timer_rearm(impl);
 }
 
 static struct spa_source *loop_add_timer(struct spa_loop_utils *utils,
@@ -527,15 +1326,13 @@ static struct spa_source *loop_add_timer(struct spa_loop_utils *utils,
 		return NULL;
 
 	source->source.loop = &impl->loop;
-	source->source.func = source_timer_func;
 	source->source.data = data;
-	source->source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	source->source.fd = -1;
 	source->source.mask = SPA_IO_IN;
 	source->impl = impl;
-	source->close = true;
+	source->close = false;
 	source->func.timer = func;
-
-	spa_loop_add_source(&impl->loop, &source->source);
+	source->slot = -1;
 
 	spa_list_insert(&impl->source_list, &source->link);
 
@@ -546,23 +1343,32 @@ static int
 loop_update_timer(struct spa_source *source,
 		  struct timespec *value, struct timespec *interval, bool absolute)
 {
-	struct itimerspec its;
-	int flags = 0;
+	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
+	struct impl *impl = s->impl;
+	uint64_t expire = 0;
+	int res;
 
-	spa_zero(its);
 	if (value) {
-		its.it_value = *value;
+		expire = SPA_TIMESPEC_TO_TIME(value);
 	} else if (interval) {
-		its.it_value = *interval;
+		/* start now */
+		expire = get_time();
 		absolute = true;
 	}
-	if (interval)
-		its.it_interval = *interval;
-	if (absolute)
-		flags |= TFD_TIMER_ABSTIME;
-
-	if (timerfd_settime(source->fd, flags, &its, NULL) < 0)
-		return errno;
+	s->interval = interval ? SPA_TIMESPEC_TO_TIME(interval) : 0;
+
+	if (s->heap_index)
+		timer_remove(impl, s);
+
+	/* like timerfd, a zero value disarms the timer */
+	if (expire != 0) {
+		if (!absolute)
+			expire += get_time();
+		s->expire = expire;
+		if ((res = timer_insert(impl, s)) < 0)
+			return res;
+	}
+	timer_rearm(impl);
 
 	return 0;
 }
@@ -621,6 +1427,15 @@ static void loop_destroy_source(struct spa_source *source)
 
 	spa_list_remove(&impl->link);
 
+	if (source->func == source_idle_func) {
+		spa_list_remove(&impl->idle_link);
+		loop_enable_idle(source, false);
+	}
+	if (impl->heap_index)
+		timer_remove(impl->impl, impl);
+	if (impl->slot >= 0)
+		free_event_slot(impl->impl, impl->slot);
+
 	if (source->loop)
 		spa_loop_remove_source(source->loop, source);
 
@@ -637,6 +1452,7 @@ static const struct spa_loop impl_loop = {
 	loop_update_source,
 	loop_remove_source,
 	loop_invoke,
+	loop_invoke_many,
 };
 
 static const struct spa_loop_control impl_loop_control = {
@@ -687,6 +1503,7 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *impl;
 	struct source_impl *source, *tmp;
+	struct invoke_queue *q, *next;
 
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
@@ -697,8 +1514,27 @@ static int impl_clear(struct spa_handle *handle)
 
 	process_destroy(impl);
 
-	close(impl->ack_fd);
-	close(impl->epoll_fd);
+	close(impl->timer_source.fd);
+	close(impl->event_source.fd);
+	free(impl->timers);
+
+	for (q = impl->queue.next; q != &impl->queue; q = next) {
+		next = q->next;
+		free(q);
+	}
+
+#ifdef ENABLE_IO_URING
+	if (impl->use_uring) {
+		struct uring_slot *slot, *t;
+
+		/* closing the ring cancels all requests */
+		uring_clear(&impl->ring);
+		spa_list_for_each_safe(slot, t, &impl->slot_list, link)
+			free(slot);
+	}
+#endif
+	if (impl->epoll_fd != -1)
+		close(impl->epoll_fd);
 
 	return 0;
 }
@@ -711,6 +1547,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *impl;
+	const char *backend = NULL;
 	uint32_t i;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
@@ -736,18 +1573,69 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	init_type(&impl->type, impl->map);
 
-	impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-	if (impl->epoll_fd == -1)
-		return errno;
+	if (info)
+		backend = spa_dict_lookup(info, "loop.backend");
+
+	impl->epoll_fd = -1;
+#ifdef ENABLE_IO_URING
+	spa_list_init(&impl->slot_list);
+	if (backend && strcmp(backend, "io_uring") == 0) {
+		int res;
+
+		if ((res = uring_init(&impl->ring, URING_ENTRIES)) < 0)
+			spa_log_warn(impl->log, NAME " %p: can't use io_uring, using epoll: %s",
+					impl, strerror(-res));
+		else
+			impl->use_uring = true;
+	}
+	if (!impl->use_uring)
+#else
+	if (backend && strcmp(backend, "io_uring") == 0)
+		spa_log_warn(impl->log, NAME " %p: io_uring support not available, using epoll",
+				impl);
+#endif
+	{
+		impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (impl->epoll_fd == -1)
+			return errno;
+	}
 
 	spa_list_init(&impl->source_list);
 	spa_list_init(&impl->destroy_list);
+	spa_list_init(&impl->idle_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	spa_ringbuffer_init(&impl->buffer);
+	impl->timer_source.func = process_timers;
+	impl->timer_source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	impl->timer_source.mask = SPA_IO_IN;
+	impl->event_source.func = process_events;
+	impl->event_source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	impl->event_source.mask = SPA_IO_IN;
+
+	if (impl->timer_source.fd == -1 || impl->event_source.fd == -1) {
+		int res = -errno;
+		if (impl->timer_source.fd != -1)
+			close(impl->timer_source.fd);
+#ifdef ENABLE_IO_URING
+		if (impl->use_uring)
+			uring_clear(&impl->ring);
+#endif
+		if (impl->epoll_fd != -1)
+			close(impl->epoll_fd);
+		return res;
+	}
+	spa_loop_add_source(&impl->loop, &impl->timer_source);
+	spa_loop_add_source(&impl->loop, &impl->event_source);
+
+	impl->queue.reserve = 0;
+	impl->queue.readindex = 0;
+	impl->queue.size = DATAS_SIZE;
+	impl->queue.data = impl->buffer_data;
+	memset(impl->buffer_data, 0, sizeof(impl->buffer_data));
+	impl->queue.next = &impl->queue;
+	impl->write_queue = impl->read_queue = &impl->queue;
 
 	impl->wakeup = spa_loop_utils_add_event(&impl->utils, wakeup_func, impl);
-	impl->ack_fd = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
 
 	spa_log_debug(impl->log, NAME " %p: initialized", impl);
 
@@ -0,0 +1,159 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <spa/utils/defs.h>
+
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			      unsigned flags, void *arg, size_t size)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+int uring_init(struct uring *ring, unsigned entries)
+{
+	struct io_uring_params p;
+	int res;
+
+	spa_zero(*ring);
+	spa_zero(p);
+
+	if ((ring->fd = sys_io_uring_setup(entries, &p)) < 0)
+		return -errno;
+
+	/* we need the timeout argument of io_uring_enter, completions that
+	 * are never dropped and reads that wait for nonblocking fds */
+#define URING_FEATURES	(IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL)
+	if ((p.features & URING_FEATURES) != URING_FEATURES) {
+		res = -ENOTSUP;
+		goto error;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+	    ring->sqes == MAP_FAILED) {
+		res = -errno;
+		goto error;
+	}
+
+	ring->sq_head = SPA_MEMBER(ring->sq_ring, p.sq_off.head, unsigned);
+	ring->sq_tail = SPA_MEMBER(ring->sq_ring, p.sq_off.tail, unsigned);
+	ring->sq_mask = SPA_MEMBER(ring->sq_ring, p.sq_off.ring_mask, unsigned);
+	ring->sq_array = SPA_MEMBER(ring->sq_ring, p.sq_off.array, unsigned);
+	ring->sq_entries = p.sq_entries;
+
+	ring->cq_head = SPA_MEMBER(ring->cq_ring, p.cq_off.head, unsigned);
+	ring->cq_tail = SPA_MEMBER(ring->cq_ring, p.cq_off.tail, unsigned);
+	ring->cq_mask = SPA_MEMBER(ring->cq_ring, p.cq_off.ring_mask, unsigned);
+	ring->cqes = SPA_MEMBER(ring->cq_ring, p.cq_off.cqes, struct io_uring_cqe);
+
+	return 0;
+
+      error:
+	uring_clear(ring);
+	return res;
+}
+
+void uring_clear(struct uring *ring)
+{
+	if (ring->sqes && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != MAP_FAILED)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	spa_zero(*ring);
+	ring->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring->sq_tail;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries) {
+		if (uring_submit_and_wait(ring, 0, 0) < 0)
+			return NULL;
+		if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries)
+			return NULL;
+	}
+	sqe = &ring->sqes[tail & *ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->sq_pending++;
+
+	return sqe;
+}
+
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr, int timeout)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = IORING_ENTER_EXT_ARG;
+	int res;
+
+	spa_zero(arg);
+	if (wait_nr > 0) {
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout >= 0) {
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * SPA_NSEC_PER_MSEC;
+			arg.ts = (uint64_t) (uintptr_t) &ts;
+		}
+	}
+	else if (ring->sq_pending == 0)
+		return 0;
+
+	res = sys_io_uring_enter(ring->fd, ring->sq_pending, wait_nr, flags, &arg, sizeof(arg));
+	if (res < 0)
+		res = -errno;
+
+	/* the kernel consumed the sqes it moved the head over */
+	ring->sq_pending = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	/* a timeout is not an error */
+	return res == -ETIME ? 0 : res;
+}
@@ -0,0 +1,80 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LOOP_URING_H__
+#define __SPA_LOOP_URING_H__
+
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/** A minimal io_uring submission and completion ring */
+struct uring {
+	int fd;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sq_pending;		/* sqes filled but not yet submitted */
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+/** setup a ring with \a entries submission entries, returns a negative
+ * errno when io_uring or a needed feature is not available */
+int uring_init(struct uring *ring, unsigned entries);
+
+void uring_clear(struct uring *ring);
+
+/** get a cleared sqe, submits the pending sqes when the ring is full */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+
+/** submit the pending sqes and wait at most \a timeout msec, -1 for
+ * no timeout, until \a wait_nr completions are available */
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr, int timeout);
+
+/** get the next completion or NULL */
+static inline struct io_uring_cqe *uring_peek_cqe(struct uring *ring)
+{
+	unsigned head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+/** mark the completion returned by uring_peek_cqe() as consumed */
+static inline void uring_cqe_seen(struct uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* __SPA_LOOP_URING_H__ */
@@ -63,7 +63,8 @@ struct buffer {
 	struct spa_meta_header *h;
 	uint32_t flags;
 	struct v4l2_buffer v4l2_buffer;
-	void *ptr;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	void *ptr[VIDEO_MAX_PLANES];
 };
 
 struct type {
@@ -148,6 +149,8 @@ struct port {
 	struct spa_loop *data_loop;
 
 	bool export_buf;
+	bool import_buf;
+	bool latest_frame;
 	bool started;
 
 	bool next_fmtdesc;
@@ -166,6 +169,12 @@ struct port {
 	struct v4l2_format fmt;
 	enum v4l2_buf_type type;
 	enum v4l2_memory memtype;
+	bool have_userptr;
+	bool have_dmabuf;
+
+	uint32_t n_planes;
+	uint32_t plane_size[VIDEO_MAX_PLANES];
+	uint32_t plane_stride[VIDEO_MAX_PLANES];
 
 	struct control controls[MAX_CONTROLS];
 	uint32_t n_controls;
@@ -180,6 +189,10 @@ struct port {
 
 	int64_t last_ticks;
 	int64_t last_monotonic;
+
+	bool have_ts_offset;
+	int64_t ts_offset;	/* estimated monotonic - device clock, in nsec */
+	uint32_t n_dropped;
 };
 
 struct impl {
@@ -534,17 +547,23 @@ static int impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
+		uint32_t i, size = 0;
+
 		if (!port->have_format)
 			return -EIO;
 		if (*index > 0)
 			return 0;
 
+		for (i = 0; i < port->n_planes; i++)
+			size = SPA_MAX(size, port->plane_size[i]);
+
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", port->fmt.fmt.pix.sizeimage,
-			":", t->param_buffers.stride,  "i", port->fmt.fmt.pix.bytesperline,
+			":", t->param_buffers.size,    "i", size,
+			":", t->param_buffers.stride,  "i", port->plane_stride[0],
 			":", t->param_buffers.buffers, "iru", MAX_BUFFERS,
 				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+			":", t->param_buffers.blocks,  "i", port->n_planes,
 			":", t->param_buffers.align,   "i", 16);
 	}
 	else if (id == t->param.idMeta) {
@@ -1014,11 +1033,20 @@ impl_init(const struct spa_handle_factory *factory,
 			   SPA_PORT_INFO_FLAG_PHYSICAL |
 			   SPA_PORT_INFO_FLAG_TERMINAL;
 	port->export_buf = true;
+	port->latest_frame = true;
 	port->have_query_ext_ctrl = true;
 
 	if (info && (str = spa_dict_lookup(info, "device.path"))) {
 		strncpy(this->props.device, str, 63);
 	}
+	/* capture into buffers allocated by the peer when the device can import them */
+	if (info && (str = spa_dict_lookup(info, "v4l2.import-dmabuf"))) {
+		port->import_buf = strcmp(str, "true") == 0 || strcmp(str, "1") == 0;
+	}
+	/* drop older queued frames and only send out the most recent one */
+	if (info && (str = spa_dict_lookup(info, "v4l2.latest-frame"))) {
+		port->latest_frame = strcmp(str, "true") == 0 || strcmp(str, "1") == 0;
+	}
 
 	return 0;
 }
@@ -24,6 +24,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <poll.h>
+#include <time.h>
 
 static void v4l2_on_fd_events(struct spa_source *source);
 
@@ -38,12 +39,25 @@ static int xioctl(int fd, int request, void *arg)
 	return err;
 }
 
+static bool probe_memory(struct port *port, enum v4l2_memory memory)
+{
+	struct v4l2_requestbuffers reqbuf;
+
+	/* requesting 0 buffers only fails when the memory type is not supported */
+	spa_zero(reqbuf);
+	reqbuf.type = port->type;
+	reqbuf.memory = memory;
+	reqbuf.count = 0;
+
+	return xioctl(port->fd, VIDIOC_REQBUFS, &reqbuf) == 0;
+}
 
 static int spa_v4l2_open(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct stat st;
 	struct props *props = &this->props;
+	uint32_t caps;
 	int err;
 
 	if (port->opened)
@@ -83,13 +97,27 @@ static int spa_v4l2_open(struct impl *this)
 		return -err;
 	}
 
-	if ((port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0 ||
-	    ((port->cap.capabilities & V4L2_CAP_DEVICE_CAPS) &&
-	     (port->cap.device_caps & V4L2_CAP_VIDEO_CAPTURE) == 0)) {
+	caps = port->cap.capabilities;
+	if (caps & V4L2_CAP_DEVICE_CAPS)
+		caps = port->cap.device_caps;
+
+	if (caps & V4L2_CAP_VIDEO_CAPTURE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else {
 		spa_log_error(port->log, "v4l2: %s is no video capture device", props->device);
 		return -ENODEV;
 	}
 
+	if (caps & V4L2_CAP_STREAMING) {
+		port->have_userptr = probe_memory(port, V4L2_MEMORY_USERPTR);
+		port->have_dmabuf = probe_memory(port, V4L2_MEMORY_DMABUF);
+	}
+	spa_log_info(port->log, "v4l2: %s planar, userptr:%d dmabuf:%d",
+			V4L2_TYPE_IS_MULTIPLANAR(port->type) ? "multi" : "single",
+			port->have_userptr, port->have_dmabuf);
+
 	port->source.func = v4l2_on_fd_events;
 	port->source.data = this;
 	port->source.fd = port->fd;
@@ -121,11 +149,54 @@ static int spa_v4l2_buffer_recycle(struct impl *this, uint32_t buffer_id)
 	return 0;
 }
 
+static void buffer_init(struct port *port, struct buffer *b, uint32_t index)
+{
+	spa_zero(b->v4l2_buffer);
+	b->v4l2_buffer.type = port->type;
+	b->v4l2_buffer.memory = port->memtype;
+	b->v4l2_buffer.index = index;
+
+	memset(b->planes, 0, sizeof(b->planes));
+	memset(b->ptr, 0, sizeof(b->ptr));
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		b->v4l2_buffer.m.planes = b->planes;
+		b->v4l2_buffer.length = port->n_planes;
+	}
+}
+
+/* single planar buffers keep their layout in the v4l2_buffer itself, copy it
+ * to and from planes[0] so that the rest of the code can work on planes */
+static void buffer_get_planes(struct port *port, struct v4l2_buffer *buf,
+			      struct v4l2_plane *planes)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return;
+
+	planes[0].bytesused = buf->bytesused;
+	planes[0].length = buf->length;
+	planes[0].data_offset = 0;
+	if (buf->memory == V4L2_MEMORY_MMAP)
+		planes[0].m.mem_offset = buf->m.offset;
+}
+
+static void buffer_set_planes(struct port *port, struct v4l2_buffer *buf,
+			      struct v4l2_plane *planes)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return;
+
+	buf->length = planes[0].length;
+	if (buf->memory == V4L2_MEMORY_USERPTR)
+		buf->m.userptr = planes[0].m.userptr;
+	else if (buf->memory == V4L2_MEMORY_DMABUF)
+		buf->m.fd = planes[0].m.fd;
+}
+
 static int spa_v4l2_clear_buffers(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
 
 	if (port->n_buffers == 0)
 		return 0;
@@ -141,18 +212,20 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 			spa_log_info(port->log, "v4l2: queueing outstanding buffer %p", b);
 			spa_v4l2_buffer_recycle(this, i);
 		}
-		if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_MAPPED)) {
-			munmap(SPA_MEMBER(b->ptr, -d[0].mapoffset, void),
-					d[0].maxsize - d[0].mapoffset);
-		}
-		if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_ALLOCATED)) {
-			close(d[0].fd);
+		for (j = 0; j < port->n_planes && j < b->outbuf->n_datas; j++) {
+			if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_MAPPED) && b->ptr[j]) {
+				munmap(SPA_MEMBER(b->ptr[j], -d[j].mapoffset, void),
+						d[j].maxsize + d[j].mapoffset);
+			}
+			if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_ALLOCATED)) {
+				close(d[j].fd);
+			}
+			d[j].type = SPA_ID_INVALID;
 		}
-		d[0].type = SPA_ID_INVALID;
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -284,7 +357,7 @@ static const struct format_info format_info[] = {
 	/* Luminance+Chrominance formats */
 	{V4L2_PIX_FMT_YVU410, FORMAT_YVU9, VIDEO, RAW},
 	{V4L2_PIX_FMT_YVU420, FORMAT_YV12, VIDEO, RAW},
-	{V4L2_PIX_FMT_YVU420M, FORMAT_UNKNOWN, VIDEO, RAW},
+	{V4L2_PIX_FMT_YVU420M, FORMAT_YV12, VIDEO, RAW},
 	{V4L2_PIX_FMT_YUYV, FORMAT_YUY2, VIDEO, RAW},
 	{V4L2_PIX_FMT_YYUV, FORMAT_UNKNOWN, VIDEO, RAW},
 	{V4L2_PIX_FMT_YVYU, FORMAT_YVYU, VIDEO, RAW},
@@ -540,7 +613,7 @@ spa_v4l2_enum_format(struct impl *this,
 	if (*index == 0) {
 		spa_zero(port->fmtdesc);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -811,22 +884,40 @@ spa_v4l2_enum_format(struct impl *this,
 	goto exit;
 }
 
+static bool device_has_fourcc(struct port *port, uint32_t fourcc)
+{
+	struct v4l2_fmtdesc fmtdesc;
+
+	spa_zero(fmtdesc);
+	fmtdesc.type = port->type;
+
+	for (fmtdesc.index = 0; xioctl(port->fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0; fmtdesc.index++) {
+		if (fmtdesc.pixelformat == fourcc)
+			return true;
+	}
+	return false;
+}
+
 static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format, bool try_only)
 {
 	struct port *port = &this->out_ports[0];
-	int res, cmd;
-	struct v4l2_format reqfmt, fmt;
+	int res, cmd, i;
+	struct v4l2_format fmt;
 	struct v4l2_streamparm streamparm;
-	const struct format_info *info = NULL;
-	uint32_t video_format;
+	const struct format_info *info = NULL, *fi;
+	uint32_t video_format, pixelformat, width, height;
 	struct spa_rectangle *size = NULL;
 	struct spa_fraction *framerate = NULL;
 	struct type *t = &this->type;
+	bool import;
+
+	if ((res = spa_v4l2_open(this)) < 0)
+		return res;
 
 	spa_zero(fmt);
 	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.type = port->type;
+	streamparm.type = port->type;
 
 	if (format->media_subtype == this->type.media_subtype.raw) {
 		video_format = format->info.raw.format;
@@ -845,33 +936,43 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		video_format = this->type.video_format.ENCODED;
 	}
 
-	info = find_format_info_by_media_type(t,
-					      format->media_type,
-					      format->media_subtype, video_format, 0);
+	/* several fourccs can map to the same format, such as NV12 and the
+	 * multiplanar NV12M, take the first one the device has */
+	for (i = 0; (fi = find_format_info_by_media_type(t, format->media_type,
+						format->media_subtype, video_format, i)); ) {
+		if (info == NULL)
+			info = fi;
+		if (device_has_fourcc(port, fi->fourcc)) {
+			info = fi;
+			break;
+		}
+		i = fi - format_info + 1;
+	}
 	if (info == NULL || size == NULL || framerate == NULL) {
 		spa_log_error(port->log, "v4l2: unknown media type %d %d %d", format->media_type,
 			      format->media_subtype, video_format);
 		return -EINVAL;
 	}
 
-
-	fmt.fmt.pix.pixelformat = info->fourcc;
-	fmt.fmt.pix.field = V4L2_FIELD_ANY;
-	fmt.fmt.pix.width = size->width;
-	fmt.fmt.pix.height = size->height;
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		fmt.fmt.pix_mp.pixelformat = info->fourcc;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix_mp.width = size->width;
+		fmt.fmt.pix_mp.height = size->height;
+	} else {
+		fmt.fmt.pix.pixelformat = info->fourcc;
+		fmt.fmt.pix.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix.width = size->width;
+		fmt.fmt.pix.height = size->height;
+	}
 	streamparm.parm.capture.timeperframe.numerator = framerate->denom;
 	streamparm.parm.capture.timeperframe.denominator = framerate->num;
 
-	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", info->fourcc,
+		     size->width, size->height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	reqfmt = fmt;
-
-	if ((res = spa_v4l2_open(this)) < 0)
-		return res;
-
 	cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(port->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -883,26 +984,54 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if (xioctl(port->fd, VIDIOC_S_PARM, &streamparm) < 0)
 		spa_log_warn(port->log, "VIDIOC_S_PARM: %m");
 
-	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		pixelformat = fmt.fmt.pix_mp.pixelformat;
+		width = fmt.fmt.pix_mp.width;
+		height = fmt.fmt.pix_mp.height;
+	} else {
+		pixelformat = fmt.fmt.pix.pixelformat;
+		width = fmt.fmt.pix.width;
+		height = fmt.fmt.pix.height;
+	}
+
+	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", pixelformat,
+		     width, height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	if (reqfmt.fmt.pix.pixelformat != fmt.fmt.pix.pixelformat ||
-	    reqfmt.fmt.pix.width != fmt.fmt.pix.width ||
-	    reqfmt.fmt.pix.height != fmt.fmt.pix.height)
+	if (info->fourcc != pixelformat ||
+	    size->width != width ||
+	    size->height != height)
 		return -EINVAL;
 
 	if (try_only)
 		return 0;
 
-	size->width = fmt.fmt.pix.width;
-	size->height = fmt.fmt.pix.height;
+	size->width = width;
+	size->height = height;
 	framerate->num = streamparm.parm.capture.timeperframe.denominator;
 	framerate->denom = streamparm.parm.capture.timeperframe.numerator;
 
 	port->fmt = fmt;
-	port->info.flags = (port->export_buf ? SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS : 0) |
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		port->n_planes = SPA_MIN(fmt.fmt.pix_mp.num_planes, VIDEO_MAX_PLANES);
+		for (i = 0; i < port->n_planes; i++) {
+			port->plane_size[i] = fmt.fmt.pix_mp.plane_fmt[i].sizeimage;
+			port->plane_stride[i] = fmt.fmt.pix_mp.plane_fmt[i].bytesperline;
+		}
+	} else {
+		port->n_planes = 1;
+		port->plane_size[0] = fmt.fmt.pix.sizeimage;
+		port->plane_stride[0] = fmt.fmt.pix.bytesperline;
+	}
+
+	/* when importing, don't offer to allocate so that the peer allocates the
+	 * buffers. Peers that can't allocate give us memory for USERPTR */
+	import = port->import_buf && port->have_dmabuf && port->have_userptr;
+	if (port->import_buf && !import)
+		spa_log_warn(port->log, "v4l2: device can't import dmabuf, disabled");
+
+	port->info.flags = (port->export_buf && !import ? SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS : 0) |
 		SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
 		SPA_PORT_INFO_FLAG_LIVE |
 		SPA_PORT_INFO_FLAG_PHYSICAL |
@@ -1138,46 +1267,112 @@ spa_v4l2_enum_controls(struct impl *this,
 	goto exit;
 }
 
+/* convert a device timestamp to the monotonic clock. Drivers that don't
+ * timestamp with CLOCK_MONOTONIC (realtime, TIMESTAMP_COPY or unknown) get a
+ * running estimate of the offset between both clocks. The dequeue time is
+ * always later than the capture time so lower offsets are followed faster than
+ * higher ones, jumps of more than a second restart the estimation. */
+static int64_t get_monotonic_time(struct port *port, const struct v4l2_buffer *buf, int64_t ts)
+{
+	struct timespec now;
+	int64_t offset, diff;
+
+	if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+		return ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ts == 0)
+		return SPA_TIMESPEC_TO_TIME(&now);
+
+	offset = SPA_TIMESPEC_TO_TIME(&now) - ts;
+	diff = offset - port->ts_offset;
+
+	if (!port->have_ts_offset || diff > SPA_NSEC_PER_SEC || diff < -SPA_NSEC_PER_SEC) {
+		port->ts_offset = offset;
+		port->have_ts_offset = true;
+	}
+	else if (diff < 0)
+		port->ts_offset += diff / 4;
+	else
+		port->ts_offset += diff / 64;
+
+	return ts + port->ts_offset;
+}
+
 static int mmap_read(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_buffer buf;
-	struct buffer *b;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	struct buffer *b = NULL;
 	struct spa_data *d;
 	int64_t pts;
 	struct spa_io_buffers *io = port->io;
+	uint32_t i, index = SPA_ID_INVALID;
+	int res;
 
-	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	buf.memory = port->memtype;
+	/* drain all ready buffers, with latest_frame only the most recent one
+	 * is kept and the older ones are queued again right away */
+	while (true) {
+		spa_zero(buf);
+		buf.type = port->type;
+		buf.memory = port->memtype;
+		if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+			buf.m.planes = planes;
+			buf.length = port->n_planes;
+		}
 
-	if (xioctl(port->fd, VIDIOC_DQBUF, &buf) < 0)
-		return -errno;
+		if (xioctl(port->fd, VIDIOC_DQBUF, &buf) < 0) {
+			res = -errno;
+			break;
+		}
 
-	port->last_ticks = (int64_t) buf.timestamp.tv_sec * SPA_USEC_PER_SEC +
-			    (uint64_t) buf.timestamp.tv_usec;
-	pts = port->last_ticks * 1000;
+		if (b != NULL) {
+			port->n_dropped++;
+			spa_log_trace(port->log, "v4l2 %p: drop buffer %d, %d dropped", this,
+					index, port->n_dropped);
+			spa_v4l2_buffer_recycle(this, index);
+		}
+		index = buf.index;
+		b = &port->buffers[index];
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUTSTANDING);
 
-	if (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+		port->last_ticks = (int64_t) buf.timestamp.tv_sec * SPA_USEC_PER_SEC +
+				    (uint64_t) buf.timestamp.tv_usec;
+		pts = get_monotonic_time(port, &buf, port->last_ticks * 1000);
 		port->last_monotonic = pts;
-	else
-		port->last_monotonic = SPA_TIME_INVALID;
-
-	b = &port->buffers[buf.index];
-	if (b->h) {
-		b->h->flags = 0;
-		if (buf.flags & V4L2_BUF_FLAG_ERROR)
-			b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
-		b->h->seq = buf.sequence;
-		b->h->pts = pts;
+
+		if (b->h) {
+			b->h->flags = 0;
+			if (buf.flags & V4L2_BUF_FLAG_ERROR)
+				b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+			b->h->seq = buf.sequence;
+			b->h->pts = pts;
+		}
+
+		buffer_get_planes(port, &buf, planes);
+
+		d = b->outbuf->datas;
+		for (i = 0; i < port->n_planes && i < b->outbuf->n_datas; i++) {
+			d[i].chunk->offset = planes[i].data_offset;
+			d[i].chunk->size = planes[i].bytesused - planes[i].data_offset;
+			d[i].chunk->stride = port->plane_stride[i];
+		}
+
+		if (!port->latest_frame)
+			break;
 	}
+	if (b == NULL)
+		return res;
 
-	d = b->outbuf->datas;
-	d[0].chunk->offset = 0;
-	d[0].chunk->size = buf.bytesused;
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	/* the previous frame was not consumed yet, replace it */
+	if (io->status == SPA_STATUS_HAVE_BUFFER && io->buffer_id < port->n_buffers) {
+		port->n_dropped++;
+		spa_log_trace(port->log, "v4l2 %p: replace buffer %d, %d dropped", this,
+				io->buffer_id, port->n_dropped);
+		spa_v4l2_buffer_recycle(this, io->buffer_id);
+	}
 
-	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUTSTANDING);
 	io->buffer_id = b->outbuf->id;
 	io->status = SPA_STATUS_HAVE_BUFFER;
 
@@ -1211,7 +1406,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
 	struct spa_data *d;
 
 	if (n_buffers > 0) {
@@ -1230,7 +1425,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1254,43 +1449,45 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 		spa_log_info(port->log, "v4l2: import buffer %p", buffers[i]);
 
-		if (buffers[i]->n_datas < 1) {
-			spa_log_error(port->log, "v4l2: invalid memory on buffer %p", buffers[i]);
+		if (buffers[i]->n_datas < port->n_planes) {
+			spa_log_error(port->log, "v4l2: buffer %p has %d datas, %d planes needed",
+					buffers[i], buffers[i]->n_datas, port->n_planes);
 			return -EINVAL;
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init(port, b, i);
 
-		if (port->memtype == V4L2_MEMORY_USERPTR) {
-			if (d[0].data == NULL) {
-				void *data;
+		for (j = 0; j < port->n_planes; j++) {
+			if (port->memtype == V4L2_MEMORY_USERPTR) {
+				if (d[j].data == NULL) {
+					void *data;
 
-				data = mmap(NULL,
-					    d[0].maxsize + d[0].mapoffset,
-					    PROT_READ | PROT_WRITE, MAP_SHARED,
-					    d[0].fd,
-					    0);
-				if (data == MAP_FAILED)
-					return -errno;
+					data = mmap(NULL,
+						    d[j].maxsize + d[j].mapoffset,
+						    PROT_READ | PROT_WRITE, MAP_SHARED,
+						    d[j].fd,
+						    0);
+					if (data == MAP_FAILED)
+						return -errno;
 
-				b->ptr = SPA_MEMBER(data, d[0].mapoffset, void);
-				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+					b->ptr[j] = SPA_MEMBER(data, d[j].mapoffset, void);
+					SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+					b->planes[j].m.userptr = (unsigned long) b->ptr[j];
+				}
+				else
+					b->planes[j].m.userptr = (unsigned long) d[j].data;
+
+				b->planes[j].length = d[j].maxsize;
+			}
+			else if (port->memtype == V4L2_MEMORY_DMABUF) {
+				b->planes[j].m.fd = d[j].fd;
+				b->planes[j].length = d[j].maxsize;
 			}
 			else
-				b->ptr = d[0].data;
-
-			b->v4l2_buffer.m.userptr = (unsigned long) b->ptr;
-			b->v4l2_buffer.length = d[0].maxsize;
-		}
-		else if (port->memtype == V4L2_MEMORY_DMABUF) {
-			b->v4l2_buffer.m.fd = d[0].fd;
+				return -EIO;
 		}
-		else
-			return -EIO;
+		buffer_set_planes(port, &b->v4l2_buffer, b->planes);
 
 		spa_v4l2_buffer_recycle(this, buffers[i]->id);
 	}
@@ -1308,12 +1505,12 @@ mmap_init(struct impl *this,
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
 
 	port->memtype = V4L2_MEMORY_MMAP;
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = *n_buffers;
 
@@ -1336,7 +1533,7 @@ mmap_init(struct impl *this,
 		struct buffer *b;
 		struct spa_data *d;
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < port->n_planes) {
 			spa_log_error(port->log, "v4l2: invalid buffer data");
 			return -EINVAL;
 		}
@@ -1346,52 +1543,61 @@ mmap_init(struct impl *this,
 		b->flags = BUFFER_FLAG_OUTSTANDING;
 		b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init(port, b, i);
 
 		if (xioctl(port->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			spa_log_error(port->log, "VIDIOC_QUERYBUF: %m");
 			return -errno;
 		}
+		buffer_get_planes(port, &b->v4l2_buffer, b->planes);
 
 		d = buffers[i]->datas;
-		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
-		d[0].chunk->offset = 0;
-		d[0].chunk->size = 0;
-		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
-
-		if (port->export_buf) {
-			struct v4l2_exportbuffer expbuf;
-
-			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			expbuf.index = i;
-			expbuf.flags = O_CLOEXEC | O_RDONLY;
-			if (xioctl(port->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-				spa_log_error(port->log, "VIDIOC_EXPBUF: %m");
-				continue;
-			}
-			d[0].type = this->type.data.DmaBuf;
-			d[0].fd = expbuf.fd;
-			d[0].data = NULL;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
-		} else {
-			d[0].type = this->type.data.MemPtr;
-			d[0].fd = -1;
-			d[0].data = mmap(NULL,
-					 b->v4l2_buffer.length,
-					 PROT_READ, MAP_SHARED,
-					 port->fd,
-					 b->v4l2_buffer.m.offset);
-			if (d[0].data == MAP_FAILED) {
-				spa_log_error(port->log, "mmap: %m");
-				continue;
+		for (j = 0; j < port->n_planes; j++) {
+			d[j].mapoffset = 0;
+			d[j].maxsize = b->planes[j].length;
+			d[j].chunk->offset = 0;
+			d[j].chunk->size = 0;
+			d[j].chunk->stride = port->plane_stride[j];
+
+			if (port->export_buf) {
+				struct v4l2_exportbuffer expbuf;
+
+				spa_zero(expbuf);
+				expbuf.type = port->type;
+				expbuf.index = i;
+				expbuf.plane = j;
+				expbuf.flags = O_CLOEXEC | O_RDONLY;
+				if (xioctl(port->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+					spa_log_error(port->log, "VIDIOC_EXPBUF: %m");
+					break;
+				}
+				d[j].type = this->type.data.DmaBuf;
+				d[j].fd = expbuf.fd;
+				d[j].data = NULL;
+				SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
+			} else {
+				d[j].type = this->type.data.MemPtr;
+				d[j].fd = -1;
+				d[j].data = mmap(NULL,
+						 b->planes[j].length,
+						 PROT_READ, MAP_SHARED,
+						 port->fd,
+						 b->planes[j].m.mem_offset);
+				if (d[j].data == MAP_FAILED) {
+					spa_log_error(port->log, "mmap: %m");
+					d[j].data = NULL;
+					break;
+				}
+				b->ptr[j] = d[j].data;
+				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
 			}
-			b->ptr = d[0].data;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+		}
+		if (j < port->n_planes) {
+			/* skip the whole buffer, the planes that are set up are
+			 * released when the buffers are cleared */
+			for (; j < port->n_planes; j++)
+				d[j].fd = -1;
+			continue;
 		}
 		spa_v4l2_buffer_recycle(this, i);
 	}
@@ -1449,12 +1655,15 @@ static int spa_v4l2_stream_on(struct impl *this)
 
 	spa_log_debug(this->log, "starting");
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(port->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMON: %m");
 		return -errno;
 	}
 
+	port->have_ts_offset = false;
+	port->n_dropped = 0;
+
 	spa_loop_add_source(port->data_loop, &port->source);
 
 	port->started = true;
@@ -1490,7 +1699,7 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_loop_invoke(port->data_loop, do_remove_source, 0, NULL, 0, true, port);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(port->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMOFF: %m");
 		return -errno;
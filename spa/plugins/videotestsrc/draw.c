@@ -71,9 +71,13 @@ typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
 
 struct _DrawingData {
 	char *line;
+	char *u_line;
+	char *v_line;
+	int y;
 	int width;
 	int height;
 	int stride;
+	int uv_stride;
 	DrawPixelFunc draw_pixel;
 };
 
@@ -130,6 +134,16 @@ static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
 	}
 }
 
+static void draw_pixel_i420(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[x] = color->Y;
+	/* chroma is subsampled 2x2, take the top-left pixel */
+	if (!(x & 1) && !(dd->y & 1)) {
+		dd->u_line[x >> 1] = color->U;
+		dd->v_line[x >> 1] = color->V;
+	}
+}
+
 static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
 {
 	struct spa_video_info *format = &this->current_format;
@@ -143,13 +157,19 @@ static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
 		dd->draw_pixel = draw_pixel_rgb;
 	} else if (format->info.raw.format == this->type.video_format.UYVY) {
 		dd->draw_pixel = draw_pixel_uyvy;
+	} else if (format->info.raw.format == this->type.video_format.I420) {
+		dd->draw_pixel = draw_pixel_i420;
 	} else
 		return -ENOTSUP;
 
 	dd->line = data;
+	dd->y = 0;
 	dd->width = size->width;
 	dd->height = size->height;
 	dd->stride = this->stride;
+	dd->uv_stride = this->uv_stride;
+	dd->u_line = data + this->u_offset;
+	dd->v_line = data + this->v_offset;
 
 	return 0;
 }
@@ -166,6 +186,10 @@ static inline void draw_pixels(DrawingData * dd, int offset, Color color, int le
 static inline void next_line(DrawingData * dd)
 {
 	dd->line += dd->stride;
+	if (dd->y++ & 1) {
+		dd->u_line += dd->uv_stride;
+		dd->v_line += dd->uv_stride;
+	}
 }
 
 static void draw_smpte_snow(DrawingData * dd)
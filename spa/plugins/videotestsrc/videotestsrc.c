@@ -140,6 +140,10 @@ struct impl {
 	struct spa_video_info current_format;
 	size_t bpp;
 	int stride;
+	int uv_stride;		/**< stride of the chroma planes of planar formats */
+	int u_offset;
+	int v_offset;
+	int size;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -508,8 +512,9 @@ static int port_enum_formats(struct spa_node *node,
 			"I", t->media_type.video,
 			"I", t->media_subtype.raw,
 			":", t->format_video.format,    "Ieu", t->video_format.RGB,
-				SPA_POD_PROP_ENUM(2, t->video_format.RGB,
-						     t->video_format.UYVY),
+				SPA_POD_PROP_ENUM(3, t->video_format.RGB,
+						     t->video_format.UYVY,
+						     t->video_format.I420),
 			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
 				SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(1, 1),
 						     &SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
@@ -597,8 +602,6 @@ impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-
 		if (!this->have_format)
 			return -EIO;
 		if (*index > 0)
@@ -606,7 +609,7 @@ impl_node_port_enum_params(struct spa_node *node,
 
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", this->stride * raw_info->size.height,
+			":", t->param_buffers.size,    "i", this->size,
 			":", t->param_buffers.stride,  "i", this->stride,
 			":", t->param_buffers.buffers, "ir", 2,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
@@ -679,6 +682,8 @@ static int port_set_format(struct spa_node *node,
 			this->bpp = 3;
 		else if (info.info.raw.format == this->type.video_format.UYVY)
 			this->bpp = 2;
+		else if (info.info.raw.format == this->type.video_format.I420)
+			this->bpp = 1;
 		else
 			return -EINVAL;
 
@@ -689,6 +694,17 @@ static int port_set_format(struct spa_node *node,
 	if (this->have_format) {
 		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
 		this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
+		this->size = this->stride * raw_info->size.height;
+
+		if (raw_info->format == this->type.video_format.I420) {
+			/* same layout as GStreamer, chroma planes follow the luma plane */
+			int height = SPA_ROUND_UP_N(raw_info->size.height, 2);
+
+			this->uv_stride = SPA_ROUND_UP_N(this->stride / 2, 4);
+			this->u_offset = this->stride * height;
+			this->v_offset = this->u_offset + this->uv_stride * (height / 2);
+			this->size = this->v_offset + this->uv_stride * (height / 2);
+		}
 	}
 
 	return 0;
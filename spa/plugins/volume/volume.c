@@ -68,6 +68,8 @@ struct port {
 	uint32_t n_buffers;
 	struct spa_io_buffers *io;
 	struct spa_io_control_range *range;
+	double *io_volume;
+	struct spa_io_control_sequence *io_volume_seq;
 
 	struct spa_list empty;
 };
@@ -78,6 +80,8 @@ struct type {
 	uint32_t props;
 	uint32_t prop_volume;
 	uint32_t prop_mute;
+	uint32_t io_prop_volume;
+	uint32_t io_prop_volume_seq;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -100,6 +104,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->prop_volume = spa_type_map_get_id(map, SPA_TYPE_PROPS__volume);
 	type->prop_mute = spa_type_map_get_id(map, SPA_TYPE_PROPS__mute);
+	type->io_prop_volume = spa_type_map_get_id(map, SPA_TYPE_IO_PROP_BASE "volume");
+	type->io_prop_volume_seq = spa_type_map_get_id(map, SPA_TYPE_IO_PROP_SEQUENCE_BASE "volume");
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_meta_map(map, &type->meta);
@@ -453,7 +459,8 @@ impl_node_port_enum_params(struct spa_node *node,
 				    t->param.idBuffers,
 				    t->param.idMeta,
 				    t->param_io.idBuffers,
-				    t->param_io.idControl };
+				    t->param_io.idControl,
+				    t->param_io.idPropsIn };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -482,7 +489,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "iru", 2,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.align,   "i", 16,
+			":", t->param_buffers.mirrored, "iru", 1,
+				SPA_POD_PROP_MIN_MAX(0, 1));
 	}
 	else if (id == t->param.idMeta) {
 		switch (*index) {
@@ -520,6 +529,36 @@ impl_node_port_enum_params(struct spa_node *node,
 			return 0;
 		}
 	}
+	else if (id == t->param_io.idPropsIn) {
+		struct props *p = &this->props;
+
+		if (direction == SPA_DIRECTION_OUTPUT)
+			return 0;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_io.Prop,
+				":", t->param_io.id,    "I", t->io_prop_volume,
+				":", t->param_io.size,  "i", sizeof(struct spa_pod_double),
+				":", t->param.propId,   "I", t->prop_volume,
+				":", t->param.propType, "dru", p->volume,
+					SPA_POD_PROP_MIN_MAX(0.0, 10.0));
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param_io.PropSequence,
+				":", t->param_io.id,    "I", t->io_prop_volume_seq,
+				":", t->param_io.size,  "i", SPA_IO_CONTROL_SEQUENCE_SIZE(
+								SPA_IO_CONTROL_SEQUENCE_EVENTS),
+				":", t->param.propId,   "I", t->prop_volume,
+				":", t->param.propType, "dru", p->volume,
+					SPA_POD_PROP_MIN_MAX(0.0, 10.0));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -686,6 +725,16 @@ impl_node_port_set_io(struct spa_node *node,
 		port->io = data;
 	else if (id == t->io.ControlRange)
 		port->range = data;
+	else if (id == t->io_prop_volume && direction == SPA_DIRECTION_INPUT)
+		if (data && size >= sizeof(struct spa_pod_double))
+			port->io_volume = &SPA_POD_VALUE(struct spa_pod_double, data);
+		else
+			port->io_volume = &this->props.volume;
+	else if (id == t->io_prop_volume_seq && direction == SPA_DIRECTION_INPUT)
+		if (data && spa_io_control_sequence_is_valid(data, size))
+			port->io_volume_seq = data;
+		else
+			port->io_volume_seq = NULL;
 	else
 		return -ENOENT;
 
@@ -738,7 +787,7 @@ impl_node_port_send_command(struct spa_node *node,
 	return -ENOTSUP;
 }
 
-static struct spa_buffer *find_free_buffer(struct impl *this, struct port *port)
+static struct buffer *find_free_buffer(struct impl *this, struct port *port)
 {
 	struct buffer *b;
 
@@ -749,10 +798,29 @@ static struct spa_buffer *find_free_buffer(struct impl *this, struct port *port)
 	spa_list_remove(&b->link);
 	b->outstanding = true;
 
-	return b->outbuf;
+	return b;
+}
+
+/* apply the volume events up to byte position @pos in the cycle and return
+ * the number of bytes, at most @len, that can be processed before the next event */
+static inline uint32_t
+apply_sequence(struct impl *this, struct spa_io_control_sequence *seq, uint64_t pos, uint32_t len)
+{
+	struct spa_io_control_event *ev;
+
+	while ((ev = spa_io_control_sequence_peek(seq)) != NULL) {
+		uint64_t ev_pos = (uint64_t) ev->offset * this->bpf;
+
+		if (ev_pos > pos)
+			return SPA_MIN(len, ev_pos - pos);
+
+		this->props.volume = ev->value;
+		spa_io_control_sequence_advance(seq);
+	}
+	return len;
 }
 
-static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf)
+static void do_volume(struct impl *this, struct buffer *dbuf, struct buffer *sbuf)
 {
 	uint32_t i, n_samples, n_bytes;
 	struct spa_data *sd, *dd;
@@ -760,11 +828,19 @@ static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buf
 	double volume;
 	uint32_t written, towrite, savail, davail;
 	uint32_t sindex, dindex;
+	struct port *in_port = GET_IN_PORT(this, 0);
+	struct spa_io_control_sequence *seq = in_port->io_volume_seq;
+	bool gap;
+
+	volume = *in_port->io_volume;
 
-	volume = this->props.volume;
+	sd = sbuf->outbuf->datas;
+	dd = dbuf->outbuf->datas;
 
-	sd = sbuf->datas;
-	dd = dbuf->datas;
+	/* silent input or volume, only write silence */
+	gap = this->props.mute ||
+	      (seq == NULL && volume < 0.001) ||
+	      (sbuf->h && (sbuf->h->flags & SPA_META_HEADER_FLAG_GAP));
 
 	savail = SPA_MIN(sd[0].chunk->size, sd[0].maxsize);
 	sindex = sd[0].chunk->offset;
@@ -782,20 +858,44 @@ static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buf
 		src = SPA_MEMBER(sd[0].data, soffset, int16_t);
 		dst = SPA_MEMBER(dd[0].data, doffset, int16_t);
 
-		n_bytes = SPA_MIN(towrite, sd[0].maxsize - soffset);
-		n_bytes = SPA_MIN(n_bytes, dd[0].maxsize - doffset);
+		/* mirrored data can be accessed past maxsize without wrapping */
+		n_bytes = towrite - written;
+		if (!(sd[0].flags & SPA_DATA_FLAG_MIRRORED))
+			n_bytes = SPA_MIN(n_bytes, sd[0].maxsize - soffset);
+		if (!(dd[0].flags & SPA_DATA_FLAG_MIRRORED))
+			n_bytes = SPA_MIN(n_bytes, dd[0].maxsize - doffset);
+
+		if (seq) {
+			n_bytes = apply_sequence(this, seq, written, n_bytes);
+			volume = this->props.volume;
+		}
 
 		n_samples = n_bytes / sizeof(int16_t);
-		for (i = 0; i < n_samples; i++)
-			dst[i] = src[i] * volume;
+		if (gap)
+			memset(dst, 0, n_samples * sizeof(int16_t));
+		else
+			for (i = 0; i < n_samples; i++)
+				dst[i] = src[i] * volume;
 
 		sindex += n_bytes;
 		dindex += n_bytes;
 		written += n_bytes;
 	}
+	/* events past the end of the cycle are applied at the end, the event
+	 * offsets in bytes can be larger than 32 bits */
+	if (seq)
+		apply_sequence(this, seq, UINT64_MAX, 0);
+
 	dd[0].chunk->offset = 0;
 	dd[0].chunk->size = written;
 	dd[0].chunk->stride = 0;
+
+	if (dbuf->h) {
+		if (gap)
+			dbuf->h->flags |= SPA_META_HEADER_FLAG_GAP;
+		else
+			dbuf->h->flags &= ~SPA_META_HEADER_FLAG_GAP;
+	}
 }
 
 static int impl_node_process_input(struct spa_node *node)
@@ -803,7 +903,7 @@ static int impl_node_process_input(struct spa_node *node)
 	struct impl *this;
 	struct spa_io_buffers *input, *output;
 	struct port *in_port, *out_port;
-	struct spa_buffer *dbuf, *sbuf;
+	struct buffer *dbuf, *sbuf;
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
 
@@ -830,14 +930,15 @@ static int impl_node_process_input(struct spa_node *node)
 		return -EPIPE;
 	}
 
-	sbuf = in_port->buffers[input->buffer_id].outbuf;
+	sbuf = &in_port->buffers[input->buffer_id];
 
 	input->status = SPA_STATUS_OK;
 
-	spa_log_trace(this->log, NAME " %p: do volume %d -> %d", this, sbuf->id, dbuf->id);
+	spa_log_trace(this->log, NAME " %p: do volume %d -> %d", this,
+		      sbuf->outbuf->id, dbuf->outbuf->id);
 	do_volume(this, dbuf, sbuf);
 
-	output->buffer_id = dbuf->id;
+	output->buffer_id = dbuf->outbuf->id;
 	output->status = SPA_STATUS_HAVE_BUFFER;
 
 	return SPA_STATUS_HAVE_BUFFER;
@@ -957,6 +1058,7 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
 	    SPA_PORT_INFO_FLAG_IN_PLACE;
+	this->in_ports[0].io_volume = &this->props.volume;
 	spa_list_init(&this->in_ports[0].empty);
 
 	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
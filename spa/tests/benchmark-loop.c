@@ -0,0 +1,298 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the cost of many timers, events and io sources on one loop.
+ *
+ *   benchmark-loop [n-timers] [seconds] [epoll|io_uring]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <error.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/type-map.h>
+#include <spa/support/loop.h>
+
+#define N_EVENTS	1000
+#define N_IO		1000
+#define IO_ROUNDS	1000
+#define IO_ACTIVE	64
+
+struct timer {
+	struct data *data;
+	struct spa_source *source;
+	uint64_t expected;
+	uint64_t interval;
+};
+
+struct data {
+	struct spa_type_map *map;
+	struct spa_support support[1];
+	uint32_t n_support;
+
+	struct spa_loop_control *control;
+	struct spa_loop_utils *utils;
+
+	struct timer *timers;
+	int n_timers;
+
+	uint64_t dispatched;
+	uint64_t latency_total;
+	uint64_t latency_max;
+	uint64_t events;
+	uint64_t io;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static int count_fds(void)
+{
+	DIR *dir;
+	int n = 0;
+
+	if ((dir = opendir("/proc/self/fd")) == NULL)
+		return -1;
+	while (readdir(dir) != NULL)
+		n++;
+	closedir(dir);
+	return n - 3;
+}
+
+static int get_handle(struct data *data, struct spa_handle **handle,
+		      const char *lib, const char *name, const struct spa_dict *info)
+{
+	int res;
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -errno;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+
+		if ((res = enum_func(&factory, &i)) <= 0)
+			break;
+		if (strcmp(factory->name, name))
+			continue;
+
+		*handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, *handle, info,
+						   data->support, data->n_support)) < 0) {
+			free(*handle);
+			return res;
+		}
+		return 0;
+	}
+	return -ENOENT;
+}
+
+static void on_timer(void *data, uint64_t expirations)
+{
+	struct timer *t = data;
+	struct data *d = t->data;
+	uint64_t now = get_time(), latency;
+
+	latency = now > t->expected ? now - t->expected : 0;
+	d->latency_total += latency;
+	d->latency_max = SPA_MAX(d->latency_max, latency);
+	d->dispatched += expirations;
+	t->expected += expirations * t->interval;
+}
+
+static void on_event(void *data, uint64_t count)
+{
+	struct data *d = data;
+	d->events += count;
+}
+
+static void on_io(void *data, int fd, enum spa_io mask)
+{
+	struct data *d = data;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(uint64_t)) == sizeof(uint64_t))
+		d->io += count;
+}
+
+static void report(const char *name, uint64_t t1, uint64_t t2, uint64_t n_ops)
+{
+	printf("%-16s %10.3f msec %8.1f nsec/op\n", name,
+	       (t2 - t1) / 1000000.0, (t2 - t1) / (double) n_ops);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct spa_handle *handle;
+	struct spa_source *events[N_EVENTS], *io[N_IO];
+	struct timespec value, interval;
+	struct spa_dict_item items[1];
+	uint64_t t1, t2, start, end, count = 1;
+	int res, i, j, fds, seconds = 5;
+	const char *backend;
+	void *iface;
+
+	data.n_timers = argc > 1 ? atoi(argv[1]) : 10000;
+	seconds = argc > 2 ? atoi(argv[2]) : 5;
+	backend = argc > 3 ? argv[3] : "epoll";
+	items[0] = SPA_DICT_ITEM_INIT("loop.backend", backend);
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so", "mapper", NULL)) < 0)
+		error(-1, -res, "can't create mapper");
+	if ((res = spa_handle_get_interface(handle, 0, &iface)) < 0)
+		error(-1, -res, "can't get mapper interface");
+
+	data.map = iface;
+	data.support[0].type = SPA_TYPE__TypeMap;
+	data.support[0].data = data.map;
+	data.n_support = 1;
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so", "loop",
+			     &SPA_DICT_INIT(items, 1))) < 0)
+		error(-1, -res, "can't create loop");
+	if ((res = spa_handle_get_interface(handle,
+				spa_type_map_get_id(data.map, SPA_TYPE__LoopControl), &iface)) < 0)
+		error(-1, -res, "can't get loop control interface");
+	data.control = iface;
+	if ((res = spa_handle_get_interface(handle,
+				spa_type_map_get_id(data.map, SPA_TYPE__LoopUtils), &iface)) < 0)
+		error(-1, -res, "can't get loop utils interface");
+	data.utils = iface;
+
+	spa_loop_control_enter(data.control);
+	printf("backend %s\n", backend);
+
+	fds = count_fds();
+	data.timers = calloc(data.n_timers, sizeof(struct timer));
+
+	t1 = get_time();
+	for (i = 0; i < data.n_timers; i++) {
+		data.timers[i].data = &data;
+		data.timers[i].source = spa_loop_utils_add_timer(data.utils, on_timer, &data.timers[i]);
+		if (data.timers[i].source == NULL)
+			error(-1, errno, "can't add timer %d", i);
+	}
+	t2 = get_time();
+	report("add timer", t1, t2, data.n_timers);
+	printf("%d timers use %d fds\n", data.n_timers, count_fds() - fds);
+
+	/* periods between 10 and 1000 msec, spread over the first period */
+	t1 = get_time();
+	for (i = 0; i < data.n_timers; i++) {
+		struct timer *t = &data.timers[i];
+
+		t->interval = (10 + (i * 7919) % 991) * SPA_NSEC_PER_MSEC;
+		t->expected = t1 + (i * 104729) % t->interval + SPA_NSEC_PER_MSEC;
+		value.tv_sec = t->expected / SPA_NSEC_PER_SEC;
+		value.tv_nsec = t->expected % SPA_NSEC_PER_SEC;
+		interval.tv_sec = t->interval / SPA_NSEC_PER_SEC;
+		interval.tv_nsec = t->interval % SPA_NSEC_PER_SEC;
+		spa_loop_utils_update_timer(data.utils, t->source, &value, &interval, true);
+	}
+	t2 = get_time();
+	report("update timer", t1, t2, data.n_timers);
+
+	start = get_time();
+	end = start + seconds * SPA_NSEC_PER_SEC;
+	while (get_time() < end)
+		spa_loop_control_iterate(data.control, 100);
+	end = get_time();
+
+	printf("%"PRIu64" expirations in %d sec, %.0f/sec, cpu %.1f nsec/expiration\n",
+	       data.dispatched, seconds, data.dispatched * (double) SPA_NSEC_PER_SEC / (end - start),
+	       (double) clock() / CLOCKS_PER_SEC * SPA_NSEC_PER_SEC / SPA_MAX(data.dispatched, 1u));
+	printf("latency avg %.1f max %.1f usec\n",
+	       data.dispatched ? data.latency_total / (double) data.dispatched / 1000.0 : 0.0,
+	       data.latency_max / 1000.0);
+
+	t1 = get_time();
+	for (i = 0; i < data.n_timers; i++)
+		spa_loop_utils_destroy_source(data.utils, data.timers[i].source);
+	t2 = get_time();
+	report("destroy timer", t1, t2, data.n_timers);
+
+	fds = count_fds();
+	for (i = 0; i < N_EVENTS; i++)
+		events[i] = spa_loop_utils_add_event(data.utils, on_event, &data);
+	printf("%d events use %d fds\n", N_EVENTS, count_fds() - fds);
+
+	t1 = get_time();
+	for (i = 0; i < N_EVENTS * 100; i++)
+		spa_loop_utils_signal_event(data.utils, events[i % N_EVENTS]);
+	t2 = get_time();
+	report("signal event", t1, t2, N_EVENTS * 100);
+
+	t1 = get_time();
+	while (data.events < N_EVENTS * 100)
+		spa_loop_control_iterate(data.control, 0);
+	t2 = get_time();
+	report("dispatch events", t1, t2, N_EVENTS * 100);
+
+	for (i = 0; i < N_EVENTS; i++)
+		spa_loop_utils_destroy_source(data.utils, events[i]);
+
+	/* many idle fds with a few active ones, like clients of the daemon */
+	for (i = 0; i < N_IO; i++)
+		io[i] = spa_loop_utils_add_io(data.utils, eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK),
+					      SPA_IO_IN, true, on_io, &data);
+
+	t1 = get_time();
+	for (i = 0; i < IO_ROUNDS; i++) {
+		for (j = 0; j < IO_ACTIVE; j++) {
+			if (write(io[(i * 7 + j * 13) % N_IO]->fd, &count, sizeof(uint64_t)) < 0)
+				error(-1, errno, "write");
+		}
+		while (data.io < (uint64_t) (i + 1) * IO_ACTIVE)
+			spa_loop_control_iterate(data.control, -1);
+	}
+	t2 = get_time();
+	report("io wakeup", t1, t2, IO_ROUNDS * IO_ACTIVE);
+
+	for (i = 0; i < N_IO; i++)
+		spa_loop_utils_destroy_source(data.utils, io[i]);
+
+	spa_loop_control_leave(data.control);
+
+	free(data.timers);
+
+	return 0;
+}
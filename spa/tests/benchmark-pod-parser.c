@@ -0,0 +1,171 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/support/type-map-impl.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/param/param.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/video/format-utils.h>
+
+#define N_ITERATIONS	1000000
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+
+struct type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static int parse_audio_varargs(const struct spa_pod *format,
+			       struct spa_audio_info_raw *info, struct spa_type_format_audio *type)
+{
+	return spa_pod_object_parse(format,
+		":",type->format,	"I", &info->format,
+		":",type->rate,		"i", &info->rate,
+		":",type->channels,	"i", &info->channels,
+		":",type->flags,	"?i", &info->flags,
+		":",type->layout,	"?i", &info->layout,
+		":",type->channel_mask,	"?i", &info->channel_mask, NULL);
+}
+
+static int parse_video_varargs(const struct spa_pod *format,
+			       struct spa_video_info_raw *info, struct spa_type_format_video *type)
+{
+	return spa_pod_object_parse(format,
+		":",type->format,		"I", &info->format,
+		":",type->size,			"R", &info->size,
+		":",type->framerate,		"F", &info->framerate,
+		":",type->max_framerate,	"?F", &info->max_framerate,
+		":",type->views,		"?i", &info->views,
+		":",type->interlace_mode,	"?i", &info->interlace_mode,
+		":",type->pixel_aspect_ratio,	"?F", &info->pixel_aspect_ratio,
+		":",type->multiview_mode,	"?i", &info->multiview_mode,
+		":",type->multiview_flags,	"?i", &info->multiview_flags,
+		":",type->chroma_site,		"?i", &info->chroma_site,
+		":",type->color_range,		"?i", &info->color_range,
+		":",type->color_matrix,		"?i", &info->color_matrix,
+		":",type->transfer_function,	"?i", &info->transfer_function,
+		":",type->color_primaries,	"?i", &info->color_primaries, NULL);
+}
+
+static void report(const char *name, uint64_t t1, uint64_t t2)
+{
+	printf("%-24s %8.1f nsec/parse\n", name, (t2 - t1) / (double) N_ITERATIONS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct spa_type_map *map = &default_map.map;
+	struct type t = { 0 };
+	uint8_t abuffer[1024], vbuffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod *audio, *video;
+	struct spa_audio_info_raw ainfo1 = { 0 }, ainfo2 = { 0 };
+	struct spa_video_info_raw vinfo1 = { 0 }, vinfo2 = { 0 };
+	uint64_t t1, t2;
+	int i, res = 0;
+
+	init_type(&t, map);
+
+	spa_pod_builder_init(&b, abuffer, sizeof(abuffer));
+	audio = spa_pod_builder_object(&b,
+		0, t.format,
+		"I", t.media_type.audio,
+		"I", t.media_subtype.raw,
+		":", t.format_audio.format,   "I", t.audio_format.S16,
+		":", t.format_audio.layout,   "i", SPA_AUDIO_LAYOUT_INTERLEAVED,
+		":", t.format_audio.rate,     "i", 44100,
+		":", t.format_audio.channels, "i", 2);
+
+	spa_pod_builder_init(&b, vbuffer, sizeof(vbuffer));
+	video = spa_pod_builder_object(&b,
+		0, t.format,
+		"I", t.media_type.video,
+		"I", t.media_subtype.raw,
+		":", t.format_video.format,    "I", t.video_format.I420,
+		":", t.format_video.size,      "R", &SPA_RECTANGLE(320, 240),
+		":", t.format_video.framerate, "F", &SPA_FRACTION(25, 1),
+		":", t.format_video.pixel_aspect_ratio, "F", &SPA_FRACTION(1, 1),
+		":", t.format_video.interlace_mode, "i", 0,
+		":", t.format_video.color_range, "i", 1);
+
+	t1 = get_time();
+	for (i = 0; i < N_ITERATIONS; i++)
+		res |= parse_audio_varargs(audio, &ainfo1, &t.format_audio);
+	t2 = get_time();
+	report("audio varargs", t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < N_ITERATIONS; i++)
+		res |= spa_format_audio_raw_parse(audio, &ainfo2, &t.format_audio);
+	t2 = get_time();
+	report("audio fields", t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < N_ITERATIONS; i++)
+		res |= parse_video_varargs(video, &vinfo1, &t.format_video);
+	t2 = get_time();
+	report("video varargs", t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < N_ITERATIONS; i++)
+		res |= spa_format_video_raw_parse(video, &vinfo2, &t.format_video);
+	t2 = get_time();
+	report("video fields", t1, t2);
+
+	if (res < 0) {
+		printf("parse error %d\n", res);
+		return -1;
+	}
+	if (memcmp(&ainfo1, &ainfo2, sizeof(ainfo1)) != 0 ||
+	    memcmp(&vinfo1, &vinfo2, sizeof(vinfo1)) != 0) {
+		printf("parsers give different results\n");
+		return -1;
+	}
+	return 0;
+}
@@ -2,112 +2,280 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sched.h>
+#include <time.h>
 
 #include <spa/utils/ringbuffer.h>
 
-#define ARRAY_SIZE 64
+#define ARRAY_SIZE 60
 #define MAX_VALUE 0x10000
+#define MAX_WRITERS 4
+#define MAX_BATCH 16
+
+/* a power of 2 in size so that the batched writes never split a chunk */
+struct chunk {
+	uint64_t time;
+	uint32_t writer;
+	uint32_t pad;
+	int values[ARRAY_SIZE];
+};
+
+#define CHUNK_SIZE sizeof(struct chunk)
+
+enum variant {
+	VARIANT_PLAIN,
+	VARIANT_PADDED,
+	VARIANT_BATCH,
+	VARIANT_MPSC,
+	VARIANT_LAST,
+};
+
+static const char *variant_names[] = { "plain", "padded", "batch", "mpsc" };
+
+struct stats {
+	uint64_t chunks;
+	uint64_t failures;
+	uint64_t latency_total;
+	uint64_t latency_max;
+};
 
 struct spa_ringbuffer rb;
+struct spa_ringbuffer_padded prb;
+struct spa_ringbuffer_mpsc mrb;
 uint32_t size;
 uint8_t *data;
+enum variant variant;
+int running;
 
-static int fill_int_array(int *array, int start, int count)
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static int fill_chunk(struct chunk *c, uint32_t writer, int start)
 {
 	int i, j = start;
-	for (i = 0; i < count; i++) {
-		array[i] = j;
+
+	c->writer = writer;
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		c->values[i] = j;
 		j = (j + 1) % MAX_VALUE;
 	}
 	return j;
 }
 
-static int cmp_array(int *array1, int *array2, int count)
+static int check_chunk(struct chunk *c, int start)
 {
-	int i;
-	for (i = 0; i < count; i++)
-		if (array1[i] != array2[i]) {
-			printf("%d != %d at offset %d\n", array1[i], array2[i], i);
-			return 0;
+	int i, j = start;
+
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		if (c->values[i] != j) {
+			printf("%d != %d at offset %d\n", c->values[i], j, i);
+			return -1;
 		}
+		j = (j + 1) % MAX_VALUE;
+	}
+	return j;
+}
+
+static uint32_t read_chunks(struct chunk *c, uint32_t max)
+{
+	uint32_t index, n = 0;
+	int32_t avail;
 
-	return 1;
+	switch (variant) {
+	case VARIANT_PLAIN:
+		if (spa_ringbuffer_get_read_index(&rb, &index) >= CHUNK_SIZE) {
+			spa_ringbuffer_read_data(&rb, data, size, index & (size - 1), c, CHUNK_SIZE);
+			spa_ringbuffer_read_update(&rb, index + CHUNK_SIZE);
+			n = 1;
+		}
+		break;
+	case VARIANT_PADDED:
+		if (spa_ringbuffer_padded_get_read_index(&prb, &index, CHUNK_SIZE) >= CHUNK_SIZE) {
+			spa_ringbuffer_read_data(NULL, data, size, index & (size - 1), c, CHUNK_SIZE);
+			spa_ringbuffer_padded_read_update(&prb, index + CHUNK_SIZE);
+			n = 1;
+		}
+		break;
+	case VARIANT_BATCH:
+		n = spa_ringbuffer_padded_read(&prb, data, size, c, max * CHUNK_SIZE) / CHUNK_SIZE;
+		break;
+	case VARIANT_MPSC:
+		while (n < max &&
+		       (avail = spa_ringbuffer_mpsc_get_read_index(&mrb, data, size, &index)) >= 0) {
+			spa_ringbuffer_read_data(NULL, data, size, index & (size - 1), &c[n],
+						 CHUNK_SIZE);
+			spa_ringbuffer_mpsc_read_update(&mrb, data, size, index, avail);
+			n++;
+		}
+		break;
+	default:
+		break;
+	}
+	return n;
 }
 
-static void *reader_start(void *arg)
+static uint32_t write_chunks(struct chunk *c, uint32_t n)
 {
-	int i = 0, a[ARRAY_SIZE], b[ARRAY_SIZE];
-	unsigned long j = 0, nfailures = 0;
+	uint32_t index;
 
-	printf("reader started on cpu: %d\n", sched_getcpu());
+	switch (variant) {
+	case VARIANT_PLAIN:
+		if (size - spa_ringbuffer_get_write_index(&rb, &index) < CHUNK_SIZE)
+			return 0;
+		spa_ringbuffer_write_data(&rb, data, size, index & (size - 1), c, CHUNK_SIZE);
+		spa_ringbuffer_write_update(&rb, index + CHUNK_SIZE);
+		return 1;
+	case VARIANT_PADDED:
+		if (size - spa_ringbuffer_padded_get_write_index(&prb, &index,
+					size, CHUNK_SIZE) < CHUNK_SIZE)
+			return 0;
+		spa_ringbuffer_write_data(NULL, data, size, index & (size - 1), c, CHUNK_SIZE);
+		spa_ringbuffer_padded_write_update(&prb, index + CHUNK_SIZE);
+		return 1;
+	case VARIANT_BATCH:
+		return spa_ringbuffer_padded_write(&prb, data, size, c, n * CHUNK_SIZE) / CHUNK_SIZE;
+	case VARIANT_MPSC:
+		if (spa_ringbuffer_mpsc_reserve(&mrb, size, CHUNK_SIZE, &index) < 0)
+			return 0;
+		spa_ringbuffer_write_data(NULL, data, size, index & (size - 1), c, CHUNK_SIZE);
+		spa_ringbuffer_mpsc_commit(&mrb, data, size, index, CHUNK_SIZE);
+		return 1;
+	default:
+		return 0;
+	}
+}
 
-	i = fill_int_array(a, i, ARRAY_SIZE);
+static void *reader_start(void *arg)
+{
+	struct stats *s = arg;
+	struct chunk c[MAX_BATCH];
+	int expected[MAX_WRITERS] = { 0 };
+	uint32_t i, n;
 
-	while (1) {
-		uint32_t index;
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+		if ((n = read_chunks(c, MAX_BATCH)) == 0)
+			continue;
 
-		if (spa_ringbuffer_get_read_index(&rb, &index) >= ARRAY_SIZE * sizeof(int)) {
-			spa_ringbuffer_read_data(&rb, data, size, index & (size - 1), b,
-						 ARRAY_SIZE * sizeof(int));
+		for (i = 0; i < n; i++) {
+			uint64_t latency = get_time() - c[i].time;
+			uint32_t w = c[i].writer % MAX_WRITERS;
+			int next;
 
-			if (!cmp_array(a, b, ARRAY_SIZE)) {
-				nfailures++;
-				printf
-				    ("failure in chunk %lu - probability: %lu/%lu = %.3f per million\n",
-				     j, nfailures, j, (float) nfailures / (j + 1) * 1000000);
-				i = (b[0] + ARRAY_SIZE) % MAX_VALUE;
+			if ((next = check_chunk(&c[i], expected[w])) < 0) {
+				s->failures++;
+				next = (c[i].values[0] + ARRAY_SIZE) % MAX_VALUE;
 			}
-			i = fill_int_array(a, i, ARRAY_SIZE);
-			j++;
+			expected[w] = next;
 
-			spa_ringbuffer_read_update(&rb, index + ARRAY_SIZE * sizeof(int));
+			s->latency_total += latency;
+			s->latency_max = SPA_MAX(s->latency_max, latency);
 		}
+		s->chunks += n;
 	}
-
 	return NULL;
 }
 
 static void *writer_start(void *arg)
 {
-	int i = 0, a[ARRAY_SIZE];
-	printf("writer started on cpu: %d\n", sched_getcpu());
+	uint32_t writer = SPA_PTR_TO_UINT32(arg);
+	struct chunk c[MAX_BATCH];
+	uint32_t i, n, n_batch, done = 0;
+	int j = 0, k;
+
+	n_batch = variant == VARIANT_BATCH ? MAX_BATCH : 1;
 
-	i = fill_int_array(a, i, ARRAY_SIZE);
+	for (i = 0; i < n_batch; i++)
+		j = fill_chunk(&c[i], writer, j);
 
-	while (1) {
-		uint32_t index;
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+		for (i = done; i < n_batch; i++)
+			c[i].time = get_time();
 
-		if (spa_ringbuffer_get_write_index(&rb, &index) >= ARRAY_SIZE * sizeof(int)) {
-			spa_ringbuffer_write_data(&rb, data, size, index & (size - 1), a,
-						  ARRAY_SIZE * sizeof(int));
-			spa_ringbuffer_write_update(&rb, index + ARRAY_SIZE * sizeof(int));
+		if ((n = write_chunks(&c[done], n_batch - done)) == 0)
+			continue;
 
-			i = fill_int_array(a, i, ARRAY_SIZE);
+		done += n;
+		if (done == n_batch) {
+			for (i = 0, k = j; i < n_batch; i++)
+				k = fill_chunk(&c[i], writer, k);
+			j = k;
+			done = 0;
 		}
 	}
-
 	return NULL;
 }
 
+static void run_variant(enum variant v, int n_writers, int seconds)
+{
+	pthread_t reader_thread, writer_threads[MAX_WRITERS];
+	struct stats s = { 0 };
+	uint64_t start, elapsed;
+	int i;
+
+	variant = v;
+	spa_ringbuffer_init(&rb);
+	spa_ringbuffer_padded_init(&prb);
+	spa_ringbuffer_mpsc_init(&mrb);
+	/* the mpsc ringbuffer needs zeroed memory */
+	memset(data, 0, size);
+	__atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+
+	start = get_time();
+	pthread_create(&reader_thread, NULL, reader_start, &s);
+	for (i = 0; i < n_writers; i++)
+		pthread_create(&writer_threads[i], NULL, writer_start, SPA_UINT32_TO_PTR(i));
+
+	sleep(seconds);
+
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	for (i = 0; i < n_writers; i++)
+		pthread_join(writer_threads[i], NULL);
+	pthread_join(reader_thread, NULL);
+	elapsed = get_time() - start;
+
+	printf("%-8s %d writer(s): %10.0f chunks/s %8.1f MB/s latency avg %8.1f max %10.1f usec, %"
+	       PRIu64" failures\n",
+	       variant_names[v], n_writers,
+	       s.chunks * (double) SPA_NSEC_PER_SEC / elapsed,
+	       s.chunks * CHUNK_SIZE * 1000.0 / elapsed,
+	       s.chunks ? s.latency_total / (double) s.chunks / 1000.0 : 0.0,
+	       s.latency_max / 1000.0,
+	       s.failures);
+}
+
 int main(int argc, char *argv[])
 {
-	printf("starting ringbuffer stress test\n");
+	int seconds = 2, n_writers = 2;
+	enum variant v;
+
+	size = 1 << 16;
+	if (argc > 1)
+		sscanf(argv[1], "%u", &size);
+	if (argc > 2)
+		sscanf(argv[2], "%d", &seconds);
 
-	sscanf(argv[1], "%d", &size);
+	if (size < MAX_BATCH * CHUNK_SIZE || (size & (size - 1)) != 0) {
+		fprintf(stderr, "size must be a power of 2 of at least %zd bytes\n",
+				MAX_BATCH * CHUNK_SIZE);
+		return -1;
+	}
 
-	printf("buffer size (bytes): %d\n", size);
-	printf("array size (bytes): %ld\n", sizeof(int) * ARRAY_SIZE);
+	printf("starting ringbuffer stress test\n");
+	printf("buffer size (bytes): %u\n", size);
+	printf("chunk size (bytes): %zd\n", CHUNK_SIZE);
 
-	spa_ringbuffer_init(&rb);
 	data = malloc(size);
 
-	pthread_t reader_thread, writer_thread;
-	pthread_create(&reader_thread, NULL, reader_start, NULL);
-	pthread_create(&writer_thread, NULL, writer_start, NULL);
+	for (v = 0; v < VARIANT_LAST; v++)
+		run_variant(v, v == VARIANT_MPSC ? n_writers : 1, seconds);
 
-	while (1)
-		sleep(1);
+	free(data);
 
 	return 0;
 }
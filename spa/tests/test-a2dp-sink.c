@@ -0,0 +1,575 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Run the a2dp sink without a headset. The transport is a socketpair, a
+ * thread reads the packets from the other end at a configurable rate.
+ *
+ * usage: test-a2dp-sink [seconds] [mtu] [drain-kbps]
+ *
+ * A drain rate of 0 reads the packets as fast as possible.
+ */
+
+#include <math.h>
+#include <error.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <spa/support/loop.h>
+#include <spa/support/log.h>
+#include <spa/support/type-map.h>
+#include <spa/utils/list.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/param.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/format-utils.h>
+
+#include "../plugins/bluez5/defs.h"
+#include "../plugins/bluez5/a2dp-codecs.h"
+#include "../plugins/bluez5/rtp.h"
+
+#define M_PI_M2 ( M_PI + M_PI )
+
+#define RATE		44100
+#define CHANNELS	2
+#define FRAME_SIZE	(CHANNELS * sizeof(int16_t))
+#define BUFFER_SAMPLES	1024
+#define MAX_BUFFERS	4
+#define MAX_BITPOOL_CHANGES	64
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_command_node command_node;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_command_node_map(map, &type->command_node);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+	int16_t samples[BUFFER_SAMPLES * CHANNELS];
+	bool outstanding;
+};
+
+struct bitpool_change {
+	int64_t time;
+	int bitpool;
+};
+
+struct data {
+	struct type type;
+	struct spa_type_map *map;
+	struct spa_log *log;
+
+	struct spa_loop *loop;
+	struct spa_loop_control *loop_control;
+
+	struct spa_support support[6];
+	uint32_t n_support;
+
+	int seconds;
+	int drain_rate;		/**< bytes per second, 0 is unlimited */
+
+	a2dp_sbc_t config;
+	struct spa_bt_transport transport;
+	int peer_fd;
+	pthread_t drain_thread;
+	bool draining;
+
+	struct spa_node *sink;
+	struct spa_io_buffers io;
+	struct spa_buffer *buffers[MAX_BUFFERS];
+	struct buffer buffer[MAX_BUFFERS];
+	int16_t tone[BUFFER_SAMPLES * CHANNELS];
+
+	int64_t start_time;
+
+	/* stats, written by the drain thread */
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t frames;
+	int bitpool;
+	struct bitpool_change changes[MAX_BITPOOL_CHANGES];
+	int n_changes;
+};
+
+static int64_t get_time(clockid_t clock_id)
+{
+	struct timespec now;
+	clock_gettime(clock_id, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static int get_handle(struct data *data,
+		      struct spa_handle **handle,
+		      const char *lib,
+		      const char *name,
+		      const struct spa_dict *info)
+{
+	int res;
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -errno;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+
+		if ((res = enum_func(&factory, &i)) <= 0) {
+			if (res != 0)
+				printf("can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		if (strcmp(factory->name, name))
+			continue;
+
+		*handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, *handle, info,
+						   data->support,
+						   data->n_support)) < 0) {
+			printf("can't make factory instance: %d\n", res);
+			free(*handle);
+			return res;
+		}
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/* read the packets from the other end of the transport, like the
+ * controller would send them out */
+static void *drain_loop(void *user_data)
+{
+	struct data *data = user_data;
+	uint8_t packet[4096];
+	int64_t start = get_time(CLOCK_MONOTONIC);
+
+	while (data->draining) {
+		struct rtp_payload *payload;
+		const uint8_t *frame;
+		ssize_t len;
+
+		len = recv(data->peer_fd, packet, sizeof(packet), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (len == 0)
+			break;
+
+		data->packets++;
+		data->bytes += len;
+
+		if (len < sizeof(struct rtp_header) + sizeof(struct rtp_payload) + 3)
+			continue;
+
+		payload = SPA_MEMBER(packet, sizeof(struct rtp_header), struct rtp_payload);
+		data->frames += payload->frame_count;
+
+		/* the sbc header: syncword, parameters, bitpool */
+		frame = SPA_MEMBER(payload, sizeof(struct rtp_payload), uint8_t);
+		if (frame[0] == 0x9c && frame[2] != data->bitpool) {
+			data->bitpool = frame[2];
+			if (data->n_changes < MAX_BITPOOL_CHANGES) {
+				struct bitpool_change *c = &data->changes[data->n_changes++];
+				c->time = get_time(CLOCK_MONOTONIC) - data->start_time;
+				c->bitpool = data->bitpool;
+			}
+		}
+
+		if (data->drain_rate > 0) {
+			int64_t target, now;
+
+			target = start + data->bytes * SPA_NSEC_PER_SEC / data->drain_rate;
+			now = get_time(CLOCK_MONOTONIC);
+			if (target > now) {
+				struct timespec ts;
+				ts.tv_sec = (target - now) / SPA_NSEC_PER_SEC;
+				ts.tv_nsec = (target - now) % SPA_NSEC_PER_SEC;
+				nanosleep(&ts, NULL);
+			}
+		}
+	}
+	return NULL;
+}
+
+static int transport_acquire(struct spa_bt_transport *transport, bool optional)
+{
+	struct data *data = SPA_CONTAINER_OF(transport, struct data, transport);
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+		return -errno;
+
+	/* the sink expects a non blocking socket */
+	transport->fd = fds[0];
+	if (fcntl(transport->fd, F_SETFL, fcntl(transport->fd, F_GETFL) | O_NONBLOCK) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -errno;
+	}
+	data->peer_fd = fds[1];
+	data->draining = true;
+	pthread_create(&data->drain_thread, NULL, drain_loop, data);
+
+	transport->acquired = true;
+	return 0;
+}
+
+static int transport_release(struct spa_bt_transport *transport)
+{
+	struct data *data = SPA_CONTAINER_OF(transport, struct data, transport);
+
+	if (!transport->acquired)
+		return 0;
+
+	data->draining = false;
+	shutdown(data->peer_fd, SHUT_RDWR);
+	pthread_join(data->drain_thread, NULL);
+
+	close(transport->fd);
+	close(data->peer_fd);
+	transport->fd = -1;
+	transport->acquired = false;
+
+	return 0;
+}
+
+static void init_transport(struct data *data, uint16_t mtu)
+{
+	a2dp_sbc_t *conf = &data->config;
+
+	conf->frequency = SBC_SAMPLING_FREQ_44100;
+	conf->channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+	conf->subbands = SBC_SUBBANDS_8;
+	conf->block_length = SBC_BLOCK_LENGTH_16;
+	conf->allocation_method = SBC_ALLOCATION_LOUDNESS;
+	conf->min_bitpool = 2;
+	conf->max_bitpool = 53;
+
+	data->transport.path = "/test/transport";
+	data->transport.profile = SPA_BT_PROFILE_A2DP_SINK;
+	data->transport.state = SPA_BT_TRANSPORT_STATE_ACTIVE;
+	data->transport.codec = 0;
+	data->transport.configuration = conf;
+	data->transport.configuration_len = sizeof(*conf);
+	data->transport.fd = -1;
+	data->transport.read_mtu = mtu;
+	data->transport.write_mtu = mtu;
+	data->transport.acquire = transport_acquire;
+	data->transport.release = transport_release;
+}
+
+static void on_sink_need_input(void *_data)
+{
+	struct data *data = _data;
+	struct buffer *b = NULL;
+	int i;
+
+	for (i = 0; i < MAX_BUFFERS; i++) {
+		if (!data->buffer[i].outstanding) {
+			b = &data->buffer[i];
+			break;
+		}
+	}
+	if (b == NULL) {
+		printf("out of buffers\n");
+		return;
+	}
+	memcpy(b->samples, data->tone, sizeof(data->tone));
+	b->datas[0].chunk->offset = 0;
+	b->datas[0].chunk->size = sizeof(b->samples);
+	b->outstanding = true;
+
+	data->io.buffer_id = b->buffer.id;
+	data->io.status = SPA_STATUS_HAVE_BUFFER;
+	spa_node_process_input(data->sink);
+}
+
+static void on_sink_reuse_buffer(void *_data, uint32_t port_id, uint32_t buffer_id)
+{
+	struct data *data = _data;
+
+	if (buffer_id < MAX_BUFFERS)
+		data->buffer[buffer_id].outstanding = false;
+}
+
+static const struct spa_node_callbacks sink_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.need_input = on_sink_need_input,
+	.reuse_buffer = on_sink_reuse_buffer,
+};
+
+static int make_sink(struct data *data)
+{
+	struct spa_handle *handle;
+	struct spa_dict_item items[1];
+	char transport[32];
+	void *iface;
+	int res;
+
+	snprintf(transport, sizeof(transport), "%p", &data->transport);
+	items[0] = SPA_DICT_ITEM_INIT("bluez5.transport", transport);
+
+	if ((res = get_handle(data, &handle,
+			     "build/spa/plugins/bluez5/libspa-bluez5.so",
+			     "a2dp-sink", &SPA_DICT_INIT(items, 1))) < 0)
+		return res;
+	if ((res = spa_handle_get_interface(handle, data->type.node, &iface)) < 0)
+		return res;
+
+	data->sink = iface;
+	return 0;
+}
+
+static int negotiate(struct data *data)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[256];
+	struct spa_pod *format;
+	int i, res;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	format = spa_pod_builder_object(&b,
+			data->type.param.idFormat, data->type.format,
+			"I", data->type.media_type.audio,
+			"I", data->type.media_subtype.raw,
+			":", data->type.format_audio.format,   "I", data->type.audio_format.S16,
+			":", data->type.format_audio.rate,     "i", RATE,
+			":", data->type.format_audio.channels, "i", CHANNELS);
+
+	if ((res = spa_node_port_set_param(data->sink, SPA_DIRECTION_INPUT, 0,
+					   data->type.param.idFormat, 0, format)) < 0)
+		return res;
+
+	data->io = SPA_IO_BUFFERS_INIT;
+	spa_node_port_set_io(data->sink, SPA_DIRECTION_INPUT, 0,
+			     data->type.io.Buffers, &data->io, sizeof(data->io));
+
+	for (i = 0; i < BUFFER_SAMPLES; i++) {
+		int16_t v = sin(M_PI_M2 * 440.0 * i / RATE) * 8192;
+		data->tone[i * CHANNELS] = v;
+		data->tone[i * CHANNELS + 1] = v;
+	}
+
+	for (i = 0; i < MAX_BUFFERS; i++) {
+		struct buffer *bu = &data->buffer[i];
+
+		data->buffers[i] = &bu->buffer;
+
+		bu->buffer.id = i;
+		bu->buffer.metas = bu->metas;
+		bu->buffer.n_metas = 1;
+		bu->buffer.datas = bu->datas;
+		bu->buffer.n_datas = 1;
+
+		bu->metas[0].type = data->type.meta.Header;
+		bu->metas[0].data = &bu->header;
+		bu->metas[0].size = sizeof(bu->header);
+
+		bu->datas[0].type = data->type.data.MemPtr;
+		bu->datas[0].flags = 0;
+		bu->datas[0].fd = -1;
+		bu->datas[0].mapoffset = 0;
+		bu->datas[0].maxsize = sizeof(bu->samples);
+		bu->datas[0].data = bu->samples;
+		bu->datas[0].chunk = &bu->chunks[0];
+		bu->datas[0].chunk->offset = 0;
+		bu->datas[0].chunk->size = 0;
+		bu->datas[0].chunk->stride = 0;
+		bu->outstanding = false;
+	}
+	if ((res = spa_node_port_use_buffers(data->sink, SPA_DIRECTION_INPUT, 0,
+					     data->buffers, MAX_BUFFERS)) < 0)
+		return res;
+
+	spa_node_set_callbacks(data->sink, &sink_callbacks, data);
+
+	return 0;
+}
+
+static void run(struct data *data)
+{
+	struct spa_command cmd;
+	int64_t stop, cpu_start, cpu, elapsed;
+	int i, res;
+
+	spa_loop_control_enter(data->loop_control);
+
+	data->start_time = get_time(CLOCK_MONOTONIC);
+	cpu_start = get_time(CLOCK_THREAD_CPUTIME_ID);
+	stop = data->start_time + data->seconds * SPA_NSEC_PER_SEC;
+
+	cmd = SPA_COMMAND_INIT(data->type.command_node.Start);
+	if ((res = spa_node_send_command(data->sink, &cmd)) < 0) {
+		printf("can't start sink: %s\n", spa_strerror(res));
+		goto done;
+	}
+
+	while (get_time(CLOCK_MONOTONIC) < stop)
+		spa_loop_control_iterate(data->loop_control, 100);
+
+	cpu = get_time(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+	elapsed = get_time(CLOCK_MONOTONIC) - data->start_time;
+
+	cmd = SPA_COMMAND_INIT(data->type.command_node.Pause);
+	spa_node_send_command(data->sink, &cmd);
+
+	printf("mtu %d, drain %d bytes/s, %f s\n", data->transport.write_mtu,
+			data->drain_rate, elapsed / (double) SPA_NSEC_PER_SEC);
+	printf("%" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64 " sbc frames, "
+			"%f frames/packet\n",
+			data->packets, data->bytes, data->frames,
+			data->packets ? data->frames / (double) data->packets : 0.0);
+	printf("%f writes/s, %f kbit/s\n",
+			data->packets * (double) SPA_NSEC_PER_SEC / elapsed,
+			data->bytes * 8.0 * SPA_NSEC_PER_SEC / elapsed / 1000.0);
+	printf("cpu %f%%, %f us/frame\n",
+			cpu * 100.0 / elapsed,
+			data->frames ? cpu / 1000.0 / data->frames : 0.0);
+	printf("bitpool:");
+	for (i = 0; i < data->n_changes; i++)
+		printf(" %d@%.3fs", data->changes[i].bitpool,
+				data->changes[i].time / (double) SPA_NSEC_PER_SEC);
+	printf("\n");
+
+      done:
+	spa_loop_control_leave(data->loop_control);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data;
+	int res;
+	const char *str;
+	struct spa_handle *handle;
+	void *iface;
+
+	spa_zero(data);
+
+	data.seconds = argc > 1 ? atoi(argv[1]) : 10;
+	init_transport(&data, argc > 2 ? atoi(argv[2]) : 895);
+	data.drain_rate = argc > 3 ? atoi(argv[3]) * 1000 / 8 : 0;
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "mapper", NULL)) < 0)
+		error(-1, res, "can't create mapper");
+	if ((res = spa_handle_get_interface(handle, 0, &iface)) < 0)
+		error(-1, res, "can't get mapper interface");
+
+	data.map = iface;
+	data.support[0].type = SPA_TYPE__TypeMap;
+	data.support[0].data = data.map;
+	data.n_support = 1;
+	init_type(&data.type, data.map);
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "logger", NULL)) < 0)
+		error(-1, res, "can't create logger");
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__Log),
+					    &iface)) < 0)
+		error(-1, res, "can't get log interface");
+
+	data.log = iface;
+	data.support[1].type = SPA_TYPE__Log;
+	data.support[1].data = data.log;
+	data.n_support = 2;
+
+	if ((str = getenv("SPA_DEBUG")))
+		data.log->level = atoi(str);
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "loop", NULL)) < 0)
+		error(-1, res, "can't create loop");
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__Loop),
+					    &iface)) < 0)
+		error(-1, res, "can't get loop interface");
+	data.loop = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__LoopControl),
+					    &iface)) < 0)
+		error(-1, res, "can't get loopcontrol interface");
+	data.loop_control = iface;
+
+	data.support[2].type = SPA_TYPE_LOOP__DataLoop;
+	data.support[2].data = data.loop;
+	data.support[3].type = SPA_TYPE_LOOP__MainLoop;
+	data.support[3].data = data.loop;
+	data.support[4].type = SPA_TYPE__LoopControl;
+	data.support[4].data = data.loop_control;
+	data.n_support = 5;
+
+	if ((res = make_sink(&data)) < 0)
+		error(-1, -res, "can't create a2dp-sink");
+	if ((res = negotiate(&data)) < 0)
+		error(-1, -res, "can't negotiate a2dp-sink");
+
+	run(&data);
+
+	return 0;
+}
@@ -0,0 +1,560 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Encode and decode the output of videotestsrc with the ffmpeg nodes and
+ * report the throughput and the cpu usage of the pipeline:
+ *
+ *   videotestsrc ! ffenc_<codec> ! ffdec_<codec> ! fakesink
+ *
+ * usage: test-ffmpeg [codec] [frames] [width] [height]
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/loop.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/param.h>
+#include <spa/param/buffers.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/format-utils.h>
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+#define MAX_BUFFERS	16
+#define BUFFER_ALIGN	64
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_command_node command_node;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_command_node_map(map, &type->command_node);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+};
+
+struct link {
+	struct spa_io_buffers io;
+	struct spa_buffer *buffers[MAX_BUFFERS];
+	struct buffer buffer[MAX_BUFFERS];
+	uint32_t n_buffers;
+};
+
+struct data {
+	struct spa_type_map *map;
+	struct spa_log *log;
+	struct spa_loop data_loop;
+	struct type type;
+
+	struct spa_support support[4];
+	uint32_t n_support;
+
+	const char *codec;
+	int iterations;
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
+
+	struct spa_node *source;
+	struct spa_node *enc;
+	struct spa_node *dec;
+	struct spa_node *sink;
+
+	struct link source_enc;
+	struct link enc_dec;
+	struct link dec_sink;
+
+	int frames;
+	int packets;
+	int64_t packet_bytes;
+};
+
+static int
+init_buffers(struct data *data, struct link *l, uint32_t n_buffers, size_t size, int stride)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &l->buffer[i];
+		void *mem;
+
+		l->buffers[i] = &b->buffer;
+
+		b->buffer.id = i;
+		b->buffer.metas = b->metas;
+		b->buffer.n_metas = 1;
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = 1;
+
+		b->header.flags = 0;
+		b->header.seq = 0;
+		b->header.pts = 0;
+		b->header.dts_offset = 0;
+		b->metas[0].type = data->type.meta.Header;
+		b->metas[0].data = &b->header;
+		b->metas[0].size = sizeof(b->header);
+
+		if (posix_memalign(&mem, BUFFER_ALIGN, size) != 0)
+			return -ENOMEM;
+
+		b->datas[0].type = data->type.data.MemPtr;
+		b->datas[0].flags = 0;
+		b->datas[0].fd = -1;
+		b->datas[0].mapoffset = 0;
+		b->datas[0].maxsize = size;
+		b->datas[0].data = mem;
+		b->datas[0].chunk = &b->chunks[0];
+		b->datas[0].chunk->offset = 0;
+		b->datas[0].chunk->size = 0;
+		b->datas[0].chunk->stride = stride;
+	}
+	l->n_buffers = n_buffers;
+	return 0;
+}
+
+static int make_node(struct data *data, struct spa_node **node, const char *lib, const char *name)
+{
+	struct spa_handle *handle;
+	int res;
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -errno;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+		void *iface;
+
+		if ((res = enum_func(&factory, &i)) <= 0) {
+			if (res != 0)
+				printf("can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		if (strcmp(factory->name, name))
+			continue;
+
+		handle = calloc(1, factory->size);
+		if ((res =
+		     spa_handle_factory_init(factory, handle, NULL, data->support,
+					     data->n_support)) < 0) {
+			printf("can't make factory instance: %d\n", res);
+			return res;
+		}
+		if ((res = spa_handle_get_interface(handle, data->type.node, &iface)) < 0) {
+			printf("can't get interface %d\n", res);
+			return res;
+		}
+		*node = iface;
+		return 0;
+	}
+	return -EBADF;
+}
+
+static uint32_t codec_subtype(struct data *data, const char *codec)
+{
+	struct spa_type_media_subtype_video *t = &data->type.media_subtype_video;
+
+	if (!strcmp(codec, "mpeg4"))
+		return t->mpeg4;
+	if (!strcmp(codec, "mjpeg"))
+		return t->mjpg;
+	if (!strcmp(codec, "mpeg1video"))
+		return t->mpeg1;
+	if (!strcmp(codec, "mpeg2video"))
+		return t->mpeg2;
+	if (!strcmp(codec, "h263"))
+		return t->h263;
+	if (!strcmp(codec, "h264") || !strcmp(codec, "libx264"))
+		return t->h264;
+	if (!strcmp(codec, "vp8") || !strcmp(codec, "libvpx"))
+		return t->vp8;
+	return SPA_ID_INVALID;
+}
+
+static void link_nodes(struct data *data, struct link *l,
+		       struct spa_node *out, struct spa_node *in)
+{
+	l->io = SPA_IO_BUFFERS_INIT;
+	l->io.status = SPA_STATUS_NEED_BUFFER;
+
+	spa_node_port_set_io(out, SPA_DIRECTION_OUTPUT, 0,
+			     data->type.io.Buffers, &l->io, sizeof(l->io));
+	spa_node_port_set_io(in, SPA_DIRECTION_INPUT, 0,
+			     data->type.io.Buffers, &l->io, sizeof(l->io));
+}
+
+static int make_nodes(struct data *data)
+{
+	char name[128];
+	int res;
+
+	if ((res = make_node(data, &data->source,
+			     "build/spa/plugins/videotestsrc/libspa-videotestsrc.so",
+			     "videotestsrc")) < 0) {
+		printf("can't create videotestsrc: %d\n", res);
+		return res;
+	}
+	snprintf(name, sizeof(name), "ffenc_%s", data->codec);
+	if ((res = make_node(data, &data->enc,
+			     "build/spa/plugins/ffmpeg/libspa-ffmpeg.so", name)) < 0) {
+		printf("can't create %s: %d\n", name, res);
+		return res;
+	}
+	snprintf(name, sizeof(name), "ffdec_%s", data->codec);
+	if ((res = make_node(data, &data->dec,
+			     "build/spa/plugins/ffmpeg/libspa-ffmpeg.so", name)) < 0) {
+		printf("can't create %s: %d\n", name, res);
+		return res;
+	}
+	if ((res = make_node(data, &data->sink,
+			     "build/spa/plugins/test/libspa-test.so", "fakesink")) < 0) {
+		printf("can't create fakesink: %d\n", res);
+		return res;
+	}
+
+	link_nodes(data, &data->source_enc, data->source, data->enc);
+	link_nodes(data, &data->enc_dec, data->enc, data->dec);
+	link_nodes(data, &data->dec_sink, data->dec, data->sink);
+
+	return 0;
+}
+
+static int set_format(struct data *data, struct spa_node *out, struct spa_node *in,
+		      struct spa_pod *format)
+{
+	int res;
+
+	if ((res = spa_node_port_set_param(out, SPA_DIRECTION_OUTPUT, 0,
+					   data->type.param.idFormat, 0, format)) < 0)
+		return res;
+	if ((res = spa_node_port_set_param(in, SPA_DIRECTION_INPUT, 0,
+					   data->type.param.idFormat, 0, format)) < 0)
+		return res;
+	return 0;
+}
+
+/* allocate the buffers as requested by the output port and use them on
+ * both sides of the link */
+static int use_buffers(struct data *data, struct link *l, struct spa_node *out, struct spa_node *in)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	uint32_t index = 0;
+	int32_t size, stride = 0, n_buffers = 8;
+	int res;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if ((res = spa_node_port_enum_params(out, SPA_DIRECTION_OUTPUT, 0,
+					     data->type.param.idBuffers, &index,
+					     NULL, &param, &b)) <= 0)
+		return res < 0 ? res : -EINVAL;
+
+	if (spa_pod_object_parse(param,
+			":", data->type.param_buffers.size,    "i", &size,
+			":", data->type.param_buffers.stride,  "?i", &stride,
+			":", data->type.param_buffers.buffers, "?i", &n_buffers, NULL) < 0)
+		return -EINVAL;
+
+	n_buffers = SPA_CLAMP(n_buffers, 2, MAX_BUFFERS);
+
+	if ((res = init_buffers(data, l, n_buffers, size, stride)) < 0)
+		return res;
+
+	if ((res = spa_node_port_use_buffers(in, SPA_DIRECTION_INPUT, 0,
+					     l->buffers, l->n_buffers)) < 0)
+		return res;
+	if ((res = spa_node_port_use_buffers(out, SPA_DIRECTION_OUTPUT, 0,
+					     l->buffers, l->n_buffers)) < 0)
+		return res;
+
+	return 0;
+}
+
+static int negotiate_formats(struct data *data)
+{
+	struct type *t = &data->type;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *format;
+	uint32_t subtype;
+	int res;
+
+	if ((subtype = codec_subtype(data, data->codec)) == SPA_ID_INVALID) {
+		printf("unknown codec %s\n", data->codec);
+		return -EINVAL;
+	}
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	format = spa_pod_builder_object(&b,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", t->video_format.I420,
+			":", t->format_video.size,      "R", &data->size,
+			":", t->format_video.framerate, "F", &data->framerate);
+
+	if ((res = set_format(data, data->source, data->enc, format)) < 0) {
+		printf("can't set raw format on encoder: %d\n", res);
+		return res;
+	}
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	format = spa_pod_builder_object(&b,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", subtype,
+			":", t->format_video.size,      "R", &data->size,
+			":", t->format_video.framerate, "F", &data->framerate);
+
+	/* the decoder input format opens the codec, do this before the output
+	 * format so that the decoder can check if it can decode in place */
+	if ((res = spa_node_port_set_param(data->dec, SPA_DIRECTION_INPUT, 0,
+					   t->param.idFormat, 0, format)) < 0 ||
+	    (res = spa_node_port_set_param(data->enc, SPA_DIRECTION_OUTPUT, 0,
+					   t->param.idFormat, 0, format)) < 0) {
+		printf("can't set %s format: %d\n", data->codec, res);
+		return res;
+	}
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	format = spa_pod_builder_object(&b,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", t->video_format.I420,
+			":", t->format_video.size,      "R", &data->size,
+			":", t->format_video.framerate, "F", &data->framerate);
+	if ((res = set_format(data, data->dec, data->sink, format)) < 0) {
+		printf("can't set raw format on decoder: %d\n", res);
+		return res;
+	}
+
+	if ((res = use_buffers(data, &data->source_enc, data->source, data->enc)) < 0 ||
+	    (res = use_buffers(data, &data->enc_dec, data->enc, data->dec)) < 0 ||
+	    (res = use_buffers(data, &data->dec_sink, data->dec, data->sink)) < 0) {
+		printf("can't allocate buffers: %d\n", res);
+		return res;
+	}
+	return 0;
+}
+
+static void push_frame(struct data *data)
+{
+	if (data->dec_sink.io.status == SPA_STATUS_HAVE_BUFFER) {
+		spa_node_process_input(data->sink);
+		data->frames++;
+	}
+}
+
+/* run the pipeline once, from the source to the sink and back */
+static void iterate(struct data *data)
+{
+	spa_node_process_output(data->source);
+
+	if (data->source_enc.io.status == SPA_STATUS_HAVE_BUFFER)
+		spa_node_process_input(data->enc);
+
+	if (data->enc_dec.io.status == SPA_STATUS_HAVE_BUFFER) {
+		struct spa_buffer *b = data->enc_dec.buffers[data->enc_dec.io.buffer_id];
+
+		data->packets++;
+		data->packet_bytes += b->datas[0].chunk->size;
+
+		spa_node_process_input(data->dec);
+		push_frame(data);
+	}
+
+	/* recycle the buffers and collect the frames the codecs still have */
+	spa_node_process_output(data->dec);
+	push_frame(data);
+
+	spa_node_process_output(data->enc);
+}
+
+static int64_t timeval_to_time(struct timeval *tv)
+{
+	return tv->tv_sec * SPA_NSEC_PER_SEC + tv->tv_usec * 1000LL;
+}
+
+static void run(struct data *data)
+{
+	struct spa_command cmd;
+	struct timespec now;
+	struct rusage start_usage, stop_usage;
+	int64_t start, stop, cpu;
+	int i, res;
+
+	cmd = SPA_COMMAND_INIT(data->type.command_node.Start);
+	if ((res = spa_node_send_command(data->source, &cmd)) < 0)
+		printf("got source error %d\n", res);
+	if ((res = spa_node_send_command(data->enc, &cmd)) < 0)
+		printf("got encoder error %d\n", res);
+	if ((res = spa_node_send_command(data->dec, &cmd)) < 0)
+		printf("got decoder error %d\n", res);
+	if ((res = spa_node_send_command(data->sink, &cmd)) < 0)
+		printf("got sink error %d\n", res);
+
+	getrusage(RUSAGE_SELF, &start_usage);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	start = SPA_TIMESPEC_TO_TIME(&now);
+
+	for (i = 0; i < data->iterations; i++)
+		iterate(data);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stop = SPA_TIMESPEC_TO_TIME(&now);
+	getrusage(RUSAGE_SELF, &stop_usage);
+
+	cpu = timeval_to_time(&stop_usage.ru_utime) - timeval_to_time(&start_usage.ru_utime) +
+	      timeval_to_time(&stop_usage.ru_stime) - timeval_to_time(&start_usage.ru_stime);
+
+	printf("%s %dx%d: %d frames %d packets (%" PRIi64 " bytes) in %f s\n",
+			data->codec, data->size.width, data->size.height,
+			data->frames, data->packets, data->packet_bytes,
+			(stop - start) / (double) SPA_NSEC_PER_SEC);
+	printf("%f fps, cpu %f%%\n",
+			data->frames * (double) SPA_NSEC_PER_SEC / (stop - start),
+			cpu * 100.0 / (stop - start));
+
+	cmd = SPA_COMMAND_INIT(data->type.command_node.Pause);
+	spa_node_send_command(data->sink, &cmd);
+	spa_node_send_command(data->dec, &cmd);
+	spa_node_send_command(data->enc, &cmd);
+	spa_node_send_command(data->source, &cmd);
+}
+
+static int do_add_source(struct spa_loop *loop, struct spa_source *source)
+{
+	return 0;
+}
+
+static int do_update_source(struct spa_source *source)
+{
+	return 0;
+}
+
+static void do_remove_source(struct spa_source *source)
+{
+}
+
+static int
+do_invoke(struct spa_loop *loop,
+	  spa_invoke_func_t func, uint32_t seq, const void *data, size_t size, bool block, void *user_data)
+{
+	return func(loop, false, seq, data, size, user_data);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { NULL };
+	int res;
+	const char *str;
+
+	data.map = &default_map.map;
+	data.log = &default_log.log;
+	data.data_loop.version = SPA_VERSION_LOOP;
+	data.data_loop.add_source = do_add_source;
+	data.data_loop.update_source = do_update_source;
+	data.data_loop.remove_source = do_remove_source;
+	data.data_loop.invoke = do_invoke;
+
+	if ((str = getenv("SPA_DEBUG")))
+		data.log->level = atoi(str);
+
+	data.codec = argc > 1 ? argv[1] : "mpeg4";
+	data.iterations = argc > 2 ? atoi(argv[2]) : 1000;
+	data.size.width = argc > 3 ? atoi(argv[3]) : 640;
+	data.size.height = argc > 4 ? atoi(argv[4]) : 480;
+	data.framerate = SPA_FRACTION(25, 1);
+
+	data.support[0].type = SPA_TYPE__TypeMap;
+	data.support[0].data = data.map;
+	data.support[1].type = SPA_TYPE__Log;
+	data.support[1].data = data.log;
+	data.support[2].type = SPA_TYPE_LOOP__DataLoop;
+	data.support[2].data = &data.data_loop;
+	data.support[3].type = SPA_TYPE_LOOP__MainLoop;
+	data.support[3].data = &data.data_loop;
+	data.n_support = 4;
+
+	init_type(&data.type, data.map);
+
+	if ((res = make_nodes(&data)) < 0) {
+		printf("can't make nodes: %d\n", res);
+		return -1;
+	}
+	if ((res = negotiate_formats(&data)) < 0) {
+		printf("can't negotiate nodes: %d\n", res);
+		return -1;
+	}
+
+	run(&data);
+
+	return 0;
+}
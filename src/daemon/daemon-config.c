@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/command.h>
@@ -183,8 +184,12 @@ int pw_daemon_config_load(struct pw_daemon_config *config, char **err)
 int pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_core *core)
 {
 	char *err = NULL;
-	int ret = 0;
+	int ret = 0, n_commands = 0;
 	struct pw_command *command, *tmp;
+	struct timespec start, t1, t2;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	t1 = start;
 
 	spa_list_for_each(command, &config->commands, link) {
 		if ((ret = pw_command_run(command, core, &err)) < 0) {
@@ -192,7 +197,17 @@ int pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_cor
 			free(err);
 			break;
 		}
+		n_commands++;
+
+		/* report the startup cost of each command, mostly module loading */
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		pw_log_info("deamon-config %p: %s %s: %" PRId64 " usec", config,
+			    command->args[0], command->n_args > 1 ? command->args[1] : "",
+			    (int64_t) (SPA_TIMESPEC_TO_TIME(&t2) - SPA_TIMESPEC_TO_TIME(&t1)) / 1000);
+		t1 = t2;
 	}
+	pw_log_info("deamon-config %p: ran %d commands in %" PRId64 " usec", config, n_commands,
+		    (int64_t) (SPA_TIMESPEC_TO_TIME(&t1) - SPA_TIMESPEC_TO_TIME(&start)) / 1000);
 
 	spa_list_for_each_safe(command, tmp, &config->commands, link)
 		pw_command_free(command);
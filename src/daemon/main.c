@@ -20,6 +20,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <getopt.h>
+#include <time.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/core.h>
@@ -60,6 +61,9 @@ int main(int argc, char *argv[])
 		{NULL,		0, NULL, 0}
 	};
 	char c;
+	struct timespec start, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	pw_init(&argc, &argv);
 
@@ -107,6 +111,10 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pw_log_info("startup took %" PRId64 " usec",
+		    (int64_t) (SPA_TIMESPEC_TO_TIME(&now) - SPA_TIMESPEC_TO_TIME(&start)) / 1000);
+
 	pw_log_info("start main loop");
 	pw_main_loop_run(loop);
 	pw_log_info("leave main loop");
@@ -0,0 +1,151 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the cost of the property operations done on the globals, the
+ * way the autolink and flatpak modules query them.
+ *
+ *   benchmark-properties [n-globals] [n-properties]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+
+static const char *common_keys[] = {
+	"node.name", "media.class", "media.role", "node.autoconnect",
+	"pipewire.client.id", "pipewire.target.node", "application.name",
+	"application.process.id", "application.process.binary",
+	"pipewire.access", "pipewire.sec.pid", "pipewire.sec.uid",
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static void report(const char *name, uint64_t t1, uint64_t t2, uint64_t n_ops)
+{
+	printf("%-16s %10.3f msec %8.1f nsec/op\n", name,
+	       (t2 - t1) / 1000000.0, (t2 - t1) / (double) n_ops);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_properties **props, **copies, *update;
+	int i, j, n_globals = 10000, n_props = 30;
+	uint64_t t1, t2, found = 0;
+	char key[64], value[64];
+
+	if (argc > 1)
+		n_globals = atoi(argv[1]);
+	if (argc > 2)
+		n_props = atoi(argv[2]);
+
+	props = calloc(n_globals, sizeof(struct pw_properties *));
+	copies = calloc(n_globals, sizeof(struct pw_properties *));
+
+	printf("%d globals with %d properties\n", n_globals, n_props);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		props[i] = pw_properties_new(NULL, NULL);
+		for (j = 0; j < n_props; j++) {
+			if (j < (int) SPA_N_ELEMENTS(common_keys))
+				snprintf(key, sizeof(key), "%s", common_keys[j]);
+			else
+				snprintf(key, sizeof(key), "custom.key.%d", j);
+			snprintf(value, sizeof(value), "value-%d-%d", i, j);
+			pw_properties_set(props[i], key, value);
+		}
+	}
+	t2 = get_time();
+	report("set", t1, t2, (uint64_t) n_globals * n_props);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		for (j = 0; j < n_props; j++) {
+			const char *k = props[i]->dict.items[j].key;
+			found += pw_properties_get(props[i], k) != NULL;
+		}
+	}
+	t2 = get_time();
+	report("get", t1, t2, (uint64_t) n_globals * n_props);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		for (j = 0; j < n_props; j++) {
+			const char *k = props[i]->dict.items[j].key;
+			found += spa_dict_lookup(&props[i]->dict, k) != NULL;
+		}
+	}
+	t2 = get_time();
+	report("linear lookup", t1, t2, (uint64_t) n_globals * n_props);
+
+	/* like looking up a target node by name in all globals */
+	snprintf(value, sizeof(value), "value-%d-0", n_globals - 1);
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		const char *str = pw_properties_get(props[i], "node.name");
+		if (str && strcmp(str, value) == 0)
+			found++;
+	}
+	t2 = get_time();
+	report("find node", t1, t2, n_globals);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++)
+		copies[i] = pw_properties_copy(props[i]);
+	t2 = get_time();
+	report("copy", t1, t2, n_globals);
+
+	update = pw_properties_new("media.role", "Music",
+				   "node.autoconnect", "1", NULL);
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		struct pw_properties *res = pw_properties_merge(copies[i], update);
+		pw_properties_free(copies[i]);
+		copies[i] = res;
+	}
+	t2 = get_time();
+	report("merge", t1, t2, n_globals);
+	pw_properties_free(update);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++)
+		found += pw_properties_get_sorted(copies[i])->n_items;
+	t2 = get_time();
+	report("sorted", t1, t2, n_globals);
+
+	t1 = get_time();
+	for (i = 0; i < n_globals; i++) {
+		pw_properties_free(copies[i]);
+		pw_properties_free(props[i]);
+	}
+	t2 = get_time();
+	report("free", t1, t2, n_globals * 2);
+
+	free(copies);
+	free(props);
+
+	return found == 0 ? -1 : 0;
+}
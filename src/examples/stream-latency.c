@@ -0,0 +1,570 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Measure the round trip time of buffers going from one stream, through the
+ * daemon, to a client that sends them back through the daemon.
+ *
+ * A source stream timestamps buffers from a timer in the main loop. The echo
+ * input stream, linked to the source and processing in its own realtime
+ * thread, passes the timestamps to the main loop, where the echo output
+ * stream sends them out again like the source does. The return stream,
+ * linked to the echo output and also processing in its own realtime thread,
+ * compares the timestamps with the current time.
+ *
+ * The one way latency, from the source to the echo input, is reported too.
+ *
+ *   stream-latency [seconds] [interval-usec]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include <spa/support/type-map.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/param/format-utils.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/props.h>
+
+#include <pipewire/pipewire.h>
+
+struct type {
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+}
+
+#define WIDTH	16
+#define HEIGHT	16
+#define BPP	3
+
+#define MAX_PENDING	64
+
+struct stats {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t total;
+};
+
+struct data {
+	struct type type;
+
+	struct pw_main_loop *loop;
+	struct spa_source *timer;
+	struct spa_source *report;
+
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_stream *source;
+	struct spa_hook source_listener;
+
+	struct pw_stream *echo_in;
+	struct spa_hook echo_in_listener;
+
+	struct pw_stream *echo_out;
+	struct spa_hook echo_out_listener;
+
+	struct pw_stream *ret;
+	struct spa_hook ret_listener;
+
+	/* timestamps from the echo input thread to the main loop */
+	struct spa_ringbuffer pending;
+	uint64_t pending_pts[MAX_PENDING];
+	struct spa_source *echo;
+
+	uint64_t interval;
+	int seconds;
+	int elapsed;
+	uint32_t seq;
+
+	/* only updated from the echo input data thread */
+	struct stats one_way;
+	struct stats one_way_last;
+	/* only updated from the return data thread */
+	struct stats round_trip;
+	struct stats round_trip_last;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+/* send a buffer with timestamp @pts on the output stream @stream */
+static void send_buffer(struct data *data, struct pw_stream *stream, uint64_t pts)
+{
+	struct spa_meta_header *h;
+	struct pw_buffer *buf;
+	struct spa_buffer *b;
+
+	if ((buf = pw_stream_dequeue_buffer(stream)) == NULL)
+		return;
+
+	b = buf->buffer;
+
+	if ((h = spa_buffer_find_meta(b, data->t->meta.Header))) {
+		h->flags = 0;
+		h->seq = data->seq++;
+		h->dts_offset = 0;
+		h->pts = pts;
+	}
+	b->datas[0].chunk->size = b->datas[0].maxsize;
+
+	pw_stream_queue_buffer(stream, buf);
+}
+
+static void on_timeout(void *userdata, uint64_t expirations)
+{
+	struct data *data = userdata;
+	send_buffer(data, data->source, get_time_ns());
+}
+
+/* send the timestamps that came in on the echo input back out */
+static void on_echo(void *userdata, uint64_t count)
+{
+	struct data *data = userdata;
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&data->pending, &index);
+	while (avail-- > 0) {
+		send_buffer(data, data->echo_out, data->pending_pts[index & (MAX_PENDING - 1)]);
+		spa_ringbuffer_read_update(&data->pending, ++index);
+	}
+}
+
+static void print_stats(const char *what, struct stats *stats, struct stats *last)
+{
+	struct stats now = *stats;
+	uint64_t count = now.count - last->count;
+
+	if (count > 0)
+		printf("  %s: %"PRIu64" buffers, min %.1f avg %.1f max %.1f usec\n",
+				what, count,
+				now.min / 1000.0,
+				(now.total - last->total) / (count * 1000.0),
+				now.max / 1000.0);
+	else
+		printf("  %s: no buffers\n", what);
+
+	*last = now;
+	stats->min = UINT64_MAX;
+	stats->max = 0;
+}
+
+static void on_report(void *userdata, uint64_t expirations)
+{
+	struct data *data = userdata;
+
+	printf("%d:\n", data->elapsed);
+	print_stats("one way", &data->one_way, &data->one_way_last);
+	print_stats("round trip", &data->round_trip, &data->round_trip_last);
+
+	if (++data->elapsed >= data->seconds)
+		pw_main_loop_quit(data->loop);
+}
+
+static void add_stats(struct stats *stats, uint64_t latency)
+{
+	stats->min = SPA_MIN(stats->min, latency);
+	stats->max = SPA_MAX(stats->max, latency);
+	stats->total += latency;
+	stats->count++;
+}
+
+/* called from the realtime thread of the echo input stream */
+static void on_echo_in_process(void *userdata)
+{
+	struct data *data = userdata;
+	struct spa_meta_header *h;
+	struct pw_buffer *buf;
+	uint64_t now = get_time_ns();
+	uint32_t index;
+	int32_t filled;
+
+	while ((buf = pw_stream_dequeue_buffer(data->echo_in)) != NULL) {
+		if ((h = spa_buffer_find_meta(buf->buffer, data->t->meta.Header)) &&
+		    h->pts > 0 && (uint64_t) h->pts <= now) {
+			add_stats(&data->one_way, now - h->pts);
+
+			/* drop the timestamp when the main loop is too far behind */
+			filled = spa_ringbuffer_get_write_index(&data->pending, &index);
+			if (filled >= 0 && filled < MAX_PENDING) {
+				data->pending_pts[index & (MAX_PENDING - 1)] = h->pts;
+				spa_ringbuffer_write_update(&data->pending, index + 1);
+			}
+		}
+		pw_stream_queue_buffer(data->echo_in, buf);
+	}
+	pw_loop_signal_event(pw_main_loop_get_loop(data->loop), data->echo);
+}
+
+/* called from the realtime thread of the return stream */
+static void on_ret_process(void *userdata)
+{
+	struct data *data = userdata;
+	struct spa_meta_header *h;
+	struct pw_buffer *buf;
+	uint64_t now = get_time_ns();
+
+	while ((buf = pw_stream_dequeue_buffer(data->ret)) != NULL) {
+		if ((h = spa_buffer_find_meta(buf->buffer, data->t->meta.Header)) &&
+		    h->pts > 0 && (uint64_t) h->pts <= now)
+			add_stats(&data->round_trip, now - h->pts);
+		pw_stream_queue_buffer(data->ret, buf);
+	}
+}
+
+/* link the input stream @stream to the output stream @target */
+static void connect_input(struct data *data, struct pw_stream *stream, struct pw_stream *target)
+{
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	char target_id[16];
+
+	snprintf(target_id, sizeof(target_id), "%d", pw_stream_get_node_id(target));
+
+	params[0] = spa_pod_builder_object(&b,
+		data->t->param.idEnumFormat, data->t->spa_format,
+		"I", data->type.media_type.video,
+		"I", data->type.media_subtype.raw,
+		":", data->type.format_video.format,    "I", data->type.video_format.RGB,
+		":", data->type.format_video.size,      "Rru", &SPA_RECTANGLE(WIDTH, HEIGHT),
+			SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(1, 1),
+					     &SPA_RECTANGLE(4096, 4096)),
+		":", data->type.format_video.framerate, "Fru", &SPA_FRACTION(25, 1),
+			SPA_POD_PROP_MIN_MAX(&SPA_FRACTION(0, 1),
+					     &SPA_FRACTION(1000, 1)));
+
+	pw_stream_connect(stream,
+			  PW_DIRECTION_INPUT,
+			  target_id,
+			  PW_STREAM_FLAG_AUTOCONNECT |
+			  PW_STREAM_FLAG_RT_THREAD,
+			  params, 1);
+}
+
+static void on_source_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct data *data = _data;
+
+	printf("source state: \"%s\"\n", pw_stream_state_as_string(state));
+
+	switch (state) {
+	case PW_STREAM_STATE_CONFIGURE:
+		if (old == PW_STREAM_STATE_CONNECTING)
+			connect_input(data, data->echo_in, data->source);
+		break;
+	case PW_STREAM_STATE_STREAMING:
+	{
+		struct timespec timeout, interval;
+
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = 1;
+		interval.tv_sec = data->interval / SPA_NSEC_PER_SEC;
+		interval.tv_nsec = data->interval % SPA_NSEC_PER_SEC;
+
+		pw_loop_update_timer(pw_main_loop_get_loop(data->loop),
+				data->timer, &timeout, &interval, false);
+
+		interval.tv_sec = 1;
+		interval.tv_nsec = 0;
+		pw_loop_update_timer(pw_main_loop_get_loop(data->loop),
+				data->report, &interval, &interval, false);
+		break;
+	}
+	default:
+		pw_loop_update_timer(pw_main_loop_get_loop(data->loop),
+				data->timer, NULL, NULL, false);
+		break;
+	}
+}
+
+static void finish_output_format(struct data *data, struct pw_stream *stream,
+				 const struct spa_pod *format)
+{
+	struct pw_type *t = data->t;
+	struct spa_video_info_raw info;
+	uint8_t params_buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(params_buffer, sizeof(params_buffer));
+	const struct spa_pod *params[2];
+	int32_t stride;
+
+	if (format == NULL) {
+		pw_stream_finish_format(stream, 0, NULL, 0);
+		return;
+	}
+	spa_format_video_raw_parse(format, &info, &data->type.format_video);
+
+	stride = SPA_ROUND_UP_N(info.size.width * BPP, 4);
+
+	params[0] = spa_pod_builder_object(&b,
+		t->param.idBuffers, t->param_buffers.Buffers,
+		":", t->param_buffers.size,    "i", stride * info.size.height,
+		":", t->param_buffers.stride,  "i", stride,
+		":", t->param_buffers.buffers, "iru", 8,
+			SPA_POD_PROP_MIN_MAX(2, 32),
+		":", t->param_buffers.align,   "i", 16);
+
+	params[1] = spa_pod_builder_object(&b,
+		t->param.idMeta, t->param_meta.Meta,
+		":", t->param_meta.type, "I", t->meta.Header,
+		":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+
+	pw_stream_finish_format(stream, 0, params, 2);
+}
+
+static void finish_input_format(struct data *data, struct pw_stream *stream,
+				const struct spa_pod *format)
+{
+	struct pw_type *t = data->t;
+	uint8_t params_buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(params_buffer, sizeof(params_buffer));
+	const struct spa_pod *params[1];
+
+	if (format == NULL) {
+		pw_stream_finish_format(stream, 0, NULL, 0);
+		return;
+	}
+
+	params[0] = spa_pod_builder_object(&b,
+		t->param.idMeta, t->param_meta.Meta,
+		":", t->param_meta.type, "I", t->meta.Header,
+		":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+
+	pw_stream_finish_format(stream, 0, params, 1);
+}
+
+static void
+on_source_format_changed(void *_data, const struct spa_pod *format)
+{
+	struct data *data = _data;
+	finish_output_format(data, data->source, format);
+}
+
+static const struct pw_stream_events source_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_source_state_changed,
+	.format_changed = on_source_format_changed,
+};
+
+static void on_echo_in_state_changed(void *_data, enum pw_stream_state old,
+				     enum pw_stream_state state, const char *error)
+{
+	printf("echo input state: \"%s\"\n", pw_stream_state_as_string(state));
+}
+
+static void
+on_echo_in_format_changed(void *_data, const struct spa_pod *format)
+{
+	struct data *data = _data;
+	finish_input_format(data, data->echo_in, format);
+}
+
+static const struct pw_stream_events echo_in_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_echo_in_state_changed,
+	.format_changed = on_echo_in_format_changed,
+	.process = on_echo_in_process,
+};
+
+static void on_echo_out_state_changed(void *_data, enum pw_stream_state old,
+				      enum pw_stream_state state, const char *error)
+{
+	struct data *data = _data;
+
+	printf("echo output state: \"%s\"\n", pw_stream_state_as_string(state));
+
+	if (state == PW_STREAM_STATE_CONFIGURE && old == PW_STREAM_STATE_CONNECTING)
+		connect_input(data, data->ret, data->echo_out);
+}
+
+static void
+on_echo_out_format_changed(void *_data, const struct spa_pod *format)
+{
+	struct data *data = _data;
+	finish_output_format(data, data->echo_out, format);
+}
+
+static const struct pw_stream_events echo_out_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_echo_out_state_changed,
+	.format_changed = on_echo_out_format_changed,
+};
+
+static void on_ret_state_changed(void *_data, enum pw_stream_state old,
+				 enum pw_stream_state state, const char *error)
+{
+	printf("return state: \"%s\"\n", pw_stream_state_as_string(state));
+}
+
+static void
+on_ret_format_changed(void *_data, const struct spa_pod *format)
+{
+	struct data *data = _data;
+	finish_input_format(data, data->ret, format);
+}
+
+static const struct pw_stream_events ret_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_ret_state_changed,
+	.format_changed = on_ret_format_changed,
+	.process = on_ret_process,
+};
+
+static struct pw_stream *make_stream(struct data *data, const char *name, const char *category,
+				     struct spa_hook *listener, const struct pw_stream_events *events)
+{
+	struct pw_stream *stream;
+
+	stream = pw_stream_new(data->remote, name,
+			pw_properties_new(
+				PW_NODE_PROP_MEDIA, "Video",
+				PW_NODE_PROP_CATEGORY, category,
+				NULL));
+	pw_stream_add_listener(stream, listener, events, data);
+	return stream;
+}
+
+static void connect_output(struct data *data, struct pw_stream *stream)
+{
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+	params[0] = spa_pod_builder_object(&b,
+		data->t->param.idEnumFormat, data->t->spa_format,
+		"I", data->type.media_type.video,
+		"I", data->type.media_subtype.raw,
+		":", data->type.format_video.format,    "I", data->type.video_format.RGB,
+		":", data->type.format_video.size,      "R", &SPA_RECTANGLE(WIDTH, HEIGHT),
+		":", data->type.format_video.framerate, "F",
+			&SPA_FRACTION(SPA_NSEC_PER_SEC / data->interval, 1));
+
+	pw_stream_connect(stream,
+			  PW_DIRECTION_OUTPUT,
+			  NULL,
+			  PW_STREAM_FLAG_DRIVER |
+			  PW_STREAM_FLAG_MAP_BUFFERS,
+			  params, 1);
+}
+
+static void on_state_changed(void *_data, enum pw_remote_state old, enum pw_remote_state state, const char *error)
+{
+	struct data *data = _data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		printf("remote error: %s\n", error);
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		printf("remote state: \"%s\"\n",
+		       pw_remote_state_as_string(state));
+
+		data->source = make_stream(data, "latency-source", "Source",
+					   &data->source_listener, &source_events);
+		data->echo_in = make_stream(data, "latency-echo-input", "Capture",
+					    &data->echo_in_listener, &echo_in_events);
+		data->echo_out = make_stream(data, "latency-echo-output", "Source",
+					     &data->echo_out_listener, &echo_out_events);
+		data->ret = make_stream(data, "latency-return", "Capture",
+					&data->ret_listener, &ret_events);
+
+		connect_output(data, data->echo_out);
+		connect_output(data, data->source);
+		break;
+
+	default:
+		printf("remote state: \"%s\"\n", pw_remote_state_as_string(state));
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+
+	pw_init(&argc, &argv);
+
+	data.seconds = argc > 1 ? atoi(argv[1]) : 10;
+	data.interval = (argc > 2 ? atoi(argv[2]) : 10000) * SPA_NSEC_PER_USEC;
+	if (data.seconds <= 0 || data.interval == 0) {
+		fprintf(stderr, "usage: %s [seconds] [interval-usec]\n", argv[0]);
+		return -1;
+	}
+	data.one_way.min = UINT64_MAX;
+	data.round_trip.min = UINT64_MAX;
+	spa_ringbuffer_init(&data.pending);
+
+	data.loop = pw_main_loop_new(NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), NULL);
+	data.t = pw_core_get_type(data.core);
+	data.remote = pw_remote_new(data.core, NULL, 0);
+
+	init_type(&data.type, data.t->map);
+
+	data.timer = pw_loop_add_timer(pw_main_loop_get_loop(data.loop), on_timeout, &data);
+	data.report = pw_loop_add_timer(pw_main_loop_get_loop(data.loop), on_report, &data);
+	data.echo = pw_loop_add_event(pw_main_loop_get_loop(data.loop), on_echo, &data);
+
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+
+	pw_remote_connect(data.remote);
+
+	pw_main_loop_run(data.loop);
+
+	if (data.ret)
+		pw_stream_destroy(data.ret);
+	if (data.echo_out)
+		pw_stream_destroy(data.echo_out);
+	if (data.echo_in)
+		pw_stream_destroy(data.echo_in);
+	if (data.source)
+		pw_stream_destroy(data.source);
+
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -34,7 +34,8 @@ struct pw_client_node_proxy;
 
 #define PW_TYPE_INTERFACE__ClientNode		PW_TYPE_INTERFACE_BASE "ClientNode"
 
-#define PW_VERSION_CLIENT_NODE			0
+/* version 1 has the padded transport ringbuffers */
+#define PW_VERSION_CLIENT_NODE			1
 
 struct pw_client_node_message;
 
@@ -59,9 +60,9 @@ struct pw_client_node_transport {
 	struct spa_io_buffers *inputs;		/**< array of buffer input io */
 	struct spa_io_buffers *outputs;		/**< array of buffer output io */
 	void *input_data;			/**< input memory for ringbuffer */
-	struct spa_ringbuffer *input_buffer;	/**< ringbuffer for input memory */
+	struct spa_ringbuffer_padded *input_buffer;	/**< ringbuffer for input memory */
 	void *output_data;			/**< output memory for ringbuffer */
-	struct spa_ringbuffer *output_buffer;	/**< ringbuffer for output memory */
+	struct spa_ringbuffer_padded *output_buffer;	/**< ringbuffer for output memory */
 
 	/** Destroy a transport
 	 * \param trans a transport to destroy
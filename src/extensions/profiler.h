@@ -0,0 +1,89 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_EXT_PROFILER_H__
+#define __PIPEWIRE_EXT_PROFILER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/utils/defs.h>
+#include <spa/pod/pod.h>
+
+#include <pipewire/proxy.h>
+
+struct pw_profiler_proxy;
+
+#define PW_TYPE_INTERFACE__Profiler		PW_TYPE_INTERFACE_BASE "Profiler"
+
+#define PW_VERSION_PROFILER			0
+
+#define PW_PROFILER_PROXY_METHOD_NUM		0
+
+#define PW_PROFILER_PROXY_EVENT_PROFILE		0
+#define PW_PROFILER_PROXY_EVENT_NUM		1
+
+/** \ref pw_profiler events */
+struct pw_profiler_proxy_events {
+#define PW_VERSION_PROFILER_PROXY_EVENTS	0
+	uint32_t version;
+	/**
+	 * Emitted periodically with the statistics of the data thread
+	 * since the previous event.
+	 *
+	 * The profile is a struct with:
+	 *
+	 *   Long: the duration of the measurement in nsec
+	 *   Int: the number of cycles
+	 *   Int: the number of xruns, cycles that took longer than their period
+	 *   Int: the number of records lost because the ring was full
+	 *   Long: the average and Long: the maximum cycle period in nsec
+	 *   Long: the average and Long: the maximum cycle processing time in nsec
+	 *   Long: the average and Long: the maximum wakeup latency in nsec
+	 *
+	 * followed by a struct for each node that was processed with:
+	 *
+	 *   Int: the node global id
+	 *   Int: the number of times the node was processed
+	 *   Long: the total, Long: the average and Long: the maximum processing
+	 *         time in nsec
+	 *
+	 * \param profile the profile
+	 */
+	void (*profile) (void *object, const struct spa_pod *profile);
+};
+
+static inline void
+pw_profiler_proxy_add_listener(struct pw_profiler_proxy *p,
+			       struct spa_hook *listener,
+			       const struct pw_profiler_proxy_events *events,
+			       void *data)
+{
+	pw_proxy_add_proxy_listener((struct pw_proxy*)p, listener, events, data);
+}
+
+#define pw_profiler_resource_profile(r,...)	\
+	pw_resource_notify(r,struct pw_profiler_proxy_events,profile,__VA_ARGS__)
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __PIPEWIRE_EXT_PROFILER_H__ */
@@ -76,6 +76,7 @@ struct impl {
 struct buffer {
         struct spa_list link;
 	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
 	void *ptr;
 };
 
@@ -278,6 +279,7 @@ static int node_process_input(struct spa_node *node)
 	struct buffer *out;
 	int16_t *op;
 	int i;
+	bool gap = true;
 
 	pw_log_trace(NAME " %p: process input", this);
 
@@ -301,9 +303,15 @@ static int node_process_input(struct spa_node *node)
 		struct buffer *in;
 		int stride = 2;
 
-		if (inio->buffer_id < inp->n_buffers && inio->status == SPA_STATUS_HAVE_BUFFER) {
+		if (inio->buffer_id < inp->n_buffers && inio->status == SPA_STATUS_HAVE_BUFFER)
 			in = &inp->buffers[inio->buffer_id];
+		else
+			in = NULL;
+
+		/* silent channels don't need to be converted */
+		if (in && !(in->h && (in->h->flags & SPA_META_HEADER_FLAG_GAP))) {
 			conv_f32_s16(op, in->ptr, n->buffer_size, stride);
+			gap = false;
 		}
 		else {
 			fill_s16(op, n->buffer_size, stride);
@@ -316,6 +324,13 @@ static int node_process_input(struct spa_node *node)
 	out->outbuf->datas[0].chunk->size = n->buffer_size * sizeof(int16_t) * 2;
 	out->outbuf->datas[0].chunk->stride = 0;
 
+	if (out->h) {
+		if (gap)
+			out->h->flags |= SPA_META_HEADER_FLAG_GAP;
+		else
+			out->h->flags &= ~SPA_META_HEADER_FLAG_GAP;
+	}
+
 	return outio->status;
 }
 
@@ -469,6 +484,15 @@ static int port_enum_params(struct spa_node *node,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
 			":", t->param_buffers.align,   "i", 16);
 	}
+	else if (id == t->param.idMeta) {
+		if (*index > 0)
+			return 0;
+
+		param = spa_pod_builder_object(&b,
+			id, t->param_meta.Meta,
+			":", t->param_meta.type, "I", t->meta.Header,
+			":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+	}
 	else
 		return -ENOENT;
 
@@ -544,6 +568,7 @@ static int port_use_buffers(struct spa_node *node, enum spa_direction direction,
 
                 b = &p->buffers[i];
 		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], t->meta.Header);
 		if ((d[0].type == t->data.MemPtr ||
 		     d[0].type == t->data.MemFd ||
 		     d[0].type == t->data.DmaBuf) && d[0].data != NULL) {
@@ -143,30 +143,47 @@ link_state_changed(void *data, enum pw_link_state old, enum pw_link_state state,
 	}
 }
 
-static void try_link_controls(struct impl *impl, struct pw_port *port, struct pw_port *target)
+static bool has_sequence_control(struct pw_port *port, enum spa_direction direction,
+		uint32_t prop_id)
+{
+	struct pw_control *c;
+
+	spa_list_for_each(c, &port->control_list[direction], port_link) {
+		if (c->prop_id == prop_id && c->sequence)
+			return true;
+	}
+	return false;
+}
+
+static void link_controls(struct impl *impl, struct pw_port *output, struct pw_port *input)
 {
 	struct pw_control *cin, *cout;
 	int res;
 
-	pw_log_debug("module %p: trying controls", impl);
-	spa_list_for_each(cout, &port->control_list[SPA_DIRECTION_OUTPUT], port_link) {
-		spa_list_for_each(cin, &target->control_list[SPA_DIRECTION_INPUT], port_link) {
-			if (cin->prop_id == cout->prop_id) {
-				if ((res = pw_control_link(cout, cin)) < 0)
-					pw_log_error("failed to link controls: %s", spa_strerror(res));
-			}
+	spa_list_for_each(cout, &output->control_list[SPA_DIRECTION_OUTPUT], port_link) {
+		spa_list_for_each(cin, &input->control_list[SPA_DIRECTION_INPUT], port_link) {
+			if (cin->prop_id != cout->prop_id ||
+			    cin->sequence != cout->sequence)
+				continue;
+
+			/* prefer sample accurate control sequences when both
+			 * sides support them */
+			if (!cout->sequence &&
+			    has_sequence_control(output, SPA_DIRECTION_OUTPUT, cout->prop_id) &&
+			    has_sequence_control(input, SPA_DIRECTION_INPUT, cin->prop_id))
+				continue;
+
+			if ((res = pw_control_link(cout, cin)) < 0)
+				pw_log_error("failed to link controls: %s", spa_strerror(res));
 		}
 	}
-	spa_list_for_each(cin, &port->control_list[SPA_DIRECTION_INPUT], port_link) {
-		spa_list_for_each(cout, &target->control_list[SPA_DIRECTION_OUTPUT], port_link) {
-			if (cin->prop_id == cout->prop_id) {
-				if ((res = pw_control_link(cout, cin)) < 0)
-					pw_log_error("failed to link controls: %s", spa_strerror(res));
-			}
-		}
-	}
-
+}
 
+static void try_link_controls(struct impl *impl, struct pw_port *port, struct pw_port *target)
+{
+	pw_log_debug("module %p: trying controls", impl);
+	link_controls(impl, port, target);
+	link_controls(impl, target, port);
 }
 
 static void
@@ -1030,6 +1030,9 @@ client_node_port_update(void *data,
 			       port_id,
 			       change_mask,
 			       n_params, params, info);
+
+		if (change_mask & PW_CLIENT_NODE_PORT_UPDATE_PARAMS)
+			pw_node_invalidate_formats(impl->this.node);
 	}
 	pw_node_update_ports(impl->this.node);
 }
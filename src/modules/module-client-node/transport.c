@@ -50,9 +50,10 @@ static size_t area_get_size(struct pw_client_node_area *area)
 	size = sizeof(struct pw_client_node_area);
 	size += area->max_input_ports * sizeof(struct spa_io_buffers);
 	size += area->max_output_ports * sizeof(struct spa_io_buffers);
-	size += sizeof(struct spa_ringbuffer);
+	size = SPA_ROUND_UP_N(size, SPA_CACHE_LINE_SIZE);
+	size += sizeof(struct spa_ringbuffer_padded);
 	size += INPUT_BUFFER_SIZE;
-	size += sizeof(struct spa_ringbuffer);
+	size += sizeof(struct spa_ringbuffer_padded);
 	size += OUTPUT_BUFFER_SIZE;
 	return size;
 }
@@ -60,6 +61,7 @@ static size_t area_get_size(struct pw_client_node_area *area)
 static void transport_setup_area(void *p, struct pw_client_node_transport *trans)
 {
 	struct pw_client_node_area *a;
+	void *start = p;
 
 	trans->area = a = p;
 	p = SPA_MEMBER(p, sizeof(struct pw_client_node_area), struct spa_io_buffers);
@@ -70,14 +72,17 @@ static void transport_setup_area(void *p, struct pw_client_node_transport *trans
 	trans->outputs = p;
 	p = SPA_MEMBER(p, a->max_output_ports * sizeof(struct spa_io_buffers), void);
 
+	/* keep the ringbuffer indexes on their own cache lines */
+	p = SPA_MEMBER(start, SPA_ROUND_UP_N(SPA_PTRDIFF(p, start), SPA_CACHE_LINE_SIZE), void);
+
 	trans->input_buffer = p;
-	p = SPA_MEMBER(p, sizeof(struct spa_ringbuffer), void);
+	p = SPA_MEMBER(p, sizeof(struct spa_ringbuffer_padded), void);
 
 	trans->input_data = p;
 	p = SPA_MEMBER(p, INPUT_BUFFER_SIZE, void);
 
 	trans->output_buffer = p;
-	p = SPA_MEMBER(p, sizeof(struct spa_ringbuffer), void);
+	p = SPA_MEMBER(p, sizeof(struct spa_ringbuffer_padded), void);
 
 	trans->output_data = p;
 	p = SPA_MEMBER(p, OUTPUT_BUFFER_SIZE, void);
@@ -96,8 +101,8 @@ static void transport_reset_area(struct pw_client_node_transport *trans)
 		trans->outputs[i].status = SPA_STATUS_OK;
 		trans->outputs[i].buffer_id = SPA_ID_INVALID;
 	}
-	spa_ringbuffer_init(trans->input_buffer);
-	spa_ringbuffer_init(trans->output_buffer);
+	spa_ringbuffer_padded_init(trans->input_buffer);
+	spa_ringbuffer_padded_init(trans->output_buffer);
 }
 
 static void destroy(struct pw_client_node_transport *trans)
@@ -119,16 +124,17 @@ static int add_message(struct pw_client_node_transport *trans, struct pw_client_
 	if (impl == NULL || message == NULL)
 		return -EINVAL;
 
-	filled = spa_ringbuffer_get_write_index(trans->output_buffer, &index);
-	avail = OUTPUT_BUFFER_SIZE - filled;
 	size = SPA_POD_SIZE(message);
+	filled = spa_ringbuffer_padded_get_write_index(trans->output_buffer, &index,
+						       OUTPUT_BUFFER_SIZE, size);
+	avail = OUTPUT_BUFFER_SIZE - filled;
 	if (avail < size)
 		return -ENOSPC;
 
-	spa_ringbuffer_write_data(trans->output_buffer,
+	spa_ringbuffer_write_data(NULL,
 				  trans->output_data, OUTPUT_BUFFER_SIZE,
 				  index & (OUTPUT_BUFFER_SIZE - 1), message, size);
-	spa_ringbuffer_write_update(trans->output_buffer, index + size);
+	spa_ringbuffer_padded_write_update(trans->output_buffer, index + size);
 
 	return 0;
 }
@@ -141,11 +147,12 @@ static int next_message(struct pw_client_node_transport *trans, struct pw_client
 	if (impl == NULL || message == NULL)
 		return -EINVAL;
 
-	avail = spa_ringbuffer_get_read_index(trans->input_buffer, &impl->current_index);
+	avail = spa_ringbuffer_padded_get_read_index(trans->input_buffer, &impl->current_index,
+						     sizeof(struct pw_client_node_message));
 	if (avail < sizeof(struct pw_client_node_message))
 		return 0;
 
-	spa_ringbuffer_read_data(trans->input_buffer,
+	spa_ringbuffer_read_data(NULL,
 				 trans->input_data, INPUT_BUFFER_SIZE,
 				 impl->current_index & (INPUT_BUFFER_SIZE - 1),
 				 &impl->current, sizeof(struct pw_client_node_message));
@@ -168,10 +175,10 @@ static int parse_message(struct pw_client_node_transport *trans, void *message)
 
 	size = SPA_POD_SIZE(&impl->current);
 
-	spa_ringbuffer_read_data(trans->input_buffer,
+	spa_ringbuffer_read_data(NULL,
 				 trans->input_data, INPUT_BUFFER_SIZE,
 				 impl->current_index & (INPUT_BUFFER_SIZE - 1), message, size);
-	spa_ringbuffer_read_update(trans->input_buffer, impl->current_index + size);
+	spa_ringbuffer_padded_read_update(trans->input_buffer, impl->current_index + size);
 
 	return 0;
 }
@@ -20,7 +20,6 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
-#include <dlfcn.h>
 
 #include "config.h"
 
@@ -28,6 +27,7 @@
 #include "pipewire/link.h"
 #include "pipewire/log.h"
 #include "pipewire/module.h"
+#include "pipewire/pipewire.h"
 #include "pipewire/type.h"
 #include "modules/spa/spa-node.h"
 
@@ -41,7 +41,6 @@ struct impl {
 	struct spa_hook module_listener;
 	struct pw_properties *properties;
 
-	void *hnd;
 	const struct spa_handle_factory *factory;
 
 	struct spa_list node_list;
@@ -54,46 +53,12 @@ struct node_data {
 
 static const struct spa_handle_factory *find_factory(struct impl *impl)
 {
-	spa_handle_factory_enum_func_t enum_func;
-	uint32_t index;
-	const struct spa_handle_factory *factory = NULL;
-	int res;
-	char *filename;
-	const char *dir;
-
-	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL)
-		dir = PLUGINDIR;
+	const struct spa_handle_factory *factory;
 
-	asprintf(&filename, "%s/%s.so", dir, AUDIOMIXER_LIB);
+	if ((factory = pw_get_spa_handle_factory(NULL, AUDIOMIXER_LIB, "audiomixer")) == NULL)
+		pw_log_error("can't find audiomixer factory in %s", AUDIOMIXER_LIB);
 
-	if ((impl->hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-		pw_log_error("can't load %s: %s", AUDIOMIXER_LIB, dlerror());
-		goto open_failed;
-	}
-	if ((enum_func = dlsym(impl->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		pw_log_error("can't find enum function");
-		goto no_symbol;
-	}
-
-	for (index = 0;;) {
-		if ((res = enum_func(&factory, &index)) <= 0) {
-			if (res != 0)
-				pw_log_error("can't enumerate factories: %s", spa_strerror(res));
-			goto enum_failed;
-		}
-		if (strcmp(factory->name, "audiomixer") == 0)
-			break;
-	}
-	free(filename);
 	return factory;
-
-      enum_failed:
-      no_symbol:
-	dlclose(impl->hnd);
-	impl->hnd = NULL;
-      open_failed:
-	free(filename);
-	return NULL;
 }
 
 static struct pw_node *make_node(struct impl *impl)
@@ -0,0 +1,666 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include "config.h"
+
+#include <spa/utils/ringbuffer.h>
+#include <spa/pod/builder.h>
+#include <spa/graph/graph.h>
+
+#include "pipewire/core.h"
+#include "pipewire/interfaces.h"
+#include "pipewire/log.h"
+#include "pipewire/mem.h"
+#include "pipewire/module.h"
+#include "pipewire/private.h"
+
+#include "extensions/profiler.h"
+
+/** report interval in seconds */
+#define PROFILER_INTERVAL	1
+
+#define RING_SIZE	(1u << 16)
+#define RING_MASK	(RING_SIZE - 1)
+
+struct pw_protocol *pw_protocol_native_ext_profiler_init(struct pw_core *core);
+
+enum record_type {
+	RECORD_NODE,		/**< processing of a node */
+	RECORD_CYCLE,		/**< a graph cycle started by a driver */
+	RECORD_WAKEUP,		/**< wakeup latency of a driver */
+};
+
+/** a fixed size record written by the data thread */
+struct record {
+	uint32_t type;
+	int32_t status;
+	struct spa_graph_node *node;
+	int64_t start;
+	int64_t end;		/**< end time or latency for RECORD_WAKEUP */
+};
+
+/** ringbuffer area between the data thread (writer) and the main thread (reader) */
+struct area {
+	struct spa_ringbuffer ring;
+	uint32_t n_dropped;
+	uint8_t data[RING_SIZE];
+};
+
+struct stats {
+	struct spa_graph_node *node;
+	uint32_t n_runs;
+	int64_t total;
+	int64_t max;
+};
+
+struct node_data {
+	struct spa_list link;
+	struct impl *impl;
+	struct pw_node *node;
+	struct spa_hook node_listener;
+};
+
+struct resource_data {
+	struct spa_hook resource_listener;
+};
+
+struct impl {
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_module *module;
+	struct spa_hook core_listener;
+	struct spa_hook module_listener;
+	struct pw_properties *properties;
+
+	uint32_t type_profiler;
+	struct pw_global *global;
+	struct spa_hook global_listener;
+	struct spa_list resource_list;
+
+	struct pw_memblock *mem;
+	struct area *area;
+
+	struct spa_list node_list;
+	struct spa_source *timer;
+
+	const struct spa_graph_callbacks *old_callbacks;
+	void *old_callbacks_data;
+
+	/* only accessed from the data thread */
+	struct {
+		uint32_t depth;
+		int64_t begin[16];
+		uint32_t cycle_depth;
+		int64_t cycle_start;
+	} rt;
+
+	/* statistics of the current interval, main thread */
+	int64_t last_report;
+	uint32_t n_dropped;
+	struct spa_graph_node *last_driver;
+	int64_t last_cycle_start;
+	uint32_t n_cycles;
+	uint32_t n_xruns;
+	uint32_t n_periods;
+	int64_t period_total, period_max;
+	int64_t busy_total, busy_max;
+	uint32_t n_wakeups;
+	int64_t wakeup_total, wakeup_max;
+	struct pw_array stats;
+};
+
+static inline int64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void write_record(struct impl *impl, uint32_t type, int32_t status,
+			 struct spa_graph_node *node, int64_t start, int64_t end)
+{
+	struct area *a = impl->area;
+	struct record r = { type, status, node, start, end };
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&a->ring, &index);
+	if (filled < 0 || filled + sizeof(r) > RING_SIZE) {
+		a->n_dropped++;
+		return;
+	}
+	spa_ringbuffer_write_data(&a->ring, a->data, RING_SIZE, index & RING_MASK, &r, sizeof(r));
+	spa_ringbuffer_write_update(&a->ring, index + sizeof(r));
+}
+
+static void profiler_process_begin(void *data, struct spa_graph_node *node)
+{
+	struct impl *impl = data;
+
+	if (impl->rt.depth < SPA_N_ELEMENTS(impl->rt.begin))
+		impl->rt.begin[impl->rt.depth] = get_time();
+	impl->rt.depth++;
+}
+
+static void profiler_process_end(void *data, struct spa_graph_node *node, int status)
+{
+	struct impl *impl = data;
+
+	if (impl->rt.depth == 0)
+		return;
+	if (--impl->rt.depth < SPA_N_ELEMENTS(impl->rt.begin))
+		write_record(impl, RECORD_NODE, status, node,
+			     impl->rt.begin[impl->rt.depth], get_time());
+}
+
+static const struct spa_graph_profiler graph_profiler = {
+	SPA_VERSION_GRAPH_PROFILER,
+	.process_begin = profiler_process_begin,
+	.process_end = profiler_process_end,
+};
+
+/* a cycle is a graph run that is not nested in another one */
+static inline void cycle_begin(struct impl *impl)
+{
+	if (impl->rt.cycle_depth++ == 0)
+		impl->rt.cycle_start = get_time();
+}
+
+static inline void cycle_end(struct impl *impl, struct spa_graph_node *node)
+{
+	if (--impl->rt.cycle_depth == 0)
+		write_record(impl, RECORD_CYCLE, 0, node, impl->rt.cycle_start, get_time());
+}
+
+static int profiler_need_input(void *data, struct spa_graph_node *node)
+{
+	struct impl *impl = data;
+	int res;
+
+	cycle_begin(impl);
+	res = impl->old_callbacks->need_input(impl->old_callbacks_data, node);
+	cycle_end(impl, node);
+
+	return res;
+}
+
+static int profiler_have_output(void *data, struct spa_graph_node *node)
+{
+	struct impl *impl = data;
+	int res;
+
+	cycle_begin(impl);
+	res = impl->old_callbacks->have_output(impl->old_callbacks_data, node);
+	cycle_end(impl, node);
+
+	return res;
+}
+
+static const struct spa_graph_callbacks graph_callbacks = {
+	SPA_VERSION_GRAPH_CALLBACKS,
+	.need_input = profiler_need_input,
+	.have_output = profiler_have_output,
+};
+
+static int do_add_profiler(struct spa_loop *loop,
+			   bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	struct spa_graph *graph = &impl->core->rt.graph;
+
+	impl->old_callbacks = graph->callbacks;
+	impl->old_callbacks_data = graph->callbacks_data;
+	spa_graph_set_callbacks(graph, &graph_callbacks, impl);
+	spa_graph_set_profiler(graph, &graph_profiler, impl);
+	return 0;
+}
+
+static int do_remove_profiler(struct spa_loop *loop,
+			      bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	struct spa_graph *graph = &impl->core->rt.graph;
+
+	spa_graph_set_callbacks(graph, impl->old_callbacks, impl->old_callbacks_data);
+	spa_graph_set_profiler(graph, NULL, NULL);
+	return 0;
+}
+
+/* the driver wakeup latency is the time between the clock update of the
+ * driver and the start of the cycle. need_input is emitted before the
+ * cycle, have_output after it. */
+static void write_wakeup(struct impl *impl, struct pw_node *node, int64_t now)
+{
+	struct spa_io_clock *c = node->clock_io;
+
+	if (c == NULL || c->monotonic_time <= 0 || impl->rt.cycle_depth > 0)
+		return;
+
+	write_record(impl, RECORD_WAKEUP, 0, &node->rt.node, now, now - c->monotonic_time);
+}
+
+static void node_need_input(void *data)
+{
+	struct node_data *nd = data;
+	write_wakeup(nd->impl, nd->node, get_time());
+}
+
+static void node_have_output(void *data)
+{
+	struct node_data *nd = data;
+	write_wakeup(nd->impl, nd->node, nd->impl->rt.cycle_start);
+}
+
+static void node_destroy(void *data)
+{
+	struct node_data *nd = data;
+
+	spa_list_remove(&nd->link);
+	spa_hook_remove(&nd->node_listener);
+	free(nd);
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.destroy = node_destroy,
+	.need_input = node_need_input,
+	.have_output = node_have_output,
+};
+
+static int on_global(void *data, struct pw_global *global)
+{
+	struct impl *impl = data;
+	struct node_data *nd;
+
+	if (pw_global_get_type(global) != impl->t->node)
+		return 0;
+
+	if ((nd = calloc(1, sizeof(struct node_data))) == NULL)
+		return -ENOMEM;
+
+	nd->impl = impl;
+	nd->node = pw_global_get_object(global);
+	spa_list_append(&impl->node_list, &nd->link);
+	pw_node_add_listener(nd->node, &nd->node_listener, &node_events, nd);
+
+	return 0;
+}
+
+static void
+core_global_added(void *data, struct pw_global *global)
+{
+	on_global(data, global);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+        .global_added = core_global_added,
+};
+
+static struct stats *find_stats(struct impl *impl, struct spa_graph_node *node)
+{
+	struct stats *s;
+
+	pw_array_for_each(s, &impl->stats) {
+		if (s->node == node)
+			return s;
+	}
+	if ((s = pw_array_add(&impl->stats, sizeof(struct stats))) == NULL)
+		return NULL;
+
+	spa_zero(*s);
+	s->node = node;
+	return s;
+}
+
+static void process_record(struct impl *impl, const struct record *r)
+{
+	struct stats *s;
+	int64_t busy, period;
+
+	switch (r->type) {
+	case RECORD_NODE:
+		if ((s = find_stats(impl, r->node)) == NULL)
+			break;
+		busy = r->end - r->start;
+		s->n_runs++;
+		s->total += busy;
+		s->max = SPA_MAX(s->max, busy);
+		break;
+
+	case RECORD_CYCLE:
+		busy = r->end - r->start;
+		impl->n_cycles++;
+		impl->busy_total += busy;
+		impl->busy_max = SPA_MAX(impl->busy_max, busy);
+
+		/* the period is only known between cycles of the same driver */
+		if (impl->last_driver == r->node && impl->last_cycle_start > 0) {
+			period = r->start - impl->last_cycle_start;
+			impl->n_periods++;
+			impl->period_total += period;
+			impl->period_max = SPA_MAX(impl->period_max, period);
+			if (busy > period)
+				impl->n_xruns++;
+		}
+		impl->last_driver = r->node;
+		impl->last_cycle_start = r->start;
+		break;
+
+	case RECORD_WAKEUP:
+		impl->n_wakeups++;
+		impl->wakeup_total += r->end;
+		impl->wakeup_max = SPA_MAX(impl->wakeup_max, r->end);
+		break;
+	}
+}
+
+/* the pw_node of a graph node, port mixers are accounted to their node */
+static struct pw_node *find_node(struct impl *impl, struct spa_graph_node *node)
+{
+	struct node_data *nd;
+	struct pw_port *p;
+
+	spa_list_for_each(nd, &impl->node_list, link) {
+		if (&nd->node->rt.node == node)
+			return nd->node;
+		spa_list_for_each(p, &nd->node->input_ports, link)
+			if (&p->rt.mix_node == node)
+				return nd->node;
+		spa_list_for_each(p, &nd->node->output_ports, link)
+			if (&p->rt.mix_node == node)
+				return nd->node;
+	}
+	return NULL;
+}
+
+static struct spa_pod *build_profile(struct impl *impl, struct spa_pod_builder *b, int64_t duration)
+{
+	struct node_data *nd;
+	struct stats *s;
+	uint32_t ref;
+	struct area *a = impl->area;
+
+	ref = spa_pod_builder_push_struct(b);
+	spa_pod_builder_long(b, duration);
+	spa_pod_builder_int(b, impl->n_cycles);
+	spa_pod_builder_int(b, impl->n_xruns);
+	spa_pod_builder_int(b, a->n_dropped - impl->n_dropped);
+	spa_pod_builder_long(b, impl->n_periods ? impl->period_total / impl->n_periods : 0);
+	spa_pod_builder_long(b, impl->period_max);
+	spa_pod_builder_long(b, impl->n_cycles ? impl->busy_total / impl->n_cycles : 0);
+	spa_pod_builder_long(b, impl->busy_max);
+	spa_pod_builder_long(b, impl->n_wakeups ? impl->wakeup_total / impl->n_wakeups : 0);
+	spa_pod_builder_long(b, impl->wakeup_max);
+
+	spa_list_for_each(nd, &impl->node_list, link) {
+		uint32_t n_runs = 0;
+		int64_t total = 0, max = 0;
+
+		if (nd->node->global == NULL)
+			continue;
+
+		pw_array_for_each(s, &impl->stats) {
+			if (find_node(impl, s->node) != nd->node)
+				continue;
+			n_runs += s->n_runs;
+			total += s->total;
+			max = SPA_MAX(max, s->max);
+		}
+		if (n_runs == 0)
+			continue;
+
+		spa_pod_builder_push_struct(b);
+		spa_pod_builder_int(b, pw_global_get_id(nd->node->global));
+		spa_pod_builder_int(b, n_runs);
+		spa_pod_builder_long(b, total);
+		spa_pod_builder_long(b, total / n_runs);
+		spa_pod_builder_long(b, max);
+		spa_pod_builder_pop(b);
+	}
+	spa_pod_builder_pop(b);
+
+	return spa_pod_builder_deref(b, ref);
+}
+
+static void reset_stats(struct impl *impl)
+{
+	impl->n_dropped = impl->area->n_dropped;
+	impl->n_cycles = impl->n_xruns = impl->n_periods = impl->n_wakeups = 0;
+	impl->period_total = impl->period_max = 0;
+	impl->busy_total = impl->busy_max = 0;
+	impl->wakeup_total = impl->wakeup_max = 0;
+	impl->stats.size = 0;
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	struct area *a = impl->area;
+	struct pw_resource *resource;
+	struct record r;
+	uint32_t index;
+	int32_t avail;
+	int64_t now;
+
+	avail = spa_ringbuffer_get_read_index(&a->ring, &index);
+	while (avail >= (int32_t) sizeof(r)) {
+		spa_ringbuffer_read_data(&a->ring, a->data, RING_SIZE, index & RING_MASK,
+					 &r, sizeof(r));
+		process_record(impl, &r);
+		index += sizeof(r);
+		avail -= sizeof(r);
+	}
+	spa_ringbuffer_read_update(&a->ring, index);
+
+	now = get_time();
+
+	if (!spa_list_is_empty(&impl->resource_list)) {
+		uint8_t buffer[8192];
+		void *data = NULL;
+		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+		struct spa_pod *profile;
+
+		profile = build_profile(impl, &b, now - impl->last_report);
+		if (profile == NULL) {
+			/* too many nodes for the stack buffer, the builder
+			 * counted the size that is needed */
+			uint32_t size = b.state.offset;
+
+			if ((data = malloc(size)) != NULL) {
+				b = SPA_POD_BUILDER_INIT(data, size);
+				profile = build_profile(impl, &b, now - impl->last_report);
+			}
+		}
+		if (profile != NULL) {
+			spa_list_for_each(resource, &impl->resource_list, link)
+				pw_profiler_resource_profile(resource, profile);
+		}
+		else
+			pw_log_warn("profiler %p: can't build profile", impl);
+
+		free(data);
+	}
+	impl->last_report = now;
+	reset_stats(impl);
+}
+
+static void resource_destroy(void *data)
+{
+	struct pw_resource *resource = data;
+	spa_list_remove(&resource->link);
+}
+
+static const struct pw_resource_events resource_events = {
+	PW_VERSION_RESOURCE_EVENTS,
+	.destroy = resource_destroy,
+};
+
+static void
+global_bind(void *_data, struct pw_client *client, uint32_t permissions,
+	    uint32_t version, uint32_t id)
+{
+	struct impl *impl = _data;
+	struct pw_resource *resource;
+	struct resource_data *data;
+
+	resource = pw_resource_new(client, id, permissions, impl->type_profiler, version,
+				   sizeof(*data));
+	if (resource == NULL)
+		goto no_mem;
+
+	data = pw_resource_get_user_data(resource);
+	pw_resource_add_listener(resource, &data->resource_listener, &resource_events, resource);
+
+	pw_log_debug("profiler %p: bound to %d", impl, resource->id);
+
+	spa_list_append(&impl->resource_list, &resource->link);
+
+	return;
+
+      no_mem:
+	pw_log_error("can't create profiler resource");
+	pw_core_resource_error(client->core_resource,
+			       client->core_resource->id, -ENOMEM, "no memory");
+}
+
+static void global_destroy(void *data)
+{
+	struct impl *impl = data;
+	spa_hook_remove(&impl->global_listener);
+	impl->global = NULL;
+}
+
+static const struct pw_global_events global_events = {
+	PW_VERSION_GLOBAL_EVENTS,
+	.destroy = global_destroy,
+	.bind = global_bind,
+};
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+	struct node_data *nd, *t;
+
+	spa_hook_remove(&impl->module_listener);
+
+	if (impl->timer) {
+		pw_loop_invoke(impl->core->data_loop,
+			       do_remove_profiler, SPA_ID_INVALID, NULL, 0, true, impl);
+
+		spa_hook_remove(&impl->core_listener);
+		spa_list_for_each_safe(nd, t, &impl->node_list, link)
+			node_destroy(nd);
+
+		pw_loop_destroy_source(impl->core->main_loop, impl->timer);
+		if (impl->global)
+			pw_global_destroy(impl->global);
+		pw_memblock_free(impl->mem);
+	}
+	pw_array_clear(&impl->stats);
+	if (impl->properties)
+		pw_properties_free(impl->properties);
+
+	free(impl);
+}
+
+static const struct pw_module_events module_events = {
+	PW_VERSION_MODULE_EVENTS,
+	.destroy = module_destroy,
+};
+
+static int module_init(struct pw_module *module, struct pw_properties *properties)
+{
+	struct pw_core *core = pw_module_get_core(module);
+	struct impl *impl;
+	struct timespec value, interval;
+	int res;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return -ENOMEM;
+
+	pw_log_debug("module %p: new", impl);
+
+	impl->core = core;
+	impl->t = pw_core_get_type(core);
+	impl->module = module;
+	impl->properties = properties;
+	impl->type_profiler = spa_type_map_get_id(impl->t->map, PW_TYPE_INTERFACE__Profiler);
+	spa_list_init(&impl->resource_list);
+	spa_list_init(&impl->node_list);
+	pw_array_init(&impl->stats, 64 * sizeof(struct stats));
+
+	pw_protocol_native_ext_profiler_init(core);
+
+	/* clients only load the module for the protocol extension */
+	if (pw_properties_get(pw_core_get_properties(core), PW_CORE_PROP_DAEMON) == NULL)
+		goto done;
+
+	if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+				     PW_MEMBLOCK_FLAG_MAP_READWRITE |
+				     PW_MEMBLOCK_FLAG_SEAL,
+				     sizeof(struct area), &impl->mem)) < 0)
+		goto no_mem;
+
+	impl->area = impl->mem->ptr;
+	spa_ringbuffer_init(&impl->area->ring);
+	impl->area->n_dropped = 0;
+
+	impl->global = pw_global_new(core, impl->type_profiler, PW_VERSION_PROFILER, NULL, impl);
+	if (impl->global == NULL) {
+		res = -ENOMEM;
+		goto no_global;
+	}
+
+	pw_global_add_listener(impl->global, &impl->global_listener, &global_events, impl);
+	pw_global_register(impl->global, NULL, pw_module_get_global(module));
+
+	pw_core_for_each_global(core, on_global, impl);
+	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
+
+	impl->last_report = get_time();
+	impl->timer = pw_loop_add_timer(core->main_loop, on_timeout, impl);
+	value.tv_sec = interval.tv_sec = PROFILER_INTERVAL;
+	value.tv_nsec = interval.tv_nsec = 0;
+	pw_loop_update_timer(core->main_loop, impl->timer, &value, &interval, false);
+
+	pw_loop_invoke(core->data_loop, do_add_profiler, SPA_ID_INVALID, NULL, 0, true, impl);
+
+      done:
+	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
+	return 0;
+
+      no_global:
+	pw_memblock_free(impl->mem);
+      no_mem:
+	pw_array_clear(&impl->stats);
+	free(impl);
+	return res;
+}
+
+int pipewire__module_init(struct pw_module *module, const char *args)
+{
+	return module_init(module, NULL);
+}
@@ -0,0 +1,88 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+
+#include <spa/pod/parser.h>
+
+#include "pipewire/pipewire.h"
+#include "pipewire/interfaces.h"
+#include "pipewire/protocol.h"
+#include "pipewire/client.h"
+
+#include "extensions/protocol-native.h"
+#include "extensions/profiler.h"
+
+static void profiler_marshal_profile(void *object, const struct spa_pod *profile)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_PROFILER_PROXY_EVENT_PROFILE);
+
+	spa_pod_builder_struct(b, "P", profile);
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
+static int profiler_demarshal_profile(void *object, void *data, size_t size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	const struct spa_pod *profile;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs, "[ P", &profile, NULL) < 0)
+		return -EINVAL;
+
+	pw_proxy_notify(proxy, struct pw_profiler_proxy_events, profile, 0, profile);
+	return 0;
+}
+
+static const struct pw_profiler_proxy_events pw_protocol_native_profiler_event_marshal = {
+	PW_VERSION_PROFILER_PROXY_EVENTS,
+	&profiler_marshal_profile,
+};
+
+static const struct pw_protocol_native_demarshal pw_protocol_native_profiler_event_demarshal[] = {
+	{ &profiler_demarshal_profile, 0 },
+};
+
+static const struct pw_protocol_marshal pw_protocol_native_profiler_marshal = {
+	PW_TYPE_INTERFACE__Profiler,
+	PW_VERSION_PROFILER,
+	NULL, NULL, PW_PROFILER_PROXY_METHOD_NUM,
+	&pw_protocol_native_profiler_event_marshal,
+	pw_protocol_native_profiler_event_demarshal,
+	PW_PROFILER_PROXY_EVENT_NUM,
+};
+
+struct pw_protocol *pw_protocol_native_ext_profiler_init(struct pw_core *core)
+{
+	struct pw_protocol *protocol;
+
+	protocol = pw_core_find_protocol(core, PW_TYPE_PROTOCOL__Native);
+
+	if (protocol == NULL)
+		return NULL;
+
+	pw_protocol_add_marshal(protocol, &pw_protocol_native_profiler_marshal);
+
+	return protocol;
+}
@@ -158,6 +158,19 @@ core_marshal_destroy(void *object, uint32_t id)
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
+static void
+core_marshal_set_freewheel(void *object, bool freewheel)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_SET_FREEWHEEL);
+
+	spa_pod_builder_struct(b, "b", freewheel);
+
+	pw_protocol_native_end_proxy(proxy, b);
+}
+
 static void
 core_marshal_update_types_client(void *object, uint32_t first_id, const char **types, uint32_t n_types)
 {
@@ -516,6 +529,20 @@ static int core_demarshal_destroy(void *object, void *data, size_t size)
 	return 0;
 }
 
+static int core_demarshal_set_freewheel(void *object, void *data, size_t size)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_parser prs;
+	int freewheel;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs, "[b]", &freewheel, NULL) < 0)
+		return -EINVAL;
+
+	pw_resource_do(resource, struct pw_core_proxy_methods, set_freewheel, 0, freewheel);
+	return 0;
+}
+
 static int core_demarshal_update_types_server(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
@@ -1171,6 +1198,7 @@ static const struct pw_core_proxy_methods pw_protocol_native_core_method_marshal
 	&core_marshal_permissions,
 	&core_marshal_create_object,
 	&core_marshal_destroy,
+	&core_marshal_set_freewheel,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_PROXY_METHOD_NUM] = {
@@ -1181,7 +1209,8 @@ static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_
 	{ &core_demarshal_client_update, 0, },
 	{ &core_demarshal_permissions, 0, },
 	{ &core_demarshal_create_object, PW_PROTOCOL_NATIVE_REMAP, },
-	{ &core_demarshal_destroy, 0, }
+	{ &core_demarshal_destroy, 0, },
+	{ &core_demarshal_set_freewheel, 0, }
 };
 
 static const struct pw_core_proxy_events pw_protocol_native_core_event_marshal = {
@@ -18,7 +18,6 @@
  */
 
 #include <stdio.h>
-#include <dlfcn.h>
 #include <errno.h>
 #include <poll.h>
 #include <string.h>
@@ -32,6 +31,7 @@
 #include <spa/pod/parser.h>
 
 #include <pipewire/log.h>
+#include <pipewire/pipewire.h>
 #include <pipewire/type.h>
 #include <pipewire/node.h>
 
@@ -52,8 +52,6 @@ struct impl {
 	struct pw_type *t;
 	struct pw_global *parent;
 
-	void *hnd;
-
 	struct spa_list item_list;
 };
 
@@ -263,9 +261,7 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	struct spa_handle *handle;
 	int res;
 	void *iface;
-	void *hnd;
 	uint32_t index;
-	spa_handle_factory_enum_func_t enum_func;
 	const struct spa_handle_factory *factory;
 	char *filename;
 	const struct spa_support *support;
@@ -274,23 +270,9 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 
 	asprintf(&filename, "%s/%s.so", dir, lib);
 
-	if ((hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-		pw_log_error("can't load %s: %s", filename, dlerror());
-		goto open_failed;
-	}
-	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		pw_log_error("can't find enum function");
-		goto no_symbol;
-	}
-
-	for (index = 0;;) {
-		if ((res = enum_func(&factory, &index)) <= 0) {
-			if (res != 0)
-				pw_log_error("can't enumerate factories: %s", spa_strerror(res));
-			goto enum_failed;
-		}
-		if (strcmp(factory->name, factory_name) == 0)
-			break;
+	if ((factory = pw_get_spa_handle_factory(dir, lib, factory_name)) == NULL) {
+		pw_log_error("can't find factory %s in %s", factory_name, filename);
+		goto not_found;
 	}
 	support = pw_core_get_support(core, &n_support);
 	handle = calloc(1, factory->size);
@@ -308,7 +290,6 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	impl->core = core;
 	impl->t = t;
 	impl->parent = parent;
-	impl->hnd = hnd;
 
 	this = &impl->this;
 	this->monitor = iface;
@@ -345,10 +326,7 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	spa_handle_clear(handle);
       init_failed:
 	free(handle);
-      enum_failed:
-      no_symbol:
-	dlclose(hnd);
-      open_failed:
+      not_found:
 	free(filename);
 	return NULL;
 
@@ -370,6 +348,5 @@ void pw_spa_monitor_destroy(struct pw_spa_monitor *monitor)
 	free(monitor->factory_name);
 	free(monitor->system_name);
 
-	dlclose(impl->hnd);
 	free(impl);
 }
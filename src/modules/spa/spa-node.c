@@ -23,7 +23,6 @@
 
 #include <string.h>
 #include <stdio.h>
-#include <dlfcn.h>
 
 #include <spa/node/node.h>
 #include <spa/param/props.h>
@@ -33,6 +32,7 @@
 #include "pipewire/node.h"
 #include "pipewire/port.h"
 #include "pipewire/log.h"
+#include "pipewire/pipewire.h"
 #include "pipewire/private.h"
 
 struct impl {
@@ -44,7 +44,6 @@ struct impl {
 	enum pw_spa_node_flags flags;
 	bool async_init;
 
-	void *hnd;
         struct spa_handle *handle;
         struct spa_node *node;          /**< handle to SPA node */
 	char *lib;
@@ -69,8 +68,6 @@ static void pw_spa_node_destroy(void *data)
 	}
 	free(impl->lib);
 	free(impl->factory_name);
-	if (impl->hnd)
-		dlclose(impl->hnd);
 }
 
 static void complete_init(struct impl *impl)
@@ -243,9 +240,6 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 	struct spa_node *spa_node;
 	int res;
 	struct spa_handle *handle;
-	void *hnd;
-	uint32_t index;
-	spa_handle_factory_enum_func_t enum_func;
 	const struct spa_handle_factory *factory;
 	void *iface;
 	char *filename;
@@ -259,23 +253,9 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 
 	asprintf(&filename, "%s/%s.so", dir, lib);
 
-	if ((hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-		pw_log_error("can't load %s: %s", filename, dlerror());
-		goto open_failed;
-	}
-	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		pw_log_error("can't find enum function");
-		goto no_symbol;
-	}
-
-	for (index = 0;;) {
-		if ((res = enum_func(&factory, &index)) <= 0) {
-			if (res != 0)
-				pw_log_error("can't enumerate factories: %s", spa_strerror(res));
-			goto enum_failed;
-		}
-		if (strcmp(factory->name, factory_name) == 0)
-			break;
+	if ((factory = pw_get_spa_handle_factory(dir, lib, factory_name)) == NULL) {
+		pw_log_error("can't find factory %s in %s", factory_name, filename);
+		goto not_found;
 	}
 
 	support = pw_core_get_support(core, &n_support);
@@ -308,7 +288,6 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 			       spa_node, handle, properties, user_data_size);
 
 	impl = this->user_data;
-	impl->hnd = hnd;
 	impl->handle = handle;
 	impl->lib = filename;
 	impl->factory_name = strdup(factory_name);
@@ -319,10 +298,7 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 	spa_handle_clear(handle);
       init_failed:
 	free(handle);
-      enum_failed:
-      no_symbol:
-	dlclose(hnd);
-      open_failed:
+      not_found:
 	free(filename);
 	return NULL;
 }
@@ -18,6 +18,7 @@
  */
 
 #include <spa/pod/parser.h>
+#include <spa/node/io.h>
 
 #include <pipewire/control.h>
 #include <pipewire/private.h>
@@ -47,6 +48,7 @@ pw_control_new(struct pw_core *core,
 
 	direction = spa_pod_is_object_id(param, t->param_io.idPropsOut) ?
 		SPA_DIRECTION_OUTPUT : SPA_DIRECTION_INPUT;
+	this->sequence = spa_pod_is_object_type(param, t->param_io.PropSequence);
 
 	if (spa_pod_object_parse(param,
 				":", t->param_io.id, "I", &this->id,
@@ -54,7 +56,11 @@ pw_control_new(struct pw_core *core,
 				":", t->param.propId, "I", &this->prop_id) < 0)
 		goto exit_free;
 
-	pw_log_debug("control %p: new %s %d", this, spa_type_map_get_type(t->map, this->prop_id), direction);
+	if (this->sequence && this->size < (int32_t) SPA_IO_CONTROL_SEQUENCE_SIZE(1))
+		goto exit_free;
+
+	pw_log_debug("control %p: new %s %d%s", this, spa_type_map_get_type(t->map, this->prop_id),
+			direction, this->sequence ? " sequence" : "");
 
 	this->core = core;
 	this->port = port;
@@ -156,6 +162,10 @@ int pw_control_link(struct pw_control *control, struct pw_control *other)
 	pw_log_debug("control %p: link to %p %s", control, other,
 			spa_type_map_get_type(control->core->type.map, control->prop_id));
 
+	/* a sequence can only be read by a sequence */
+	if (control->sequence != other->sequence)
+		return -EINVAL;
+
 	if (impl->mem == NULL) {
 		if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
 					     PW_MEMBLOCK_FLAG_SEAL |
@@ -164,6 +174,8 @@ int pw_control_link(struct pw_control *control, struct pw_control *other)
 					     &impl->mem)) < 0)
 			goto exit;
 
+		if (control->sequence)
+			spa_io_control_sequence_init(impl->mem->ptr, control->size);
 	}
 
 	if (other->port) {
@@ -174,7 +174,7 @@ static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 						    global->type,
 						    global->version,
 						    global->properties ?
-						        &global->properties->dict : NULL);
+						        pw_properties_get_sorted(global->properties) : NULL);
 		}
 	}
 
@@ -279,6 +279,23 @@ static void core_update_types(void *object, uint32_t first_id, const char **type
 	}
 }
 
+static void core_set_freewheel(void *object, bool freewheel)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+	struct pw_core *this = resource->core;
+	int res;
+
+	if (!PW_PERM_IS_X(pw_global_get_permissions(this->global, client))) {
+		pw_core_resource_error(client->core_resource,
+				       resource->id, -EPERM, "freewheel not allowed");
+		return;
+	}
+	if ((res = pw_core_set_freewheel(this, freewheel)) < 0)
+		pw_core_resource_error(client->core_resource,
+				       resource->id, res, "can't set freewheel: %d", res);
+}
+
 static const struct pw_core_proxy_methods core_methods = {
 	PW_VERSION_CORE_PROXY_METHODS,
 	.hello = core_hello,
@@ -289,6 +306,7 @@ static const struct pw_core_proxy_methods core_methods = {
 	.permissions = core_permissions,
 	.create_object = core_create_object,
 	.destroy = core_destroy,
+	.set_freewheel = core_set_freewheel,
 };
 
 static void core_unbind_func(void *data)
@@ -386,6 +404,10 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	this->main_loop = main_loop;
 
 	pw_type_init(&this->type);
+	spa_type_media_type_map(this->type.map, &this->audio_type.media_type);
+	spa_type_media_subtype_map(this->type.map, &this->audio_type.media_subtype);
+	spa_type_format_audio_map(this->type.map, &this->audio_type.format_audio);
+	spa_type_audio_format_map(this->type.map, &this->audio_type.audio_format);
 	pw_map_init(&this->globals, 128, 32);
 
 	spa_graph_init(&this->rt.graph);
@@ -415,6 +437,7 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	spa_list_init(&this->link_list);
 	spa_list_init(&this->control_list[0]);
 	spa_list_init(&this->control_list[1]);
+	spa_list_init(&this->rt.freewheel_list);
 	spa_hook_list_init(&this->listener_list);
 
 	if ((name = pw_properties_get(properties, PW_CORE_PROP_NAME)) == NULL) {
@@ -571,6 +594,110 @@ int pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict)
 	return 0;
 }
 
+static void freewheel_cycle(void *data)
+{
+	struct pw_core *core = data;
+	struct pw_node *node;
+
+	spa_list_for_each(node, &core->rt.freewheel_list, rt.freewheel_link)
+		pw_node_freewheel_cycle(node);
+}
+
+void pw_core_update_freewheel(struct pw_core *core)
+{
+	bool run = core->freewheel && !spa_list_is_empty(&core->rt.freewheel_list);
+
+	if (run && core->rt.freewheel == NULL) {
+		core->rt.freewheel = pw_loop_add_idle(core->data_loop, true,
+						      freewheel_cycle, core);
+	}
+	else if (!run && core->rt.freewheel != NULL) {
+		pw_loop_destroy_source(core->data_loop, core->rt.freewheel);
+		core->rt.freewheel = NULL;
+	}
+}
+
+static int
+do_freewheel(struct spa_loop *loop,
+	     bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_core *core = user_data;
+	struct pw_node *node, *t;
+
+	if (core->freewheel) {
+		spa_list_for_each(node, &core->node_list, link) {
+			if (!node->freewheel || node->rt.freewheel ||
+			    node->info.n_input_ports == 0)
+				continue;
+			pw_node_set_freewheel(node, true);
+			spa_list_append(&core->rt.freewheel_list, &node->rt.freewheel_link);
+		}
+	}
+	else {
+		spa_list_for_each_safe(node, t, &core->rt.freewheel_list, rt.freewheel_link) {
+			pw_node_set_freewheel(node, false);
+			spa_list_remove(&node->rt.freewheel_link);
+		}
+	}
+	pw_core_update_freewheel(core);
+
+	return 0;
+}
+
+/** Start or stop freewheeling
+ *
+ * \param core a core
+ * \param freewheel if the graph should freewheel
+ * \return 0 on success, < 0 on error
+ *
+ * When freewheeling, the drivers are paused and the graph is processed
+ * as fast as possible from the data thread instead of following the
+ * hardware clocks. The clock io of the drivers has the
+ * SPA_IO_CLOCK_FLAG_FREEWHEEL flag set while freewheeling.
+ *
+ * \memberof pw_core
+ */
+int pw_core_set_freewheel(struct pw_core *core, bool freewheel)
+{
+	struct pw_node *node;
+	struct spa_dict_item items[1];
+
+	if (core->freewheel == freewheel)
+		return 0;
+
+	pw_log_debug("core %p: freewheel %d", core, freewheel);
+
+	if (freewheel) {
+		spa_list_for_each(node, &core->node_list, link) {
+			if (node->clock == NULL || node->info.state != PW_NODE_STATE_RUNNING)
+				continue;
+			spa_node_send_command(node->node,
+					&SPA_COMMAND_INIT(core->type.command_node.Pause));
+			node->freewheel = true;
+		}
+		core->freewheel = true;
+		pw_loop_invoke(core->data_loop, do_freewheel, 1, NULL, 0, true, core);
+	}
+	else {
+		core->freewheel = false;
+		pw_loop_invoke(core->data_loop, do_freewheel, 1, NULL, 0, true, core);
+
+		spa_list_for_each(node, &core->node_list, link) {
+			if (!node->freewheel)
+				continue;
+			node->freewheel = false;
+			if (node->info.state == PW_NODE_STATE_RUNNING)
+				spa_node_send_command(node->node,
+						&SPA_COMMAND_INIT(core->type.command_node.Start));
+		}
+	}
+
+	items[0] = SPA_DICT_ITEM_INIT(PW_CORE_PROP_FREEWHEEL, freewheel ? "true" : "false");
+	pw_core_update_properties(core, &SPA_DICT_INIT(items, 1));
+
+	return 0;
+}
+
 int pw_core_for_each_global(struct pw_core *core,
 			    int (*callback) (void *data, struct pw_global *global),
 			    void *data)
@@ -677,6 +804,11 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
 				pout = other_port;
 			}
 
+			if (!pw_port_media_compatible(pout, pin)) {
+				pw_log_debug("port %p: no common media type with %p", p, other_port);
+				continue;
+			}
+
 			if (pw_core_find_format(core,
 						pout,
 						pin,
@@ -770,10 +902,7 @@ int pw_core_find_format(struct pw_core *core,
 		/* both ports need a format */
 		pw_log_debug("core %p: do enum input %d", core, iidx);
 		spa_pod_builder_init(&fb, fbuf, sizeof(fbuf));
-		if ((res = spa_node_port_enum_params(input->node->node,
-						     input->direction, input->port_id,
-						     t->param.idEnumFormat, &iidx,
-						     NULL, &filter, &fb)) <= 0) {
+		if ((res = pw_port_enum_formats(input, &iidx, NULL, &filter, &fb)) <= 0) {
 			if (res == 0 && iidx == 0) {
 				asprintf(error, "error input enum formats: %s", spa_strerror(res));
 				goto error;
@@ -785,10 +914,7 @@ int pw_core_find_format(struct pw_core *core,
 		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
 			spa_debug_format(2, core->type.map, filter);
 
-		if ((res = spa_node_port_enum_params(output->node->node,
-						     output->direction, output->port_id,
-						     t->param.idEnumFormat, &oidx,
-						     filter, format, builder)) <= 0) {
+		if ((res = pw_port_enum_formats(output, &oidx, filter, format, builder)) <= 0) {
 			if (res == 0) {
 				oidx = 0;
 				goto again;
@@ -110,6 +110,8 @@ struct pw_core_events {
 #define PW_CORE_PROP_VERSION	"pipewire.core.version"
 /** If the core should listen for connections, boolean default false */
 #define PW_CORE_PROP_DAEMON	"pipewire.daemon"
+/** If the graph is freewheeling, boolean, see \ref pw_core_set_freewheel() */
+#define PW_CORE_PROP_FREEWHEEL	"pipewire.freewheel"
 
 /** Make a new core object for a given main_loop. Ownership of the properties is taken */
 struct pw_core * pw_core_new(struct pw_loop *main_loop, struct pw_properties *props);
@@ -135,6 +137,11 @@ struct pw_global *pw_core_get_global(struct pw_core *core);
 /** Get the core properties */
 const struct pw_properties *pw_core_get_properties(struct pw_core *core);
 
+/** Start or stop freewheeling. While freewheeling the hardware drivers
+ * are paused and the graph is processed as fast as possible from the
+ * data loop, for offline rendering. */
+int pw_core_set_freewheel(struct pw_core *core, bool freewheel);
+
 /** Update the core properties */
 int pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict);
 
@@ -130,7 +130,7 @@ pw_global_register(struct pw_global *global,
 						    global->type,
 						    global->version,
 						    global->properties ?
-						        &global->properties->dict : NULL);
+						        pw_properties_get_sorted(global->properties) : NULL);
 	}
 	return 0;
 }
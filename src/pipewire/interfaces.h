@@ -76,7 +76,8 @@ struct pw_link_proxy;
 #define PW_CORE_PROXY_METHOD_PERMISSIONS	5
 #define PW_CORE_PROXY_METHOD_CREATE_OBJECT	6
 #define PW_CORE_PROXY_METHOD_DESTROY		7
-#define PW_CORE_PROXY_METHOD_NUM		8
+#define PW_CORE_PROXY_METHOD_SET_FREEWHEEL	8
+#define PW_CORE_PROXY_METHOD_NUM		9
 
 /**
  * Key to update default permissions of globals without specific
@@ -193,6 +194,16 @@ struct pw_core_proxy_methods {
 	 * \param id the object id to destroy
 	 */
 	void (*destroy) (void *object, uint32_t id);
+	/**
+	 * Start or stop freewheeling
+	 *
+	 * While freewheeling, the graph is processed as fast as possible
+	 * instead of at the rate of the hardware drivers. The core
+	 * property "pipewire.freewheel" reflects the current state.
+	 *
+	 * \param freewheel true to start freewheeling
+	 */
+	void (*set_freewheel) (void *object, bool freewheel);
 };
 
 static inline void
@@ -253,6 +264,12 @@ pw_core_proxy_destroy(struct pw_core_proxy *core, uint32_t id)
 	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, destroy, id);
 }
 
+static inline void
+pw_core_proxy_set_freewheel(struct pw_core_proxy *core, bool freewheel)
+{
+	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, set_freewheel, freewheel);
+}
+
 #define PW_CORE_PROXY_EVENT_UPDATE_TYPES 0
 #define PW_CORE_PROXY_EVENT_DONE         1
 #define PW_CORE_PROXY_EVENT_ERROR        2
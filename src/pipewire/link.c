@@ -37,6 +37,37 @@
 #include <spa/debug/format.h>
 
 #define MAX_BUFFERS     16
+#define MAX_DATAS       8
+
+struct meta_info {
+	uint32_t type;
+	uint32_t size;
+};
+
+static const struct spa_pod_object_field meta_fields[] = {
+	SPA_POD_OBJECT_FIELD(struct spa_type_param_meta, type, 'I', 0, struct meta_info, type),
+	SPA_POD_OBJECT_FIELD(struct spa_type_param_meta, size, 'i', 0, struct meta_info, size),
+};
+
+struct buffers_info {
+	uint32_t size;
+	uint32_t stride;
+	uint32_t buffers;
+	uint32_t blocks;
+	int32_t mirrored;
+};
+
+#define BUFFERS_FIELD(key,flags)						\
+	SPA_POD_OBJECT_FIELD(struct spa_type_param_buffers, key, 'i', flags,	\
+			     struct buffers_info, key)
+
+static const struct spa_pod_object_field buffers_fields[] = {
+	BUFFERS_FIELD(size, 0),
+	BUFFERS_FIELD(stride, 0),
+	BUFFERS_FIELD(buffers, 0),
+	BUFFERS_FIELD(blocks, SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+	BUFFERS_FIELD(mirrored, SPA_POD_OBJECT_FIELD_FLAG_OPTIONAL),
+};
 
 /** \cond */
 struct impl {
@@ -313,6 +344,11 @@ static struct spa_pod *find_param(struct spa_pod **params, uint32_t n_params, ui
  *
  * The shared memory block should not contain any types or structure,
  * just the actual metadata contents.
+ *
+ * When mirrored data is requested, the data memory is not placed in the
+ * shared memory block. Each data gets its own memory, rounded up to the
+ * page size and mapped twice back to back, so that a ring buffer can be
+ * read and written without splitting at the wrap around point.
  */
 static int alloc_buffers(struct pw_link *this,
 			 uint32_t n_buffers,
@@ -321,11 +357,13 @@ static int alloc_buffers(struct pw_link *this,
 			 uint32_t n_datas,
 			 size_t *data_sizes,
 			 ssize_t *data_strides,
+			 bool mirrored,
 			 struct allocation *allocation)
 {
 	int res;
 	struct spa_buffer **buffers, *bp;
-	uint32_t i;
+	struct pw_memblock **mirrors = NULL;
+	uint32_t i, n_mirrors = 0;
 	size_t skel_size, data_size, meta_size;
 	struct spa_chunk *cdp;
 	void *ddp;
@@ -343,17 +381,16 @@ static int alloc_buffers(struct pw_link *this,
 	/* collect metadata */
 	for (i = 0; i < n_params; i++) {
 		if (spa_pod_is_object_type (params[i], t->param_meta.Meta)) {
-			uint32_t type, size;
+			struct meta_info info;
 
-			if (spa_pod_object_parse(params[i],
-				":", t->param_meta.type, "I", &type,
-				":", t->param_meta.size, "i", &size, NULL) < 0)
+			if (spa_pod_object_parse_fields(params[i], &t->param_meta,
+						meta_fields, SPA_N_ELEMENTS(meta_fields), &info) < 0)
 				continue;
 
-			pw_log_debug("link %p: enable meta %d %d", this, type, size);
+			pw_log_debug("link %p: enable meta %d %d", this, info.type, info.size);
 
-			metas[n_metas].type = type;
-			metas[n_metas].size = size;
+			metas[n_metas].type = info.type;
+			metas[n_metas].size = info.size;
 			meta_size += metas[n_metas].size;
 			n_metas++;
 			skel_size += sizeof(struct spa_meta);
@@ -364,18 +401,27 @@ static int alloc_buffers(struct pw_link *this,
 	/* data */
 	for (i = 0; i < n_datas; i++) {
 		data_size += sizeof(struct spa_chunk);
-		data_size += data_sizes[i];
+		if (!mirrored)
+			data_size += data_sizes[i];
 		skel_size += sizeof(struct spa_data);
 	}
 
 	buffers = calloc(n_buffers, skel_size + sizeof(struct spa_buffer *));
+	if (buffers == NULL)
+		return -ENOMEM;
 	/* pointer to buffer structures */
 	bp = SPA_MEMBER(buffers, n_buffers * sizeof(struct spa_buffer *), struct spa_buffer);
 
+	if (mirrored &&
+	    (mirrors = calloc(n_buffers * n_datas, sizeof(struct pw_memblock *))) == NULL) {
+		res = -ENOMEM;
+		goto no_mirrors;
+	}
+
 	if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
 				     PW_MEMBLOCK_FLAG_MAP_READWRITE |
 				     PW_MEMBLOCK_FLAG_SEAL, n_buffers * data_size, &m)) < 0)
-		return res;
+		goto no_mem;
 
 	for (i = 0; i < n_buffers; i++) {
 		int j;
@@ -408,7 +454,29 @@ static int alloc_buffers(struct pw_link *this,
 			struct spa_data *d = &b->datas[j];
 
 			d->chunk = &cdp[j];
-			if (data_sizes[j] > 0) {
+			if (data_sizes[j] > 0 && mirrored) {
+				struct pw_memblock *dm;
+				size_t size = SPA_ROUND_UP_N(data_sizes[j],
+							     this->core->sc_pagesize);
+
+				if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+							     PW_MEMBLOCK_FLAG_MAP_READWRITE |
+							     PW_MEMBLOCK_FLAG_MAP_TWICE |
+							     PW_MEMBLOCK_FLAG_SEAL, size, &dm)) < 0)
+					goto no_mirror;
+
+				mirrors[n_mirrors++] = dm;
+
+				d->type = t->data.MemFd;
+				d->flags = SPA_DATA_FLAG_MIRRORED;
+				d->fd = dm->fd;
+				d->mapoffset = 0;
+				d->maxsize = size;
+				d->data = dm->ptr;
+				d->chunk->offset = 0;
+				d->chunk->size = 0;
+				d->chunk->stride = data_strides[j];
+			} else if (data_sizes[j] > 0) {
 				d->type = t->data.MemFd;
 				d->flags = 0;
 				d->fd = m->fd;
@@ -429,8 +497,20 @@ static int alloc_buffers(struct pw_link *this,
 	allocation->mem = m;
 	allocation->n_buffers = n_buffers;
 	allocation->buffers = buffers;
+	allocation->mirrors = mirrors;
+	allocation->n_mirrors = n_mirrors;
 
 	return 0;
+
+      no_mirror:
+	for (i = 0; i < n_mirrors; i++)
+		pw_memblock_free(mirrors[i]);
+	pw_memblock_free(m);
+      no_mem:
+	free(mirrors);
+      no_mirrors:
+	free(buffers);
+	return res;
 }
 
 static int
@@ -581,10 +661,11 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		uint8_t buffer[4096];
 		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 		uint32_t i, offset, n_params;
-		uint32_t max_buffers;
+		uint32_t max_buffers, blocks;
+		bool mirrored = false;
 		size_t minsize = 1024, stride = 0;
-		size_t data_sizes[1];
-		ssize_t data_strides[1];
+		size_t data_sizes[MAX_DATAS];
+		ssize_t data_strides[MAX_DATAS];
 
 		n_params = param_filter(this, input, output, t->param.idBuffers, &b);
 		n_params += param_filter(this, input, output, t->param.idMeta, &b);
@@ -600,25 +681,32 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		}
 
 		max_buffers = MAX_BUFFERS;
+		blocks = 1;
 		minsize = stride = 0;
 		param = find_param(params, n_params, t->param_buffers.Buffers);
 		if (param) {
-			uint32_t qmax_buffers = max_buffers,
-			    qminsize = minsize, qstride = stride;
+			struct buffers_info q = {
+				.size = minsize,
+				.stride = stride,
+				.buffers = max_buffers,
+				.blocks = blocks,
+				.mirrored = 0,
+			};
 
-			spa_pod_object_parse(param,
-				":", t->param_buffers.size, "i", &qminsize,
-				":", t->param_buffers.stride, "i", &qstride,
-				":", t->param_buffers.buffers, "i", &qmax_buffers, NULL);
+			spa_pod_object_parse_fields(param, &t->param_buffers,
+					buffers_fields, SPA_N_ELEMENTS(buffers_fields), &q);
 
 			max_buffers =
-			    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
+			    q.buffers == 0 ? max_buffers : SPA_MIN(q.buffers,
 							      max_buffers);
-			minsize = SPA_MAX(minsize, qminsize);
-			stride = SPA_MAX(stride, qstride);
-
-			pw_log_debug("%d %d %d -> %zd %zd %d", qminsize, qstride, qmax_buffers,
-				     minsize, stride, max_buffers);
+			blocks = SPA_CLAMP(q.blocks, 1, MAX_DATAS);
+			minsize = SPA_MAX(minsize, q.size);
+			stride = SPA_MAX(stride, q.stride);
+			mirrored = q.mirrored != 0;
+
+			pw_log_debug("%d %d %d %d %d -> %zd %zd %d %d %d", q.size, q.stride,
+				     q.buffers, q.blocks, q.mirrored, minsize, stride,
+				     max_buffers, blocks, mirrored);
 		} else {
 			pw_log_warn("no buffers param");
 			minsize = 1024;
@@ -630,15 +718,18 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		    (out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS))
 			minsize = 0;
 
-		data_sizes[0] = minsize;
-		data_strides[0] = stride;
+		for (i = 0; i < blocks; i++) {
+			data_sizes[i] = minsize;
+			data_strides[i] = stride;
+		}
 
 		if ((res = alloc_buffers(this,
 					 max_buffers,
 					 n_params,
 					 params,
-					 1,
+					 blocks,
 					 data_sizes, data_strides,
+					 mirrored,
 					 &allocation)) < 0) {
 			asprintf(&error, "error alloc buffers: %d", res);
 			goto error;
@@ -864,6 +955,36 @@ do_remove_input(struct spa_loop *loop,
 	return 0;
 }
 
+/* make the driver clock visible to both ports, nodes that don't know
+ * about the clock io area will ignore it */
+static void set_clock_io(struct pw_link *this, struct spa_io_clock *clock_io)
+{
+	struct pw_type *t = &this->core->type;
+
+	if (clock_io == NULL)
+		return;
+
+	spa_node_port_set_io(this->output->node->node,
+			     SPA_DIRECTION_OUTPUT, this->output->port_id,
+			     t->io.Clock, clock_io, sizeof(struct spa_io_clock));
+	spa_node_port_set_io(this->input->node->node,
+			     SPA_DIRECTION_INPUT, this->input->port_id,
+			     t->io.Clock, clock_io, sizeof(struct spa_io_clock));
+}
+
+/* invoke items[0] in the output node data loop and items[1] in the input
+ * node data loop, with one wakeup when both nodes share the loop */
+static void invoke_ports(struct pw_node *output_node, struct pw_node *input_node,
+			 struct spa_loop_invoke_item items[2], bool block)
+{
+	if (output_node->data_loop == input_node->data_loop) {
+		pw_loop_invoke_many(output_node->data_loop, items, 2, block);
+	} else {
+		pw_loop_invoke_many(output_node->data_loop, &items[0], 1, block);
+		pw_loop_invoke_many(input_node->data_loop, &items[1], 1, block);
+	}
+}
+
 static void input_remove(struct pw_link *this, struct pw_port *port)
 {
 	struct impl *impl = (struct impl *) this;
@@ -872,9 +993,6 @@ static void input_remove(struct pw_link *this, struct pw_port *port)
 	spa_hook_remove(&impl->input_port_listener);
 	spa_hook_remove(&impl->input_node_listener);
 
-	pw_loop_invoke(port->node->data_loop,
-		       do_remove_input, 1, NULL, 0, true, this);
-
 	pw_map_remove(&port->mix_port_map, this->rt.in_port.port_id);
 
 	spa_list_remove(&this->input_link);
@@ -901,9 +1019,6 @@ static void output_remove(struct pw_link *this, struct pw_port *port)
 	spa_hook_remove(&impl->output_port_listener);
 	spa_hook_remove(&impl->output_node_listener);
 
-	pw_loop_invoke(port->node->data_loop,
-		       do_remove_output, 1, NULL, 0, true, this);
-
 	pw_map_remove(&port->mix_port_map, this->rt.out_port.port_id);
 
 	spa_list_remove(&this->output_link);
@@ -1100,6 +1215,7 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	struct impl *impl;
 	struct pw_link *this;
 	struct pw_node *input_node, *output_node;
+	struct spa_loop_invoke_item items[2];
 
 	if (output == input)
 		goto same_ports;
@@ -1147,8 +1263,11 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	pw_node_add_listener(output_node, &impl->output_node_listener, &output_node_events, impl);
 
 	input_node->live = output_node->live;
-	if (output_node->clock)
+	if (output_node->clock) {
 		input_node->clock = output_node->clock;
+		input_node->clock_io = output_node->clock_io;
+	}
+	set_clock_io(this, output_node->clock_io ? output_node->clock_io : input_node->clock_io);
 
 	pw_log_debug("link %p: output node %p clock %p, live %d",
 			this, output_node, output_node->clock, output_node->live);
@@ -1186,12 +1305,13 @@ struct pw_link *pw_link_new(struct pw_core *core,
 
 	this->rt.in_port.scheduler_data = this;
 	this->rt.out_port.scheduler_data = this;
+	this->rt.tee_given = SPA_ID_INVALID;
 
-	/* nodes can be in different data loops so we do this twice */
-	pw_loop_invoke(output_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, &output, sizeof(struct pw_port *), false, this);
-	pw_loop_invoke(input_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, &input, sizeof(struct pw_port *), false, this);
+	items[0] = (struct spa_loop_invoke_item) {
+		do_add_link, SPA_ID_INVALID, &output, sizeof(struct pw_port *), this, 0 };
+	items[1] = (struct spa_loop_invoke_item) {
+		do_add_link, SPA_ID_INVALID, &input, sizeof(struct pw_port *), this, 0 };
+	invoke_ports(output_node, input_node, items, false);
 
 	spa_hook_list_call(&output->listener_list, struct pw_port_events, link_added, 0, this);
 	spa_hook_list_call(&input->listener_list, struct pw_port_events, link_added, 0, this);
@@ -1279,6 +1399,10 @@ void pw_link_destroy(struct pw_link *link)
 {
 	struct impl *impl = SPA_CONTAINER_OF(link, struct impl, this);
 	struct pw_resource *resource, *tmp;
+	struct spa_loop_invoke_item items[2] = {
+		{ do_remove_output, 1, NULL, 0, link, 0 },
+		{ do_remove_input, 1, NULL, 0, link, 0 },
+	};
 
 	pw_log_debug("link %p: destroy", impl);
 	pw_link_events_destroy(link);
@@ -1288,6 +1412,8 @@ void pw_link_destroy(struct pw_link *link)
 	if (link->registered)
 		spa_list_remove(&link->link);
 
+	invoke_ports(link->output->node, link->input->node, items, true);
+
 	input_remove(link, link->input);
 
 	output_remove(link, link->output);
@@ -38,6 +38,9 @@ struct impl {
 /** \endcond */
 
 /** Create a new loop
+ * \param properties extra properties, "loop.backend" selects the
+ *	backend of the loop, "epoll" or "io_uring". When not given, the
+ *	PIPEWIRE_LOOP_BACKEND environment variable is used.
  * \returns a newly allocated loop
  * \memberof pw_loop
  */
@@ -51,6 +54,8 @@ struct pw_loop *pw_loop_new(struct pw_properties *properties)
 	void *iface;
 	const struct spa_support *support;
 	uint32_t n_support;
+	struct spa_dict_item items[1];
+	const char *str = NULL;
 
 	support = pw_get_support(&n_support);
 	if (support == NULL)
@@ -72,9 +77,15 @@ struct pw_loop *pw_loop_new(struct pw_properties *properties)
 
 	this = &impl->this;
 
+	if (properties)
+		str = pw_properties_get(properties, "loop.backend");
+	if (str == NULL)
+		str = getenv("PIPEWIRE_LOOP_BACKEND");
+	items[0] = SPA_DICT_ITEM_INIT("loop.backend", str ? str : "epoll");
+
 	if ((res = spa_handle_factory_init(factory,
 					   impl->handle,
-					   NULL,
+					   &SPA_DICT_INIT(items, 1),
 					   support,
 					   n_support)) < 0) {
 		fprintf(stderr, "can't make factory instance: %d\n", res);
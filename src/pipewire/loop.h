@@ -50,6 +50,7 @@ pw_loop_destroy(struct pw_loop *loop);
 #define pw_loop_update_source(l,...)	spa_loop_update_source(__VA_ARGS__)
 #define pw_loop_remove_source(l,...)	spa_loop_remove_source(__VA_ARGS__)
 #define pw_loop_invoke(l,...)		spa_loop_invoke((l)->loop,__VA_ARGS__)
+#define pw_loop_invoke_many(l,...)	spa_loop_invoke_many((l)->loop,__VA_ARGS__)
 
 #define pw_loop_get_fd(l)		spa_loop_control_get_fd((l)->control)
 #define pw_loop_add_hook(l,...)		spa_loop_control_add_hook((l)->control,__VA_ARGS__)
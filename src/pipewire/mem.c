@@ -256,10 +256,14 @@ void pw_memblock_free(struct pw_memblock *mem)
 		return;
 
 	pw_log_debug("mem %p: free", mem);
-	if (mem->flags & PW_MEMBLOCK_FLAG_WITH_FD) {
-		if (mem->ptr)
-			munmap(mem->ptr, mem->size);
-		if (mem->fd != -1)
+	if (mem->flags & (PW_MEMBLOCK_FLAG_WITH_FD | PW_MEMBLOCK_FLAG_MAP_TWICE)) {
+		if (mem->ptr) {
+			if (mem->flags & PW_MEMBLOCK_FLAG_MAP_TWICE)
+				munmap(mem->ptr, mem->size << 1);
+			else
+				munmap(mem->ptr, mem->size);
+		}
+		if ((mem->flags & PW_MEMBLOCK_FLAG_WITH_FD) && mem->fd != -1)
 			close(mem->fd);
 	} else {
 		free(mem->ptr);
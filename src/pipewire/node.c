@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 #include <spa/clock/clock.h>
 #include <spa/pod/parser.h>
@@ -71,10 +72,33 @@ static int pause_node(struct pw_node *this)
 	return do_pause_node(this);
 }
 
+static int
+do_node_freewheel(struct spa_loop *loop,
+		  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node *this = user_data;
+
+	if (this->core->freewheel && !this->rt.freewheel) {
+		pw_node_set_freewheel(this, true);
+		spa_list_append(&this->core->rt.freewheel_list, &this->rt.freewheel_link);
+		pw_core_update_freewheel(this->core);
+	}
+	return 0;
+}
+
 static int start_node(struct pw_node *this)
 {
 	int res = 0;
 
+	/* drivers are started when the freewheeling stops */
+	if (this->core->freewheel && this->clock) {
+		pw_log_debug("node %p: start node after freewheel", this);
+		this->freewheel = true;
+		if (this->info.n_input_ports > 0)
+			pw_loop_invoke(this->data_loop, do_node_freewheel, 1, NULL, 0, true, this);
+		return 0;
+	}
+
 	pw_log_debug("node %p: start node", this);
 	res = spa_node_send_command(this->node,
 				    &SPA_COMMAND_INIT(this->core->type.command_node.Start));
@@ -137,6 +161,171 @@ static void send_clock_update(struct pw_node *this)
 		pw_log_debug("node %p: send clock update error %s", this, spa_strerror(res));
 }
 
+static int alloc_clock_io(struct pw_node *this)
+{
+	int res;
+
+	if (this->clock == NULL || this->clock_mem != NULL)
+		return 0;
+
+	if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+				     PW_MEMBLOCK_FLAG_SEAL |
+				     PW_MEMBLOCK_FLAG_MAP_READWRITE,
+				     sizeof(struct spa_io_clock),
+				     &this->clock_mem)) < 0)
+		return res;
+
+	this->clock_io = this->clock_mem->ptr;
+	spa_zero(*this->clock_io);
+	this->clock_io->rate_diff = 1.0;
+
+	return 0;
+}
+
+/* called from the data loop every cycle of the node that owns the clock,
+ * \a latency is the number of frames of the negotiated audio format that
+ * are buffered in the driver, 0 when the driver ports have no audio format */
+static void update_clock_io(struct pw_node *this, uint64_t latency)
+{
+	struct spa_io_clock *c = this->clock_io;
+	int32_t rate;
+	int64_t ticks, monotonic_time;
+	double rate_diff;
+
+	if (this->clock_mem == NULL ||
+	    spa_clock_get_time(this->clock, &rate, &ticks, &monotonic_time) < 0 ||
+	    rate <= 0)
+		return;
+
+	rate_diff = c->rate_diff;
+	if (c->flags & SPA_IO_CLOCK_FLAG_FREEWHEEL) {
+		/* the ticks ran ahead while freewheeling, start measuring again */
+		rate_diff = 1.0;
+	}
+	else if (c->seq > 0 && c->rate.denom == (uint32_t) rate && monotonic_time > c->monotonic_time) {
+		double elapsed = (double)(monotonic_time - c->monotonic_time) / SPA_NSEC_PER_SEC;
+		double measured = (double)(ticks - (int64_t) c->ticks) / rate / elapsed;
+		/* smooth out scheduling jitter */
+		rate_diff += (measured - rate_diff) * 0.01;
+	}
+
+	spa_io_clock_write_begin(c);
+	c->flags = this->live ? SPA_IO_CLOCK_FLAG_LIVE : 0;
+	c->rate = SPA_FRACTION(1, rate);
+	c->ticks = ticks;
+	c->monotonic_time = monotonic_time;
+	c->rate_diff = rate_diff;
+	c->latency = latency;
+	spa_io_clock_write_end(c);
+}
+
+/* the freewheel clock keeps the rate of the driver and advances with the
+ * data that was consumed in the previous cycle */
+static void update_freewheel_clock_io(struct pw_node *this, uint64_t frames)
+{
+	struct spa_io_clock *c = this->clock_io;
+	struct timespec now;
+
+	if (this->clock_mem == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	spa_io_clock_write_begin(c);
+	c->flags = SPA_IO_CLOCK_FLAG_FREEWHEEL;
+	c->ticks += frames;
+	c->monotonic_time = SPA_TIMESPEC_TO_TIME(&now);
+	c->rate_diff = 1.0;
+	c->latency = 0;
+	spa_io_clock_write_end(c);
+}
+
+void pw_node_set_freewheel(struct pw_node *node, bool freewheel)
+{
+	struct spa_graph_port *p;
+
+	pw_log_debug("node %p: freewheel %d", node, freewheel);
+
+	/* the paused driver does not consume the buffers, keep the mixers
+	 * from pushing to it and let the freewheel cycles take them */
+	spa_list_for_each(p, &node->rt.node.ports[SPA_DIRECTION_INPUT], link) {
+		struct pw_port *port = p->scheduler_data;
+
+		if (freewheel && !SPA_FLAG_CHECK(p->flags, SPA_GRAPH_PORT_FLAG_DISABLED)) {
+			SPA_FLAG_SET(p->flags, SPA_GRAPH_PORT_FLAG_DISABLED);
+			port->rt.freewheel = true;
+		}
+		else if (!freewheel && port->rt.freewheel) {
+			SPA_FLAG_UNSET(p->flags, SPA_GRAPH_PORT_FLAG_DISABLED);
+			port->rt.freewheel = false;
+		}
+	}
+	node->rt.freewheel = freewheel;
+}
+
+/* the buffers of an input port are allocated on one of its links */
+static struct spa_buffer *find_port_buffer(struct pw_port *port, uint32_t id)
+{
+	struct spa_graph_port *p;
+
+	if (id < port->allocation.n_buffers)
+		return port->allocation.buffers[id];
+
+	spa_list_for_each(p, &port->rt.mix_node.ports[SPA_DIRECTION_INPUT], link) {
+		struct pw_link *link = p->scheduler_data;
+
+		if (id < link->output->allocation.n_buffers)
+			return link->output->allocation.buffers[id];
+	}
+	return NULL;
+}
+
+/* the number of frames in the buffers on the ports of \a node */
+static uint64_t port_frames(struct pw_node *node, enum spa_direction direction)
+{
+	struct spa_graph_port *p;
+	uint64_t frames = 0;
+
+	spa_list_for_each(p, &node->rt.node.ports[direction], link) {
+		struct pw_port *port = p->scheduler_data;
+		struct spa_io_buffers *io = p->io;
+		struct spa_buffer *b;
+
+		if (io == NULL || io->buffer_id == SPA_ID_INVALID || port->frame_size == 0)
+			continue;
+
+		/* the chunk stride is not the frame size, many nodes leave it 0 */
+		b = find_port_buffer(port, io->buffer_id);
+		if (b && b->n_datas > 0)
+			frames = SPA_MAX(frames, b->datas[0].chunk->size / port->frame_size);
+	}
+	return frames;
+}
+
+void pw_node_freewheel_cycle(struct pw_node *node)
+{
+	struct spa_graph_port *p, *pp;
+	uint64_t frames;
+
+	/* consume the buffers of the previous cycle, like the driver would */
+	frames = port_frames(node, SPA_DIRECTION_INPUT);
+	spa_list_for_each(p, &node->rt.node.ports[SPA_DIRECTION_INPUT], link) {
+		struct spa_io_buffers *io = p->io;
+
+		if (io->buffer_id != SPA_ID_INVALID) {
+			if ((pp = p->peer) != NULL)
+				spa_node_port_reuse_buffer(pp->node->implementation,
+							   pp->port_id, io->buffer_id);
+		}
+		io->buffer_id = SPA_ID_INVALID;
+		io->status = SPA_STATUS_NEED_BUFFER;
+	}
+	update_freewheel_clock_io(node, frames);
+
+	pw_node_events_need_input(node);
+	spa_graph_need_input(node->rt.graph, &node->rt.node);
+}
+
 static void node_unbind_func(void *data)
 {
 	struct pw_resource *resource = data;
@@ -188,6 +377,16 @@ static void update_port_map(struct pw_node *node, enum pw_direction direction,
 	}
 }
 
+void pw_node_invalidate_formats(struct pw_node *node)
+{
+	struct pw_port *port;
+
+	spa_list_for_each(port, &node->input_ports, link)
+		pw_port_invalidate_formats(port);
+	spa_list_for_each(port, &node->output_ports, link)
+		pw_port_invalidate_formats(port);
+}
+
 int pw_node_update_ports(struct pw_node *node)
 {
 	uint32_t *input_port_ids, *output_port_ids;
@@ -346,6 +545,9 @@ int pw_node_register(struct pw_node *this,
 
 	pw_node_update_ports(this);
 
+	if (alloc_clock_io(this) < 0)
+		pw_log_warn("node %p: can't allocate clock io", this);
+
 	pw_loop_invoke(this->data_loop, do_node_add, 1, NULL, 0, false, this);
 
 	if ((str = pw_properties_get(this->properties, "media.class")) != NULL)
@@ -522,6 +724,8 @@ static void node_need_input(void *data)
 {
 	struct pw_node *node = data;
 	pw_log_trace("node %p: need input", node);
+	/* the driver still holds the data it was given in the last cycle */
+	update_clock_io(node, port_frames(node, SPA_DIRECTION_INPUT));
 	pw_node_events_need_input(node);
 	spa_graph_need_input(node->rt.graph, &node->rt.node);
 }
@@ -530,6 +734,8 @@ static void node_have_output(void *data)
 {
 	struct pw_node *node = data;
 	pw_log_trace("node %p: have output", node);
+	/* the data was captured a cycle before it is handed out */
+	update_clock_io(node, port_frames(node, SPA_DIRECTION_OUTPUT));
 	spa_graph_have_output(node->rt.graph, &node->rt.node);
 	pw_node_events_have_output(node);
 }
@@ -592,6 +798,11 @@ do_node_remove(struct spa_loop *loop,
 
 	pause_node(this);
 
+	if (this->rt.freewheel) {
+		pw_node_set_freewheel(this, false);
+		spa_list_remove(&this->rt.freewheel_link);
+		pw_core_update_freewheel(this->core);
+	}
 	spa_graph_node_remove(&this->rt.node);
 
 	return 0;
@@ -653,6 +864,9 @@ void pw_node_destroy(struct pw_node *node)
 	if (node->properties)
 		pw_properties_free(node->properties);
 
+	if (node->clock_mem)
+		pw_memblock_free(node->clock_mem);
+
 	clear_info(node);
 
 	free(impl);
@@ -28,6 +28,8 @@
 #include <pwd.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <spa/support/dbus.h>
 
@@ -37,61 +39,128 @@
 
 static char **categories = NULL;
 
-static struct support_info {
+/** a SPA plugin, opened once and shared by everyone in the process */
+struct plugin {
+	struct spa_list link;
+	char *filename;
 	void *hnd;
-	spa_handle_factory_enum_func_t enum_func;
+	uint32_t n_factories;
+	const struct spa_handle_factory **factories;
+};
+
+static struct spa_list plugin_list = { &plugin_list, &plugin_list };
+static pthread_mutex_t plugin_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct support_info {
+	struct plugin *plugin;
 	struct spa_support support[16];
 	uint32_t n_support;
 } support_info;
 
-static bool
-open_support(const char *path,
-	     const char *lib,
-	     struct support_info *info)
+static struct plugin *open_plugin(const char *filename)
+{
+	struct plugin *plugin;
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory, **factories;
+	uint32_t index;
+	struct timespec t1, t2;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if ((plugin = calloc(1, sizeof(struct plugin))) == NULL)
+		return NULL;
+
+	if ((plugin->hnd = dlopen(filename, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", filename, dlerror());
+		goto open_failed;
+	}
+	if ((enum_func = dlsym(plugin->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		fprintf(stderr, "can't find enum function in %s\n", filename);
+		goto no_symbol;
+	}
+
+	/* index all factories so that lookups don't have to call into the plugin */
+	for (index = 0;;) {
+		if ((res = enum_func(&factory, &index)) <= 0) {
+			if (res != 0)
+				fprintf(stderr, "can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		factories = realloc(plugin->factories,
+				    (plugin->n_factories + 1) * sizeof(factory));
+		if (factories == NULL)
+			goto no_mem;
+		plugin->factories = factories;
+		plugin->factories[plugin->n_factories++] = factory;
+	}
+	plugin->filename = strdup(filename);
+	spa_list_append(&plugin_list, &plugin->link);
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	pw_log_debug("plugin %s: %d factories, loaded in %" PRId64 " usec", filename,
+		     plugin->n_factories,
+		     (int64_t) (SPA_TIMESPEC_TO_TIME(&t2) - SPA_TIMESPEC_TO_TIME(&t1)) / 1000);
+
+	return plugin;
+
+      no_mem:
+	free(plugin->factories);
+      no_symbol:
+	dlclose(plugin->hnd);
+      open_failed:
+	free(plugin);
+	return NULL;
+}
+
+static struct plugin *find_plugin(const char *path, const char *lib)
 {
+	struct plugin *plugin;
 	char *filename;
 
         if (asprintf(&filename, "%s/%s.so", path, lib) < 0)
-		goto no_filename;
+		return NULL;
 
-        if ((info->hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-                fprintf(stderr, "can't load %s: %s\n", filename, dlerror());
-                goto open_failed;
-        }
-        if ((info->enum_func = dlsym(info->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-                fprintf(stderr, "can't find enum function\n");
-                goto no_symbol;
-        }
+	pthread_mutex_lock(&plugin_lock);
+	spa_list_for_each(plugin, &plugin_list, link) {
+		if (strcmp(plugin->filename, filename) == 0)
+			goto done;
+	}
+	plugin = open_plugin(filename);
+      done:
+	pthread_mutex_unlock(&plugin_lock);
 	free(filename);
-	return true;
 
-      no_filename:
-	return false;
-      no_symbol:
-	dlclose(info->hnd);
-      open_failed:
-        free(filename);
-	return false;
+	return plugin;
 }
 
-static const struct spa_handle_factory *get_factory(struct support_info *info, const char *factory_name)
+static const struct spa_handle_factory *find_factory(struct plugin *plugin, const char *factory_name)
 {
-	int res;
-	uint32_t index;
-        const struct spa_handle_factory *factory;
+	uint32_t i;
 
-        for (index = 0;;) {
-                if ((res = info->enum_func(&factory, &index)) <= 0) {
-                        if (res != 0)
-                                fprintf(stderr, "can't enumerate factories: %s\n", spa_strerror(res));
-                        break;
-                }
-                if (strcmp(factory->name, factory_name) == 0)
-                        return factory;
+	for (i = 0; i < plugin->n_factories; i++) {
+		if (strcmp(plugin->factories[i]->name, factory_name) == 0)
+			return plugin->factories[i];
 	}
 	return NULL;
 }
 
+static bool
+open_support(const char *path,
+	     const char *lib,
+	     struct support_info *info)
+{
+	info->plugin = find_plugin(path, lib);
+	return info->plugin != NULL;
+}
+
+static const struct spa_handle_factory *get_factory(struct support_info *info, const char *factory_name)
+{
+	if (info->plugin == NULL)
+		return NULL;
+	return find_factory(info->plugin, factory_name);
+}
+
 static void *
 load_interface(struct support_info *info,
 	       const char *factory_name,
@@ -165,6 +234,29 @@ const struct spa_handle_factory *pw_get_support_factory(const char *factory_name
 	return get_factory(&support_info, factory_name);
 }
 
+/** Get a factory from a SPA plugin
+ * \param dir the plugin directory or NULL for the default
+ * \param lib the plugin name relative to \a dir, without extension
+ * \param factory_name the name of the factory
+ * \return the factory or NULL when not found
+ *
+ * Plugins are opened only once and stay loaded, all factories they contain
+ * are cached so that subsequent lookups are cheap.
+ */
+const struct spa_handle_factory *
+pw_get_spa_handle_factory(const char *dir, const char *lib, const char *factory_name)
+{
+	struct plugin *plugin;
+
+	if (dir == NULL && (dir = getenv("SPA_PLUGIN_DIR")) == NULL)
+		dir = PLUGINDIR;
+
+	if ((plugin = find_plugin(dir, lib)) == NULL)
+		return NULL;
+
+	return find_factory(plugin, factory_name);
+}
+
 const struct spa_support *pw_get_support(uint32_t *n_support)
 {
 	*n_support = support_info.n_support;
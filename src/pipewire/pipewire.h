@@ -141,6 +141,9 @@ pw_get_support_factory(const char *factory_name);
 const struct spa_support *
 pw_get_support(uint32_t *n_support);
 
+const struct spa_handle_factory *
+pw_get_spa_handle_factory(const char *dir, const char *lib, const char *factory_name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,7 @@
 #include <errno.h>
 
 #include <spa/pod/parser.h>
+#include <spa/pod/filter.h>
 
 #include "pipewire/pipewire.h"
 #include "pipewire/private.h"
@@ -49,24 +50,168 @@ static void port_update_state(struct pw_port *port, enum pw_port_state state)
 	}
 }
 
+/* The tee gives the same buffer to all consumers. For each buffer it
+ * keeps a mask of the consumers, by mixer port_id, that still use it and
+ * only gives it back to the producer when the last one is done. */
+
+static void tee_release(struct pw_port *this, uint32_t buffer_id)
+{
+	struct spa_graph_port *pp;
+
+	if ((pp = this->rt.mix_port.peer) != NULL) {
+		pw_log_trace("port %p: tee release buffer %d", this, buffer_id);
+		spa_node_port_reuse_buffer(pp->node->implementation, pp->port_id, buffer_id);
+	}
+}
+
+static void tee_unref(struct pw_port *this, uint32_t buffer_id, uint32_t consumer)
+{
+	uint64_t *holders;
+
+	if (buffer_id >= this->rt.n_tee_buffers)
+		return;
+
+	holders = &this->rt.tee_holders[buffer_id];
+	if (consumer < TEE_MAX_CONSUMERS && (*holders & (1ULL << consumer))) {
+		*holders &= ~(1ULL << consumer);
+		if (*holders == 0)
+			tee_release(this, buffer_id);
+	}
+	else if (*holders == 0) {
+		/* only untracked consumers got this buffer */
+		tee_release(this, buffer_id);
+	}
+}
+
+/* the consumers are the output ports of the links */
+static inline uint32_t *tee_given(struct spa_graph_port *p)
+{
+	struct pw_link *link = p->scheduler_data;
+	return &link->rt.tee_given;
+}
+
+/* check if the consumer did not take the buffer it was given yet. After
+ * it took it, the consumer io can still have the same buffer_id but no
+ * longer with HAVE_BUFFER */
+static bool tee_pending(struct pw_port *this, struct spa_graph_port *p)
+{
+	uint32_t *given = tee_given(p);
+
+	if (*given == SPA_ID_INVALID)
+		return false;
+
+	if (p->io->buffer_id == *given && p->io->status == SPA_STATUS_HAVE_BUFFER)
+		return true;
+
+	/* taken, the consumer gives it back with reuse_buffer or in its io */
+	*given = SPA_ID_INVALID;
+	return false;
+}
+
+/* drop the buffer that the consumer did not take */
+static void tee_drop_pending(struct pw_port *this, struct spa_graph_port *p)
+{
+	if (tee_pending(this, p)) {
+		tee_unref(this, *tee_given(p), p->port_id);
+		*tee_given(p) = SPA_ID_INVALID;
+	}
+}
+
+/* consumers that don't use reuse_buffer give the buffer back by leaving
+ * its id in their io with NEED_BUFFER, take it before the io is overwritten */
+static void tee_take_returned(struct pw_port *this, struct spa_graph_port *p)
+{
+	struct spa_io_buffers *io = p->io;
+	uint32_t id = io->buffer_id;
+
+	if (io->status != SPA_STATUS_NEED_BUFFER || id == SPA_ID_INVALID)
+		return;
+
+	io->buffer_id = SPA_ID_INVALID;
+
+	if (id >= this->rt.n_tee_buffers)
+		tee_release(this, id);
+	else if (p->port_id >= TEE_MAX_CONSUMERS ||
+		 (this->rt.tee_holders[id] & (1ULL << p->port_id)))
+		tee_unref(this, id, p->port_id);
+}
+
+/* release the buffers of consumers that were unlinked */
+static void tee_update_consumers(struct pw_port *this, uint64_t consumers)
+{
+	uint64_t gone = this->rt.tee_consumers & ~consumers;
+	uint32_t i;
+
+	this->rt.tee_consumers = consumers;
+	if (gone == 0)
+		return;
+
+	for (i = 0; i < this->rt.n_tee_buffers; i++) {
+		uint64_t *holders = &this->rt.tee_holders[i];
+
+		if ((*holders & gone) == 0)
+			continue;
+		*holders &= ~gone;
+		if (*holders == 0)
+			tee_release(this, i);
+	}
+}
+
 static int schedule_tee_input(struct spa_node *data)
 {
 	struct pw_port *this = SPA_CONTAINER_OF(data, struct pw_port, mix_node);
 	struct spa_graph_node *node = &this->rt.mix_node;
 	struct spa_graph_port *p;
 	struct spa_io_buffers *io = this->rt.mix_port.io;
+	uint64_t consumers = 0;
+	bool lagging = false;
+
+	if (spa_list_is_empty(&node->ports[SPA_DIRECTION_OUTPUT])) {
+		io->status = SPA_STATUS_NEED_BUFFER;
+		return io->status;
+	}
+
+	pw_log_trace("node %p: tee input %d %d", node, io->status, io->buffer_id);
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		if (p->port_id < TEE_MAX_CONSUMERS)
+			consumers |= 1ULL << p->port_id;
+	}
+	tee_update_consumers(this, consumers);
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		tee_take_returned(this, p);
+		if (tee_pending(this, p))
+			lagging = true;
+	}
 
-	if (!spa_list_is_empty(&node->ports[SPA_DIRECTION_OUTPUT])) {
-		pw_log_trace("node %p: tee input %d %d", node, io->status, io->buffer_id);
-		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link)
+	if (io->buffer_id >= this->rt.n_tee_buffers) {
+		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+			tee_drop_pending(this, p);
 			*p->io = *io;
+		}
 		io->buffer_id = SPA_ID_INVALID;
+		return io->status;
 	}
-	else
-		io->status = SPA_STATUS_NEED_BUFFER;
+
+	/* keep the buffer in the producer until the consumers took theirs */
+	if (lagging && this->rt.tee_hold)
+		return io->status;
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		/* the consumer did not take its previous buffer, drop it */
+		tee_drop_pending(this, p);
+
+		*p->io = *io;
+		*tee_given(p) = io->buffer_id;
+		if (p->port_id < TEE_MAX_CONSUMERS)
+			this->rt.tee_holders[io->buffer_id] |= 1ULL << p->port_id;
+	}
+	io->buffer_id = SPA_ID_INVALID;
 
         return io->status;
 }
+
 static int schedule_tee_output(struct spa_node *data)
 {
 	struct pw_port *this = SPA_CONTAINER_OF(data, struct pw_port, mix_node);
@@ -75,7 +220,18 @@ static int schedule_tee_output(struct spa_node *data)
 	struct spa_io_buffers *io = this->rt.mix_port.io;
 
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link)
-		*io = *p->io;
+		tee_take_returned(this, p);
+
+	/* buffers are given back with reuse_buffer when all consumers are done,
+	 * only ask for a new buffer when one is needed and none is held */
+	if (io->buffer_id == SPA_ID_INVALID) {
+		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+			if (p->io->status == SPA_STATUS_NEED_BUFFER) {
+				io->status = SPA_STATUS_NEED_BUFFER;
+				break;
+			}
+		}
+	}
 	pw_log_trace("node %p: tee output %d %d", node, io->status, io->buffer_id);
 	return io->status;
 }
@@ -84,12 +240,14 @@ static int schedule_tee_reuse_buffer(struct spa_node *data, uint32_t port_id, ui
 {
 	struct pw_port *this = SPA_CONTAINER_OF(data, struct pw_port, mix_node);
 	struct spa_graph_node *node = &this->rt.mix_node;
-	struct spa_graph_port *p = &this->rt.mix_port, *pp;
 
-	if ((pp = p->peer) != NULL) {
-		pw_log_trace("node %p: tee reuse buffer %d %d", node, port_id, buffer_id);
-		spa_node_port_reuse_buffer(pp->node->implementation, port_id, buffer_id);
-	}
+	pw_log_trace("node %p: tee reuse buffer %d %d", node, port_id, buffer_id);
+
+	if (buffer_id < this->rt.n_tee_buffers)
+		tee_unref(this, buffer_id, port_id);
+	else
+		tee_release(this, buffer_id);
+
 	return 0;
 }
 
@@ -145,8 +303,8 @@ static int schedule_mix_reuse_buffer(struct spa_node *data, uint32_t port_id, ui
 
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		if ((pp = p->peer) != NULL) {
-			pw_log_trace("mix %p: reuse buffer %d %d", node, port_id, buffer_id);
-			spa_node_port_reuse_buffer(pp->node->implementation, port_id, buffer_id);
+			pw_log_trace("mix %p: reuse buffer %d %d", node, pp->port_id, buffer_id);
+			spa_node_port_reuse_buffer(pp->node->implementation, pp->port_id, buffer_id);
 		}
 	}
 	return 0;
@@ -212,6 +370,8 @@ struct pw_port *pw_port_new(enum pw_direction direction,
 				schedule_tee_node;
 	spa_graph_node_set_implementation(&this->rt.mix_node, &this->mix_node);
 	pw_map_init(&this->mix_port_map, 64, 64);
+	pw_array_init(&this->enum_formats.formats, 64);
+	pw_array_init(&this->enum_formats.media, 64);
 
 	spa_graph_port_init(&this->rt.mix_port,
 			    pw_direction_reverse(this->direction),
@@ -288,7 +448,8 @@ static int do_add_port(struct spa_loop *loop,
 {
         struct pw_port *this = user_data;
 
-	this->rt.port.flags = this->spa_info->flags;
+	/* only OPTIONAL matters to the scheduler, REMOVABLE would read as DISABLED */
+	this->rt.port.flags = this->spa_info->flags & SPA_PORT_INFO_FLAG_OPTIONAL;
 	spa_graph_port_add(&this->node->rt.node, &this->rt.port);
 	spa_graph_node_add(this->rt.graph, &this->rt.mix_node);
 	spa_graph_port_add(&this->rt.mix_node, &this->rt.mix_port);
@@ -558,7 +719,12 @@ void pw_port_destroy(struct pw_port *port)
 
 	free_allocation(&port->allocation);
 
+	pw_port_invalidate_formats(port);
+	pw_array_clear(&port->enum_formats.formats);
+	pw_array_clear(&port->enum_formats.media);
+
 	pw_map_clear(&port->mix_port_map);
+	free(port->rt.tee_holders);
 
 	if (port->properties)
 		pw_properties_free(port->properties);
@@ -653,6 +819,168 @@ int pw_port_for_each_filtered_param(struct pw_port *in_port,
 	return res;
 }
 
+struct media_type {
+	uint32_t type;
+	uint32_t subtype;
+};
+
+void pw_port_invalidate_formats(struct pw_port *port)
+{
+	struct spa_pod **f;
+
+	pw_array_for_each(f, &port->enum_formats.formats)
+		free(*f);
+	port->enum_formats.formats.size = 0;
+	port->enum_formats.media.size = 0;
+	port->enum_formats.media_any = false;
+	port->enum_formats.valid = false;
+}
+
+static void add_media_type(struct pw_port *port, const struct spa_pod *format)
+{
+	struct media_type *m;
+	uint32_t type, subtype;
+
+	if (spa_pod_object_parse(format, "I", &type, "I", &subtype) < 0) {
+		port->enum_formats.media_any = true;
+		return;
+	}
+	pw_array_for_each(m, &port->enum_formats.media) {
+		if (m->type == type && m->subtype == subtype)
+			return;
+	}
+	if ((m = pw_array_add(&port->enum_formats.media, sizeof(struct media_type))) != NULL) {
+		m->type = type;
+		m->subtype = subtype;
+	}
+}
+
+static int update_formats(struct pw_port *port)
+{
+	struct pw_node *node = port->node;
+	struct pw_type *t = &node->core->type;
+	uint32_t index = 0;
+	uint8_t buf[4096];
+	struct spa_pod_builder b = { 0 };
+	struct spa_pod *format, **f;
+	int res;
+
+	pw_port_invalidate_formats(port);
+
+	while (true) {
+		spa_pod_builder_init(&b, buf, sizeof(buf));
+		if ((res = spa_node_port_enum_params(node->node,
+						     port->direction, port->port_id,
+						     t->param.idEnumFormat, &index,
+						     NULL, &format, &b)) <= 0)
+			break;
+
+		if ((f = pw_array_add(&port->enum_formats.formats, sizeof(struct spa_pod *))) == NULL) {
+			res = -ENOMEM;
+			break;
+		}
+		*f = pw_spa_pod_copy(format);
+		add_media_type(port, format);
+	}
+	if (res < 0) {
+		pw_port_invalidate_formats(port);
+		return res;
+	}
+	pw_log_debug("port %p: cached %zd formats", port,
+			pw_array_get_len(&port->enum_formats.formats, struct spa_pod *));
+
+	port->enum_formats.valid = true;
+	return 0;
+}
+
+int pw_port_enum_formats(struct pw_port *port, uint32_t *index,
+			 const struct spa_pod *filter,
+			 struct spa_pod **format, struct spa_pod_builder *builder)
+{
+	struct spa_pod **f;
+	int res;
+
+	if (!port->enum_formats.valid && (res = update_formats(port)) < 0)
+		return res;
+
+	while (pw_array_check_index(&port->enum_formats.formats, *index, struct spa_pod *)) {
+		f = pw_array_get_unchecked(&port->enum_formats.formats, *index, struct spa_pod *);
+		(*index)++;
+		if (*f != NULL && spa_pod_filter(builder, format, *f, filter) >= 0)
+			return 1;
+	}
+	return 0;
+}
+
+bool pw_port_media_compatible(struct pw_port *port, struct pw_port *other)
+{
+	struct media_type *m1, *m2;
+
+	if (!port->enum_formats.valid && update_formats(port) < 0)
+		return true;
+	if (!other->enum_formats.valid && update_formats(other) < 0)
+		return true;
+
+	/* unknown formats, let the negotiation decide */
+	if (port->enum_formats.media_any || other->enum_formats.media_any ||
+	    port->enum_formats.media.size == 0 || other->enum_formats.media.size == 0)
+		return true;
+
+	pw_array_for_each(m1, &port->enum_formats.media) {
+		pw_array_for_each(m2, &other->enum_formats.media) {
+			if (m1->type == m2->type && m1->subtype == m2->subtype)
+				return true;
+		}
+	}
+	return false;
+}
+
+static uint32_t audio_sample_size(struct spa_type_audio_format *t, uint32_t format)
+{
+	if (format == t->S8 || format == t->U8)
+		return 1;
+	if (format == t->S16 || format == t->U16 ||
+	    format == t->S16_OE || format == t->U16_OE)
+		return 2;
+	if (format == t->S24 || format == t->U24 ||
+	    format == t->S24_OE || format == t->U24_OE ||
+	    format == t->S20 || format == t->U20 ||
+	    format == t->S20_OE || format == t->U20_OE ||
+	    format == t->S18 || format == t->U18 ||
+	    format == t->S18_OE || format == t->U18_OE)
+		return 3;
+	if (format == t->S24_32 || format == t->U24_32 ||
+	    format == t->S24_32_OE || format == t->U24_32_OE ||
+	    format == t->S32 || format == t->U32 ||
+	    format == t->S32_OE || format == t->U32_OE ||
+	    format == t->F32 || format == t->F32_OE)
+		return 4;
+	if (format == t->F64 || format == t->F64_OE)
+		return 8;
+	return 0;
+}
+
+/* the size of one frame of a raw audio format, 0 for other formats */
+static uint32_t format_frame_size(struct pw_core *core, const struct spa_pod *format)
+{
+	struct spa_audio_info info = { 0 };
+
+	if (format == NULL ||
+	    spa_pod_object_parse(format,
+				 "I", &info.media_type,
+				 "I", &info.media_subtype) < 0)
+		return 0;
+
+	if (info.media_type != core->audio_type.media_type.audio ||
+	    info.media_subtype != core->audio_type.media_subtype.raw ||
+	    spa_format_audio_raw_parse(format, &info.info.raw,
+				       &core->audio_type.format_audio) < 0)
+		return 0;
+
+	return info.info.raw.channels *
+		audio_sample_size(&core->audio_type.audio_format, info.info.raw.format);
+}
+
 int pw_port_set_param(struct pw_port *port, uint32_t id, uint32_t flags,
 		      const struct spa_pod *param)
 {
@@ -665,7 +993,13 @@ int pw_port_set_param(struct pw_port *port, uint32_t id, uint32_t flags,
 	pw_log_debug("port %p: set param %s: %d (%s)", port,
 			spa_type_map_get_type(t->map, id), res, spa_strerror(res));
 
+	/* the possible formats can depend on the params of any port */
+	pw_node_invalidate_formats(node);
+
 	if (id == t->param.idFormat) {
+		port->frame_size = res < 0 ? 0 : format_frame_size(core, param);
+		pw_log_debug("port %p: frame size %u", port, port->frame_size);
+
 		if (param == NULL || res < 0) {
 			free_allocation(&port->allocation);
 			port->allocated = false;
@@ -678,6 +1012,55 @@ int pw_port_set_param(struct pw_port *port, uint32_t id, uint32_t flags,
 	return res;
 }
 
+struct tee_buffers {
+	struct pw_port *port;
+	uint64_t *holders;
+	uint32_t n_buffers;
+	bool hold;
+};
+
+static int do_tee_set_buffers(struct spa_loop *loop,
+			      bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct tee_buffers *tb = user_data;
+	struct pw_port *this = tb->port;
+	uint64_t *old = this->rt.tee_holders;
+	struct spa_graph_port *p;
+
+	this->rt.tee_holders = tb->holders;
+	this->rt.n_tee_buffers = tb->n_buffers;
+	this->rt.tee_consumers = 0;
+	this->rt.tee_hold = tb->hold;
+	spa_list_for_each(p, &this->rt.mix_node.ports[SPA_DIRECTION_OUTPUT], link)
+		*tee_given(p) = SPA_ID_INVALID;
+
+	tb->holders = old;
+	return 0;
+}
+
+/* size the tee buffer references of an output port, they are swapped in
+ * the data thread and the old ones are freed here */
+static void tee_set_buffers(struct pw_port *port, uint32_t n_buffers)
+{
+	struct tee_buffers tb;
+	const char *str;
+
+	if (port->direction != PW_DIRECTION_OUTPUT)
+		return;
+
+	str = pw_properties_get(port->properties, PW_PORT_PROP_TEE_POLICY);
+
+	tb.port = port;
+	tb.holders = n_buffers ? calloc(n_buffers, sizeof(uint64_t)) : NULL;
+	tb.n_buffers = tb.holders ? n_buffers : 0;
+	tb.hold = str && strcmp(str, "hold") == 0;
+
+	pw_loop_invoke(port->node->data_loop, do_tee_set_buffers,
+		       SPA_ID_INVALID, NULL, 0, true, &tb);
+
+	free(tb.holders);
+}
+
 int pw_port_use_buffers(struct pw_port *port, struct spa_buffer **buffers, uint32_t n_buffers)
 {
 	int res;
@@ -700,6 +1083,7 @@ int pw_port_use_buffers(struct pw_port *port, struct spa_buffer **buffers, uint3
 		n_buffers = 0;
 		buffers = NULL;
 	}
+	tee_set_buffers(port, n_buffers);
 
 	if (n_buffers == 0)
 		port_update_state (port, PW_PORT_STATE_READY);
@@ -734,6 +1118,7 @@ int pw_port_alloc_buffers(struct pw_port *port,
 	else {
 		port->allocated = true;
 	}
+	tee_set_buffers(port, n_buffers ? *n_buffers : 0);
 
 	if (n_buffers == 0)
 		port_update_state (port, PW_PORT_STATE_READY);
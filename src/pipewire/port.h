@@ -56,6 +56,12 @@ enum pw_port_state {
 	PW_PORT_STATE_STREAMING = 4,	/**< the port is streaming */
 };
 
+/** What an output port with multiple links does when a new buffer arrives
+  * while a consumer did not take the previous one yet. "drop" gives the
+  * unused buffer back to the producer, "hold" keeps the new buffer in the
+  * producer until all consumers took theirs. The default is "drop". */
+#define PW_PORT_PROP_TEE_POLICY	"pipewire.port.tee-policy"
+
 /** Port events, use \ref pw_port_add_listener */
 struct pw_port_events {
 #define PW_VERSION_PORT_EVENTS 0
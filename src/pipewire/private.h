@@ -37,6 +37,7 @@ extern "C" {
 #endif
 
 #include <spa/graph/graph.h>
+#include <spa/param/audio/format-utils.h>
 
 struct pw_command;
 
@@ -162,6 +163,12 @@ struct pw_core {
 	struct pw_properties *properties;	/**< properties of the core */
 
 	struct pw_type type;			/**< type map and common types */
+	struct {
+		struct spa_type_media_type media_type;
+		struct spa_type_media_subtype media_subtype;
+		struct spa_type_format_audio format_audio;
+		struct spa_type_audio_format audio_format;
+	} audio_type;				/**< types to find the audio frame size */
 
 	struct pw_map globals;			/**< map of globals */
 
@@ -190,8 +197,12 @@ struct pw_core {
 
 	long sc_pagesize;
 
+	bool freewheel;			/**< if the graph is freewheeling */
+
 	struct {
 		struct spa_graph graph;
+		struct spa_list freewheel_list;	/**< drivers driven by the freewheel cycles */
+		struct spa_source *freewheel;	/**< idle source running the freewheel cycles */
 	} rt;
 };
 
@@ -225,6 +236,8 @@ struct allocation {
 	struct pw_memblock *mem;	/**< allocated buffer memory */
 	struct spa_buffer **buffers;	/**< port buffers */
 	uint32_t n_buffers;		/**< number of port buffers */
+	struct pw_memblock **mirrors;	/**< mirrored data memory, one per data */
+	uint32_t n_mirrors;		/**< number of mirrored data memories */
 };
 
 static inline void move_allocation(struct allocation *alloc, struct allocation *dest)
@@ -235,13 +248,20 @@ static inline void move_allocation(struct allocation *alloc, struct allocation *
 
 static inline void free_allocation(struct allocation *alloc)
 {
+	uint32_t i;
+
 	if (alloc->mem) {
+		for (i = 0; i < alloc->n_mirrors; i++)
+			pw_memblock_free(alloc->mirrors[i]);
+		free(alloc->mirrors);
 		pw_memblock_free(alloc->mem);
 		free(alloc->buffers);
 	}
 	alloc->mem = NULL;
 	alloc->buffers = NULL;
 	alloc->n_buffers = 0;
+	alloc->mirrors = NULL;
+	alloc->n_mirrors = 0;
 }
 
 #define pw_link_events_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_link_events, m, v, ##__VA_ARGS__)
@@ -278,6 +298,8 @@ struct pw_link {
 	struct {
 		struct spa_graph_port out_port;
 		struct spa_graph_port in_port;
+		uint32_t tee_given;		/**< buffer given by the output tee and
+						  *  not taken yet */
 	} rt;
 
 	void *user_data;
@@ -335,7 +357,10 @@ struct pw_node {
 	bool enabled;			/**< if the node is enabled */
 	bool active;			/**< if the node is active */
 	bool live;			/**< if the node is live */
+	bool freewheel;			/**< driver paused for freewheeling */
 	struct spa_clock *clock;	/**< handle to SPA clock if any */
+	struct spa_io_clock *clock_io;	/**< shared clock io area of \a clock */
+	struct pw_memblock *clock_mem;	/**< memory of clock_io when we own the clock */
 	struct spa_node *node;		/**< SPA node implementation */
 
 	struct spa_list resource_list;	/**< list of resources for this node */
@@ -357,6 +382,8 @@ struct pw_node {
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		struct spa_list freewheel_link;	/**< link in core freewheel_list */
+		bool freewheel;			/**< driven by the freewheel cycles */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -372,6 +399,9 @@ struct pw_node {
 #define pw_port_events_control_added(p,c)	pw_port_events_emit(p, control_added, 0, c)
 #define pw_port_events_control_removed(p,c)	pw_port_events_emit(p, control_removed, 0, c)
 
+/** consumers of an output port with refcounted buffers */
+#define TEE_MAX_CONSUMERS	64
+
 struct pw_port {
 	struct spa_list link;		/**< link in node port_list */
 
@@ -393,6 +423,16 @@ struct pw_port {
 
 	struct spa_io_buffers io;	/**< io area of the port */
 
+	struct {
+		bool valid;		/**< cache is filled */
+		struct pw_array formats;	/**< copies of the EnumFormat params */
+		struct pw_array media;	/**< media type/subtype pairs of the formats */
+		bool media_any;		/**< a format without media type was found */
+	} enum_formats;			/**< cache of EnumFormat results */
+
+	uint32_t frame_size;		/**< bytes per frame of the audio format, 0
+					  *  when there is no audio format */
+
 	bool allocated;			/**< if buffers are allocated */
 	struct allocation allocation;
 
@@ -411,6 +451,11 @@ struct pw_port {
 		struct spa_graph_port port;	/**< this graph port, linked to mix_port */
 		struct spa_graph_port mix_port;	/**< port from the mixer */
 		struct spa_graph_node mix_node;	/**< mixer node */
+		uint64_t *tee_holders;		/**< consumers holding each buffer */
+		uint32_t n_tee_buffers;		/**< number of tee_holders */
+		uint64_t tee_consumers;		/**< consumers of the last cycle */
+		bool tee_hold;			/**< hold the producer for lagging consumers */
+		bool freewheel;			/**< detached from the mixer for freewheeling */
 	} rt;					/**< data only accessed from the data thread */
 
         void *user_data;                /**< extra user data */
@@ -565,6 +610,7 @@ struct pw_control {
 	uint32_t id;
 	uint32_t prop_id;
 	int32_t size;
+	bool sequence;			/**< io area is a struct spa_io_control_sequence */
 
 	struct spa_hook_list listener_list;
 
@@ -639,6 +685,21 @@ int pw_port_for_each_filtered_param(struct pw_port *in_port,
 						     struct spa_pod *param),
 				    void *data);
 
+/** Enumerate the EnumFormat params of a port. The results are cached in
+ * the port until \ref pw_port_invalidate_formats is called.
+ * Returns 1 when a format was placed in \a format, 0 when there are no
+ * more formats or <0 on error. \memberof pw_port */
+int pw_port_enum_formats(struct pw_port *port, uint32_t *index,
+			 const struct spa_pod *filter,
+			 struct spa_pod **format, struct spa_pod_builder *builder);
+
+/** Clear the cached EnumFormat params of a port \memberof pw_port */
+void pw_port_invalidate_formats(struct pw_port *port);
+
+/** Check if two ports have formats with a common media type and subtype.
+ * This is a cheap check done before format negotiation. \memberof pw_port */
+bool pw_port_media_compatible(struct pw_port *port, struct pw_port *other);
+
 /** Set a param on a port \memberof pw_port */
 int pw_port_set_param(struct pw_port *port, uint32_t id, uint32_t flags,
 		      const struct spa_pod *param);
@@ -662,6 +723,21 @@ void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *
 
 int pw_node_update_ports(struct pw_node *node);
 
+/** Clear the cached EnumFormat params of all ports of the node, the formats
+ * of a port can depend on the params of the other ports \memberof pw_node */
+void pw_node_invalidate_formats(struct pw_node *node);
+
+/** Detach or attach the inputs of a driver for freewheeling, called from
+ * the data loop */
+void pw_node_set_freewheel(struct pw_node *node, bool freewheel);
+
+/** Run one freewheel cycle of a driver, called from the data loop */
+void pw_node_freewheel_cycle(struct pw_node *node);
+
+/** Run the freewheel cycles only while there are drivers to run, called
+ * from the data loop after the freewheel_list changed */
+void pw_core_update_freewheel(struct pw_core *core);
+
 /** Activate a link \memberof pw_link
   * Starts the negotiation of formats and buffers on \a link and then
   * starts data streaming */
@@ -18,48 +18,292 @@
  */
 
 #include <stdio.h>
+#include <pthread.h>
 
 #include "pipewire/pipewire.h"
 #include "pipewire/properties.h"
 
 /** \cond */
+
+/* Keys and values are stored in refcounted strings so that copies of
+ * properties can share them. Keys are additionally interned in a global
+ * table, the many properties objects of the globals use the same small
+ * set of keys. */
+struct string {
+	struct string *next;
+	uint32_t ref;
+	uint32_t hash;
+	char str[];
+};
+
+static inline struct string *string_of(const char *str)
+{
+	return SPA_CONTAINER_OF(str, struct string, str);
+}
+
+static struct {
+	pthread_mutex_t lock;
+	struct string **buckets;
+	uint32_t n_buckets;
+	uint32_t n_keys;
+} keys = { PTHREAD_MUTEX_INITIALIZER, };
+
 struct properties {
 	struct pw_properties this;
 
 	struct pw_array items;
+
+	uint32_t *index;		/* item index + 1, 0 when empty */
+	uint32_t index_mask;
+
+	struct spa_dict_item *sorted;	/* sorted view, NULL when invalid */
+	struct spa_dict sorted_dict;
 };
 /** \endcond */
 
+static uint32_t hash_string(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (uint8_t) str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct string *string_alloc(size_t len, uint32_t hash)
+{
+	struct string *s;
+
+	if ((s = malloc(sizeof(struct string) + len + 1)) == NULL)
+		return NULL;
+
+	s->next = NULL;
+	s->ref = 1;
+	s->hash = hash;
+	s->str[len] = '\0';
+	return s;
+}
+
+static struct string *string_new(const char *str, size_t len, uint32_t hash)
+{
+	struct string *s;
+
+	if ((s = string_alloc(len, hash)) != NULL)
+		memcpy(s->str, str, len);
+	return s;
+}
+
+static char *value_new(const char *str)
+{
+	struct string *s;
+
+	if (str == NULL)
+		return NULL;
+	if ((s = string_new(str, strlen(str), 0)) == NULL)
+		return NULL;
+	return s->str;
+}
+
+static char *value_ref(const char *value)
+{
+	if (value)
+		__atomic_add_fetch(&string_of(value)->ref, 1, __ATOMIC_RELAXED);
+	return (char *) value;
+}
+
+static void value_unref(const char *value)
+{
+	if (value && __atomic_sub_fetch(&string_of(value)->ref, 1, __ATOMIC_ACQ_REL) == 0)
+		free(string_of(value));
+}
+
+static int keys_grow(void)
+{
+	struct string **buckets, *s, *next;
+	uint32_t i, n_buckets = keys.n_buckets ? keys.n_buckets * 2 : 256;
+
+	if ((buckets = calloc(n_buckets, sizeof(struct string *))) == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < keys.n_buckets; i++) {
+		for (s = keys.buckets[i]; s; s = next) {
+			next = s->next;
+			s->next = buckets[s->hash & (n_buckets - 1)];
+			buckets[s->hash & (n_buckets - 1)] = s;
+		}
+	}
+	free(keys.buckets);
+	keys.buckets = buckets;
+	keys.n_buckets = n_buckets;
+	return 0;
+}
+
+/* must be called with keys.lock */
+static char *key_intern(const char *str, size_t len)
+{
+	uint32_t hash = hash_string(str, len);
+	struct string *s;
+
+	if (keys.n_buckets) {
+		for (s = keys.buckets[hash & (keys.n_buckets - 1)]; s; s = s->next) {
+			if (s->hash == hash && strncmp(s->str, str, len) == 0 && s->str[len] == '\0') {
+				s->ref++;
+				return s->str;
+			}
+		}
+	}
+	if (keys.n_keys >= keys.n_buckets && keys_grow() < 0)
+		return NULL;
+
+	if ((s = string_new(str, len, hash)) == NULL)
+		return NULL;
+
+	s->next = keys.buckets[hash & (keys.n_buckets - 1)];
+	keys.buckets[hash & (keys.n_buckets - 1)] = s;
+	keys.n_keys++;
+	return s->str;
+}
+
+/* must be called with keys.lock */
+static void key_unref(const char *key)
+{
+	struct string *s = string_of(key), **p;
+
+	if (--s->ref > 0)
+		return;
+
+	for (p = &keys.buckets[s->hash & (keys.n_buckets - 1)]; *p; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+	keys.n_keys--;
+	free(s);
+}
+
+static char *key_new(const char *str, size_t len)
+{
+	char *key;
+
+	pthread_mutex_lock(&keys.lock);
+	key = key_intern(str, len);
+	pthread_mutex_unlock(&keys.lock);
+	return key;
+}
+
+static void invalidate_sorted(struct properties *impl)
+{
+	free(impl->sorted);
+	impl->sorted = NULL;
+}
+
+static void update_dict(struct properties *impl)
+{
+	impl->this.dict.items = impl->items.data;
+	impl->this.dict.n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
+	invalidate_sorted(impl);
+}
+
+static void index_insert(struct properties *impl, uint32_t hash, uint32_t index)
+{
+	uint32_t i;
+
+	for (i = hash & impl->index_mask; impl->index[i]; i = (i + 1) & impl->index_mask);
+	impl->index[i] = index + 1;
+}
+
+/* size the index for at least twice the number of items and fill it.
+ * On error the index is left untouched */
+static int index_rebuild(struct properties *impl, uint32_t n_items)
+{
+	struct spa_dict_item *item;
+	uint32_t size = 16, i = 0;
+
+	while (size < n_items * 2)
+		size <<= 1;
+
+	if (size - 1 != impl->index_mask) {
+		uint32_t *index = realloc(impl->index, size * sizeof(uint32_t));
+		if (index != NULL) {
+			impl->index = index;
+			impl->index_mask = size - 1;
+		}
+		else if (impl->index == NULL || size > impl->index_mask + 1)
+			return -ENOMEM;
+		/* else we failed to shrink, keep using the bigger index */
+		size = impl->index_mask + 1;
+	}
+	memset(impl->index, 0, size * sizeof(uint32_t));
+
+	pw_array_for_each(item, &impl->items)
+		index_insert(impl, string_of(item->key)->hash, i++);
+
+	return 0;
+}
+
+static void clear_item(struct spa_dict_item *item)
+{
+	pthread_mutex_lock(&keys.lock);
+	key_unref(item->key);
+	pthread_mutex_unlock(&keys.lock);
+	value_unref(item->value);
+}
+
 static int add_func(struct pw_properties *this, char *key, char *value)
 {
 	struct spa_dict_item *item;
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	uint32_t n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
+
+	if (key == NULL) {
+		value_unref(value);
+		return -ENOMEM;
+	}
 
 	item = pw_array_add(&impl->items, sizeof(struct spa_dict_item));
+	if (item == NULL) {
+		clear_item(&SPA_DICT_ITEM_INIT(key, value));
+		return -ENOMEM;
+	}
+
 	item->key = key;
 	item->value = value;
 
-	this->dict.items = impl->items.data;
-	this->dict.n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
-	return 0;
-}
+	if ((n_items + 1) * 2 > impl->index_mask + 1) {
+		/* the index stays valid for the old items */
+		if (index_rebuild(impl, n_items + 1) < 0) {
+			impl->items.size -= sizeof(struct spa_dict_item);
+			clear_item(&SPA_DICT_ITEM_INIT(key, value));
+			return -ENOMEM;
+		}
+	}
+	else
+		index_insert(impl, string_of(key)->hash, n_items);
 
-static void clear_item(struct spa_dict_item *item)
-{
-	free((char *) item->key);
-	free((char *) item->value);
+	update_dict(impl);
+	return 0;
 }
 
 static int find_index(const struct pw_properties *this, const char *key)
 {
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
-	int i, len = pw_array_get_len(&impl->items, struct spa_dict_item);
+	uint32_t i, hash;
 
-	for (i = 0; i < len; i++) {
+	if (impl->index == NULL)
+		return -1;
+
+	hash = hash_string(key, strlen(key));
+
+	for (i = hash & impl->index_mask; impl->index[i]; i = (i + 1) & impl->index_mask) {
 		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
-		if (strcmp(item->key, key) == 0)
-			return i;
+		    pw_array_get_unchecked(&impl->items, impl->index[i] - 1, struct spa_dict_item);
+		if (item->key == key ||
+		    (string_of(item->key)->hash == hash && strcmp(item->key, key) == 0))
+			return impl->index[i] - 1;
 	}
 	return -1;
 }
@@ -72,11 +316,57 @@ static struct properties *properties_new(int prealloc)
 	if (impl == NULL)
 		return NULL;
 
-	pw_array_init(&impl->items, prealloc);
+	pw_array_init(&impl->items, prealloc * sizeof(struct spa_dict_item));
+	if (index_rebuild(impl, prealloc) < 0) {
+		free(impl);
+		return NULL;
+	}
 
 	return impl;
 }
 
+static int do_replace(struct pw_properties *properties, char *key, char *value)
+{
+	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
+	int index;
+
+	if (key == NULL) {
+		value_unref(value);
+		return -ENOMEM;
+	}
+
+	index = find_index(properties, key);
+
+	if (index == -1) {
+		if (value == NULL) {
+			clear_item(&SPA_DICT_ITEM_INIT(key, value));
+			return 0;
+		}
+		return add_func(properties, key, value);
+	} else {
+		struct spa_dict_item *item =
+		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
+		uint32_t n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
+
+		clear_item(item);
+		if (value == NULL) {
+			struct spa_dict_item *other = pw_array_get_unchecked(&impl->items,
+						     n_items - 1, struct spa_dict_item);
+			item->key = other->key;
+			item->value = other->value;
+			impl->items.size -= sizeof(struct spa_dict_item);
+			clear_item(&SPA_DICT_ITEM_INIT(key, value));
+			/* can't fail, the index is never grown here */
+			index_rebuild(impl, n_items - 1);
+		} else {
+			item->key = key;
+			item->value = value;
+		}
+		update_dict(impl);
+	}
+	return 0;
+}
+
 /** Make a new properties object
  *
  * \param key a first key
@@ -98,7 +388,7 @@ struct pw_properties *pw_properties_new(const char *key, ...)
 	va_start(varargs, key);
 	while (key != NULL) {
 		value = va_arg(varargs, char *);
-		add_func(&impl->this, strdup(key), value ? strdup(value) : NULL);
+		add_func(&impl->this, key_new(key, strlen(key)), value_new(value));
 		key = va_arg(varargs, char *);
 	}
 	va_end(varargs);
@@ -123,9 +413,10 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 		return NULL;
 
 	for (i = 0; i < dict->n_items; i++) {
-		if (dict->items[i].key != NULL)
-			add_func(&impl->this, strdup(dict->items[i].key),
-				 dict->items[i].value ? strdup(dict->items[i].value) : NULL);
+		const struct spa_dict_item *it = &dict->items[i];
+		if (it->key != NULL)
+			add_func(&impl->this, key_new(it->key, strlen(it->key)),
+				 value_new(it->value));
 	}
 
 	return &impl->this;
@@ -155,13 +446,11 @@ pw_properties_new_string(const char *str)
 
 	s = pw_split_walk(str, " \t\n\r", &len, &state);
 	while (s) {
-		char *val, *eq;
+		const char *eq = memchr(s, '=', len);
 
-		val = strndup(s, len);
-		eq = strchr(val, '=');
 		if (eq) {
-			*eq = '\0';
-			add_func(&impl->this, val, strdup(eq+1));
+			struct string *val = string_new(eq + 1, len - (eq + 1 - s), 0);
+			add_func(&impl->this, key_new(s, eq - s), val ? val->str : NULL);
 		}
 		s = pw_split_walk(str, " \t\n\r", &len, &state);
 	}
@@ -178,17 +467,39 @@ pw_properties_new_string(const char *str)
 struct pw_properties *pw_properties_copy(const struct pw_properties *properties)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	struct pw_properties *copy;
+	struct properties *copy;
 	struct spa_dict_item *item;
+	size_t size = impl->items.size;
 
-	copy = pw_properties_new(NULL, NULL);
+	copy = properties_new(16);
 	if (copy == NULL)
 		return NULL;
 
-	pw_array_for_each(item, &impl->items)
-	    add_func(copy, strdup(item->key), item->value ? strdup(item->value) : NULL);
+	if (size > 0) {
+		if (!pw_array_ensure_size(&copy->items, size)) {
+			pw_properties_free(&copy->this);
+			return NULL;
+		}
+		memcpy(copy->items.data, impl->items.data, size);
+		copy->items.size = size;
+
+		/* keys and values are shared with the original */
+		pthread_mutex_lock(&keys.lock);
+		pw_array_for_each(item, &copy->items)
+			string_of(item->key)->ref++;
+		pthread_mutex_unlock(&keys.lock);
+
+		pw_array_for_each(item, &copy->items)
+			value_ref(item->value);
 
-	return copy;
+		if (index_rebuild(copy, pw_array_get_len(&copy->items, struct spa_dict_item)) < 0) {
+			pw_properties_free(&copy->this);
+			return NULL;
+		}
+	}
+	update_dict(copy);
+
+	return &copy->this;
 }
 
 /** Merge properties into one
@@ -215,15 +526,18 @@ struct pw_properties *pw_properties_merge(const struct pw_properties *oldprops,
 	} else if (newprops == NULL) {
 		res = pw_properties_copy(oldprops);
 	} else {
-		const char *key;
-		void *state = NULL;
+		struct properties *impl = SPA_CONTAINER_OF(newprops, struct properties, this);
+		struct spa_dict_item *item;
 
 		res = pw_properties_copy(oldprops);
 		if (res == NULL)
 			return NULL;
 
-		while ((key = pw_properties_iterate(newprops, &state))) {
-			pw_properties_set(res, key, pw_properties_get(newprops, key));
+		pw_array_for_each(item, &impl->items) {
+			pthread_mutex_lock(&keys.lock);
+			string_of(item->key)->ref++;
+			pthread_mutex_unlock(&keys.lock);
+			do_replace(res, (char *) item->key, value_ref(item->value));
 		}
 	}
 	return res;
@@ -240,40 +554,20 @@ void pw_properties_free(struct pw_properties *properties)
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
 	struct spa_dict_item *item;
 
+	pthread_mutex_lock(&keys.lock);
+	pw_array_for_each(item, &impl->items)
+		key_unref(item->key);
+	pthread_mutex_unlock(&keys.lock);
+
 	pw_array_for_each(item, &impl->items)
-	    clear_item(item);
+		value_unref(item->value);
 
 	pw_array_clear(&impl->items);
+	free(impl->index);
+	free(impl->sorted);
 	free(impl);
 }
 
-static int do_replace(struct pw_properties *properties, char *key, char *value)
-{
-	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	int index = find_index(properties, key);
-
-	if (index == -1) {
-		add_func(properties, key, value);
-	} else {
-		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
-
-		clear_item(item);
-		if (value == NULL) {
-			struct spa_dict_item *other = pw_array_get_unchecked(&impl->items,
-						     pw_array_get_len(&impl->items, struct spa_dict_item) - 1,
-						     struct spa_dict_item);
-			item->key = other->key;
-			item->value = other->value;
-			impl->items.size -= sizeof(struct spa_dict_item);
-		} else {
-			item->key = key;
-			item->value = value;
-		}
-	}
-	return 0;
-}
-
 /** Set a property value
  *
  * \param properties the properties to change
@@ -288,7 +582,7 @@ static int do_replace(struct pw_properties *properties, char *key, char *value)
  */
 int pw_properties_set(struct pw_properties *properties, const char *key, const char *value)
 {
-	return do_replace(properties, strdup(key), value ? strdup(value) : NULL);
+	return do_replace(properties, key_new(key, strlen(key)), value_new(value));
 }
 
 /** Set a property value by format
@@ -306,13 +600,23 @@ int pw_properties_set(struct pw_properties *properties, const char *key, const c
 int pw_properties_setf(struct pw_properties *properties, const char *key, const char *format, ...)
 {
 	va_list varargs;
-	char *value;
+	struct string *value;
+	int len;
+
+	va_start(varargs, format);
+	len = vsnprintf(NULL, 0, format, varargs);
+	va_end(varargs);
+
+	if (len < 0)
+		return -EINVAL;
+	if ((value = string_alloc(len, 0)) == NULL)
+		return -ENOMEM;
 
 	va_start(varargs, format);
-	vasprintf(&value, format, varargs);
+	vsnprintf(value->str, len + 1, format, varargs);
 	va_end(varargs);
 
-	return do_replace(properties, strdup(key), value);
+	return do_replace(properties, key_new(key, strlen(key)), value->str);
 }
 
 /** Get a property
@@ -366,3 +670,37 @@ const char *pw_properties_iterate(const struct pw_properties *properties, void *
 
 	return pw_array_get_unchecked(&impl->items, index, struct spa_dict_item)->key;
 }
+
+static int compare_items(const void *a, const void *b)
+{
+	return strcmp(((const struct spa_dict_item *) a)->key,
+		      ((const struct spa_dict_item *) b)->key);
+}
+
+/** Get the properties sorted by key
+ *
+ * \param properties a \ref pw_properties
+ * \return a dictionary with the items of \a properties sorted by key
+ *
+ * The sorted view is cached until \a properties is modified, it is meant to be
+ * used when marshalling the properties. The returned dictionary is valid until
+ * the next modification of \a properties.
+ *
+ * \memberof pw_properties
+ */
+const struct spa_dict *pw_properties_get_sorted(const struct pw_properties *properties)
+{
+	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
+	uint32_t n_items = properties->dict.n_items;
+
+	if (impl->sorted == NULL && n_items > 0) {
+		if ((impl->sorted = malloc(n_items * sizeof(struct spa_dict_item))) == NULL)
+			return &properties->dict;
+
+		memcpy(impl->sorted, properties->dict.items, n_items * sizeof(struct spa_dict_item));
+		qsort(impl->sorted, n_items, sizeof(struct spa_dict_item), compare_items);
+	}
+	impl->sorted_dict = SPA_DICT_INIT(impl->sorted, n_items);
+
+	return &impl->sorted_dict;
+}
@@ -70,6 +70,9 @@ pw_properties_get(const struct pw_properties *properties, const char *key);
 const char *
 pw_properties_iterate(const struct pw_properties *properties, void **state);
 
+const struct spa_dict *
+pw_properties_get_sorted(const struct pw_properties *properties);
+
 static inline bool pw_properties_parse_bool(const char *value) {
 	return (strcmp(value, "true") == 0 || atoi(value) == 1);
 }
@@ -54,11 +54,22 @@ struct mem_id {
 	void *ptr;
 };
 
+/** A single mapping of a mem_id, shared by all buffers of a port that
+ * live in that memory */
+struct buffer_mem {
+	struct mem_id *mid;
+	uint32_t start;		/**< first byte used by the buffers */
+	uint32_t end;		/**< last byte + 1 used by the buffers */
+	struct pw_map_range map;
+	void *ptr;
+	uint32_t ref;		/**< number of buffers using the mapping */
+};
+
 struct buffer_id {
 	struct spa_list link;
 	uint32_t id;
 	struct spa_buffer *buf;
-	struct pw_map_range map;
+	struct buffer_mem *bmem;
 	void *ptr;
 	uint32_t n_mem;
 	struct mem_id **mem;
@@ -71,6 +82,8 @@ struct port {
 	struct pw_port *port;
 
 	struct pw_array buffer_ids;
+	struct pw_array buffer_mems;
+	void *skeletons;
 	bool in_order;
 };
 
@@ -557,11 +570,32 @@ static struct mem_id *find_mem(struct pw_array *mem_ids, uint32_t id)
 {
 	struct mem_id *mid;
 
-	pw_array_for_each(mid, mem_ids) {
-		if (mid->id == id)
-			return mid;
+	if (!pw_array_check_index(mem_ids, id, struct mem_id))
+		return NULL;
+
+	mid = pw_array_get_unchecked(mem_ids, id, struct mem_id);
+	return mid->id == id ? mid : NULL;
+}
+
+/* mem_ids are indexed by id, make room for @id, filling the gap with
+ * unused slots */
+static struct mem_id *add_mem(struct pw_array *mem_ids, uint32_t id)
+{
+	struct mem_id *mid;
+
+	if (id == SPA_ID_INVALID)
+		return NULL;
+
+	while (!pw_array_check_index(mem_ids, id, struct mem_id)) {
+		if ((mid = pw_array_add(mem_ids, sizeof(struct mem_id))) == NULL)
+			return NULL;
+		mid->id = SPA_ID_INVALID;
+		mid->fd = -1;
+		mid->ref = 0;
+		mid->map = PW_MAP_RANGE_INIT;
+		mid->ptr = NULL;
 	}
-	return NULL;
+	return pw_array_get_unchecked(mem_ids, id, struct mem_id);
 }
 
 static void *mem_map(struct node_data *data, struct mem_id *mid, uint32_t offset, uint32_t size)
@@ -649,6 +683,8 @@ static void port_init(struct port *port)
 {
         pw_array_init(&port->buffer_ids, 32);
         pw_array_ensure_size(&port->buffer_ids, sizeof(struct buffer_id) * 64);
+        pw_array_init(&port->buffer_mems, 4);
+	port->skeletons = NULL;
 	port->in_order = true;
 }
 
@@ -681,7 +717,12 @@ static void client_node_add_mem(void *object,
 		return;
 	}
 
-	m = pw_array_add(&data->mem_ids, sizeof(struct mem_id));
+	m = add_mem(&data->mem_ids, mem_id);
+	if (m == NULL) {
+		pw_log_error("can't add mem %u", mem_id);
+		close(memfd);
+		return;
+	}
 	pw_log_debug("add mem %u, fd %d, flags %d", mem_id, memfd, flags);
 
 	m->id = mem_id;
@@ -959,19 +1000,28 @@ client_node_port_set_param(void *object,
 	pw_client_node_proxy_done(data->node_proxy, seq, res);
 }
 
+static void buffer_mem_unmap(struct buffer_mem *bmem)
+{
+	if (bmem->ptr != NULL) {
+		if (munmap(bmem->ptr, bmem->map.size) < 0)
+			pw_log_warn("failed to unmap: %m");
+		bmem->ptr = NULL;
+	}
+}
+
 static void clear_buffers(struct node_data *data, struct port *port)
 {
         struct buffer_id *bid;
+	struct buffer_mem *bmem;
 	int i;
 
         pw_log_debug("port %p: clear buffers", port);
 	pw_port_use_buffers(port->port, NULL, 0);
 
         pw_array_for_each(bid, &port->buffer_ids) {
-		if (bid->ptr != NULL) {
-			if (munmap(bid->ptr, bid->map.size) < 0)
-				pw_log_warn("failed to unmap: %m");
-		}
+		if (bid->bmem != NULL && --bid->bmem->ref == 0)
+			buffer_mem_unmap(bid->bmem);
+		bid->bmem = NULL;
 		if (bid->mem != NULL) {
 			for (i = 0; i < bid->n_mem; i++) {
 				if (--bid->mem[i]->ref == 0)
@@ -981,10 +1031,39 @@ static void clear_buffers(struct node_data *data, struct port *port)
 			bid->n_mem = 0;
 		}
 		bid->ptr = NULL;
-                free(bid->buf);
                 bid->buf = NULL;
         }
         port->buffer_ids.size = 0;
+
+	pw_array_for_each(bmem, &port->buffer_mems)
+		buffer_mem_unmap(bmem);
+        port->buffer_mems.size = 0;
+
+	free(port->skeletons);
+	port->skeletons = NULL;
+}
+
+static struct buffer_mem *find_buffer_mem(struct port *port, struct mem_id *mid)
+{
+	struct buffer_mem *bmem;
+
+	pw_array_for_each(bmem, &port->buffer_mems) {
+		if (bmem->mid == mid)
+			return bmem;
+	}
+	return NULL;
+}
+
+static size_t skeleton_size(const struct spa_buffer *b)
+{
+	size_t size;
+
+	size = sizeof(struct spa_buffer);
+	size += sizeof(struct mem_id *);
+	size += b->n_metas * sizeof(struct spa_meta);
+	size += b->n_datas * (sizeof(struct spa_data) + sizeof(struct mem_id *));
+
+	return SPA_ROUND_UP_N(size, 8);
 }
 
 static void
@@ -996,8 +1075,11 @@ client_node_port_use_buffers(void *object,
 	struct pw_proxy *proxy = object;
 	struct node_data *data = proxy->user_data;
 	struct buffer_id *bid;
+	struct buffer_mem *bmem;
 	uint32_t i, j, len;
 	struct spa_buffer *b, **bufs;
+	size_t skel_size;
+	void *skel;
 	struct port *port;
 	struct pw_core *core = proxy->remote->core;
 	struct pw_type *t = &core->type;
@@ -1016,68 +1098,94 @@ client_node_port_use_buffers(void *object,
 
 	bufs = alloca(n_buffers * sizeof(struct spa_buffer *));
 
+	/* collect the range of each memory used by the buffers so that we can
+	 * map it only once and allocate all buffer skeletons in one go */
+	if (!pw_array_ensure_size(&port->buffer_mems, n_buffers * sizeof(struct buffer_mem))) {
+		res = -ENOMEM;
+		goto cleanup;
+	}
+	skel_size = 0;
 	for (i = 0; i < n_buffers; i++) {
-		off_t offset;
-
 		struct mem_id *mid = find_mem(&data->mem_ids, buffers[i].mem_id);
 		if (mid == NULL) {
 			pw_log_error("unknown memory id %u", buffers[i].mem_id);
 			res = -EINVAL;
 			goto cleanup;
 		}
+		if ((bmem = find_buffer_mem(port, mid)) == NULL) {
+			bmem = pw_array_add(&port->buffer_mems, sizeof(struct buffer_mem));
+			bmem->mid = mid;
+			bmem->start = buffers[i].offset;
+			bmem->end = buffers[i].offset + buffers[i].size;
+			bmem->ptr = NULL;
+			bmem->ref = 0;
+		} else {
+			bmem->start = SPA_MIN(bmem->start, buffers[i].offset);
+			bmem->end = SPA_MAX(bmem->end, buffers[i].offset + buffers[i].size);
+		}
+		skel_size += skeleton_size(buffers[i].buffer);
+	}
 
-		len = pw_array_get_len(&port->buffer_ids, struct buffer_id);
-		bid = pw_array_add(&port->buffer_ids, sizeof(struct buffer_id));
-
-		pw_map_range_init(&bid->map, buffers[i].offset, buffers[i].size, core->sc_pagesize);
+	pw_array_for_each(bmem, &port->buffer_mems) {
+		pw_map_range_init(&bmem->map, bmem->start, bmem->end - bmem->start,
+				  core->sc_pagesize);
 
-		bid->ptr = mmap(NULL, bid->map.size, prot, MAP_SHARED, mid->fd, bid->map.offset);
-		if (bid->ptr == MAP_FAILED) {
-			bid->ptr = NULL;
+		bmem->ptr = mmap(NULL, bmem->map.size, prot, MAP_SHARED,
+				 bmem->mid->fd, bmem->map.offset);
+		if (bmem->ptr == MAP_FAILED) {
+			bmem->ptr = NULL;
 			pw_log_error("Failed to mmap memory %u %u %u %d: %m",
-				bid->map.offset, bid->map.size, buffers[i].mem_id, mid->fd);
+				bmem->map.offset, bmem->map.size, bmem->mid->id, bmem->mid->fd);
 			res = -errno;
 			goto cleanup;
 		}
-		if (mlock(bid->ptr, bid->map.size) < 0)
+		if (mlock(bmem->ptr, bmem->map.size) < 0)
 			pw_log_warn("Failed to mlock memory %u %u: %m",
-					bid->map.offset, bid->map.size);
+					bmem->map.offset, bmem->map.size);
+	}
 
-		b = buffers[i].buffer;
+	if (n_buffers > 0 && (port->skeletons = malloc(skel_size)) == NULL) {
+		res = -errno;
+		goto cleanup;
+	}
+	skel = port->skeletons;
 
-		{
-			size_t size;
+	for (i = 0; i < n_buffers; i++) {
+		off_t offset;
 
-			size = sizeof(struct spa_buffer);
-			size += sizeof(struct mem_id *);
-			for (j = 0; j < buffers[i].buffer->n_metas; j++)
-				size += sizeof(struct spa_meta);
-			for (j = 0; j < buffers[i].buffer->n_datas; j++) {
-				size += sizeof(struct spa_data);
-				size += sizeof(struct mem_id *);
-			}
+		struct mem_id *mid = find_mem(&data->mem_ids, buffers[i].mem_id);
 
-			b = bid->buf = malloc(size);
-			memcpy(b, buffers[i].buffer, sizeof(struct spa_buffer));
+		len = pw_array_get_len(&port->buffer_ids, struct buffer_id);
+		bid = pw_array_add(&port->buffer_ids, sizeof(struct buffer_id));
 
-			b->metas = SPA_MEMBER(b, sizeof(struct spa_buffer), struct spa_meta);
-			b->datas = SPA_MEMBER(b->metas, sizeof(struct spa_meta) * b->n_metas,
-				       struct spa_data);
-			bid->mem = SPA_MEMBER(b->datas, sizeof(struct spa_data) * b->n_datas,
-				       struct mem_id*);
-			bid->n_mem = 0;
+		bmem = find_buffer_mem(port, mid);
+		bmem->ref++;
+		bid->bmem = bmem;
+		bid->ptr = SPA_MEMBER(bmem->ptr, buffers[i].offset - bmem->map.offset, void);
+
+		b = bid->buf = skel;
+		skel = SPA_MEMBER(skel, skeleton_size(buffers[i].buffer), void);
+
+		memcpy(b, buffers[i].buffer, sizeof(struct spa_buffer));
+		b->metas = SPA_MEMBER(b, sizeof(struct spa_buffer), struct spa_meta);
+		b->datas = SPA_MEMBER(b->metas, sizeof(struct spa_meta) * b->n_metas,
+			       struct spa_data);
+		bid->mem = SPA_MEMBER(b->datas, sizeof(struct spa_data) * b->n_datas,
+			       struct mem_id*);
+		bid->n_mem = 0;
+
+		mid->ref++;
+		bid->mem[bid->n_mem++] = mid;
 
-			mid->ref++;
-			bid->mem[bid->n_mem++] = mid;
-		}
 		bid->id = b->id;
 
 		if (bid->id != len) {
 			pw_log_warn("unexpected id %u found, expected %u", bid->id, len);
 		}
-		pw_log_debug("add buffer %d %d %u %u", mid->id, bid->id, bid->map.offset, bid->map.size);
+		pw_log_debug("add buffer %d %d %u %u", mid->id, bid->id,
+				buffers[i].offset, buffers[i].size);
 
-		offset = bid->map.start;
+		offset = 0;
 		for (j = 0; j < b->n_metas; j++) {
 			struct spa_meta *m = &b->metas[j];
 			memcpy(m, &buffers[i].buffer->metas[j], sizeof(struct spa_meta));
@@ -1105,12 +1213,13 @@ client_node_port_use_buffers(void *object,
 
 				d->data = NULL;
 				d->fd = bmid->fd;
+				/* the node maps the fd itself, only once */
+				d->flags &= ~SPA_DATA_FLAG_MIRRORED;
 				bmid->ref++;
 				bid->mem[bid->n_mem++] = bmid;
 				pw_log_debug(" data %d %u -> fd %d", j, bmid->id, bmid->fd);
 			} else if (d->type == t->data.MemPtr) {
-				d->data = SPA_MEMBER(bid->ptr,
-						bid->map.start + SPA_PTR_TO_INT(d->data), void);
+				d->data = SPA_MEMBER(bid->ptr, SPA_PTR_TO_INT(d->data), void);
 				d->fd = -1;
 				pw_log_debug(" data %d %u -> mem %p", j, bid->id, d->data);
 			} else {
@@ -1265,6 +1374,7 @@ static void clear_port(struct node_data *data, struct port *port)
 {
 	clear_buffers(data, port);
 	pw_array_clear(&port->buffer_ids);
+	pw_array_clear(&port->buffer_mems);
 }
 
 static void node_proxy_destroy(void *_data)
@@ -23,6 +23,8 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "spa/utils/ringbuffer.h"
 
@@ -30,6 +32,7 @@
 #include "pipewire/private.h"
 #include "pipewire/interfaces.h"
 #include "pipewire/array.h"
+#include "pipewire/data-loop.h"
 #include "pipewire/stream.h"
 #include "pipewire/utils.h"
 #include "extensions/client-node.h"
@@ -42,6 +45,10 @@
 
 #define MAX_PORTS	1
 
+/* the priority of the data thread of PW_STREAM_FLAG_RT_THREAD streams,
+ * the same as what module-rtkit asks for */
+#define RT_PRIORITY	20
+
 struct mem {
 	uint32_t id;
 	int fd;
@@ -51,21 +58,31 @@ struct mem {
 	void *ptr;
 };
 
+/** A single mapping of a mem, shared by all buffers that live in it */
+struct buffer_mem {
+	struct mem *m;
+	uint32_t start;		/**< first byte used by the buffers */
+	uint32_t end;		/**< last byte + 1 used by the buffers */
+	struct pw_map_range map;
+	void *ptr;
+	uint32_t ref;		/**< number of buffers using the mapping */
+};
+
 struct buffer {
 	struct pw_buffer buffer;
 	uint32_t id;
 #define BUFFER_FLAG_MAPPED	(1 << 0)
 #define BUFFER_FLAG_QUEUED	(1 << 1)
 	uint32_t flags;
+	struct buffer_mem *bmem;
 	void *ptr;
-	struct pw_map_range map;
 	uint32_t n_mem;
 	struct mem **mem;
 };
 
 struct queue {
+	struct spa_ringbuffer_padded ring;
 	uint32_t ids[MAX_BUFFERS];
-	struct spa_ringbuffer ring;
 	uint64_t incount;
 	uint64_t outcount;
 };
@@ -92,6 +109,7 @@ struct stream {
 
 	int rtwritefd;
 	struct spa_source *rtsocket_source;
+	struct pw_data_loop *data_loop;		/**< own data loop for PW_STREAM_FLAG_RT_THREAD */
 
 	struct pw_client_node_proxy *node_proxy;
 	bool disconnecting;
@@ -105,6 +123,7 @@ struct stream {
 	struct pw_array mem_ids;
 
 	struct spa_io_buffers *io;
+	struct spa_io_clock *clock;
 
 	bool client_reuse;
 	struct queue dequeue;
@@ -113,6 +132,8 @@ struct stream {
 
 	struct buffer buffers[MAX_BUFFERS];
 	int n_buffers;
+	struct pw_array buffer_mems;
+	void *skeletons;
 
 	struct pw_time last_time;
 };
@@ -123,11 +144,32 @@ static struct mem *find_mem(struct pw_stream *stream, uint32_t id)
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	struct mem *m;
 
-	pw_array_for_each(m, &impl->mem_ids) {
-		if (m->id == id)
-			return m;
+	if (!pw_array_check_index(&impl->mem_ids, id, struct mem))
+		return NULL;
+
+	m = pw_array_get_unchecked(&impl->mem_ids, id, struct mem);
+	return m->id == id ? m : NULL;
+}
+
+/* mem_ids are indexed by id, make room for @id, filling the gap with
+ * unused slots */
+static struct mem *add_mem(struct stream *impl, uint32_t id)
+{
+	struct mem *m;
+
+	if (id == SPA_ID_INVALID)
+		return NULL;
+
+	while (!pw_array_check_index(&impl->mem_ids, id, struct mem)) {
+		if ((m = pw_array_add(&impl->mem_ids, sizeof(struct mem))) == NULL)
+			return NULL;
+		m->id = SPA_ID_INVALID;
+		m->fd = -1;
+		m->ref = 0;
+		m->map = PW_MAP_RANGE_INIT;
+		m->ptr = NULL;
 	}
-	return NULL;
+	return pw_array_get_unchecked(&impl->mem_ids, id, struct mem);
 }
 
 static void *mem_map(struct pw_stream *stream, struct mem *m, uint32_t offset, uint32_t size)
@@ -187,6 +229,7 @@ static void clear_mems(struct pw_stream *stream)
 	pw_array_for_each(m, &impl->mem_ids)
 		clear_mem(impl, m);
 	impl->mem_ids.size = 0;
+	impl->clock = NULL;
 }
 
 static int map_data(struct stream *impl, struct spa_data *data, int prot)
@@ -223,10 +266,20 @@ static int unmap_data(struct stream *impl, struct spa_data *data)
 	return 0;
 }
 
+static void buffer_mem_unmap(struct buffer_mem *bmem)
+{
+	if (bmem->ptr != NULL) {
+		if (munmap(bmem->ptr, bmem->map.size) < 0)
+			pw_log_warn("failed to unmap buffer: %m");
+		bmem->ptr = NULL;
+	}
+}
+
 static void clear_buffers(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	struct buffer *b;
+	struct buffer_mem *bmem;
 	int i, j;
 
 	pw_log_debug("stream %p: clear buffers", stream);
@@ -245,56 +298,95 @@ static void clear_buffers(struct pw_stream *stream)
 			}
 		}
 
-		if (b->ptr != NULL)
-			if (munmap(b->ptr, b->map.size) < 0)
-				pw_log_warn("failed to unmap buffer: %m");
+		if (b->bmem != NULL && --b->bmem->ref == 0)
+			buffer_mem_unmap(b->bmem);
+		b->bmem = NULL;
 		b->ptr = NULL;
-		free(b->buffer.buffer);
 		b->buffer.buffer = NULL;
 	}
 	impl->n_buffers = 0;
-	spa_ringbuffer_init(&impl->queue.ring);
-	spa_ringbuffer_init(&impl->dequeue.ring);
+
+	pw_array_for_each(bmem, &impl->buffer_mems)
+		buffer_mem_unmap(bmem);
+	impl->buffer_mems.size = 0;
+
+	free(impl->skeletons);
+	impl->skeletons = NULL;
+	spa_ringbuffer_padded_init(&impl->queue.ring);
+	spa_ringbuffer_padded_init(&impl->dequeue.ring);
 
 }
 
-static inline int push_queue(struct stream *stream, struct queue *queue, struct buffer *buffer)
+static inline int push_queue_many(struct stream *stream, struct queue *queue,
+				   struct buffer **buffers, uint32_t n_buffers)
 {
-	uint32_t index;
+	uint32_t i, index;
 	int32_t filled;
 
-	if (SPA_FLAG_CHECK(buffer->flags, BUFFER_FLAG_QUEUED))
-		return -EINVAL;
-
-	SPA_FLAG_SET(buffer->flags, BUFFER_FLAG_QUEUED);
-	queue->incount += buffer->buffer.size;
+	filled = spa_ringbuffer_padded_get_write_index(&queue->ring, &index,
+						       MAX_BUFFERS, n_buffers);
+	if (filled < 0 || filled + n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
 
-	filled = spa_ringbuffer_get_write_index(&queue->ring, &index);
-	queue->ids[index & MASK_BUFFERS] = buffer->id;
-	spa_ringbuffer_write_update(&queue->ring, index + 1);
+	/* set the flag while checking so that a buffer that is in the batch
+	 * twice is refused */
+	for (i = 0; i < n_buffers; i++) {
+		if (SPA_FLAG_CHECK(buffers[i]->flags, BUFFER_FLAG_QUEUED))
+			goto in_use;
+		SPA_FLAG_SET(buffers[i]->flags, BUFFER_FLAG_QUEUED);
+	}
+	for (i = 0; i < n_buffers; i++) {
+		queue->incount += buffers[i]->buffer.size;
+		queue->ids[(index + i) & MASK_BUFFERS] = buffers[i]->id;
+	}
+	spa_ringbuffer_padded_write_update(&queue->ring, index + n_buffers);
 
-	pw_log_trace("stream %p: queued buffer %d %d", stream, buffer->id, filled);
+	pw_log_trace("stream %p: queued %d buffers %d", stream, n_buffers, filled);
 
 	return filled;
+
+      in_use:
+	while (i-- > 0)
+		SPA_FLAG_UNSET(buffers[i]->flags, BUFFER_FLAG_QUEUED);
+	return -EINVAL;
 }
 
-static inline struct buffer *pop_queue(struct stream *stream, struct queue *queue)
+static inline int push_queue(struct stream *stream, struct queue *queue, struct buffer *buffer)
+{
+	return push_queue_many(stream, queue, &buffer, 1);
+}
+
+static inline uint32_t pop_queue_many(struct stream *stream, struct queue *queue,
+				      struct buffer **buffers, uint32_t max_buffers)
 {
 	int32_t avail;
-	uint32_t index, id;
-	struct buffer *buffer;
+	uint32_t i, index, n_buffers;
 
-	if ((avail = spa_ringbuffer_get_read_index(&queue->ring, &index)) < MIN_QUEUED)
-		return NULL;
+	if ((avail = spa_ringbuffer_padded_get_read_index(&queue->ring, &index,
+							  MIN_QUEUED)) < MIN_QUEUED)
+		return 0;
+
+	n_buffers = SPA_MIN((uint32_t) avail, max_buffers);
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *buffer = &stream->buffers[queue->ids[(index + i) & MASK_BUFFERS]];
 
-	id = queue->ids[index & MASK_BUFFERS];
-	spa_ringbuffer_read_update(&queue->ring, index + 1);
+		queue->outcount += buffer->buffer.size;
+		SPA_FLAG_UNSET(buffer->flags, BUFFER_FLAG_QUEUED);
+		buffers[i] = buffer;
+	}
+	spa_ringbuffer_padded_read_update(&queue->ring, index + n_buffers);
 
-	buffer = &stream->buffers[id];
-	queue->outcount += buffer->buffer.size;
-	SPA_FLAG_UNSET(buffer->flags, BUFFER_FLAG_QUEUED);
+	pw_log_trace("stream %p: dequeued %d buffers %d", stream, n_buffers, avail);
 
-	pw_log_trace("stream %p: dequeued buffer %d %d", stream, id, avail);
+	return n_buffers;
+}
+
+static inline struct buffer *pop_queue(struct stream *stream, struct queue *queue)
+{
+	struct buffer *buffer;
+
+	if (pop_queue_many(stream, queue, &buffer, 1) == 0)
+		return NULL;
 
 	return buffer;
 }
@@ -318,6 +410,13 @@ static bool stream_set_state(struct pw_stream *stream, enum pw_stream_state stat
 	return res;
 }
 
+static inline struct pw_loop *get_data_loop(struct stream *impl)
+{
+	if (impl->data_loop)
+		return pw_data_loop_get_loop(impl->data_loop);
+	return impl->this.remote->core->data_loop;
+}
+
 static struct buffer *get_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
@@ -340,7 +439,7 @@ do_call_process(struct spa_loop *loop,
 
 static void call_process(struct stream *impl)
 {
-	if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_RT_PROCESS)) {
+	if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_RT_PROCESS | PW_STREAM_FLAG_RT_THREAD)) {
 		do_call_process(NULL, false, 1, NULL, 0, impl);
 	}
 	else {
@@ -408,11 +507,12 @@ struct pw_stream *pw_stream_new(struct pw_remote *remote,
 
 	pw_array_init(&impl->mem_ids, 64);
 	pw_array_ensure_size(&impl->mem_ids, sizeof(struct mem) * 64);
+	pw_array_init(&impl->buffer_mems, 4);
 
 	impl->pending_seq = SPA_ID_INVALID;
 
-	spa_ringbuffer_init(&impl->queue.ring);
-	spa_ringbuffer_init(&impl->dequeue.ring);
+	spa_ringbuffer_padded_init(&impl->queue.ring);
+	spa_ringbuffer_padded_init(&impl->dequeue.ring);
 
 	spa_list_append(&remote->stream_list, &this->link);
 
@@ -460,10 +560,9 @@ do_remove_sources(struct spa_loop *loop,
                   bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct stream *impl = user_data;
-	struct pw_stream *stream = &impl->this;
 
 	if (impl->rtsocket_source) {
-		pw_loop_destroy_source(stream->remote->core->data_loop, impl->rtsocket_source);
+		pw_loop_destroy_source(get_data_loop(impl), impl->rtsocket_source);
 		impl->rtsocket_source = NULL;
 	}
 	if (impl->rtwritefd != -1) {
@@ -481,10 +580,25 @@ static void unhandle_socket(struct pw_stream *stream)
 		pw_loop_destroy_source(stream->remote->core->main_loop, impl->timeout_source);
 		impl->timeout_source = NULL;
 	}
-        pw_loop_invoke(stream->remote->core->data_loop,
+        pw_loop_invoke(get_data_loop(impl),
                        do_remove_sources, 1, NULL, 0, true, impl);
 }
 
+static int
+do_make_realtime(struct spa_loop *loop,
+		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct sched_param sp;
+	int err;
+
+	spa_zero(sp);
+	sp.sched_priority = RT_PRIORITY;
+
+	if ((err = pthread_setschedparam(pthread_self(), SCHED_FIFO | SCHED_RESET_ON_FORK, &sp)) != 0)
+		return -err;
+	return 0;
+}
+
 static void
 set_init_params(struct pw_stream *stream,
 		     int n_init_params,
@@ -554,6 +668,7 @@ void pw_stream_destroy(struct pw_stream *stream)
 
 	clear_mems(stream);
 	pw_array_clear(&impl->mem_ids);
+	pw_array_clear(&impl->buffer_mems);
 
 	if (stream->properties)
 		pw_properties_free(stream->properties);
@@ -609,37 +724,47 @@ static void add_port_update(struct pw_stream *stream, uint32_t change_mask)
 					 &impl->port_info);
 }
 
+static inline void send_signal(struct stream *impl)
+{
+	uint64_t cmd = 1;
+	write(impl->rtwritefd, &cmd, 8);
+}
+
 static inline void send_need_input(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
-	uint64_t cmd = 1;
 
 	pw_log_trace("send");
 	pw_client_node_transport_add_message(impl->trans,
 			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_NEED_INPUT));
-	write(impl->rtwritefd, &cmd, 8);
+	send_signal(impl);
 }
 
 static inline void send_have_output(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
-	uint64_t cmd = 1;
 
 	pw_log_trace("send");
 	pw_client_node_transport_add_message(impl->trans,
 			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT));
-	write(impl->rtwritefd, &cmd, 8);
+	send_signal(impl);
 }
 
-static inline void send_reuse_buffer(struct pw_stream *stream, uint32_t id)
+static inline void add_reuse_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
-	uint64_t cmd = 1;
 
-	pw_log_trace("send");
 	pw_client_node_transport_add_message(impl->trans, (struct pw_client_node_message*)
 			       &PW_CLIENT_NODE_MESSAGE_PORT_REUSE_BUFFER_INIT(impl->port_id, id));
-	write(impl->rtwritefd, &cmd, 8);
+}
+
+static inline void send_reuse_buffer(struct pw_stream *stream, uint32_t id)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+
+	pw_log_trace("send");
+	add_reuse_buffer(stream, id);
+	send_signal(impl);
 }
 
 static void add_async_complete(struct pw_stream *stream, uint32_t seq, int res)
@@ -737,11 +862,13 @@ static int process_output(struct pw_stream *stream)
 {
 	int i, res = 0;
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	bool rt_thread = SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_RT_THREAD);
 
 	for (i = 0; i < impl->trans->area->n_output_ports; i++) {
 		struct spa_io_buffers *io = &impl->trans->outputs[i];
 		struct buffer *b;
 		uint32_t index;
+		bool processed = false;
 
 	      again:
 		pw_log_trace("stream %p: process out %d %d", stream,
@@ -764,9 +891,13 @@ static int process_output(struct pw_stream *stream)
 			}
 		}
 
-		if (!SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER)) {
+		/* in the realtime thread, process is called at most once per cycle */
+		if (!SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER) &&
+		    !(rt_thread && processed)) {
 			call_process(impl);
-			if (spa_ringbuffer_get_read_index(&impl->queue.ring, &index) >= MIN_QUEUED &&
+			processed = true;
+			if (spa_ringbuffer_padded_get_read_index(&impl->queue.ring, &index,
+								 MIN_QUEUED) >= MIN_QUEUED &&
 			    io->status == SPA_STATUS_NEED_BUFFER)
 				goto again;
 		}
@@ -803,8 +934,19 @@ static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_nod
 		if (impl->direction != SPA_DIRECTION_OUTPUT)
 			return;
 
-
 		reuse_buffer(stream, p->body.buffer_id.value);
+
+		/* a driver is never asked for output, the buffer it pushed is
+		 * only released when it comes back here. Push the next one. */
+		if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER)) {
+			struct spa_io_buffers *io = &impl->trans->outputs[0];
+			if (io->buffer_id == p->body.buffer_id.value) {
+				io->buffer_id = SPA_ID_INVALID;
+				io->status = SPA_STATUS_NEED_BUFFER;
+				if (process_output(stream) == SPA_STATUS_HAVE_BUFFER)
+					send_have_output(stream);
+			}
+		}
 		break;
 	}
 	default:
@@ -846,7 +988,7 @@ static void handle_socket(struct pw_stream *stream, int rtreadfd, int rtwritefd)
 	struct timespec interval;
 
 	impl->rtwritefd = rtwritefd;
-	impl->rtsocket_source = pw_loop_add_io(stream->remote->core->data_loop,
+	impl->rtsocket_source = pw_loop_add_io(get_data_loop(impl),
 					       rtreadfd,
 					       SPA_IO_ERR | SPA_IO_HUP,
 					       true, on_rtsocket_condition, stream);
@@ -883,7 +1025,7 @@ static void client_node_command(void *data, uint32_t seq, const struct spa_comma
 		if (stream->state == PW_STREAM_STATE_STREAMING) {
 			pw_log_debug("stream %p: pause %d", stream, seq);
 
-			pw_loop_update_io(stream->remote->core->data_loop,
+			pw_loop_update_io(get_data_loop(impl),
 					  impl->rtsocket_source, SPA_IO_ERR | SPA_IO_HUP);
 
 			stream_set_state(stream, PW_STREAM_STATE_PAUSED, NULL);
@@ -896,7 +1038,7 @@ static void client_node_command(void *data, uint32_t seq, const struct spa_comma
 
 			pw_log_debug("stream %p: start %d %d", stream, seq, impl->direction);
 
-			pw_loop_update_io(stream->remote->core->data_loop,
+			pw_loop_update_io(get_data_loop(impl),
 					  impl->rtsocket_source,
 					  SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP);
 
@@ -1001,7 +1143,12 @@ client_node_add_mem(void *data,
 			     mem_id, memfd, flags);
 		clear_mem(impl, m);
 	} else {
-		m = pw_array_add(&impl->mem_ids, sizeof(struct mem));
+		m = add_mem(impl, mem_id);
+		if (m == NULL) {
+			pw_log_error("can't add mem %u", mem_id);
+			close(memfd);
+			return;
+		}
 		pw_log_debug("add mem %u, fd %d, flags %d",
 			     mem_id, memfd, flags);
 	}
@@ -1012,6 +1159,29 @@ client_node_add_mem(void *data,
 	m->ptr = NULL;
 }
 
+static struct buffer_mem *find_buffer_mem(struct stream *impl, struct mem *m)
+{
+	struct buffer_mem *bmem;
+
+	pw_array_for_each(bmem, &impl->buffer_mems) {
+		if (bmem->m == m)
+			return bmem;
+	}
+	return NULL;
+}
+
+static size_t skeleton_size(const struct spa_buffer *b)
+{
+	size_t size;
+
+	size = sizeof(struct spa_buffer);
+	size += sizeof(struct mem *);
+	size += b->n_metas * sizeof(struct spa_meta);
+	size += b->n_datas * (sizeof(struct spa_data) + sizeof(struct mem *));
+
+	return SPA_ROUND_UP_N(size, 8);
+}
+
 static void
 client_node_port_use_buffers(void *data,
 			     uint32_t seq,
@@ -1023,8 +1193,11 @@ client_node_port_use_buffers(void *data,
 	struct pw_core *core = stream->remote->core;
 	struct pw_type *t = &core->type;
 	struct buffer *bid;
+	struct buffer_mem *bmem;
 	uint32_t i, j;
 	struct spa_buffer *b;
+	size_t skel_size;
+	void *skel;
 	int prot;
 
 	prot = PROT_READ | (direction == SPA_DIRECTION_OUTPUT ? PROT_WRITE : 0);
@@ -1032,6 +1205,48 @@ client_node_port_use_buffers(void *data,
 	/* clear previous buffers */
 	clear_buffers(stream);
 
+	/* collect the range of each memory used by the buffers so that we can
+	 * map it only once and allocate all buffer skeletons in one go */
+	if (!pw_array_ensure_size(&impl->buffer_mems, n_buffers * sizeof(struct buffer_mem)))
+		goto no_mem;
+
+	skel_size = 0;
+	for (i = 0; i < n_buffers; i++) {
+		struct mem *m = find_mem(stream, buffers[i].mem_id);
+		if (m == NULL)
+			continue;
+
+		if ((bmem = find_buffer_mem(impl, m)) == NULL) {
+			bmem = pw_array_add(&impl->buffer_mems, sizeof(struct buffer_mem));
+			bmem->m = m;
+			bmem->start = buffers[i].offset;
+			bmem->end = buffers[i].offset + buffers[i].size;
+			bmem->ptr = NULL;
+			bmem->ref = 0;
+		} else {
+			bmem->start = SPA_MIN(bmem->start, buffers[i].offset);
+			bmem->end = SPA_MAX(bmem->end, buffers[i].offset + buffers[i].size);
+		}
+		skel_size += skeleton_size(buffers[i].buffer);
+	}
+
+	pw_array_for_each(bmem, &impl->buffer_mems) {
+		pw_map_range_init(&bmem->map, bmem->start, bmem->end - bmem->start,
+				  core->sc_pagesize);
+
+		bmem->ptr = mmap(NULL, bmem->map.size, prot, MAP_SHARED,
+				 bmem->m->fd, bmem->map.offset);
+		if (bmem->ptr == MAP_FAILED) {
+			bmem->ptr = NULL;
+			pw_log_warn("Failed to mmap memory %d %p: %s", bmem->map.size, bmem->m,
+				    strerror(errno));
+		}
+	}
+
+	if (skel_size > 0 && (impl->skeletons = malloc(skel_size)) == NULL)
+		goto no_mem;
+	skel = impl->skeletons;
+
 	for (i = 0; i < n_buffers; i++) {
 		off_t offset;
 
@@ -1044,49 +1259,33 @@ client_node_port_use_buffers(void *data,
 		bid = &impl->buffers[i];
 		bid->id = i;
 		bid->flags = 0;
-		b = buffers[i].buffer;
-
-		pw_map_range_init(&bid->map, buffers[i].offset, buffers[i].size,
-				core->sc_pagesize);
 
-		bid->ptr = mmap(NULL, bid->map.size, prot, MAP_SHARED, m->fd, bid->map.offset);
-		if (bid->ptr == MAP_FAILED) {
-			bid->ptr = NULL;
-			pw_log_warn("Failed to mmap memory %d %p: %s", bid->map.size, m,
-				    strerror(errno));
+		bmem = find_buffer_mem(impl, m);
+		if (bmem->ptr == NULL)
 			continue;
-		}
 
-		{
-			size_t size;
+		bmem->ref++;
+		bid->bmem = bmem;
+		bid->ptr = SPA_MEMBER(bmem->ptr, buffers[i].offset - bmem->map.offset, void);
 
-			size = sizeof(struct spa_buffer);
-			size += sizeof(struct mem *);
-			for (j = 0; j < buffers[i].buffer->n_metas; j++)
-				size += sizeof(struct spa_meta);
-			for (j = 0; j < buffers[i].buffer->n_datas; j++) {
-				size += sizeof(struct spa_data);
-				size += sizeof(struct mem *);
-			}
-
-			b = bid->buffer.buffer = malloc(size);
-			memcpy(b, buffers[i].buffer, sizeof(struct spa_buffer));
+		b = bid->buffer.buffer = skel;
+		skel = SPA_MEMBER(skel, skeleton_size(buffers[i].buffer), void);
 
-			b->metas = SPA_MEMBER(b, sizeof(struct spa_buffer), struct spa_meta);
-			b->datas = SPA_MEMBER(b->metas, sizeof(struct spa_meta) * b->n_metas,
-				       struct spa_data);
-			bid->mem = SPA_MEMBER(b->datas, sizeof(struct spa_data) * b->n_datas,
-				       struct mem*);
-			bid->n_mem = 0;
+		memcpy(b, buffers[i].buffer, sizeof(struct spa_buffer));
+		b->metas = SPA_MEMBER(b, sizeof(struct spa_buffer), struct spa_meta);
+		b->datas = SPA_MEMBER(b->metas, sizeof(struct spa_meta) * b->n_metas,
+			       struct spa_data);
+		bid->mem = SPA_MEMBER(b->datas, sizeof(struct spa_data) * b->n_datas,
+			       struct mem*);
+		bid->n_mem = 0;
 
-			m->ref++;
-			bid->mem[bid->n_mem++] = m;
-		}
+		m->ref++;
+		bid->mem[bid->n_mem++] = m;
 
 		pw_log_debug("add buffer %d %d %u %u", m->id,
-				b->id, bid->map.offset, bid->map.size);
+				b->id, buffers[i].offset, buffers[i].size);
 
-		offset = bid->map.start;
+		offset = 0;
 		for (j = 0; j < b->n_metas; j++) {
 			struct spa_meta *m = &b->metas[j];
 			memcpy(m, &buffers[i].buffer->metas[j], sizeof(struct spa_meta));
@@ -1106,6 +1305,8 @@ client_node_port_use_buffers(void *data,
 				struct mem *bm = find_mem(stream, SPA_PTR_TO_UINT32(d->data));
 				d->data = NULL;
 				d->fd = bm->fd;
+				/* we map the data only once */
+				d->flags &= ~SPA_DATA_FLAG_MIRRORED;
 				bm->ref++;
 				bid->mem[bid->n_mem++] = bm;
 				pw_log_debug(" data %d %u -> fd %d", j, bm->id, bm->fd);
@@ -1116,8 +1317,7 @@ client_node_port_use_buffers(void *data,
 					SPA_FLAG_SET(bid->flags, BUFFER_FLAG_MAPPED);
 				}
 			} else if (d->type == t->data.MemPtr) {
-				d->data = SPA_MEMBER(bid->ptr,
-						bid->map.start + SPA_PTR_TO_INT(d->data), void);
+				d->data = SPA_MEMBER(bid->ptr, SPA_PTR_TO_INT(d->data), void);
 				d->fd = -1;
 				pw_log_debug(" data %d %u -> mem %p", j, b->id, d->data);
 			} else {
@@ -1141,6 +1341,11 @@ client_node_port_use_buffers(void *data,
 		clear_mems(stream);
 		stream_set_state(stream, PW_STREAM_STATE_READY, NULL);
 	}
+	return;
+
+      no_mem:
+	clear_buffers(stream);
+	add_async_complete(stream, seq, -ENOMEM);
 }
 
 static void
@@ -1210,6 +1415,10 @@ static void client_node_port_set_io(void *data,
 		impl->io = ptr;
 		pw_log_debug("stream %p: set io id %u %p", stream, id, ptr);
 	}
+	else if (id == t->io.Clock) {
+		impl->clock = size >= sizeof(struct spa_io_clock) ? ptr : NULL;
+		pw_log_debug("stream %p: set clock io %p", stream, impl->clock);
+	}
 
 	res = 0;
 
@@ -1264,6 +1473,25 @@ pw_stream_connect(struct pw_stream *stream,
 	impl->port_id = 0;
 	impl->flags = flags;
 
+	if (SPA_FLAG_CHECK(flags, PW_STREAM_FLAG_RT_THREAD) && impl->data_loop == NULL) {
+		int res;
+
+		if ((impl->data_loop = pw_data_loop_new(NULL)) == NULL)
+			return -ENOMEM;
+		if ((res = pw_data_loop_start(impl->data_loop)) < 0) {
+			pw_data_loop_destroy(impl->data_loop);
+			impl->data_loop = NULL;
+			return res;
+		}
+		pw_log_debug("stream %p: started data loop %p", stream, impl->data_loop);
+
+		/* keep running without realtime priority when it is not allowed */
+		if ((res = pw_loop_invoke(pw_data_loop_get_loop(impl->data_loop),
+					  do_make_realtime, 1, NULL, 0, true, impl)) < 0)
+			pw_log_warn("stream %p: can't make the data thread realtime: %s",
+				    stream, spa_strerror(res));
+	}
+
 	set_init_params(stream, n_params, params);
 
 	stream_set_state(stream, PW_STREAM_STATE_CONNECTING, NULL);
@@ -1336,6 +1564,11 @@ int pw_stream_disconnect(struct pw_stream *stream)
 
 	unhandle_socket(stream);
 
+	if (impl->data_loop) {
+		pw_data_loop_destroy(impl->data_loop);
+		impl->data_loop = NULL;
+	}
+
 	if (impl->node_proxy) {
 		pw_client_node_proxy_destroy(impl->node_proxy);
 		impl->node_proxy = NULL;
@@ -1362,11 +1595,19 @@ static inline int64_t get_queue_size(struct queue *queue)
 int pw_stream_get_time(struct pw_stream *stream, struct pw_time *time)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct spa_io_clock clock;
 
-	if (impl->last_time.rate.denom == 0)
+	if (impl->clock && spa_io_clock_read(impl->clock, &clock) == 0) {
+		time->now = clock.monotonic_time;
+		time->rate = clock.rate;
+		time->ticks = clock.ticks;
+		time->delay = clock.latency;
+	}
+	else if (impl->last_time.rate.denom != 0)
+		*time = impl->last_time;
+	else
 		return -EAGAIN;
 
-	*time = impl->last_time;
 	if (impl->direction == SPA_DIRECTION_INPUT)
 		time->queued = get_queue_size(&impl->dequeue);
 	else
@@ -1416,8 +1657,8 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 		return res;
 
 	if (impl->direction == SPA_DIRECTION_OUTPUT) {
-		if (res == 0 &&
-		    SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER) &&
+		if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER) &&
+		    impl->trans->outputs[0].status != SPA_STATUS_HAVE_BUFFER &&
 		    process_output(stream) == SPA_STATUS_HAVE_BUFFER)
 			send_have_output(stream);
 	}
@@ -1428,3 +1669,62 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	}
 	return 0;
 }
+
+int pw_stream_dequeue_buffers(struct pw_stream *stream,
+			      struct pw_buffer **buffers, uint32_t max_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i, n_buffers;
+
+	n_buffers = pop_queue_many(impl, &impl->dequeue, b, SPA_MIN(max_buffers, MAX_BUFFERS));
+	for (i = 0; i < n_buffers; i++)
+		buffers[i] = &b[i]->buffer;
+
+	pw_log_trace("stream %p: dequeue %d buffers", stream, n_buffers);
+
+	return n_buffers;
+}
+
+int pw_stream_queue_buffers(struct pw_stream *stream,
+			    struct pw_buffer **buffers, uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i;
+	int res;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -EINVAL;
+	if (n_buffers == 0)
+		return 0;
+
+	for (i = 0; i < n_buffers; i++) {
+		if ((b[i] = get_buffer(stream, buffers[i]->buffer->id)) == NULL)
+			return -EINVAL;
+	}
+
+	pw_log_trace("stream %p: queue %d buffers", stream, n_buffers);
+	if ((res = push_queue_many(impl, &impl->queue, b, n_buffers)) < 0)
+		return res;
+
+	if (impl->direction == SPA_DIRECTION_OUTPUT) {
+		if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_DRIVER) &&
+		    impl->trans->outputs[0].status != SPA_STATUS_HAVE_BUFFER &&
+		    process_output(stream) == SPA_STATUS_HAVE_BUFFER)
+			send_have_output(stream);
+	}
+	else {
+		if (impl->client_reuse) {
+			uint32_t n_reuse;
+
+			/* send all reuse messages with one wakeup */
+			if ((n_reuse = pop_queue_many(impl, &impl->queue, b, n_buffers)) > 0) {
+				for (i = 0; i < n_reuse; i++)
+					add_reuse_buffer(stream, b[i]->id);
+				send_signal(impl);
+			}
+		}
+	}
+	return 0;
+}
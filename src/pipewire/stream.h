@@ -131,6 +131,28 @@ extern "C" {
  * The process event is emited when PipeWire has emptied a buffer that
  * can now be refilled.
  *
+ * \subsection ssec_rt_thread Realtime processing
+ *
+ * When connected with \ref PW_STREAM_FLAG_RT_THREAD, the stream creates
+ * its own data thread and the process event is emited directly from that
+ * thread, without going through the main loop. The thread asks for
+ * SCHED_FIFO scheduling and keeps running with the normal scheduling,
+ * with a warning, when that is not allowed. The following guarantees
+ * are made in this mode:
+ *
+ * \li the process event is always emited from the same thread, which
+ *     is not the thread of the main loop.
+ * \li the process event is emited at most once per graph cycle.
+ * \li \ref pw_stream_dequeue_buffer(), \ref pw_stream_dequeue_buffers(),
+ *     \ref pw_stream_queue_buffer(), \ref pw_stream_queue_buffers() and
+ *     \ref pw_stream_get_time() can be called from the process event.
+ *     They do not allocate memory, take locks or block.
+ *
+ * No other stream or remote function may be called from the process event
+ * and the process event must not block. In particular, \ref
+ * pw_stream_disconnect() and \ref pw_stream_destroy() must be called from
+ * the main loop; they stop and join the data thread.
+ *
  * \section sec_stream_disconnect Disconnect
  *
  * Use \ref pw_stream_disconnect() to disconnect a stream after use.
@@ -215,6 +237,9 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_NO_CONVERT	= (1 << 5),	/**< don't convert format */
 	PW_STREAM_FLAG_EXCLUSIVE	= (1 << 6),	/**< require exclusive access to the
 							  *  device */
+	PW_STREAM_FLAG_RT_THREAD	= (1 << 7),	/**< call process from a realtime
+							  *  thread owned by the stream, see
+							  *  \ref ssec_rt_thread */
 };
 
 /** Create a new unconneced \ref pw_stream \memberof pw_stream
@@ -324,7 +349,11 @@ struct pw_time {
 					     currently queued */
 };
 
-/** Query the time on the stream \memberof pw_stream */
+/** Query the time on the stream \memberof pw_stream
+ *
+ * When the driver of the stream shares its clock io area, this reads
+ * the clock directly from shared memory and is cheap enough to call
+ * from the process callback. */
 int pw_stream_get_time(struct pw_stream *stream, struct pw_time *time);
 
 /** Get a buffer that can be filled for playback streams or consumed
@@ -334,6 +363,22 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream);
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer);
 
+/** Get up to \a max_buffers buffers at once. \memberof pw_stream
+ * \return the number of buffers placed in \a buffers */
+int pw_stream_dequeue_buffers(struct pw_stream *stream,	/**< a \ref pw_stream */
+			      struct pw_buffer **buffers,	/**< array of at least
+								  *  \a max_buffers items */
+			      uint32_t max_buffers		/**< max number of buffers */);
+
+/** Submit or recycle \a n_buffers buffers at once. \memberof pw_stream
+ *
+ * This does the same as calling \ref pw_stream_queue_buffer() for
+ * each buffer but wakes up the other side only once.
+ * \return 0 on success, < 0 on error, in which case no buffer was queued */
+int pw_stream_queue_buffers(struct pw_stream *stream,		/**< a \ref pw_stream */
+			    struct pw_buffer **buffers,		/**< buffers to queue */
+			    uint32_t n_buffers			/**< number of buffers */);
+
 
 #ifdef __cplusplus
 }
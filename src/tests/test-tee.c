@@ -0,0 +1,370 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* audiotestsrc -> audiomixer -> sink, where the sink drives the graph.
+ *
+ * The mixer and the sink give their input buffers back by leaving the id
+ * in their io with NEED_BUFFER instead of with reuse_buffer. The port tees
+ * must return those buffers to the producers or the producers run out of
+ * buffers after n_buffers cycles. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/support/type-map.h>
+#include <spa/param/format-utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/node/io.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/module.h>
+#include <pipewire/factory.h>
+#include <pipewire/private.h>
+
+#define MAX_BUFFERS	16
+#define BUFFER_SAMPLES	128
+#define N_CYCLES	(4 * MAX_BUFFERS)
+
+struct type {
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+struct data {
+	struct type type;
+
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+
+	struct pw_node *source;
+	struct pw_node *mixer;
+	struct pw_node *sink;
+
+	struct pw_link *links[2];
+	struct spa_hook link_listener[2];
+	int link_state[2];
+
+	struct spa_node impl_node;
+	struct spa_port_info port_info;
+	struct spa_io_buffers *io;
+
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	bool have_format;
+	uint32_t n_buffers;
+	uint32_t n_received;
+};
+
+static int impl_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int impl_set_callbacks(struct spa_node *node,
+			      const struct spa_node_callbacks *callbacks, void *data)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+	d->callbacks = callbacks;
+	d->callbacks_data = data;
+	return 0;
+}
+
+static int impl_get_n_ports(struct spa_node *node,
+			    uint32_t *n_input_ports,
+			    uint32_t *max_input_ports,
+			    uint32_t *n_output_ports,
+			    uint32_t *max_output_ports)
+{
+	*n_input_ports = *max_input_ports = 1;
+	*n_output_ports = *max_output_ports = 0;
+	return 0;
+}
+
+static int impl_get_port_ids(struct spa_node *node,
+			     uint32_t *input_ids,
+			     uint32_t n_input_ids,
+			     uint32_t *output_ids,
+			     uint32_t n_output_ids)
+{
+	if (n_input_ids > 0)
+		input_ids[0] = 0;
+	return 0;
+}
+
+static int impl_port_set_io(struct spa_node *node, enum spa_direction direction, uint32_t port_id,
+			    uint32_t id, void *data, size_t size)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+
+	if (id == d->t->io.Buffers)
+		d->io = data;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_port_get_info(struct spa_node *node, enum spa_direction direction, uint32_t port_id,
+			      const struct spa_port_info **info)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+
+	d->port_info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	d->port_info.rate = 0;
+	d->port_info.props = NULL;
+
+	*info = &d->port_info;
+
+	return 0;
+}
+
+static int impl_port_enum_params(struct spa_node *node,
+				 enum spa_direction direction, uint32_t port_id,
+				 uint32_t id, uint32_t *index,
+				 const struct spa_pod *filter,
+				 struct spa_pod **result,
+				 struct spa_pod_builder *builder)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+	struct pw_type *t = d->t;
+
+	if (*index > 0)
+		return 0;
+
+	if (id == t->param.idEnumFormat || (id == t->param.idFormat && d->have_format)) {
+		*result = spa_pod_builder_object(builder,
+			id, t->spa_format,
+			"I", d->type.media_type.audio,
+			"I", d->type.media_subtype.raw,
+			":", d->type.format_audio.format,   "I", d->type.audio_format.S16,
+			":", d->type.format_audio.channels, "i", 2,
+			":", d->type.format_audio.rate,     "i", 44100);
+	}
+	else if (id == t->param.idBuffers) {
+		*result = spa_pod_builder_object(builder,
+			id, t->param_buffers.Buffers,
+			":", t->param_buffers.size,    "i", BUFFER_SAMPLES * 2 * sizeof(int16_t),
+			":", t->param_buffers.stride,  "i", 2 * sizeof(int16_t),
+			":", t->param_buffers.buffers, "iru", 2,
+				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
+			":", t->param_buffers.align,   "i", 16);
+	}
+	else if (id == t->param.idFormat)
+		return 0;
+	else
+		return -ENOENT;
+
+	(*index)++;
+	return 1;
+}
+
+static int impl_port_set_param(struct spa_node *node,
+			       enum spa_direction direction, uint32_t port_id,
+			       uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+
+	if (id != d->t->param.idFormat)
+		return -ENOENT;
+
+	d->have_format = param != NULL;
+	return 0;
+}
+
+static int impl_port_use_buffers(struct spa_node *node, enum spa_direction direction, uint32_t port_id,
+				 struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+	d->n_buffers = n_buffers;
+	return 0;
+}
+
+/* keep the buffer id in the io, it is given back with the next NEED_BUFFER,
+ * like the mixer does */
+static int impl_node_process_input(struct spa_node *node)
+{
+	struct data *d = SPA_CONTAINER_OF(node, struct data, impl_node);
+
+	if (d->io->status == SPA_STATUS_HAVE_BUFFER && d->io->buffer_id < d->n_buffers) {
+		d->n_received++;
+		d->io->status = SPA_STATUS_OK;
+	}
+	return SPA_STATUS_OK;
+}
+
+static const struct spa_node impl_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	.send_command = impl_send_command,
+	.set_callbacks = impl_set_callbacks,
+	.get_n_ports = impl_get_n_ports,
+	.get_port_ids = impl_get_port_ids,
+	.port_set_io = impl_port_set_io,
+	.port_get_info = impl_port_get_info,
+	.port_enum_params = impl_port_enum_params,
+	.port_set_param = impl_port_set_param,
+	.port_use_buffers = impl_port_use_buffers,
+	.process_input = impl_node_process_input,
+};
+
+static struct pw_node *make_spa_node(struct data *data, const char *lib, const char *factory_name)
+{
+	struct pw_factory *factory;
+
+	factory = pw_core_find_factory(data->core, "spa-node-factory");
+	if (factory == NULL)
+		return NULL;
+
+	return pw_factory_create_object(factory,
+					NULL,
+					data->t->node,
+					PW_VERSION_NODE,
+					pw_properties_new("spa.library.name", lib,
+							  "spa.factory.name", factory_name, NULL),
+					SPA_ID_INVALID);
+}
+
+static void link_state_changed(void *_data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	int *link_state = _data;
+
+	if (state == PW_LINK_STATE_ERROR)
+		fprintf(stderr, "link error: %s\n", error);
+	*link_state = state;
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static int make_link(struct data *data, int i, struct pw_port *output, struct pw_port *input)
+{
+	struct pw_loop *loop = pw_main_loop_get_loop(data->loop);
+	char *error = NULL;
+	int n;
+
+	if (output == NULL || input == NULL)
+		return -EINVAL;
+
+	data->links[i] = pw_link_new(data->core, output, input, NULL, NULL, &error, 0);
+	if (data->links[i] == NULL) {
+		fprintf(stderr, "can't link: %s\n", error);
+		free(error);
+		return -EINVAL;
+	}
+	data->link_state[i] = PW_LINK_STATE_INIT;
+	pw_link_add_listener(data->links[i], &data->link_listener[i],
+			     &link_events, &data->link_state[i]);
+	pw_link_register(data->links[i], NULL, NULL, NULL);
+
+	for (n = 0; n < 1000 && data->link_state[i] != PW_LINK_STATE_RUNNING; n++) {
+		if (data->link_state[i] == PW_LINK_STATE_ERROR)
+			return -EIO;
+		pw_loop_iterate(loop, 10);
+	}
+	return data->link_state[i] == PW_LINK_STATE_RUNNING ? 0 : -ETIMEDOUT;
+}
+
+static int do_cycle(struct spa_loop *loop, bool async, uint32_t seq,
+		    const void *_data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	d->io->status = SPA_STATUS_NEED_BUFFER;
+	d->callbacks->need_input(d->callbacks_data);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	uint32_t i;
+	int res;
+
+	pw_init(&argc, &argv);
+
+	data.loop = pw_main_loop_new(NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), NULL);
+	data.t = pw_core_get_type(data.core);
+	init_type(&data.type, data.t->map);
+
+	if (pw_module_load(data.core, "libpipewire-module-spa-node-factory",
+			   NULL, NULL, NULL, NULL) == NULL) {
+		fprintf(stderr, "can't load spa-node-factory\n");
+		return -1;
+	}
+
+	data.source = make_spa_node(&data, "audiotestsrc/libspa-audiotestsrc", "audiotestsrc");
+	data.mixer = make_spa_node(&data, "audiomixer/libspa-audiomixer", "audiomixer");
+	if (data.source == NULL || data.mixer == NULL) {
+		fprintf(stderr, "can't make nodes\n");
+		return -1;
+	}
+
+	data.sink = pw_node_new(data.core, "test-sink", NULL, 0);
+	data.impl_node = impl_node;
+	pw_node_set_implementation(data.sink, &data.impl_node);
+	pw_node_register(data.sink, NULL, NULL, NULL);
+	pw_node_set_active(data.sink, true);
+
+	if ((res = make_link(&data, 0,
+			     pw_node_get_free_port(data.source, PW_DIRECTION_OUTPUT),
+			     pw_node_get_free_port(data.mixer, PW_DIRECTION_INPUT))) < 0 ||
+	    (res = make_link(&data, 1,
+			     pw_node_get_free_port(data.mixer, PW_DIRECTION_OUTPUT),
+			     pw_node_find_port(data.sink, PW_DIRECTION_INPUT, 0))) < 0) {
+		fprintf(stderr, "can't link nodes: %s\n", spa_strerror(res));
+		return -1;
+	}
+
+	for (i = 0; i < N_CYCLES; i++)
+		pw_loop_invoke(data.core->data_loop, do_cycle,
+			       SPA_ID_INVALID, NULL, 0, true, &data);
+
+	printf("%u cycles with %u buffers: received %u buffers\n",
+	       N_CYCLES, data.n_buffers, data.n_received);
+
+	res = data.n_received == N_CYCLES ? 0 : -1;
+
+	pw_link_destroy(data.links[1]);
+	pw_link_destroy(data.links[0]);
+	pw_node_destroy(data.sink);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	if (res < 0)
+		fprintf(stderr, "the producers ran out of buffers\n");
+
+	return res;
+}
@@ -178,6 +178,7 @@ static bool do_create_link(struct data *data, const char *cmd, char *args, char
 static bool do_export_node(struct data *data, const char *cmd, char *args, char **error);
 static bool do_node_params(struct data *data, const char *cmd, char *args, char **error);
 static bool do_port_params(struct data *data, const char *cmd, char *args, char **error);
+static bool do_freewheel(struct data *data, const char *cmd, char *args, char **error);
 
 static struct command command_list[] = {
 	{ "help", "Show this help", do_help },
@@ -195,6 +196,7 @@ static struct command command_list[] = {
 	{ "export-node", "Export a local node to the current remote. <node-id> [remote-var]", do_export_node },
 	{ "node-params", "Enumerate params of a node <node-id> [<param-id-name>]", do_node_params },
 	{ "port-params", "Enumerate params of a port <port-id> [<param-id-name>]", do_port_params },
+	{ "freewheel", "Process the graph as fast as possible. on|off", do_freewheel },
 };
 
 static bool do_help(struct data *data, const char *cmd, char *args, char **error)
@@ -1008,6 +1010,22 @@ static bool do_destroy(struct data *data, const char *cmd, char *args, char **er
 	return true;
 }
 
+static bool do_freewheel(struct data *data, const char *cmd, char *args, char **error)
+{
+	struct remote_data *rd = data->current;
+	char *a[1];
+	int n;
+
+	n = pw_split_ip(args, WHITESPACE, 1, a);
+	if (n < 1 || (strcmp(a[0], "on") != 0 && strcmp(a[0], "off") != 0)) {
+		asprintf(error, "%s on|off", cmd);
+		return false;
+	}
+	pw_core_proxy_set_freewheel(rd->core_proxy, strcmp(a[0], "on") == 0);
+
+	return true;
+}
+
 static bool do_create_link(struct data *data, const char *cmd, char *args, char **error)
 {
 	struct remote_data *rd = data->current;
@@ -20,13 +20,20 @@
 #include <stdio.h>
 #include <signal.h>
 
+#include <spa/pod/iter.h>
 #include <spa/debug/pod.h>
 #include <spa/debug/format.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/interfaces.h>
+#include <pipewire/module.h>
 #include <pipewire/type.h>
 
+#include <extensions/profiler.h>
+
+#define N_HEADER_VALUES	10
+#define N_NODE_VALUES	5
+
 struct proxy_data;
 
 typedef void (*print_func_t) (struct proxy_data *data);
@@ -45,6 +52,8 @@ struct data {
 
 	uint32_t seq;
 	struct spa_list pending_list;
+
+	uint32_t type_profiler;
 };
 
 struct proxy_data {
@@ -445,6 +454,68 @@ static const struct pw_link_proxy_events link_events = {
 	.info = link_event_info
 };
 
+static int64_t pod_value(const struct spa_pod *pod)
+{
+	switch (SPA_POD_TYPE(pod)) {
+	case SPA_POD_TYPE_INT:
+		return SPA_POD_VALUE(struct spa_pod_int, pod);
+	case SPA_POD_TYPE_LONG:
+		return SPA_POD_VALUE(struct spa_pod_long, pod);
+	default:
+		return 0;
+	}
+}
+
+static int parse_values(const struct spa_pod *pod, int64_t *values, int n_values)
+{
+	const struct spa_pod *it;
+	int i = 0;
+
+	SPA_POD_CONTENTS_FOREACH(pod, sizeof(struct spa_pod_struct), it) {
+		if (i == n_values)
+			break;
+		values[i++] = pod_value(it);
+	}
+	return i;
+}
+
+static void profiler_event_profile(void *object, const struct spa_pod *profile)
+{
+        struct proxy_data *data = object;
+	const struct spa_pod *it;
+	int64_t h[N_HEADER_VALUES], v[N_NODE_VALUES];
+	double duration;
+
+	if (SPA_POD_TYPE(profile) != SPA_POD_TYPE_STRUCT ||
+	    parse_values(profile, h, N_HEADER_VALUES) < N_HEADER_VALUES)
+		return;
+
+	duration = h[0] > 0 ? h[0] : 1;
+
+	printf("profile:\n");
+	printf("\tid: %d\n", data->id);
+	printf("\tcycles: %"PRIi64"\n", h[1]);
+	printf("\txruns: %"PRIi64"\n", h[2]);
+	printf("\tdropped: %"PRIi64"\n", h[3]);
+	printf("\tload: %.1f%%\n", h[4] > 0 ? h[6] * 100.0 / h[4] : 0.0);
+	printf("\tnodes:\n");
+
+	SPA_POD_CONTENTS_FOREACH(profile, sizeof(struct spa_pod_struct), it) {
+		if (SPA_POD_TYPE(it) != SPA_POD_TYPE_STRUCT ||
+		    parse_values(it, v, N_NODE_VALUES) < N_NODE_VALUES)
+			continue;
+
+		printf("\t\tid %"PRIi64": load %.1f%% avg %.1f max %.1f usec\n",
+				v[0], v[2] * 100.0 / duration,
+				v[3] / 1000.0, v[4] / 1000.0);
+	}
+}
+
+static const struct pw_profiler_proxy_events profiler_events = {
+	PW_VERSION_PROFILER_PROXY_EVENTS,
+	.profile = profiler_event_profile,
+};
+
 static void
 destroy_proxy (void *data)
 {
@@ -512,6 +583,11 @@ static void registry_event_global(void *data, uint32_t id, uint32_t parent_id,
 		client_version = PW_VERSION_LINK;
 		destroy = (pw_destroy_t) pw_link_info_free;
 	}
+	else if (type == d->type_profiler) {
+		events = &profiler_events;
+		client_version = PW_VERSION_PROFILER;
+		destroy = NULL;
+	}
 	else {
 		printf("added:\n");
 		printf("\tid: %u\n", id);
@@ -626,6 +702,9 @@ int main(int argc, char *argv[])
 	if (data.core == NULL)
 		return -1;
 
+	data.type_profiler = spa_type_map_get_id(pw_core_get_type(data.core)->map,
+						 PW_TYPE_INTERFACE__Profiler);
+
 	if (argc > 1)
 		props = pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, argv[1], NULL);
 
@@ -633,6 +712,11 @@ int main(int argc, char *argv[])
 	if (data.remote == NULL)
 		return -1;
 
+	/* for the profiler protocol extension, show the profiles when
+	 * the daemon has the profiler */
+	if (pw_module_load(data.core, "libpipewire-module-profiler", NULL, NULL, NULL, NULL) == NULL)
+		data.type_profiler = SPA_ID_INVALID;
+
 	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
 	if (pw_remote_connect(data.remote) < 0)
 		return -1;
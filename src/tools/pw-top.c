@@ -0,0 +1,278 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <signal.h>
+
+#include <spa/pod/iter.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/interfaces.h>
+#include <pipewire/module.h>
+#include <pipewire/type.h>
+
+#include <extensions/profiler.h>
+
+#define N_HEADER_VALUES	10
+#define N_NODE_VALUES	5
+
+struct node {
+	struct spa_list link;
+	uint32_t id;
+	char name[64];
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_core_proxy *core_proxy;
+
+	struct pw_registry_proxy *registry_proxy;
+	struct spa_hook registry_listener;
+
+	uint32_t type_profiler;
+	struct pw_proxy *profiler;
+	struct spa_hook profiler_listener;
+
+	struct spa_list node_list;
+};
+
+static struct node *find_node(struct data *d, uint32_t id)
+{
+	struct node *n;
+
+	spa_list_for_each(n, &d->node_list, link) {
+		if (n->id == id)
+			return n;
+	}
+	return NULL;
+}
+
+static int64_t pod_value(const struct spa_pod *pod)
+{
+	switch (SPA_POD_TYPE(pod)) {
+	case SPA_POD_TYPE_INT:
+		return SPA_POD_VALUE(struct spa_pod_int, pod);
+	case SPA_POD_TYPE_LONG:
+		return SPA_POD_VALUE(struct spa_pod_long, pod);
+	default:
+		return 0;
+	}
+}
+
+static int parse_values(const struct spa_pod *pod, int64_t *values, int n_values)
+{
+	const struct spa_pod *it;
+	int i = 0;
+
+	SPA_POD_CONTENTS_FOREACH(pod, sizeof(struct spa_pod_struct), it) {
+		if (i == n_values)
+			break;
+		values[i++] = pod_value(it);
+	}
+	return i;
+}
+
+static void profiler_event_profile(void *data, const struct spa_pod *profile)
+{
+	struct data *d = data;
+	const struct spa_pod *it;
+	int64_t h[N_HEADER_VALUES], v[N_NODE_VALUES];
+	double duration;
+
+	if (SPA_POD_TYPE(profile) != SPA_POD_TYPE_STRUCT ||
+	    parse_values(profile, h, N_HEADER_VALUES) < N_HEADER_VALUES)
+		return;
+
+	duration = h[0] > 0 ? h[0] : 1;
+
+	printf("\033[H\033[2J");
+	printf("cycles %"PRIi64" xruns %"PRIi64" dropped %"PRIi64"\n", h[1], h[2], h[3]);
+	printf("period avg %8.1f max %8.1f usec\n", h[4] / 1000.0, h[5] / 1000.0);
+	printf("busy   avg %8.1f max %8.1f usec  load %5.1f%%\n", h[6] / 1000.0, h[7] / 1000.0,
+			h[4] > 0 ? h[6] * 100.0 / h[4] : 0.0);
+	printf("wakeup avg %8.1f max %8.1f usec\n\n", h[8] / 1000.0, h[9] / 1000.0);
+
+	printf("%5s %8s %6s %9s %9s  %s\n", "ID", "RUNS", "LOAD", "AVG(us)", "MAX(us)", "NAME");
+
+	SPA_POD_CONTENTS_FOREACH(profile, sizeof(struct spa_pod_struct), it) {
+		struct node *n;
+
+		if (SPA_POD_TYPE(it) != SPA_POD_TYPE_STRUCT ||
+		    parse_values(it, v, N_NODE_VALUES) < N_NODE_VALUES)
+			continue;
+
+		n = find_node(d, v[0]);
+
+		printf("%5"PRIi64" %8"PRIi64" %5.1f%% %9.1f %9.1f  %s\n",
+				v[0], v[1], v[2] * 100.0 / duration,
+				v[3] / 1000.0, v[4] / 1000.0,
+				n ? n->name : "");
+	}
+	fflush(stdout);
+}
+
+static const struct pw_profiler_proxy_events profiler_events = {
+	PW_VERSION_PROFILER_PROXY_EVENTS,
+	.profile = profiler_event_profile,
+};
+
+static void registry_event_global(void *data, uint32_t id, uint32_t parent_id,
+				  uint32_t permissions, uint32_t type, uint32_t version,
+				  const struct spa_dict *props)
+{
+	struct data *d = data;
+	struct pw_type *t = pw_core_get_type(d->core);
+	const char *str;
+
+	if (type == t->node) {
+		struct node *n;
+
+		if ((n = calloc(1, sizeof(struct node))) == NULL)
+			return;
+
+		n->id = id;
+		if (props && (str = spa_dict_lookup(props, "node.name")))
+			snprintf(n->name, sizeof(n->name), "%s", str);
+		spa_list_append(&d->node_list, &n->link);
+	}
+	else if (type == d->type_profiler && d->profiler == NULL) {
+		d->profiler = pw_registry_proxy_bind(d->registry_proxy, id, type,
+						     PW_VERSION_PROFILER, 0);
+		if (d->profiler == NULL)
+			return;
+
+		pw_profiler_proxy_add_listener((struct pw_profiler_proxy *) d->profiler,
+					       &d->profiler_listener,
+					       &profiler_events, d);
+	}
+}
+
+static void registry_event_global_remove(void *data, uint32_t id)
+{
+	struct data *d = data;
+	struct node *n;
+
+	if ((n = find_node(d, id)) != NULL) {
+		spa_list_remove(&n->link);
+		free(n);
+	}
+}
+
+static const struct pw_registry_proxy_events registry_events = {
+	PW_VERSION_REGISTRY_PROXY_EVENTS,
+	.global = registry_event_global,
+	.global_remove = registry_event_global_remove,
+};
+
+static void on_state_changed(void *_data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct data *data = _data;
+	struct pw_type *t = pw_core_get_type(data->core);
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		printf("remote error: %s\n", error);
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		data->core_proxy = pw_remote_get_core_proxy(data->remote);
+		data->registry_proxy = pw_core_proxy_get_registry(data->core_proxy,
+								  t->registry,
+								  PW_VERSION_REGISTRY, 0);
+		pw_registry_proxy_add_listener(data->registry_proxy,
+					       &data->registry_listener,
+					       &registry_events, data);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct pw_loop *l;
+	struct pw_properties *props = NULL;
+	struct node *n, *t;
+
+	pw_init(&argc, &argv);
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL)
+		return -1;
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+
+	data.core = pw_core_new(l, NULL);
+	if (data.core == NULL)
+		return -1;
+
+	spa_list_init(&data.node_list);
+	data.type_profiler = spa_type_map_get_id(pw_core_get_type(data.core)->map,
+						 PW_TYPE_INTERFACE__Profiler);
+
+	if (argc > 1)
+		props = pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, argv[1], NULL);
+
+	data.remote = pw_remote_new(data.core, props, 0);
+	if (data.remote == NULL)
+		return -1;
+
+	/* for the profiler protocol extension */
+	if (pw_module_load(data.core, "libpipewire-module-profiler", NULL, NULL, NULL, NULL) == NULL) {
+		fprintf(stderr, "can't load profiler module\n");
+		return -1;
+	}
+
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	if (pw_remote_connect(data.remote) < 0)
+		return -1;
+
+	pw_main_loop_run(data.loop);
+
+	spa_list_for_each_safe(n, t, &data.node_list, link)
+		free(n);
+
+	pw_remote_destroy(data.remote);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}